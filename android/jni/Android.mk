@@ -60,6 +60,14 @@ LOCAL_CPPFLAGS += \
 	-isystem $(LOCAL_PATH)/../../thirdparty/cpptoml/include \
 	-isystem $(LOCAL_PATH)/../../thirdparty/libjpeg-turbo/$(TARGET_ARCH_ABI)/usr/include
 
+# the Open H.264 encoding, if thirdparty/ffmpeg/build.sh has been run.
+FFMPEG_PATH := $(LOCAL_PATH)/../../thirdparty/ffmpeg/$(TARGET_ARCH_ABI)/usr
+ifneq ($(wildcard $(FFMPEG_PATH)/lib/libavcodec.so),)
+LOCAL_SRC_FILES        += $(TIGERVNC_PATH)/rfb/H264Decoder.cxx
+LOCAL_SHARED_LIBRARIES += avcodec avutil swscale
+LOCAL_CPPFLAGS         += -DHAVE_H264 -isystem $(FFMPEG_PATH)/include
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
@@ -67,6 +75,23 @@ LOCAL_MODULE := jpeg
 LOCAL_SRC_FILES := $(LOCAL_PATH)/../../thirdparty/libjpeg-turbo/$(TARGET_ARCH_ABI)/usr/lib/libjpeg.so
 include $(PREBUILT_SHARED_LIBRARY)
 
+ifneq ($(wildcard $(FFMPEG_PATH)/lib/libavcodec.so),)
+include $(CLEAR_VARS)
+LOCAL_MODULE := avcodec
+LOCAL_SRC_FILES := $(FFMPEG_PATH)/lib/libavcodec.so
+include $(PREBUILT_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := avutil
+LOCAL_SRC_FILES := $(FFMPEG_PATH)/lib/libavutil.so
+include $(PREBUILT_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := swscale
+LOCAL_SRC_FILES := $(FFMPEG_PATH)/lib/libswscale.so
+include $(PREBUILT_SHARED_LIBRARY)
+endif
+
 $(call import-module,LibOVRKernel/Projects/Android/jni)
 $(call import-module,VrApi/Projects/AndroidPrebuilt/jni)
 $(call import-module,VrAppFramework/Projects/Android/jni)
@@ -0,0 +1,155 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// connects n screens through the same engine as the app, without VrApi or GL,
+// and takes their regions at the display rate as the render thread does.
+// reports the regions, the pixels, the time to the first pixels and the
+// latency from the socket to the take of each screen, and the CPU time of the
+// process; it fails if a screen shows nothing.  with host/load_server (or make
+// bench, which plays each workload):
+//
+//     host/bench -n 16 -t 30 127.0.0.1
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "vnc_engine.hpp"
+
+
+using clock_type = std::chrono::steady_clock;
+
+struct screen_stats_t {
+	uint64_t          regions = 0;
+	uint64_t          pixels  = 0; // uploaded.
+	uint64_t          copies  = 0;
+	uint64_t          resizes = 0;
+	int               w       = 0;
+	int               h       = 0;
+	double            first   = 0.0; // [s] the start .. the take of the first region.
+	trace_histogram_t latency; // the first byte of the oldest update .. take().
+};
+
+inline double cpu_seconds() {
+	rusage ru;
+	getrusage( RUSAGE_SELF, &ru );
+	return double( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) + 1e-6 * double( ru.ru_utime.tv_usec + ru.ru_stime.tv_usec );
+}
+
+int main( int const argc, char** const argv ) {
+	vnc_params_t params;
+	int    screens = 1;
+	bool   ports   = false;
+	double rate    = 72.0;
+	double secs    = 10.0;
+	for( int opt; (opt = getopt( argc, argv, "n:it:f:p:q:lad:mc5g" )) != -1; ) {
+		switch( opt ) {
+			case 'n': screens                    = std::atoi( optarg ); break;
+			case 'i': ports                      = true;                break;
+			case 't': secs                       = std::atof( optarg ); break;
+			case 'f': rate                       = std::atof( optarg ); break;
+			case 'p': params.port                = std::atoi( optarg ); break;
+			case 'q': params.quality.quality_max = std::atoi( optarg ); break;
+			case 'l': params.quality.lossy       = false;               break;
+			case 'a': params.quality.adaptive    = true;                break;
+			case 'd': params.scale               = std::atoi( optarg ); break;
+			case 'm': params.mipmap              = true;                break;
+			case 'c': params.cursor              = true;                break;
+			case '5': params.rgb565              = true;                break;
+			case 'g': params.throttle            = true;                break;
+			default:
+				screens = 0;
+				break;
+		}
+	}
+	if( optind + 1 != argc || screens < 1 || rate <= 0.0 || secs <= 0.0 ) {
+		std::fprintf( stderr, "usage: %s [-n screens] [-i] [-t seconds] [-f hz] [-p port] [-q quality] [-l] [-a] [-d scale] [-m] [-c] [-5] [-g] host\n", argv[0] );
+		std::fprintf( stderr, "  -n  the number of screens (default 1).\n" );
+		std::fprintf( stderr, "  -i  connect screen i to port + i, otherwise all to port (default 5900).\n" );
+		std::fprintf( stderr, "  -t  the duration (default 10 s).\n" );
+		std::fprintf( stderr, "  -f  the display rate to take the regions at (default 72 Hz).\n" );
+		std::fprintf( stderr, "  -q  the JPEG quality level, as quality_max in the config (default 8).\n" );
+		std::fprintf( stderr, "  -l  lossless, as lossy = false.\n" );
+		std::fprintf( stderr, "  -a  adapt the quality, as adaptive_quality.\n" );
+		std::fprintf( stderr, "  -d  decode the desktop reduced by 2^scale.\n" );
+		std::fprintf( stderr, "  -m  build the mipmap on the CPU.\n" );
+		std::fprintf( stderr, "  -c  draw the cursor on the client.\n" );
+		std::fprintf( stderr, "  -5  ask for 16 bit pixels, as pixel_format = \"rgb565\".\n" );
+		std::fprintf( stderr, "  -g  pause the updates while the link is congested, as congestion_control = true.\n" );
+		return 1;
+	}
+	params.host                = argv[optind];
+	params.scale               = std::min( std::max( params.scale, 0 ), 3 );
+	params.quality.quality_max = std::min( std::max( params.quality.quality_max, 0 ), 9 );
+	params.quality.quality_min = std::min( params.quality.quality_min, params.quality.quality_max );
+
+	// for region_t::read_at; poll() logs the decode and rtt percentiles.
+	latency_trace_t::get().enable( "" );
+
+	vnc_engine_t engine;
+	std::vector<std::shared_ptr<vnc_screen_t>> ss;
+	for( int i = 0; i < screens; ++i ) {
+		vnc_params_t p = params;
+		p.port += ports ? i : 0;
+		ss.push_back( engine.add( p ) );
+	}
+
+	std::vector<screen_stats_t> stats( screens );
+	auto const period = std::chrono::nanoseconds( int64_t( 1e9 / rate ) );
+	auto const t0 = clock_type::now();
+	double const cpu0 = cpu_seconds();
+	for( auto next = t0; next < t0 + std::chrono::nanoseconds( int64_t( 1e9 * secs ) ); next += period ) {
+		std::this_thread::sleep_until( next );
+		int64_t const now = trace_now();
+		for( int i = 0; i < screens; ++i ) {
+			std::unique_ptr<region_t> region = ss[i]->mailbox.take();
+			if( region == nullptr ) {
+				continue;
+			}
+			auto& s = stats[i];
+			if( s.regions == 0 ) {
+				s.first = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+			}
+			s.regions += 1;
+			s.copies  += region->copies.size();
+			s.pixels  += region->pixels.size();
+			if( region->w != s.w || region->h != s.h ) {
+				s.resizes += s.w != 0;
+				s.w = region->w;
+				s.h = region->h;
+			}
+			if( region->read_at != 0 ) {
+				s.latency.add( now - region->read_at );
+				latency_trace_t::record( trace_kind_t::queue, region->decoded_at, now );
+			}
+			ss[i]->mailbox.recycle( std::move( region ) );
+		}
+		latency_trace_t::get().poll( now );
+	}
+	double const wall = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+	double const cpu  = cpu_seconds() - cpu0;
+
+	std::printf( "%6s %11s %10s %11s %9s %8s %11s %10s %10s %10s\n", "screen", "size", "regions/s", "Mpixels/s", "copies/s", "resizes", "first [ms]", "p50 [ms]", "p95 [ms]", "max [ms]" );
+	for( int i = 0; i < screens; ++i ) {
+		auto const& s = stats[i];
+		char size[16];
+		std::snprintf( size, sizeof( size ), "%dx%d", s.w, s.h );
+		std::printf( "%6d %11s %10.1f %11.2f %9.1f %8llu %11.0f %10.2f %10.2f %10.2f\n",
+			i, size, double( s.regions ) / wall, 1e-6 * double( s.pixels ) / wall, double( s.copies ) / wall, (unsigned long long)s.resizes, 1e3 * s.first,
+			s.latency.percentile( 0.50 ), s.latency.percentile( 0.95 ), s.latency.max()
+		);
+	}
+	// the engine and the decoder threads serve all screens: only the total is known.
+	std::printf( "\n" );
+	std::printf( "cpu:    %.1f %% of a core, %.1f %% a screen\n", 100.0 * cpu / wall, 100.0 * cpu / wall / screens );
+
+	// a screen which never showed anything has measured nothing.
+	for( auto const& s: stats ) {
+		if( s.regions == 0 ) {
+			return 1;
+		}
+	}
+	return 0;
+}
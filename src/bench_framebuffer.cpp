@@ -0,0 +1,207 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the layout of the framebuffer at 5K and 8K.  a resize, to a zero-filled
+// std::vector and to framebuffer_pixels_t, and then the layout: the linear
+// one pixel_buffer_t has against tiles of 64x64.  the decoders write a rect
+// through a pointer and a stride, so a tiled store decodes into scratch and
+// scatters; copy_rects() packs the rects for the upload out of either.  the
+// rects are those of a full screen update (Tight, 2048 pixels wide at most),
+// of narrow tall ones and of small unaligned ones.
+//
+//     host/bench_framebuffer [seconds per case]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "zero_page.hpp"
+
+
+using clock_type = std::chrono::steady_clock;
+
+// [ms] of f, run for secs at least.
+template<class F>
+double time_of( F const& f, double const secs ) {
+	f(); // warms up the caches.
+	auto const t0 = clock_type::now();
+	uint64_t n = 0;
+	double t = 0.0;
+	do {
+		f();
+		n += 1;
+		t = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+	} while( t < secs );
+	return 1e3 * t / double( n );
+}
+
+struct rect_t {
+	int x, y, w, h;
+};
+
+// the tiles are allocated as they are written.
+struct tiled_t {
+	static int const size = 64;
+
+	tiled_t( int const w, int const h ):
+		_cols( (w + size - 1) / size ),
+		_tiles( _cols * ((h + size - 1) / size) )
+	{
+	}
+
+	uint32_t* tile( int const tx, int const ty ) {
+		auto& t = _tiles[_cols * ty + tx];
+		if( !t ) {
+			t.reset( new uint32_t[size * size]() );
+		}
+		return t.get();
+	}
+
+	// src: the pixels of r, stride apart.
+	void put( rect_t const& r, uint32_t const* const src, int const stride ) {
+		for( int ty = r.y / size; ty <= (r.y + r.h - 1) / size; ++ty ) {
+			for( int tx = r.x / size; tx <= (r.x + r.w - 1) / size; ++tx ) {
+				uint32_t* const t = tile( tx, ty );
+				int const x0 = std::max( r.x, tx * size );
+				int const x1 = std::min( r.x + r.w, tx * size + size );
+				int const y0 = std::max( r.y, ty * size );
+				int const y1 = std::min( r.y + r.h, ty * size + size );
+				for( int y = y0; y < y1; ++y ) {
+					std::memcpy( t + size * (y - ty * size) + (x0 - tx * size), src + stride * (y - r.y) + (x0 - r.x), 4 * (x1 - x0) );
+				}
+			}
+		}
+	}
+
+	// packs r to dst, opaque.
+	uint32_t* get( rect_t const& r, uint32_t* dst ) {
+		for( int y = r.y; y < r.y + r.h; ++y ) {
+			for( int tx = r.x / size; tx <= (r.x + r.w - 1) / size; ++tx ) {
+				int const x0 = std::max( r.x, tx * size );
+				int const x1 = std::min( r.x + r.w, tx * size + size );
+				uint32_t const* src = tile( tx, y / size ) + size * (y % size) + (x0 - tx * size);
+				for( int x = x0; x < x1; ++x ) {
+					*dst++ = *src++ | 0xff000000u;
+				}
+			}
+		}
+		return dst;
+	}
+
+private:
+	int                                      _cols;
+	std::vector<std::unique_ptr<uint32_t[]>> _tiles;
+};
+
+// a stand-in of the decoders, which write a rect row by row.
+void decode( uint32_t* const dst, int const stride, rect_t const& r, uint32_t const seed ) {
+	for( int y = 0; y < r.h; ++y ) {
+		uint32_t* const row = dst + stride * y;
+		for( int x = 0; x < r.w; ++x ) {
+			row[x] = seed + 0x010203u * x + y;
+		}
+	}
+}
+
+// as TightEncoder splits a full screen update.
+std::vector<rect_t> full_screen( int const w, int const h ) {
+	std::vector<rect_t> rects;
+	int const rw = std::min( w, 2048 );
+	int const rh = std::max( 65536 / rw, 1 );
+	for( int y = 0; y < h; y += rh ) {
+		for( int x = 0; x < w; x += rw ) {
+			rects.push_back( { x, y, std::min( rw, w - x ), std::min( rh, h - y ) } );
+		}
+	}
+	return rects;
+}
+
+int main( int const argc, char** const argv ) {
+	double const secs = argc > 1 ? std::atof( argv[1] ) : 0.5;
+
+	for( auto const& [w, h]: { std::pair( 5120, 2880 ), std::pair( 7680, 4320 ) } ) {
+		size_t const size = size_t( w ) * h;
+		std::printf( "%dx%d\n", w, h );
+
+		double const cleared = time_of( [&]() {
+			std::vector<uint32_t> pixels( size );
+			asm volatile( "" :: "r"( pixels.data() ) : "memory" );
+		}, secs );
+		double const mapped = time_of( [&]() {
+			framebuffer_pixels_t pixels( size );
+			asm volatile( "" :: "r"( pixels.data() ) : "memory" );
+		}, secs );
+		std::printf( "  resize [ms]: std::vector %.2f, zero pages %.2f\n", cleared, mapped );
+
+		char const* const names[] = { "full screen", "16x1024", "64x64 unaligned" };
+		for( int shape = 0; shape < 3; ++shape ) {
+			std::vector<rect_t> rects;
+			if( shape == 0 ) {
+				rects = full_screen( w, h );
+			}
+			else if( shape == 1 ) {
+				for( int x = 0; x + 16 <= w; x += 37 ) {
+					rects.push_back( { x, (7 * x) % (h - 1024), 16, 1024 } );
+				}
+			}
+			else {
+				for( int i = 0; i < 4000; ++i ) {
+					rects.push_back( { (97 * i) % (w - 64), (61 * i) % (h - 64), 64, 64 } );
+				}
+			}
+			size_t pixels = 0;
+			for( auto const& r: rects ) {
+				pixels += size_t( r.w ) * r.h;
+			}
+
+			framebuffer_pixels_t linear( size );
+			tiled_t tiled( w, h );
+			std::vector<uint32_t> scratch;
+			std::vector<uint32_t> packed( pixels );
+			uint32_t seed = 0;
+
+			double const decode_linear = time_of( [&]() {
+				for( auto const& r: rects ) {
+					decode( linear.data() + size_t( w ) * r.y + r.x, w, r, seed );
+				}
+				seed += 1;
+			}, secs );
+			double const decode_tiled = time_of( [&]() {
+				for( auto const& r: rects ) {
+					scratch.resize( size_t( r.w ) * r.h );
+					decode( scratch.data(), r.w, r, seed );
+					tiled.put( r, scratch.data(), r.w );
+				}
+				seed += 1;
+			}, secs );
+			double const pack_linear = time_of( [&]() {
+				uint32_t* dst = packed.data();
+				for( auto const& r: rects ) {
+					for( int y = r.y; y < r.y + r.h; ++y ) {
+						uint32_t const* const src = linear.data() + size_t( w ) * y;
+						for( int x = r.x; x < r.x + r.w; ++x ) {
+							*dst++ = src[x] | 0xff000000u;
+						}
+					}
+				}
+			}, secs );
+			double const pack_tiled = time_of( [&]() {
+				uint32_t* dst = packed.data();
+				for( auto const& r: rects ) {
+					dst = tiled.get( r, dst );
+				}
+			}, secs );
+
+			// [Mpx / s].
+			auto const rate = [&]( double const ms ) {
+				return 1e-3 * double( pixels ) / ms;
+			};
+			std::printf(
+				"  %-16s decode [Mpx/s]: linear %5.0f, tiled %5.0f; pack: linear %5.0f, tiled %5.0f\n",
+				names[shape], rate( decode_linear ), rate( decode_tiled ), rate( pack_linear ), rate( pack_tiled )
+			);
+		}
+	}
+	return 0;
+}
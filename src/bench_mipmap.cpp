@@ -0,0 +1,74 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the time mip_pyramid_t takes for the levels above a damaged rect, and a full
+// rebuild, on a 4K framebuffer.  "plain" is the same 2x2 box filter without
+// the sRGB tables, which the compiler vectorizes: the bound of what SIMD could
+// gain, as the tables are gathers which NEON does not have.
+//
+//     host/bench_mipmap [seconds per case]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "mipmap.hpp"
+
+
+using clock_type = std::chrono::steady_clock;
+
+// [ms] of f, run for secs at least.
+template<class F>
+double time_of( F const& f, double const secs ) {
+	f(); // warms up the caches.
+	auto const t0 = clock_type::now();
+	uint64_t n = 0;
+	double t = 0.0;
+	do {
+		f();
+		n += 1;
+		t = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+	} while( t < secs );
+	return 1e3 * t / double( n );
+}
+
+// level 1 of a rect of src, averaged in sRGB.
+void plain_reduce( uint32_t const* const src, int const src_w, std::vector<uint32_t>& dst, int const dst_w, rfb::Rect const& d ) {
+	for( int y = d.tl.y; y < d.br.y; ++y ) {
+		uint32_t const* const r0 = src + src_w * (2 * y + 0);
+		uint32_t const* const r1 = src + src_w * (2 * y + 1);
+		uint32_t* const out = dst.data() + dst_w * y;
+		for( int x = d.tl.x; x < d.br.x; ++x ) {
+			uint32_t const a = r0[2 * x], b = r0[2 * x + 1], c = r1[2 * x], e = r1[2 * x + 1];
+			uint32_t const lo = ((a & 0x00ff00ffu) + (b & 0x00ff00ffu) + (c & 0x00ff00ffu) + (e & 0x00ff00ffu) + 0x00020002u) >> 2;
+			uint32_t const hi = (((a >> 8) & 0x00ff00ffu) + ((b >> 8) & 0x00ff00ffu) + ((c >> 8) & 0x00ff00ffu) + ((e >> 8) & 0x00ff00ffu) + 0x00020002u) >> 2;
+			out[x] = (lo & 0x00ff00ffu) | ((hi & 0x00ff00ffu) << 8);
+		}
+	}
+}
+
+int main( int const argc, char** const argv ) {
+	double const secs = argc > 1 ? std::atof( argv[1] ) : 0.5;
+	int const w = 3840;
+	int const h = 2160;
+
+	std::mt19937 rng( 1 );
+	std::vector<uint32_t> base( w * h );
+	for( auto& p: base ) {
+		p = rng() | 0xff000000u;
+	}
+	mip_pyramid_t pyramid;
+	pyramid.resize( w, h );
+	std::vector<uint32_t> plain( (w / 2) * (h / 2) );
+
+	std::printf( "%-12s %12s %12s %9s\n", "rect", "sRGB [ms]", "plain [ms]", "/ plain" );
+	for( int const size: { 16, 64, 256, 1024 } ) {
+		rfb::Rect const r = { 512, 512, 512 + size, 512 + size };
+		double const srgb = time_of( [&]() { pyramid.update( base.data(), { r } ); }, secs );
+		// level 1 is three quarters of the work of all the levels.
+		double const bound = time_of( [&]() { plain_reduce( base.data(), w, plain, w / 2, mip_pyramid_t::level_rect( r, 1 ) ); }, secs ) * 4.0 / 3.0;
+		std::printf( "%4dx%-7d %12.4f %12.4f %8.1fx\n", size, size, srgb, bound, srgb / bound );
+	}
+	double const srgb = time_of( [&]() { pyramid.rebuild( base.data() ); }, secs );
+	double const bound = time_of( [&]() { plain_reduce( base.data(), w, plain, w / 2, { 0, 0, w / 2, h / 2 } ); }, secs ) * 4.0 / 3.0;
+	std::printf( "%-12s %12.4f %12.4f %8.1fx\n", "rebuild", srgb, bound, srgb / bound );
+	return 0;
+}
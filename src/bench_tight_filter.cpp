@@ -0,0 +1,116 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the throughput of the Tight filter kernels (TigerVNC patch,
+// rfb/TightFilter.h) which this CPU runs, against the scalar ones, on rects
+// of the sizes which servers send.  host/test_tight_filter checks that they agree.
+//
+//     host/bench_tight_filter [seconds per case]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <rfb/TightFilter.h>
+
+
+using clock_type = std::chrono::steady_clock;
+
+// [Mpixels / s] of f on a rect of pixels, run for secs at least.
+template<class F>
+double throughput( F const& f, int const pixels, double const secs ) {
+	f(); // warms up the caches.
+	auto const t0 = clock_type::now();
+	uint64_t n = 0;
+	double t = 0.0;
+	do {
+		for( int i = 0; i < 16; ++i ) {
+			f();
+		}
+		n += 16;
+		t = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+	} while( t < secs );
+	return 1e-6 * double( n ) * double( pixels ) / t;
+}
+
+void report( char const* const filter, char const* const kernel, int const w, int const h, double const mpps, double const scalar ) {
+	std::printf( "%-10s %-8s %5dx%-5d %10.1f %8.2fx\n", filter, kernel, w, h, mpps, mpps / scalar );
+}
+
+int main( int const argc, char** const argv ) {
+	double const secs = argc > 1 ? std::atof( argv[1] ) : 0.2;
+
+	// the largest rect of TigerVNC's EncodeManager, a line of it, a tile.
+	int const sizes[][2] = { { 2048, 32 }, { 256, 256 }, { 64, 64 }, { 16, 16 } };
+
+	std::mt19937 rng( 1 );
+	rfb::TightFilterLayout const layout = { { 0, 1, 2 } };
+	std::vector<rdr::U32> palette( 256 );
+	for( auto& p: palette ) {
+		p = rng();
+	}
+
+	std::printf( "%-10s %-8s %11s %10s %9s\n", "filter", "kernel", "rect", "Mpixels/s", "/ scalar" );
+	for( auto const& size: sizes ) {
+		int const w = size[0];
+		int const h = size[1];
+		std::vector<rdr::U8> in( 3 * w * h );
+		for( auto& x: in ) {
+			x = rdr::U8( rng() );
+		}
+		std::vector<rdr::U32> out( w * h );
+
+		auto const gradient = [&]( auto const f ) {
+			return throughput( [&]() { f( in.data(), out.data(), w, w, h, layout ); }, w * h, secs );
+		};
+		double const gradient_scalar = gradient( rfb::tightGradient24Scalar );
+		report( "gradient24", "scalar", w, h, gradient_scalar, gradient_scalar );
+#if defined( TIGHT_FILTER_X86 )
+		if( __builtin_cpu_supports( "ssse3" ) ) {
+			report( "gradient24", "SSSE3", w, h, gradient( rfb::tightGradient24SSSE3 ), gradient_scalar );
+		}
+#elif defined( TIGHT_FILTER_NEON )
+		report( "gradient24", "NEON", w, h, gradient( rfb::tightGradient24NEON ), gradient_scalar );
+#endif
+
+		auto const palette1 = [&]( auto const f ) {
+			return throughput( [&]() { f( palette.data(), in.data(), out.data(), w, w, h ); }, w * h, secs );
+		};
+		double const palette1_scalar = palette1( rfb::tightPalette1Scalar );
+		report( "palette1", "scalar", w, h, palette1_scalar, palette1_scalar );
+#if defined( TIGHT_FILTER_X86 )
+		if( __builtin_cpu_supports( "sse2" ) ) {
+			report( "palette1", "SSE2", w, h, palette1( rfb::tightPalette1SSE2 ), palette1_scalar );
+		}
+		if( __builtin_cpu_supports( "avx2" ) ) {
+			report( "palette1", "AVX2", w, h, palette1( rfb::tightPalette1AVX2 ), palette1_scalar );
+		}
+#elif defined( TIGHT_FILTER_NEON )
+		report( "palette1", "NEON", w, h, palette1( rfb::tightPalette1NEON ), palette1_scalar );
+#endif
+
+		// up to 16 colours take the table lookups, more the gather.
+		for( int const colours: { 16, 256 } ) {
+			char name[16];
+			std::snprintf( name, sizeof( name ), "palette%d", colours );
+			std::vector<rdr::U8> index( w * h );
+			for( auto& x: index ) {
+				x = rdr::U8( rng() % colours );
+			}
+			auto const palette8 = [&]( auto const f ) {
+				return throughput( [&]() { f( palette.data(), colours, index.data(), out.data(), w, w, h ); }, w * h, secs );
+			};
+			double const palette8_scalar = palette8( rfb::tightPalette8Scalar );
+			report( name, "scalar", w, h, palette8_scalar, palette8_scalar );
+#if defined( TIGHT_FILTER_X86 )
+			if( __builtin_cpu_supports( "ssse3" ) ) {
+				report( name, "SSSE3", w, h, palette8( rfb::tightPalette8SSSE3 ), palette8_scalar );
+			}
+			if( __builtin_cpu_supports( "avx2" ) ) {
+				report( name, "AVX2", w, h, palette8( rfb::tightPalette8AVX2 ), palette8_scalar );
+			}
+#elif defined( TIGHT_FILTER_NEON )
+			report( name, "NEON", w, h, palette8( rfb::tightPalette8NEON ), palette8_scalar );
+#endif
+		}
+	}
+	return 0;
+}
@@ -3,26 +3,53 @@
 
 #include <vector>
 #include <string>
+#include <android/log.h>
 #define CPPTOML_NO_RTTI
 #include <cpptoml.h>
 
 
 struct config_t {
+	// a monitor of a screen's desktop, placed on its own.
+	struct monitor_t {
+		float latitude  = 0.0f;
+		float longitude = 0.0f;
+	};
+
 	struct screen_t {
 		std::string host;
-		int         port          = 5900;
+		int         port               = 5900;
 		std::string password;
-		float       latitude      = 0.0f;
-		float       longitude     = 0.0f;
-		float       pixel_scaling = 1.0f;
-		bool        lossy         = true;
-		bool        use_pointer   = true;
+		float       latitude           = 0.0f;
+		float       longitude          = 0.0f;
+		float       pixel_scaling      = 1.0f;
+		bool        scaled_decode      = false;
+		bool        lossy              = true;
+		bool        h264               = false;
+		std::string pixel_format       = "rgb888"; // or "rgb565": 16 bits a pixel on the wire only.
+		bool        adaptive_quality   = false;
+		int         quality_min        = 2;
+		int         quality_max        = 8;
+		int         compress_min       = 1;
+		int         compress_max       = 6;
+		bool        lossless_refresh   = false;
+		float       target_latency     = 50.0f; // [ms].
+		bool        use_pointer        = true;
+		bool        cull_updates       = false;
+		bool        congestion_control = false;
+		std::string record;
+		std::vector<monitor_t> monitors; // from the left; empty: the desktop as a whole.
 	};
 
 	float                 resolution  = 2560.0f;
 	std::vector<screen_t> screens;
 	float                 bg_color[3] = { 0.0f, 0.0f, 0.0f };
 	std::string           bg_image;
+	bool                  bg_mipmap   = true;
+	bool                  bg_cache    = true;
+	bool                  trace       = false;
+	std::string           trace_path;
+	float                 upload_time = 4.0f;  // [ms] a frame.  0: unlimited.
+	float                 upload_size = 32.0f; // [MB] a frame.  0: unlimited.
 };
 
 inline config_t config_load( std::string const& fn ) {
@@ -40,6 +67,18 @@ inline config_t config_load( std::string const& fn ) {
 		if( auto img = bg->get_as<std::string>( "image" ) ) {
 			result.bg_image = std::move( *img );
 		}
+		result.bg_mipmap = bg->get_as<bool>( "mipmap" ).value_or( result.bg_mipmap );
+		result.bg_cache  = bg->get_as<bool>( "cache" ).value_or( result.bg_cache );
+	}
+
+	if( auto const trace = config->get_table( "trace" ) ) {
+		result.trace      = trace->get_as<bool>( "enable" ).value_or( result.trace );
+		result.trace_path = trace->get_as<std::string>( "path" ).value_or( result.trace_path );
+	}
+
+	if( auto const upload = config->get_table( "upload" ) ) {
+		result.upload_time = float( upload->get_as<double>( "time" ).value_or( result.upload_time ) );
+		result.upload_size = float( upload->get_as<double>( "size" ).value_or( result.upload_size ) );
 	}
 
 	if( auto const screens = config->get_table_array( "screens" ) ) {
@@ -52,9 +91,37 @@ inline config_t config_load( std::string const& fn ) {
 				float( screen->get_as<double>( "latitude"  ).value_or( d.latitude ) ),
 				float( screen->get_as<double>( "longitude" ).value_or( d.longitude ) ),
 				float( screen->get_as<double>( "pixel_scaling" ).value_or( d.pixel_scaling ) ),
+				screen->get_as<bool>( "scaled_decode" ).value_or( d.scaled_decode ),
 				screen->get_as<bool>( "lossy" ).value_or( d.lossy ),
-				screen->get_as<bool>( "use_pointer" ).value_or( d.use_pointer )
+				screen->get_as<bool>( "h264" ).value_or( d.h264 ),
+				screen->get_as<std::string>( "pixel_format" ).value_or( d.pixel_format ),
+				screen->get_as<bool>( "adaptive_quality" ).value_or( d.adaptive_quality ),
+				screen->get_as<int>( "quality_min" ).value_or( d.quality_min ),
+				screen->get_as<int>( "quality_max" ).value_or( d.quality_max ),
+				screen->get_as<int>( "compress_min" ).value_or( d.compress_min ),
+				screen->get_as<int>( "compress_max" ).value_or( d.compress_max ),
+				screen->get_as<bool>( "lossless_refresh" ).value_or( d.lossless_refresh ),
+				float( screen->get_as<double>( "target_latency" ).value_or( d.target_latency ) ),
+				screen->get_as<bool>( "use_pointer" ).value_or( d.use_pointer ),
+				screen->get_as<bool>( "cull_updates" ).value_or( d.cull_updates ),
+				screen->get_as<bool>( "congestion_control" ).value_or( d.congestion_control ),
+				screen->get_as<std::string>( "record" ).value_or( d.record )
 			} );
+			auto& pixel_format = result.screens.back().pixel_format;
+			if( pixel_format != "rgb888" && pixel_format != "rgb565" ) {
+				__android_log_print( ANDROID_LOG_WARN, "ovrvnc", "unknown pixel_format \"%s\": rgb888 instead", pixel_format.c_str() );
+				pixel_format = d.pixel_format;
+			}
+			// the latitude of the screen by default.
+			if( auto const monitors = screen->get_table_array( "monitors" ) ) {
+				auto& s = result.screens.back();
+				for( auto const& monitor: *monitors ) {
+					s.monitors.push_back( {
+						float( monitor->get_as<double>( "latitude"  ).value_or( s.latitude ) ),
+						float( monitor->get_as<double>( "longitude" ).value_or( 0.0 ) )
+					} );
+				}
+			}
 		}
 	}
 
@@ -0,0 +1,112 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+
+// keeps about one update in flight while the server pushes continuous
+// updates as fast as it can.  the server answers a fence after all it has
+// sent before, so the round trip of a fence over the least recent one is the
+// time the data waits in the buffers of the link (TCP, Wi-Fi).  once that
+// exceeds the time an update takes on the link, the updates pause after each
+// one until the fence sent with the pause comes back, i.e. the buffers have
+// drained.  they flow again once the link has had room for a while.
+struct congestion_controller_t {
+	// after each update of bytes.  time [s]; pos: the bytes received so far,
+	// which may wrap around.  true: send a fence now, after pausing the
+	// updates if paused().  a fence not answered in 10 s is given up.
+	bool update( double const time, unsigned const pos, size_t const bytes ) {
+		_update_bytes = _update_bytes == 0.0 ? double( bytes ) : 0.8 * _update_bytes + 0.2 * double( bytes );
+		if( _fence_at >= 0.0 && time - _fence_at < 10.0 ) {
+			return false;
+		}
+		if( _bandwidth > 0.0 && _queued > _update_bytes / _bandwidth + slack ) {
+			_paced_until = time + hold;
+		}
+		// paced: the link has been busy with the update since the resume.
+		else if( time < _paced_until && double( bytes ) / _bandwidth > 0.5 * (time - _resumed_at) ) {
+			_paced_until = time + hold;
+		}
+		_paused    = time < _paced_until;
+		_pauses   += _paused;
+		_fence_at  = time;
+		_fence_pos = pos;
+		return true;
+	}
+
+	// the response to the fence, received at time with pos bytes before it.
+	void acknowledge( double const time, unsigned const pos ) {
+		if( _fence_at < 0.0 ) {
+			return;
+		}
+		double const rtt   = time - _fence_at;
+		double const bytes = double( unsigned( pos - _fence_pos ) );
+		_fence_at = -1.0;
+
+		// the filters forget the samples older than 10 - 20 s, as the link changes.
+		if( time - _window_at > 10.0 ) {
+			_min_rtt        = _next_min_rtt;
+			_bandwidth      = _next_bandwidth > 0.0 ? _next_bandwidth : _bandwidth;
+			_next_min_rtt   = std::numeric_limits<double>::infinity();
+			_next_bandwidth = 0.0;
+			_window_at      = time;
+		}
+		_min_rtt      = std::min( _min_rtt,      rtt );
+		_next_min_rtt = std::min( _next_min_rtt, rtt );
+		// the link has carried at least the bytes ahead of the fence in its round trip.
+		if( rtt > 1e-3 && bytes > 0.0 ) {
+			_bandwidth      = std::max( _bandwidth,      bytes / rtt );
+			_next_bandwidth = std::max( _next_bandwidth, bytes / rtt );
+		}
+		// a fence sent with the pause has seen the buffers drain.
+		_queued     = _paused ? 0.0 : rtt - _min_rtt;
+		_resumed_at = _paused ? time : _resumed_at;
+		_paused     = false;
+	}
+
+	// gives up the fence in flight, which the server has not answered, and the pause.
+	void reset() {
+		_fence_at = -1.0;
+		_queued   = 0.0;
+		_paused   = false;
+	}
+
+	bool paused() const {
+		return _paused;
+	}
+
+	// [bytes / s], 0 while unknown.
+	double bandwidth() const {
+		return _bandwidth;
+	}
+
+	// [s] the data waited in the buffers, as the last fence has seen.
+	double queued() const {
+		return _queued;
+	}
+
+	// the number of pauses so far.
+	size_t pauses() const {
+		return _pauses;
+	}
+
+	double slack = 0.01; // [s] of waiting allowed beyond an update, for the jitter of the link.
+	double hold  = 1.0;  // [s] of pausing after each update once the link is busy.
+
+private:
+	double   _update_bytes   = 0.0;
+	double   _fence_at       = -1.0; // the fence in flight; < 0: none.
+	unsigned _fence_pos      = 0;
+	bool     _paused         = false;
+	size_t   _pauses         = 0;
+	double   _paced_until    = -1e9;
+	double   _resumed_at     = -1e9;
+	double   _queued         = 0.0;
+	double   _min_rtt        = std::numeric_limits<double>::infinity();
+	double   _next_min_rtt   = std::numeric_limits<double>::infinity();
+	double   _bandwidth      = 0.0;
+	double   _next_bandwidth = 0.0;
+	double   _window_at      = 0.0;
+};
@@ -0,0 +1,35 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <vector>
+#include <rfb/Region.h>
+
+
+// a move of pixels within the framebuffer (CopyRect), which the render
+// thread repeats on the texture instead of uploading the pixels again.
+struct copy_rect_t {
+	rfb::Rect  rect;  // the destination.
+	rfb::Point delta; // from the source to the destination.
+
+	rfb::Rect source() const {
+		return rect.translate( delta.negate() );
+	}
+};
+
+// the damage not on the texture yet moves along with a copy: the pixels
+// copied out of it are still to be uploaded, those it covers no more.
+inline void move_damage( rfb::Region& damage, copy_rect_t const& copy ) {
+	rfb::Region moved = damage.intersect( copy.source() );
+	moved.translate( copy.delta );
+	damage.assign_subtract( copy.rect );
+	damage.assign_union( moved );
+}
+
+// the destinations of copies, whose texels are moved on level 0 only.
+inline rfb::Region copy_destinations( std::vector<copy_rect_t> const& copies ) {
+	rfb::Region region;
+	for( auto const& c: copies ) {
+		region.assign_union( c.rect );
+	}
+	return region;
+}
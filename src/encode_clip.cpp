@@ -0,0 +1,207 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// writes a video clip as a recording, which host/replay reads, of a server
+// sending it full screen: either raw RGB frames encoded as Tight JPEG, or an
+// H.264 stream (Annex B) as the Open H.264 encoding.  both come from ffmpeg:
+//
+//     ffmpeg -i clip.mp4 -f rawvideo -pix_fmt rgb24 - | host/encode_clip -t 1920x1080 >tight.rfb
+//     ffmpeg -i clip.mp4 -c:v libx264 -tune zerolatency -f h264 - | host/encode_clip -h 1920x1080 >h264.rfb
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "rfb_encoder.hpp"
+#include "recorder.hpp"
+
+
+// the timestamps are those of a server sending at the frame rate.
+struct recording_writer_t: rfb_buffer_t {
+	recording_writer_t( FILE* const file ):
+		_file( file )
+	{
+		std::fwrite( recording_magic, 1, sizeof( recording_magic ) - 1, _file );
+	}
+
+	// what the server sends up to ServerInit: RFB 3.8 without authentication.
+	void handshake( int const w, int const h ) {
+		char const version[] = "RFB 003.008\n";
+		bytes( reinterpret_cast<uint8_t const*>( version ), sizeof( version ) - 1 );
+		u8( 1 ); // security types.
+		u8( 1 ); // none.
+		u32( 0 ); // SecurityResult: OK.
+		u16( w );
+		u16( h );
+		// 32 bpp, depth 24, little endian, true colour, the same as pixel_buffer_t.
+		u8( 32 ); u8( 24 ); u8( 0 ); u8( 1 );
+		u16( 255 ); u16( 255 ); u16( 255 );
+		u8( 0 ); u8( 8 ); u8( 16 );
+		u8( 0 ); u8( 0 ); u8( 0 );
+		char const name[] = "encode_clip";
+		u32( sizeof( name ) - 1 );
+		bytes( reinterpret_cast<uint8_t const*>( name ), sizeof( name ) - 1 );
+		flush( 0 );
+	}
+
+	// the header of a FramebufferUpdate of n rects, which follow.
+	void update( int const n ) {
+		u8( 0 );
+		u8( 0 );
+		u16( n );
+	}
+
+	void flush( uint64_t const usec ) {
+		uint32_t const size = data.size();
+		std::fwrite( &usec, sizeof( usec ), 1, _file );
+		std::fwrite( &size, sizeof( size ), 1, _file );
+		std::fwrite( data.data(), 1, data.size(), _file );
+		data.clear();
+	}
+
+private:
+	FILE* _file;
+};
+
+// each frame in rects of at most 2048 pixels wide and 65536 pixels, as
+// TigerVNC's EncodeManager splits it.  the decoder threads take them in parallel.
+void write_tight( recording_writer_t& out, int const w, int const h, double const fps, int const level ) {
+	int const rw = std::min( w, 2048 );
+	int const rh = std::max( 65536 / rw, 1 );
+	std::vector<uint8_t> frame( 3 * w * h );
+	uint64_t n = 0;
+	while( std::fread( frame.data(), frame.size(), 1, stdin ) == 1 ) {
+		out.update( ((w + rw - 1) / rw) * ((h + rh - 1) / rh) );
+		for( int y = 0; y < h; y += rh ) {
+			for( int x = 0; x < w; x += rw ) {
+				int const cw = std::min( rw, w - x );
+				int const ch = std::min( rh, h - y );
+				out.rect( x, y, cw, ch, 7 );
+				tight_jpeg( out, encode_jpeg( frame.data() + 3 * (size_t( w ) * y + x), 3 * w, cw, ch, jpeg_quality[level] ) );
+			}
+		}
+		out.flush( uint64_t( 1e6 * double( n++ ) / fps ) );
+	}
+}
+
+// splits an Annex B stream into access units: a frame each, as the server
+// would send them.
+struct access_unit_reader_t {
+	bool next( std::vector<uint8_t>& au ) {
+		au.clear();
+		bool vcl = false;
+		while( true ) {
+			size_t begin;
+			while( (begin = _find_start( _pos )) == _buf.size() ) {
+				if( !_fill() ) {
+					return !au.empty();
+				}
+			}
+			// the NAL unit ends at the next start code or at the end of the stream.
+			size_t end;
+			while( (end = _find_start( begin + 3 )) == _buf.size() && _fill() ) {
+			}
+			uint8_t const header = _buf[begin + 3];
+			int const type = header & 0x1f;
+			bool const is_vcl = type == 1 || type == 5;
+			// first_mb_in_slice == 0: ue(v) starts with a 1 bit.
+			bool const first_slice = is_vcl && begin + 4 < end && (_buf[begin + 4] & 0x80) != 0;
+			bool const starts_au = type == 9 || (6 <= type && type <= 8) || first_slice;
+			if( vcl && starts_au ) {
+				_pos = begin;
+				return true;
+			}
+			vcl = vcl || is_vcl;
+			au.push_back( 0 );
+			au.insert( au.end(), _buf.begin() + begin, _buf.begin() + end );
+			_pos = end;
+			if( _pos > (1 << 20) ) {
+				_buf.erase( _buf.begin(), _buf.begin() + _pos );
+				_pos = 0;
+			}
+		}
+	}
+
+private:
+	// the position of the next 00 00 01 from i, or the end.
+	size_t _find_start( size_t const i ) const {
+		for( size_t j = i; j + 3 < _buf.size(); ++j ) {
+			if( _buf[j] == 0 && _buf[j + 1] == 0 && _buf[j + 2] == 1 ) {
+				return j;
+			}
+		}
+		return _buf.size();
+	}
+
+	bool _fill() {
+		if( _eof ) {
+			return false;
+		}
+		uint8_t tmp[1 << 16];
+		size_t const n = std::fread( tmp, 1, sizeof( tmp ), stdin );
+		_buf.insert( _buf.end(), tmp, tmp + n );
+		_eof = n == 0;
+		return !_eof;
+	}
+
+	std::vector<uint8_t> _buf;
+	size_t               _pos = 0;
+	bool                 _eof = false;
+};
+
+void write_h264( recording_writer_t& out, int const w, int const h, double const fps ) {
+	access_unit_reader_t reader;
+	std::vector<uint8_t> au;
+	uint64_t n = 0;
+	while( reader.next( au ) ) {
+		out.update( 1 );
+		out.rect( 0, 0, w, h, 50 );
+		out.u32( au.size() );
+		out.u32( n == 0 ? 1 : 0 ); // reset the context of the rect.
+		out.bytes( au.data(), au.size() );
+		out.flush( uint64_t( 1e6 * double( n++ ) / fps ) );
+	}
+}
+
+int main( int const argc, char** const argv ) {
+	char   mode  = 0;
+	int    w     = 0;
+	int    h     = 0;
+	double fps   = 30.0;
+	int    level = 8;
+	for( int opt; (opt = getopt( argc, argv, "t:h:r:q:" )) != -1; ) {
+		switch( opt ) {
+			case 't':
+			case 'h':
+				mode = char( opt );
+				if( std::sscanf( optarg, "%dx%d", &w, &h ) != 2 ) {
+					w = 0;
+				}
+				break;
+			case 'r': fps   = std::atof( optarg ); break;
+			case 'q': level = std::atoi( optarg ); break;
+			default:
+				mode = 0;
+				break;
+		}
+	}
+	if( mode == 0 || w <= 0 || h <= 0 || w > 0xffff || h > 0xffff || fps <= 0.0 || optind != argc ) {
+		std::fprintf( stderr, "usage: %s (-t | -h) WxH [-r fps] [-q quality] <input >recording.rfb\n", argv[0] );
+		std::fprintf( stderr, "  -t  raw RGB24 frames to Tight JPEG at the quality level (0 - 9, default 8).\n" );
+		std::fprintf( stderr, "  -h  an H.264 Annex B stream to the Open H.264 encoding.\n" );
+		std::fprintf( stderr, "  -r  the frame rate of the timestamps (default 30).\n" );
+		return 1;
+	}
+	level = std::min( std::max( level, 0 ), 9 );
+
+	recording_writer_t out( stdout );
+	out.handshake( w, h );
+	if( mode == 't' ) {
+		write_tight( out, w, h, fps, level );
+	}
+	else {
+		write_h264( out, w, h, fps );
+	}
+	return 0;
+}
@@ -0,0 +1,340 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <jpeglib.h>
+#if __has_include( <stb_image.h> )
+#include <stb_image.h>
+#endif
+#include "etc2.hpp"
+#include "mipmap.hpp"
+
+
+// the background and its mipmap levels, as the GL texture has them: RGBA
+// texels as decoded, or ETC2 blocks as mapped from the cache, so that the
+// kernel may drop the pages which have been uploaded.
+struct equirect_image_t {
+	struct level_t {
+		int         w    = 0;
+		int         h    = 0;
+		void const* data = nullptr; // row by row, of texels or of blocks.
+	};
+
+	equirect_image_t()                                     = default;
+	equirect_image_t( equirect_image_t&& )                 = delete;
+	equirect_image_t( equirect_image_t const& )            = delete;
+	equirect_image_t& operator=( equirect_image_t&& )      = delete;
+	equirect_image_t& operator=( equirect_image_t const& ) = delete;
+
+	~equirect_image_t() {
+		if( _map != MAP_FAILED ) {
+			munmap( _map, _map_size );
+		}
+	}
+
+	bool mapped() const {
+		return _map != MAP_FAILED;
+	}
+
+	std::vector<level_t> levels;
+	bool                 compressed = false; // GL_COMPRESSED_SRGB8_ETC2, otherwise GL_SRGB8_ALPHA8.
+
+private:
+	friend struct equirect_cache_t;
+	friend std::unique_ptr<equirect_image_t> equirect_decode( std::string const&, bool );
+
+	// either of them.
+	void*                                       _map      = MAP_FAILED;
+	size_t                                      _map_size = 0;
+	std::unique_ptr<uint8_t, void (*)( void* )> _base     = { nullptr, std::free };
+	mip_pyramid_t                               _pyramid;
+};
+
+struct equirect_jpeg_error_t {
+	jpeg_error_mgr mgr;
+	std::jmp_buf   jump;
+};
+
+// a JPEG file as RGBA through libjpeg-turbo, which is several times faster
+// than stb_image on a large panorama and which the host has too; nullptr if
+// it is not one or is broken.  the buffer is to be released with free().
+inline uint8_t* equirect_decode_jpeg( std::FILE* const fp, int& w, int& h ) {
+	uint8_t magic[3] = {};
+	if( std::fread( magic, 1, 3, fp ) != 3 || magic[0] != 0xff || magic[1] != 0xd8 || magic[2] != 0xff ) {
+		return nullptr;
+	}
+	std::rewind( fp );
+
+	jpeg_decompress_struct dinfo;
+	equirect_jpeg_error_t err;
+	dinfo.err = jpeg_std_error( &err.mgr );
+	err.mgr.error_exit = []( j_common_ptr const info ) {
+		std::longjmp( reinterpret_cast<equirect_jpeg_error_t*>( info->err )->jump, 1 );
+	};
+	err.mgr.output_message = []( j_common_ptr ) {};
+	// volatile across longjmp().
+	uint8_t* volatile base = nullptr;
+	if( setjmp( err.jump ) != 0 ) {
+		jpeg_destroy_decompress( &dinfo );
+		std::free( base );
+		return nullptr;
+	}
+	jpeg_create_decompress( &dinfo );
+	jpeg_stdio_src( &dinfo, fp );
+	jpeg_read_header( &dinfo, TRUE );
+	dinfo.out_color_space = JCS_EXT_RGBA;
+	jpeg_start_decompress( &dinfo );
+	w = int( dinfo.output_width );
+	h = int( dinfo.output_height );
+	base = static_cast<uint8_t*>( std::malloc( 4 * size_t( w ) * size_t( h ) ) );
+	if( base == nullptr ) {
+		jpeg_destroy_decompress( &dinfo );
+		return nullptr;
+	}
+	while( dinfo.output_scanline < dinfo.output_height ) {
+		JSAMPROW row = base + 4 * size_t( w ) * dinfo.output_scanline;
+		jpeg_read_scanlines( &dinfo, &row, 1 );
+	}
+	jpeg_finish_decompress( &dinfo );
+	jpeg_destroy_decompress( &dinfo );
+	return base;
+}
+
+// decodes the image file; mipmap: with the levels 1.. reduced as glGenerateMipmap() does.
+inline std::unique_ptr<equirect_image_t> equirect_decode( std::string const& path, bool const mipmap ) {
+	auto image = std::make_unique<equirect_image_t>();
+	int w = 0, h = 0;
+	if( std::FILE* const fp = std::fopen( path.c_str(), "rb" ) ) {
+		image->_base = { equirect_decode_jpeg( fp, w, h ), std::free };
+		std::fclose( fp );
+	}
+#if __has_include( <stb_image.h> )
+	// the other formats.
+	if( image->_base == nullptr ) {
+		image->_base = { stbi_load( path.c_str(), &w, &h, nullptr, 4 ), stbi_image_free };
+	}
+#endif
+	if( image->_base == nullptr ) {
+		throw std::runtime_error( "cannot decode " + path );
+	}
+
+	auto const* const base = reinterpret_cast<uint32_t const*>( image->_base.get() );
+	image->levels.push_back( { w, h, base } );
+	if( mipmap ) {
+		image->_pyramid.resize( w, h );
+		image->_pyramid.rebuild( base );
+		for( auto const& l: image->_pyramid.levels() ) {
+			image->levels.push_back( { l.w, l.h, l.pixels.data() } );
+		}
+	}
+	return image;
+}
+
+// the background compressed to ETC2 on disk, 1/8 of the decoded pixels to
+// read and to upload: one file, which the next image replaces.  it is found
+// by the path, the size and the modification time of the source file; its
+// contents are hashed only if they differ, so that a file touched or moved
+// with the same contents is found too.
+struct equirect_cache_t {
+	struct header_t {
+		char     magic[8];
+		uint64_t path;  // the hash of the path of the source file.
+		uint64_t size;  // [bytes] of the source file.
+		int64_t  mtime; // [ns] of the source file.
+		uint64_t hash;  // of the contents of the source file.
+		int32_t  w;
+		int32_t  h;
+		int32_t  levels;
+		int32_t  reserved;
+	};
+
+	static constexpr char const magic[8] = { 'o', 'v', 'r', 'v', 'n', 'c', 'e', '2' };
+	static constexpr char const name[]   = "equirect.etc2";
+
+	equirect_cache_t( std::string dir ):
+		_dir( std::move( dir ) )
+	{
+	}
+
+	// the image from the cache, or nullptr: then store() it once decoded.
+	std::unique_ptr<equirect_image_t> map( std::string const& path, bool const mipmap ) {
+		hashed = false;
+		_key   = {};
+		header_t key = {};
+		std::memcpy( key.magic, magic, sizeof( key.magic ) );
+		key.path = _hash_bytes( path.data(), path.size() );
+		struct stat st;
+		if( stat( path.c_str(), &st ) != 0 ) {
+			return nullptr;
+		}
+		key.size  = uint64_t( st.st_size );
+		key.mtime = int64_t( st.st_mtim.tv_sec ) * 1'000'000'000 + st.st_mtim.tv_nsec;
+
+		int const fd = open( _file().c_str(), O_RDWR | O_CLOEXEC );
+		header_t header;
+		bool const valid =
+			fd >= 0 &&
+			read( fd, &header, sizeof( header ) ) == ssize_t( sizeof( header ) ) &&
+			std::memcmp( header.magic, magic, sizeof( header.magic ) ) == 0 &&
+			header.w > 0 && header.h > 0 &&
+			header.levels == (mipmap ? mip_pyramid_t::count_levels( header.w, header.h ) : 1) &&
+			fstat( fd, &st ) == 0 && size_t( st.st_size ) == _size( header );
+		bool const same =
+			valid && header.path == key.path && header.size == key.size && header.mtime == key.mtime;
+		if( !same ) {
+			hashed = true;
+			if( !_hash_file( path, key.hash ) ) {
+				if( fd >= 0 ) {
+					close( fd );
+				}
+				return nullptr;
+			}
+			if( !valid || header.size != key.size || header.hash != key.hash ) {
+				if( fd >= 0 ) {
+					close( fd );
+				}
+				_key = key;
+				return nullptr;
+			}
+			// the same contents: the entry is of this file now.
+			header.path  = key.path;
+			header.mtime = key.mtime;
+			if( pwrite( fd, &header, sizeof( header ), 0 ) != ssize_t( sizeof( header ) ) ) {
+				close( fd );
+				return nullptr;
+			}
+		}
+
+		void* const map = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+		close( fd );
+		if( map == MAP_FAILED ) {
+			return nullptr;
+		}
+		auto image = std::make_unique<equirect_image_t>();
+		image->_map       = map;
+		image->_map_size  = st.st_size;
+		image->compressed = true;
+		uint8_t const* ptr = static_cast<uint8_t const*>( map ) + sizeof( header_t );
+		for( int i = 0; i < header.levels; ++i ) {
+			int const w = std::max( 1, header.w >> i );
+			int const h = std::max( 1, header.h >> i );
+			image->levels.push_back( { w, h, ptr } );
+			ptr += etc2_size( w, h );
+		}
+		return image;
+	}
+
+	// the decoded image of the source which the last map() did not find, or
+	// false.  written to a temporary file, which is renamed when complete.
+	bool store( equirect_image_t const& image ) {
+		if( image.compressed || _key.magic[0] == 0 ) {
+			return false;
+		}
+		header_t header = _key;
+		header.w      = image.levels[0].w;
+		header.h      = image.levels[0].h;
+		header.levels = int32_t( image.levels.size() );
+
+		mkdir( _dir.c_str(), 0777 );
+		std::string const file = _file();
+		std::string const tmp  = file + ".tmp";
+		FILE* const fp = std::fopen( tmp.c_str(), "wb" );
+		if( fp == nullptr ) {
+			return false;
+		}
+		bool ok = std::fwrite( &header, sizeof( header ), 1, fp ) == 1;
+		std::vector<uint8_t> blocks;
+		for( auto const& l: image.levels ) {
+			blocks.resize( etc2_size( l.w, l.h ) );
+			etc2_encode( static_cast<uint32_t const*>( l.data ), l.w, l.h, blocks.data() );
+			ok = ok && std::fwrite( blocks.data(), blocks.size(), 1, fp ) == 1;
+		}
+		ok = std::fclose( fp ) == 0 && ok;
+		if( !ok || std::rename( tmp.c_str(), file.c_str() ) != 0 ) {
+			std::remove( tmp.c_str() );
+			return false;
+		}
+		_remove_others();
+		return true;
+	}
+
+	bool hashed = false; // by the last map(): the source was not found by its path, size and time.
+
+private:
+	static uint64_t _mix( uint64_t const h, uint64_t const v ) {
+		uint64_t const x = (h ^ v) * 0x9e3779b97f4a7c15u;
+		return (x << 31) | (x >> 33);
+	}
+
+	// the tail is padded with zeros: the size goes in last.
+	static uint64_t _hash_bytes( void const* const src, size_t const size, uint64_t h = 1 ) {
+		uint8_t const* const p = static_cast<uint8_t const*>( src );
+		for( size_t i = 0; i < size; i += 8 ) {
+			uint64_t v = 0;
+			std::memcpy( &v, p + i, std::min<size_t>( 8, size - i ) );
+			h = _mix( h, v );
+		}
+		return h;
+	}
+
+	static bool _hash_file( std::string const& path, uint64_t& hash ) {
+		int const fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+		if( fd < 0 ) {
+			return false;
+		}
+		std::vector<uint8_t> buf( 1 << 19 );
+		uint64_t h = 1;
+		uint64_t size = 0;
+		ssize_t n;
+		while( (n = read( fd, buf.data(), buf.size() )) > 0 ) {
+			h = _hash_bytes( buf.data(), n, h );
+			size += n;
+		}
+		close( fd );
+		hash = _mix( h, size );
+		return n == 0;
+	}
+
+	static size_t _size( header_t const& header ) {
+		size_t size = sizeof( header_t );
+		for( int i = 0; i < header.levels; ++i ) {
+			size += etc2_size( std::max( 1, header.w >> i ), std::max( 1, header.h >> i ) );
+		}
+		return size;
+	}
+
+	std::string _file() const {
+		return _dir + "/" + name;
+	}
+
+	// those of the older versions and the temporary files left by a kill.
+	void _remove_others() {
+		DIR* const dir = opendir( _dir.c_str() );
+		if( dir == nullptr ) {
+			return;
+		}
+		while( dirent const* const e = readdir( dir ) ) {
+			if( std::strncmp( e->d_name, "equirect", 8 ) == 0 && std::strcmp( e->d_name, name ) != 0 ) {
+				std::remove( (_dir + "/" + e->d_name).c_str() );
+			}
+		}
+		closedir( dir );
+	}
+
+	std::string _dir;
+	header_t    _key = {}; // of the source which the last map() did not find.
+};
@@ -1,34 +1,101 @@
 // (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
 #pragma once
-#include <stb_image.h>
+#include <chrono>
+#include <future>
+#include "equirect_image.hpp"
 
 
+// the image is decoded (or mapped from the cache) on a worker thread and
+// uploaded a band of rows at a time over the frames; the layer shows once it
+// is complete.  a decoded image is compressed into the cache after it is
+// handed over, for the next launch.
 struct equirect_layer_t {
-	static equirect_layer_t load( std::string const& path ) {
-		int w, h;
-		uint8_t* img = stbi_load( path.c_str(), &w, &h, nullptr, 4 );
-		if( img == nullptr ) {
-			throw std::runtime_error( "" );
+	// cache_dir: empty not to cache.
+	void load( std::string path, std::string cache_dir, bool const mipmap ) {
+		std::promise<std::shared_ptr<equirect_image_t>> promise;
+		_future = promise.get_future();
+		_task = std::async( std::launch::async, [promise = std::move( promise ), path = std::move( path ), cache_dir = std::move( cache_dir ), mipmap]() mutable {
+			try {
+				if( cache_dir.empty() ) {
+					promise.set_value( equirect_decode( path, mipmap ) );
+					return;
+				}
+				equirect_cache_t cache( cache_dir );
+				if( auto image = cache.map( path, mipmap ) ) {
+					promise.set_value( std::move( image ) );
+					return;
+				}
+				std::shared_ptr<equirect_image_t> const image = equirect_decode( path, mipmap );
+				promise.set_value( image );
+				cache.store( *image );
+			}
+			catch( ... ) {
+				promise.set_exception( std::current_exception() );
+			}
+		} );
+	}
+
+	// render thread, every frame.
+	void update() {
+		if( _image == nullptr ) {
+			if( !_future.valid() || _future.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) {
+				return;
+			}
+			try {
+				_image = _future.get();
+			}
+			catch( std::exception const& ) {
+				return;
+			}
+
+			auto const& base = _image->levels[0];
+			_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
+				VRAPI_TEXTURE_TYPE_2D, _image->compressed ? GL_COMPRESSED_SRGB8_ETC2 : GL_SRGB8_ALPHA8, base.w, base.h, _image->levels.size(), 1
+			) );
+			glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _chain.get(), 0 ) );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _image->levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+			_level = 0;
+			_row   = 0;
 		}
 
-		equirect_layer_t layer;
-		layer._image = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
-			VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, w, h, 1, 1
-		) );
-		glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( layer._image.get(), 0 ) );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
 		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
-		glPixelStorei( GL_UNPACK_ROW_LENGTH, w );
-		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, img );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+		glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _chain.get(), 0 ) );
+		size_t budget = upload_budget;
+		while( _level < _image->levels.size() && budget > 0 ) {
+			auto const& l = _image->levels[_level];
+			int rows;
+			if( _image->compressed ) {
+				// whole rows of blocks, 8 bytes each.
+				size_t const line = etc2_size( l.w, 4 );
+				rows = std::min( 4 * std::max( int( budget / line ), 1 ), l.h - _row );
+				size_t const size = line * ((rows + 3) / 4);
+				glCompressedTexSubImage2D( GL_TEXTURE_2D, _level, 0, _row, l.w, rows, GL_COMPRESSED_SRGB8_ETC2, size, static_cast<uint8_t const*>( l.data ) + line * (_row / 4) );
+				budget -= std::min( budget, size );
+			}
+			else {
+				rows = std::min( std::max( int( budget / (4 * size_t( l.w )) ), 1 ), l.h - _row );
+				glTexSubImage2D( GL_TEXTURE_2D, _level, 0, _row, l.w, rows, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<uint32_t const*>( l.data ) + size_t( l.w ) * _row );
+				budget -= std::min( budget, 4 * size_t( l.w ) * rows );
+			}
+			_row += rows;
+			if( _row == l.h ) {
+				_level += 1;
+				_row    = 0;
+			}
+		}
 		glBindTexture( GL_TEXTURE_2D, 0 );
 
-		stbi_image_free( img );
-		return layer;
+		if( _level == _image->levels.size() ) {
+			// the texture has it all.
+			_image.reset();
+			_ready = true;
+		}
 	}
 
 	operator bool() const {
-		return _image != nullptr;
+		return _ready;
 	}
 
 	ovrLayerEquirect2 layer( ovrTracking2 const& tracking ) const {
@@ -37,13 +104,21 @@ struct equirect_layer_t {
 		layer.HeadPose.Pose.Orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
 		layer.TexCoordsFromTanAngles    = ovrMatrix4f_CreateIdentity();
 		for( size_t eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye ) {
-			layer.Textures[eye].ColorSwapChain = _image.get();
+			layer.Textures[eye].ColorSwapChain = _chain.get();
 			layer.Textures[eye].SwapChainIndex = 0;
 		}
 
 		return layer;
 	}
 
+	size_t upload_budget = 4 << 20; // [bytes] per frame.
+
 private:
-	std::unique_ptr<ovrTextureSwapChain> _image;
+	std::future<void>                              _task;   // decodes, then stores in the cache.
+	std::future<std::shared_ptr<equirect_image_t>> _future;
+	std::shared_ptr<equirect_image_t>              _image;  // being uploaded.
+	std::unique_ptr<ovrTextureSwapChain>           _chain;
+	size_t                                         _level = 0; // the next rows to upload.
+	int                                            _row   = 0;
+	bool                                           _ready = false;
 };
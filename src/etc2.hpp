@@ -0,0 +1,211 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+
+// ETC2 RGB8 (GL_COMPRESSED_SRGB8_ETC2) in the modes it shares with ETC1: 4 bits
+// per texel instead of 32.  a block of 4x4 texels is two halves, side by side
+// or one above the other (flip), each a base color plus one of four offsets
+// to all of R, G and B per texel; alpha is dropped.  the differential mode
+// is used only where its second color does not overflow, which ETC2 would
+// read as one of its own modes.
+
+// the offsets of the 8 tables: +a, +b, -a, -b by the index of a texel.
+inline constexpr int etc2_modifiers[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// [bytes] of a level w x h.
+inline size_t etc2_size( int const w, int const h ) {
+	return 8 * size_t( (w + 3) / 4 ) * size_t( (h + 3) / 4 );
+}
+
+// the table and the indices of the texels of a half about base, whose squared
+// error is returned.  px: the block row by row, idx: by the position in px.
+inline uint32_t etc2_encode_half( uint32_t const px[16], int const flip, int const half, int const base[3], int& table, uint8_t idx[16] ) {
+	// of each texel: the differences, their sum, and the error without an offset.
+	int pos[8];
+	int diff[8][3];
+	int sum[8];
+	int err0 = 0;
+	for( int i = 0, n = 0; i < 16; ++i ) {
+		if( ((flip ? i / 4 : i % 4) >> 1) != half ) {
+			continue;
+		}
+		sum[n] = 0;
+		for( int c = 0; c < 3; ++c ) {
+			diff[n][c] = int( (px[i] >> (8 * c)) & 0xff ) - base[c];
+			sum[n]    += diff[n][c];
+			err0      += diff[n][c] * diff[n][c];
+		}
+		pos[n] = i;
+		++n;
+	}
+
+	// the error with table t; the indices too, if out.
+	auto const encode = [&]( int const t, uint8_t* const out ) {
+		int const a = etc2_modifiers[t][0];
+		int const b = etc2_modifiers[t][1];
+		bool clamped = false;
+		for( int c = 0; c < 3; ++c ) {
+			clamped = clamped || base[c] - b < 0 || base[c] + b > 255;
+		}
+		int err = err0;
+		if( !clamped ) {
+			// an offset m adds 3 m^2 - 2 m sum: the nearest to sum / 3 is the best.
+			for( int k = 0; k < 8; ++k ) {
+				int const s = std::abs( sum[k] );
+				int const j = 2 * s >= 3 * (a + b) ? 1 : 0;
+				int const m = j ? b : a;
+				err += 3 * m * m - 2 * m * s;
+				if( out != nullptr ) {
+					out[pos[k]] = uint8_t( j | (sum[k] < 0 ? 2 : 0) );
+				}
+			}
+			return uint32_t( err );
+		}
+
+		// the colors clamped at 0 or 255 are nearer than the offsets say.
+		int const m[4] = { a, b, -a, -b };
+		int offset[4][3];
+		for( int j = 0; j < 4; ++j ) {
+			for( int c = 0; c < 3; ++c ) {
+				offset[j][c] = std::min( std::max( base[c] + m[j], 0 ), 255 ) - base[c];
+			}
+		}
+		err = 0;
+		for( int k = 0; k < 8; ++k ) {
+			int best = INT32_MAX;
+			for( int j = 0; j < 4; ++j ) {
+				int e = 0;
+				for( int c = 0; c < 3; ++c ) {
+					int const d = diff[k][c] - offset[j][c];
+					e += d * d;
+				}
+				if( e < best ) {
+					best = e;
+					if( out != nullptr ) {
+						out[pos[k]] = uint8_t( j );
+					}
+				}
+			}
+			err += best;
+		}
+		return uint32_t( err );
+	};
+
+	uint32_t best = UINT32_MAX;
+	for( int t = 0; t < 8; ++t ) {
+		uint32_t const err = encode( t, nullptr );
+		if( err < best ) {
+			best  = err;
+			table = t;
+		}
+	}
+	encode( table, idx );
+	return best;
+}
+
+// a block of 4x4 texels, RGBX row by row, as the 8 bytes of the texture.
+inline void etc2_encode_block( uint32_t const px[16], uint8_t* const dst ) {
+	uint64_t best     = 0;
+	uint64_t best_err = UINT64_MAX;
+	for( int flip = 0; flip < 2; ++flip ) {
+		int avg[2][3] = {};
+		for( int i = 0; i < 16; ++i ) {
+			int const half = (flip ? i / 4 : i % 4) >> 1;
+			for( int c = 0; c < 3; ++c ) {
+				avg[half][c] += (px[i] >> (8 * c)) & 0xff;
+			}
+		}
+		int c4[2][3], c5[2][3];
+		bool differential = true;
+		for( int h = 0; h < 2; ++h ) {
+			for( int c = 0; c < 3; ++c ) {
+				avg[h][c] = (avg[h][c] + 4) / 8;
+				c4[h][c]  = (avg[h][c] * 15 + 127) / 255;
+				c5[h][c]  = (avg[h][c] * 31 + 127) / 255;
+			}
+		}
+		for( int c = 0; c < 3; ++c ) {
+			int const d = c5[1][c] - c5[0][c];
+			differential = differential && -4 <= d && d <= 3;
+		}
+
+		for( int mode = differential ? 1 : 0; mode >= 0; --mode ) {
+			int base[2][3];
+			for( int h = 0; h < 2; ++h ) {
+				for( int c = 0; c < 3; ++c ) {
+					base[h][c] = mode ? (c5[h][c] << 3) | (c5[h][c] >> 2) : (c4[h][c] << 4) | c4[h][c];
+				}
+			}
+			int table[2] = {};
+			uint8_t idx[16];
+			uint64_t const err =
+				uint64_t( etc2_encode_half( px, flip, 0, base[0], table[0], idx ) ) +
+				uint64_t( etc2_encode_half( px, flip, 1, base[1], table[1], idx ) );
+			if( err >= best_err ) {
+				continue;
+			}
+
+			uint64_t b = 0;
+			for( int c = 0; c < 3; ++c ) {
+				int const shift = 56 - 8 * c;
+				if( mode ) {
+					b |= uint64_t( c5[0][c] ) << (shift + 3);
+					b |= uint64_t( (c5[1][c] - c5[0][c]) & 7 ) << shift;
+				}
+				else {
+					b |= uint64_t( c4[0][c] ) << (shift + 4);
+					b |= uint64_t( c4[1][c] ) << shift;
+				}
+			}
+			b |= uint64_t( table[0] ) << 37 | uint64_t( table[1] ) << 34 | uint64_t( mode ) << 33 | uint64_t( flip ) << 32;
+			// the texels column by column, the high bits of the indices first.
+			for( int i = 0; i < 16; ++i ) {
+				int const j = 4 * (i % 4) + i / 4;
+				b |= uint64_t( idx[i] >> 1 ) << (16 + j) | uint64_t( idx[i] & 1 ) << j;
+			}
+			best     = b;
+			best_err = err;
+		}
+	}
+	for( int i = 0; i < 8; ++i ) {
+		dst[i] = uint8_t( best >> (56 - 8 * i) );
+	}
+}
+
+// a level w x h, RGBX row by row, into etc2_size( w, h ) bytes.  the blocks
+// over the right and the bottom edges repeat the last texels.  the rows of
+// blocks are spread over the cores.
+inline void etc2_encode( uint32_t const* const src, int const w, int const h, uint8_t* const dst ) {
+	int const bw = (w + 3) / 4;
+	int const bh = (h + 3) / 4;
+	auto const encode = [=]( int const by0, int const by1 ) {
+		uint32_t px[16];
+		for( int by = by0; by < by1; ++by ) {
+			for( int bx = 0; bx < bw; ++bx ) {
+				for( int i = 0; i < 16; ++i ) {
+					int const x = std::min( 4 * bx + i % 4, w - 1 );
+					int const y = std::min( 4 * by + i / 4, h - 1 );
+					px[i] = src[size_t( w ) * y + x];
+				}
+				etc2_encode_block( px, dst + 8 * (size_t( bw ) * by + bx) );
+			}
+		}
+	};
+
+	int const n = std::min( int( std::max( std::thread::hardware_concurrency(), 1u ) ), std::max( bh / 16, 1 ) );
+	std::vector<std::thread> threads;
+	for( int i = 1; i < n; ++i ) {
+		threads.emplace_back( encode, bh * i / n, bh * (i + 1) / n );
+	}
+	encode( 0, bh / n );
+	for( auto& t: threads ) {
+		t.join();
+	}
+}
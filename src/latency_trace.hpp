@@ -0,0 +1,239 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined( __ANDROID__ )
+#include <android/log.h>
+#else
+// host builds (replay tool, tests) log to stderr.
+#define ANDROID_LOG_INFO 4
+#define __android_log_print( prio, tag, ... ) \
+	( std::fprintf( stderr, "%s: ", tag ), std::fprintf( stderr, __VA_ARGS__ ), std::fputc( '\n', stderr ) )
+#endif
+
+
+// timestamps in ns of CLOCK_MONOTONIC, which is also the clock of VrApi
+// (PredictedDisplayTimeInSeconds).
+inline int64_t trace_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+enum class trace_kind_t: uint8_t {
+	decode,  // the first byte of a FramebufferUpdate read .. framebufferUpdateEnd().
+	queue,   // framebufferUpdateEnd() .. the texture upload.
+	display, // the texture upload .. the predicted display time of the frame.
+	total,   // the first byte read .. the predicted display time.
+	rtt,     // a fence request .. its response.
+	count,
+};
+
+inline char const* trace_name( trace_kind_t const kind ) {
+	static char const* const names[] = { "decode", "queue", "display", "total", "rtt" };
+	return names[size_t( kind )];
+}
+
+struct trace_span_t {
+	int64_t      begin = 0;
+	int64_t      end   = 0;
+	trace_kind_t kind  = trace_kind_t::count;
+	uint32_t     tid   = 0;
+};
+
+// the spans of one thread.  single producer (the thread), single consumer
+// (the collector); a span is dropped when the ring is full.
+struct trace_ring_t {
+	bool push( trace_span_t const& s ) {
+		size_t const head = _head.load( std::memory_order_relaxed );
+		if( head - _tail.load( std::memory_order_acquire ) >= _spans.size() ) {
+			return false;
+		}
+		_spans[head % _spans.size()] = s;
+		_head.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	template<class F>
+	void drain( F const& f ) {
+		size_t tail = _tail.load( std::memory_order_relaxed );
+		size_t const head = _head.load( std::memory_order_acquire );
+		for( ; tail != head; ++tail ) {
+			f( _spans[tail % _spans.size()] );
+		}
+		_tail.store( tail, std::memory_order_release );
+	}
+
+private:
+	std::array<trace_span_t, 4096> _spans;
+	std::atomic<size_t>            _head = { 0 };
+	std::atomic<size_t>            _tail = { 0 };
+};
+
+// log-linear buckets of the duration in us: 8 per octave (9 %), up to ~17 min.
+struct trace_histogram_t {
+	void add( int64_t const ns ) {
+		double const us = std::max( double( ns ) * 1e-3, 1.0 );
+		size_t const i = std::min( size_t( 8.0 * std::log2( us ) ), _counts.size() - 1 );
+		_counts[i] += 1;
+		_total     += 1;
+		_max        = std::max( _max, ns );
+	}
+
+	// in ms: the upper bound of the bucket.  the last one has none.
+	double percentile( double const p ) const {
+		uint64_t const n = uint64_t( std::ceil( p * double( _total ) ) );
+		uint64_t sum = 0;
+		for( size_t i = 0; i + 1 < _counts.size(); ++i ) {
+			sum += _counts[i];
+			if( sum >= n ) {
+				return std::min( std::exp2( double( i + 1 ) / 8.0 ) * 1e-3, max() );
+			}
+		}
+		return max();
+	}
+
+	double max() const {
+		return double( _max ) * 1e-6;
+	}
+
+	uint64_t total() const {
+		return _total;
+	}
+
+	void clear() {
+		_counts.fill( 0 );
+		_total = 0;
+		_max   = 0;
+	}
+
+private:
+	std::array<uint64_t, 240> _counts = {};
+	uint64_t                  _total  = 0;
+	int64_t                   _max    = 0;
+};
+
+// the latency of the updates, from the socket to the display.  the threads
+// push spans into their own rings; poll() on the render thread collects them,
+// logs the percentiles and writes the recent spans as a Chrome trace
+// (chrome://tracing, Perfetto).  while disabled, record() only tests a flag.
+struct latency_trace_t {
+	static latency_trace_t& get() {
+		static latency_trace_t trace;
+		return trace;
+	}
+
+	static bool enabled() {
+		return get()._enabled.load( std::memory_order_relaxed );
+	}
+
+	// path: where to write the Chrome trace, overwritten on each summary.
+	void enable( std::string path ) {
+		_path = std::move( path );
+		_last = trace_now();
+		_enabled.store( true, std::memory_order_relaxed );
+	}
+
+	static void record( trace_kind_t const kind, int64_t const begin, int64_t const end ) {
+		if( !enabled() ) {
+			return;
+		}
+		thread_local trace_ring_t* ring = get()._register();
+		if( !ring->push( { begin, end, kind, _tid() } ) ) {
+			get()._dropped.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+
+	// render thread.
+	void poll( int64_t const now ) {
+		if( !enabled() || now - _last < 5'000'000'000 ) {
+			return;
+		}
+		double const dt = double( now - _last ) * 1e-9;
+		_last = now;
+
+		{
+			std::lock_guard<std::mutex> lock( _rings_mutex );
+			for( auto const& ring: _rings ) {
+				ring->drain( [&]( trace_span_t const& s ) {
+					_histograms[size_t( s.kind )].add( s.end - s.begin );
+					_recent.push_back( s );
+				} );
+			}
+		}
+		while( _recent.size() > 16384 ) {
+			_recent.pop_front();
+		}
+
+		for( size_t i = 0; i < _histograms.size(); ++i ) {
+			auto& h = _histograms[i];
+			if( h.total() == 0 ) {
+				continue;
+			}
+			__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "latency %-7s %5.1f/s  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms",
+				trace_name( trace_kind_t( i ) ), double( h.total() ) / dt, h.percentile( 0.5 ), h.percentile( 0.9 ), h.percentile( 0.99 ), h.max()
+			);
+			h.clear();
+		}
+		if( uint64_t const n = _dropped.exchange( 0 ) ) {
+			__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "latency: %llu spans dropped", (unsigned long long)n );
+		}
+		_write();
+	}
+
+private:
+	static uint32_t _tid() {
+		static std::atomic<uint32_t> next = { 1 };
+		thread_local uint32_t const tid = next.fetch_add( 1 );
+		return tid;
+	}
+
+	trace_ring_t* _register() {
+		std::lock_guard<std::mutex> lock( _rings_mutex );
+		_rings.push_back( std::make_unique<trace_ring_t>() );
+		return _rings.back().get();
+	}
+
+	// on another thread, not to miss a frame.  skipped while the last one is
+	// still being written.
+	void _write() {
+		if( _path.empty() || _writing.exchange( true ) ) {
+			return;
+		}
+		std::thread( [this, path = _path, spans = std::vector<trace_span_t>( _recent.begin(), _recent.end() )]() {
+			if( std::FILE* const fp = std::fopen( path.c_str(), "w" ) ) {
+				std::fputs( "{\"traceEvents\":[\n", fp );
+				for( size_t i = 0; i < spans.size(); ++i ) {
+					auto const& s = spans[i];
+					std::fprintf( fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}\n",
+						i == 0 ? "" : ",", trace_name( s.kind ), s.tid, double( s.begin ) * 1e-3, double( s.end - s.begin ) * 1e-3
+					);
+				}
+				std::fputs( "],\"displayTimeUnit\":\"ms\"}\n", fp );
+				std::fclose( fp );
+			}
+			_writing = false;
+		} ).detach();
+	}
+
+	std::atomic<bool>                          _enabled = { false };
+	std::atomic<uint64_t>                      _dropped = { 0 };
+	std::atomic<bool>                          _writing = { false };
+	std::mutex                                 _rings_mutex;
+	std::vector<std::unique_ptr<trace_ring_t>> _rings; // live as long as the process: threads may exit.
+	// render thread.
+	std::string                                                _path;
+	int64_t                                                    _last = 0;
+	std::array<trace_histogram_t, size_t( trace_kind_t::count )> _histograms;
+	std::deque<trace_span_t>                                   _recent;
+};
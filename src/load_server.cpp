@@ -0,0 +1,733 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// a local RFB server which plays a scripted workload, so that the client
+// (host/bench, the app) can be measured on the same updates every run:
+//
+//     host/load_server -w video -s 1920x1080 -r 30 -p 5900 &
+//     host/bench -n 16 -t 30 127.0.0.1
+//
+// each connection is served on its own thread from the beginning of the
+// script.  the encodings are Tight (JPEG, lossless in the client's pixel
+// format if it asks for no quality level, and fill) and CopyRect, with
+// continuous updates, fences and (Extended)DesktopSize, optionally through an
+// emulated slow link.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <zlib.h>
+#include "rfb_encoder.hpp"
+
+
+using clock_type = std::chrono::steady_clock;
+
+enum class workload_t {
+	video,      // the whole screen changes every frame.
+	scroll,     // a page of text scrolls by a line a frame: CopyRect and a strip.
+	scatter,    // small rects here and there: fills and JPEG.
+	resize,     // the desktop changes its size every second.
+	disconnect, // video, closed after 1 - 4 s.
+};
+
+struct options_t {
+	workload_t workload = workload_t::video;
+	int        w        = 1920;
+	int        h        = 1080;
+	double     fps      = 30.0;
+	int        port     = 5900;
+	double     link     = 0.0; // [bytes / s] the link to emulate; 0: unlimited.
+};
+
+struct rect_t {
+	int x = 0;
+	int y = 0;
+	int w = 0;
+	int h = 0;
+
+	rect_t intersect( rect_t const& r ) const {
+		int const x0 = std::max( x, r.x );
+		int const y0 = std::max( y, r.y );
+		int const x1 = std::min( x + w, r.x + r.w );
+		int const y1 = std::min( y + h, r.y + r.h );
+		return x0 < x1 && y0 < y1 ? rect_t{ x0, y0, x1 - x0, y1 - y0 } : rect_t();
+	}
+
+	bool empty() const {
+		return w <= 0 || h <= 0;
+	}
+
+	bool contains( rect_t const& r ) const {
+		return x <= r.x && y <= r.y && r.x + r.w <= x + w && r.y + r.h <= y + h;
+	}
+};
+
+// the rects TigerVNC's encoder splits an area into.
+inline std::vector<rect_t> split_rect( rect_t const& r ) {
+	int const w = std::min( r.w, 2048 );
+	int const h = std::max( 65536 / w, 1 );
+	std::vector<rect_t> rects;
+	for( int y = r.y; y < r.y + r.h; y += h ) {
+		for( int x = r.x; x < r.x + r.w; x += w ) {
+			rects.push_back( { x, y, std::min( w, r.x + r.w - x ), std::min( h, r.y + r.h - y ) } );
+		}
+	}
+	return rects;
+}
+
+// moving rings and a grain, which JPEG compresses about as well as a video.
+inline void draw_video( std::vector<uint8_t>& rgb, int const w, int const h, int const t ) {
+	for( int y = 0; y < h; ++y ) {
+		uint8_t* row = rgb.data() + 3 * size_t( w ) * y;
+		int const dy = y - h / 2 + 40 * t;
+		for( int x = 0; x < w; ++x ) {
+			int const dx = x - w / 2 - 25 * t;
+			uint32_t const r2 = uint32_t( dx * dx + dy * dy ) >> 9;
+			uint32_t const n = (uint32_t( x * 73856093 ) ^ uint32_t( y * 19349663 ) ^ uint32_t( t * 83492791 )) * 2654435761u;
+			int const grain = int( n >> 29 ) - 4;
+			row[3 * x + 0] = uint8_t( std::min( std::max( int( r2 & 0xff ) + grain, 0 ), 255 ) );
+			row[3 * x + 1] = uint8_t( std::min( std::max( int( (r2 >> 1) & 0xff ) + grain, 0 ), 255 ) );
+			row[3 * x + 2] = uint8_t( std::min( std::max( int( (x + y + 3 * t) & 0xff ) + grain, 0 ), 255 ) );
+		}
+	}
+}
+
+// the video frames loop each second.  the tiles of a frame are encoded once
+// for all the connections.
+struct video_cache_t {
+	struct tile_t {
+		rect_t               rect;
+		std::vector<uint8_t> jpeg;
+	};
+
+	using frame_t = std::vector<tile_t>;
+
+	std::shared_ptr<frame_t const> get( int const w, int const h, int const quality, int const t ) {
+		auto const key = std::make_tuple( w, h, quality, t );
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			auto const it = _frames.find( key );
+			if( it != _frames.end() ) {
+				return it->second;
+			}
+		}
+
+		std::vector<uint8_t> rgb( 3 * size_t( w ) * h );
+		draw_video( rgb, w, h, t );
+		auto frame = std::make_shared<frame_t>();
+		for( auto const& r: split_rect( { 0, 0, w, h } ) ) {
+			frame->push_back( { r, encode_jpeg( rgb.data() + 3 * (size_t( w ) * r.y + r.x), 3 * w, r.w, r.h, quality ) } );
+		}
+		std::lock_guard<std::mutex> lock( _mutex );
+		return _frames.emplace( key, std::move( frame ) ).first->second;
+	}
+
+private:
+	std::mutex                                                                  _mutex;
+	std::map<std::tuple<int, int, int, int>, std::shared_ptr<frame_t const>> _frames;
+};
+
+struct closed_t {};
+
+// one connection.
+struct session_t {
+	session_t( int const fd, options_t const& opts, video_cache_t& cache, uint32_t const seed ):
+		_fd( fd ),
+		_opts( opts ),
+		_cache( cache ),
+		_random( seed ),
+		_w( opts.w ),
+		_h( opts.h ),
+		_rgb( 3 * size_t( opts.w ) * opts.h, 0xff )
+	{
+		_zlib = z_stream();
+		deflateInit( &_zlib, 1 );
+	}
+
+	session_t( session_t const& ) = delete;
+
+	~session_t() {
+		deflateEnd( &_zlib );
+	}
+
+	void run() {
+		_handshake();
+		auto const start = clock_type::now();
+		double const end = std::uniform_real_distribution<double>( 1.0, 4.0 )( _random );
+		auto next = clock_type::now();
+		_shaped     = _opts.link > 0.0;
+		_drained_at = next;
+		while( true ) {
+			_drain();
+			int ms = int( std::chrono::duration_cast<std::chrono::milliseconds>( next - clock_type::now() ).count() );
+			if( _head < _link.size() ) {
+				ms = std::min( ms, 1 );
+			}
+			pollfd p = { _fd, POLLIN, 0 };
+			int const n = poll( &p, 1, std::max( ms, 0 ) );
+			if( n < 0 && errno != EINTR ) {
+				throw closed_t();
+			}
+			if( n > 0 ) {
+				_message();
+				continue;
+			}
+			if( clock_type::now() < next ) {
+				continue;
+			}
+
+			next += std::chrono::microseconds( int64_t( 1e6 / _opts.fps ) );
+			next = std::max( next, clock_type::now() - std::chrono::seconds( 1 ) );
+			if( _opts.workload == workload_t::disconnect && std::chrono::duration<double>( clock_type::now() - start ).count() > end ) {
+				return;
+			}
+			if( _continuous || _requested ) {
+				_frame();
+				_requested = false;
+			}
+		}
+	}
+
+private:
+	// I/O.
+	void _read( void* const dst, size_t const size ) {
+		for( size_t i = 0; i < size; ) {
+			ssize_t const n = read( _fd, static_cast<uint8_t*>( dst ) + i, size - i );
+			if( n <= 0 ) {
+				if( n < 0 && errno == EINTR ) {
+					continue;
+				}
+				throw closed_t();
+			}
+			i += n;
+		}
+	}
+
+	uint8_t _u8() {
+		uint8_t x;
+		_read( &x, 1 );
+		return x;
+	}
+
+	uint16_t _u16() {
+		uint8_t x[2];
+		_read( x, 2 );
+		return uint16_t( (x[0] << 8) | x[1] );
+	}
+
+	uint32_t _u32() {
+		uint32_t const hi = _u16();
+		return (hi << 16) | _u16();
+	}
+
+	void _skip( size_t const size ) {
+		std::vector<uint8_t> tmp( size );
+		_read( tmp.data(), size );
+	}
+
+	// through the emulated link, if any, after the handshake: what the server
+	// sends queues up as in the buffers of a slow link, fences included.
+	void _send( rfb_buffer_t& buf ) {
+		if( _shaped ) {
+			_link.insert( _link.end(), buf.data.begin(), buf.data.end() );
+			buf.data.clear();
+			return;
+		}
+		_write( buf.data.data(), buf.data.size() );
+		buf.data.clear();
+	}
+
+	// sends what the link has carried since the last call.
+	void _drain() {
+		auto const now = clock_type::now();
+		double const dt = std::chrono::duration<double>( now - _drained_at ).count();
+		size_t const size = std::min( size_t( _opts.link * dt ), _link.size() - _head );
+		if( size == 0 && _head < _link.size() ) {
+			return; // the time accumulates.
+		}
+		_drained_at = now;
+		_write( _link.data() + _head, size );
+		_head += size;
+		if( _head == _link.size() ) {
+			_link.clear();
+			_head = 0;
+		}
+	}
+
+	void _write( uint8_t const* const data, size_t const size ) {
+		for( size_t i = 0; i < size; ) {
+			ssize_t const n = send( _fd, data + i, size - i, MSG_NOSIGNAL ); // not SIGPIPE if closed.
+			if( n <= 0 ) {
+				if( n < 0 && errno == EINTR ) {
+					continue;
+				}
+				throw closed_t();
+			}
+			i += n;
+		}
+	}
+
+	// RFB 3.8 without authentication.
+	void _handshake() {
+		rfb_buffer_t out;
+		char const version[] = "RFB 003.008\n";
+		out.bytes( reinterpret_cast<uint8_t const*>( version ), sizeof( version ) - 1 );
+		_send( out );
+		_skip( 12 );
+		out.u8( 1 ); // security types.
+		out.u8( 1 ); // none.
+		_send( out );
+		_skip( 1 );
+		out.u32( 0 ); // SecurityResult: OK.
+		_send( out );
+		_skip( 1 ); // ClientInit.
+
+		out.u16( _w );
+		out.u16( _h );
+		// 32 bpp, depth 24, little endian, true colour, the same as pixel_buffer_t.
+		out.u8( 32 ); out.u8( 24 ); out.u8( 0 ); out.u8( 1 );
+		out.u16( 255 ); out.u16( 255 ); out.u16( 255 );
+		out.u8( 0 ); out.u8( 8 ); out.u8( 16 );
+		out.u8( 0 ); out.u8( 0 ); out.u8( 0 );
+		char const name[] = "load_server";
+		out.u32( sizeof( name ) - 1 );
+		out.bytes( reinterpret_cast<uint8_t const*>( name ), sizeof( name ) - 1 );
+		_send( out );
+	}
+
+	void _message() {
+		rfb_buffer_t out;
+		switch( _u8() ) {
+			case 0: { // SetPixelFormat.
+				_skip( 3 );
+				_bpp   = _u8();
+				_depth = _u8();
+				_big   = _u8() != 0;
+				_skip( 1 );
+				for( int i = 0; i < 3; ++i ) {
+					_max[i] = _u16();
+				}
+				for( int i = 0; i < 3; ++i ) {
+					_shift[i] = _u8();
+				}
+				_skip( 3 );
+				break;
+			}
+			case 2: { // SetEncodings.
+				_skip( 1 );
+				int const n = _u16();
+				bool cu = false, fence = false;
+				_quality = -1;
+				for( int i = 0; i < n; ++i ) {
+					int32_t const e = int32_t( _u32() );
+					cu    = cu    || e == -313;
+					fence = fence || e == -312;
+					_extended = _extended || e == -308;
+					if( -32 <= e && e <= -23 ) {
+						_quality = e + 32;
+					}
+				}
+				// tells the client that they are supported.
+				if( cu && !_sent_cu ) {
+					out.u8( 150 ); // EndOfContinuousUpdates.
+					_sent_cu = true;
+				}
+				if( fence && !_sent_fence ) {
+					out.u8( 248 );
+					out.u8( 0 ); out.u8( 0 ); out.u8( 0 );
+					out.u32( 1u << 31 ); // request.
+					out.u8( 0 );
+					_sent_fence = true;
+				}
+				_send( out );
+				break;
+			}
+			case 3: { // FramebufferUpdateRequest.
+				bool const incremental = _u8() != 0;
+				rect_t r;
+				r.x = _u16(); r.y = _u16(); r.w = _u16(); r.h = _u16();
+				_requested = true;
+				_refresh   = _refresh || !incremental || !r.contains( _area );
+				if( !_continuous ) {
+					_area = r;
+				}
+				break;
+			}
+			case 4: // KeyEvent.
+				_skip( 7 );
+				break;
+			case 5: // PointerEvent.
+				_skip( 5 );
+				break;
+			case 6: // ClientCutText.
+				_skip( 3 );
+				_skip( _u32() );
+				break;
+			case 150: { // EnableContinuousUpdates.
+				bool const enable = _u8() != 0;
+				rect_t r;
+				r.x = _u16(); r.y = _u16(); r.w = _u16(); r.h = _u16();
+				if( enable ) {
+					// what has changed out of the old area is sent with the next frame.
+					_refresh    = _refresh || !_area.contains( r );
+					_area       = r;
+					_continuous = true;
+				}
+				else {
+					_continuous = false;
+					out.u8( 150 );
+					_send( out );
+				}
+				break;
+			}
+			case 248: { // Fence.
+				_skip( 3 );
+				uint32_t const flags = _u32();
+				int const len = _u8();
+				std::vector<uint8_t> data( len );
+				_read( data.data(), len );
+				if( flags & (1u << 31) ) {
+					out.u8( 248 );
+					out.u8( 0 ); out.u8( 0 ); out.u8( 0 );
+					out.u32( flags & 7 ); // BlockBefore, BlockAfter, SyncNext.
+					out.u8( len );
+					out.bytes( data.data(), len );
+					_send( out );
+				}
+				break;
+			}
+			case 251: { // SetDesktopSize: refused by ignoring.
+				_skip( 5 );
+				int const n = _u8();
+				_skip( 1 + 16 * n );
+				break;
+			}
+			default:
+				throw closed_t();
+		}
+	}
+
+	// a pixel in the client's format, for a fill.
+	void _tpixel( rfb_buffer_t& out, uint8_t const* const rgb ) const {
+		uint32_t p = 0;
+		for( int i = 0; i < 3; ++i ) {
+			p |= (uint32_t( rgb[i] ) * _max[i] / 255) << _shift[i];
+		}
+		// Tight drops the padding byte of 32 bpp, depth 24.
+		bool const packed = _bpp == 32 && _depth == 24 && _max[0] == 255 && _max[1] == 255 && _max[2] == 255;
+		int const size = packed ? 3 : _bpp / 8;
+		for( int i = 0; i < size; ++i ) {
+			int const byte = _big ? (packed ? 2 - i : size - 1 - i) : i;
+			out.u8( uint8_t( p >> (8 * byte) ) );
+		}
+	}
+
+	// the pixels of r as Tight rects: JPEG if the client has asked for a
+	// quality level, otherwise lossless in its pixel format.
+	void _pixels( rfb_buffer_t& out, rect_t const& r, uint16_t& count ) {
+		for( auto const& s: split_rect( r ) ) {
+			out.rect( s.x, s.y, s.w, s.h, 7 );
+			if( _quality >= 0 ) {
+				tight_jpeg( out, encode_jpeg( _rgb.data() + 3 * (size_t( _w ) * s.y + s.x), 3 * _w, s.w, s.h, jpeg_quality[_quality] ) );
+			}
+			else {
+				_basic( out, s );
+			}
+			++count;
+		}
+	}
+
+	// the data of a Tight rect without a filter, through zlib stream 0.
+	void _basic( rfb_buffer_t& out, rect_t const& r ) {
+		rfb_buffer_t raw;
+		for( int y = r.y; y < r.y + r.h; ++y ) {
+			for( int x = r.x; x < r.x + r.w; ++x ) {
+				_tpixel( raw, &_rgb[3 * (size_t( _w ) * y + x)] );
+			}
+		}
+		out.u8( 0x00 );
+		if( raw.data.size() < 12 ) {
+			out.bytes( raw.data.data(), raw.data.size() );
+			return;
+		}
+		std::vector<uint8_t> z( deflateBound( &_zlib, raw.data.size() ) + 16 );
+		_zlib.next_in   = raw.data.data();
+		_zlib.avail_in  = raw.data.size();
+		_zlib.next_out  = z.data();
+		_zlib.avail_out = z.size();
+		deflate( &_zlib, Z_SYNC_FLUSH );
+		size_t const size = z.size() - _zlib.avail_out;
+		out.compact_length( size );
+		out.bytes( z.data(), size );
+	}
+
+	void _fill( rfb_buffer_t& out, rect_t const& r, uint8_t const* const rgb, uint16_t& count ) {
+		for( int y = r.y; y < r.y + r.h; ++y ) {
+			for( int x = r.x; x < r.x + r.w; ++x ) {
+				std::copy( rgb, rgb + 3, &_rgb[3 * (size_t( _w ) * y + x)] );
+			}
+		}
+		out.rect( r.x, r.y, r.w, r.h, 7 );
+		out.u8( 0x80 );
+		_tpixel( out, rgb );
+		++count;
+	}
+
+	// advances the script by a frame and sends what has changed in the area.
+	void _frame() {
+		rfb_buffer_t out;
+		out.u8( 0 ); // FramebufferUpdate.
+		out.u8( 0 );
+		out.u16( 0 ); // the number of rects, filled in below.
+		uint16_t count = 0;
+		rect_t const screen = { 0, 0, _w, _h };
+		rect_t area = _area.intersect( screen );
+
+		switch( _opts.workload ) {
+			case workload_t::video:
+			case workload_t::disconnect:
+				_video( out, area, count );
+				break;
+
+			case workload_t::scroll: {
+				int const line = 16;
+				rect_t const dst = { 0, 0, _w, _h - line };
+				std::memmove( _rgb.data(), _rgb.data() + 3 * size_t( _w ) * line, 3 * size_t( _w ) * (_h - line) );
+				_text_line( _h - line, line );
+				if( !_refresh && area.contains( screen ) ) {
+					out.rect( dst.x, dst.y, dst.w, dst.h, 1 ); // CopyRect.
+					out.u16( 0 );
+					out.u16( line );
+					++count;
+					_pixels( out, rect_t{ 0, _h - line, _w, line }.intersect( area ), count );
+				}
+				else {
+					_refresh = true;
+				}
+				break;
+			}
+
+			case workload_t::resize:
+				if( ++_t % int( std::max( _opts.fps, 1.0 ) ) == 0 ) {
+					bool const small = _w == _opts.w;
+					_w = small ? _opts.w * 3 / 4 & ~1 : _opts.w;
+					_h = small ? _opts.h * 3 / 4 & ~1 : _opts.h;
+					_rgb.assign( 3 * size_t( _w ) * _h, 0xff );
+					if( _extended ) {
+						out.rect( 0, 0, _w, _h, -308 ); // ExtendedDesktopSize: by the server.
+						out.u8( 1 );
+						out.u8( 0 ); out.u8( 0 ); out.u8( 0 );
+						out.u32( 0 );
+						out.u16( 0 ); out.u16( 0 ); out.u16( _w ); out.u16( _h );
+						out.u32( 0 );
+					}
+					else {
+						out.rect( 0, 0, _w, _h, -223 ); // DesktopSize.
+					}
+					++count;
+					area = _area.intersect( { 0, 0, _w, _h } );
+					_refresh = true;
+				}
+				_scatter( out, area, count );
+				break;
+
+			case workload_t::scatter:
+				_scatter( out, area, count );
+				break;
+		}
+
+		if( _refresh && !area.empty() ) {
+			_pixels( out, area, count );
+			_refresh = false;
+		}
+		if( count == 0 ) {
+			return;
+		}
+		out.data[2] = uint8_t( count >> 8 );
+		out.data[3] = uint8_t( count );
+		_send( out );
+	}
+
+	void _video( rfb_buffer_t& out, rect_t const& area, uint16_t& count ) {
+		int const t = _t++ % std::max( int( _opts.fps ), 1 );
+		if( _quality < 0 ) {
+			draw_video( _rgb, _w, _h, t );
+			_pixels( out, area, count );
+			_refresh = false;
+			return;
+		}
+		auto const frame = _cache.get( _w, _h, jpeg_quality[_quality], t );
+		for( auto const& tile: *frame ) {
+			if( tile.rect.intersect( area ).empty() ) {
+				continue;
+			}
+			out.rect( tile.rect.x, tile.rect.y, tile.rect.w, tile.rect.h, 7 );
+			tight_jpeg( out, tile.jpeg );
+			++count;
+		}
+		// the cached tiles have covered the area, but _rgb is not drawn.
+		_refresh = false;
+	}
+
+	// dark glyphs on a light page.
+	void _text_line( int const y0, int const line ) {
+		std::uniform_int_distribution<int> glyph( 0, 5 );
+		for( int y = y0; y < y0 + line; ++y ) {
+			std::fill( _rgb.begin() + 3 * size_t( _w ) * y, _rgb.begin() + 3 * size_t( _w ) * (y + 1), 0xf0 );
+		}
+		for( int x = 8; x + 8 < _w; x += 8 ) {
+			if( glyph( _random ) == 0 ) {
+				continue; // a space.
+			}
+			for( int y = y0 + 3; y < y0 + line - 3; ++y ) {
+				uint8_t* const p = &_rgb[3 * (size_t( _w ) * y + x)];
+				for( int i = 0; i < 6; ++i ) {
+					if( ((y * 7 + x + i * 3) & 3) != 0 ) {
+						p[3 * i + 0] = p[3 * i + 1] = p[3 * i + 2] = 0x20;
+					}
+				}
+			}
+		}
+	}
+
+	// 32 rects of 16 - 64 pixels: half of them a solid colour, half noise.
+	void _scatter( rfb_buffer_t& out, rect_t const& area, uint16_t& count ) {
+		std::uniform_int_distribution<int> size( 16, 64 );
+		std::uniform_int_distribution<int> byte( 0, 255 );
+		for( int i = 0; i < 32; ++i ) {
+			int const w = std::min( size( _random ), _w );
+			int const h = std::min( size( _random ), _h );
+			rect_t const r = rect_t{ std::uniform_int_distribution<int>( 0, _w - w )( _random ), std::uniform_int_distribution<int>( 0, _h - h )( _random ), w, h }.intersect( area );
+			if( r.empty() ) {
+				continue;
+			}
+			if( i % 2 == 0 ) {
+				uint8_t const rgb[3] = { uint8_t( byte( _random ) ), uint8_t( byte( _random ) ), uint8_t( byte( _random ) ) };
+				_fill( out, r, rgb, count );
+			}
+			else {
+				for( int y = r.y; y < r.y + r.h; ++y ) {
+					for( int x = r.x; x < r.x + r.w; ++x ) {
+						uint8_t* const p = &_rgb[3 * (size_t( _w ) * y + x)];
+						p[0] = uint8_t( byte( _random ) );
+						p[1] = uint8_t( x + y );
+						p[2] = uint8_t( 4 * y );
+					}
+				}
+				_pixels( out, r, count );
+			}
+		}
+	}
+
+	int                  _fd;
+	options_t const&     _opts;
+	video_cache_t&       _cache;
+	std::mt19937         _random;
+	int                  _w;
+	int                  _h;
+	std::vector<uint8_t> _rgb; // the desktop as the client has it, if not video.
+	int                  _t = 0; // frames.
+	// the client's pixel format.
+	int                  _bpp      = 32;
+	int                  _depth    = 24;
+	bool                 _big      = false;
+	int                  _max[3]   = { 255, 255, 255 };
+	int                  _shift[3] = { 0, 8, 16 };
+	// what the client has asked for.
+	int                  _quality    = -1; // lossless.
+	bool                 _extended   = false;
+	bool                 _sent_cu    = false;
+	bool                 _sent_fence = false;
+	bool                 _continuous = false;
+	bool                 _requested  = false;
+	bool                 _refresh    = true; // all of the area is sent with the next frame.
+	rect_t               _area;
+	z_stream             _zlib; // Tight stream 0.
+	// the emulated link.
+	bool                 _shaped = false;
+	std::vector<uint8_t> _link; // sent from _head on.
+	size_t               _head   = 0;
+	clock_type::time_point _drained_at;
+};
+
+int main( int const argc, char** const argv ) {
+	options_t opts;
+	bool ok = true;
+	for( int opt; (opt = getopt( argc, argv, "w:s:r:p:b:" )) != -1; ) {
+		switch( opt ) {
+			case 'w': {
+				std::string const w = optarg;
+				if     ( w == "video"      ) opts.workload = workload_t::video;
+				else if( w == "scroll"     ) opts.workload = workload_t::scroll;
+				else if( w == "scatter"    ) opts.workload = workload_t::scatter;
+				else if( w == "resize"     ) opts.workload = workload_t::resize;
+				else if( w == "disconnect" ) opts.workload = workload_t::disconnect;
+				else ok = false;
+				break;
+			}
+			case 's': ok = ok && std::sscanf( optarg, "%dx%d", &opts.w, &opts.h ) == 2; break;
+			case 'r': opts.fps  = std::atof( optarg ); break;
+			case 'p': opts.port = std::atoi( optarg ); break;
+			case 'b': opts.link = 1e6 * std::atof( optarg ); break;
+			default:  ok = false; break;
+		}
+	}
+	if( !ok || optind != argc || opts.w < 64 || opts.h < 64 || opts.w > 0x7fff || opts.h > 0x7fff || opts.fps <= 0.0 || opts.link < 0.0 ) {
+		std::fprintf( stderr, "usage: %s [-w workload] [-s WxH] [-r fps] [-p port] [-b MB/s]\n", argv[0] );
+		std::fprintf( stderr, "  -w  video (default), scroll, scatter, resize or disconnect.\n" );
+		std::fprintf( stderr, "  -s  the size of the desktop (default 1920x1080).\n" );
+		std::fprintf( stderr, "  -r  the frames per second (default 30).\n" );
+		std::fprintf( stderr, "  -p  the port on 127.0.0.1 (default 5900).\n" );
+		std::fprintf( stderr, "  -b  emulate a link of this bandwidth, which queues without a limit.\n" );
+		return 1;
+	}
+
+	int const server = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	int const one = 1;
+	setsockopt( server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	sockaddr_in addr = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons( opts.port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( bind( server, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) != 0 || listen( server, 64 ) != 0 ) {
+		std::perror( "load_server" );
+		return 1;
+	}
+
+	video_cache_t cache;
+	std::atomic<int> sessions = { 0 };
+	for( uint32_t seed = 1; true; ++seed ) {
+		int const fd = accept4( server, nullptr, nullptr, SOCK_CLOEXEC );
+		if( fd < 0 ) {
+			continue;
+		}
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+		std::thread( [&, fd, seed]() {
+			std::fprintf( stderr, "load_server: connection %u opened, %d open\n", seed, ++sessions );
+			try {
+				session_t( fd, opts, cache, seed ).run();
+			}
+			catch( closed_t const& ) {
+			}
+			close( fd );
+			std::fprintf( stderr, "load_server: connection %u closed, %d open\n", seed, --sessions );
+		} ).detach();
+	}
+}
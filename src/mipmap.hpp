@@ -0,0 +1,138 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <rfb/Rect.h>
+
+
+// sRGB <-> linear light in 16 bits.  the reduction is done in linear light
+// like glGenerateMipmap() on an sRGB texture.
+struct srgb_table_t {
+	srgb_table_t() {
+		for( int i = 0; i < 256; ++i ) {
+			double const v = i / 255.0;
+			double const l = v <= 0.04045 ? v / 12.92 : std::pow( (v + 0.055) / 1.055, 2.4 );
+			to_linear[i] = uint16_t( std::lround( 65535.0 * l ) );
+		}
+		for( int i = 0; i < 65536; ++i ) {
+			double const l = i / 65535.0;
+			double const v = l <= 0.0031308 ? 12.92 * l : 1.055 * std::pow( l, 1.0 / 2.4 ) - 0.055;
+			to_srgb[i] = uint8_t( std::lround( 255.0 * v ) );
+		}
+	}
+
+	static srgb_table_t const& get() {
+		static srgb_table_t const table;
+		return table;
+	}
+
+	std::array<uint16_t, 256>   to_linear;
+	std::array<uint8_t,  65536> to_srgb;
+};
+
+// the levels 1.. of the mipmap of an RGBX framebuffer, kept on the CPU so that
+// a damaged rect only recomputes the texels above it.  level i has the size
+// of the GL texture level: max( 1, w >> i ) x max( 1, h >> i ).  a texel is the
+// average of the 2x2 texels below it which exist.
+struct mip_pyramid_t {
+	struct level_t {
+		int                   w = 0;
+		int                   h = 0;
+		std::vector<uint32_t> pixels;
+	};
+
+	// the GL texture with the base level w x h has this many levels.
+	static int count_levels( int const w, int const h ) {
+		int n = 1;
+		while( std::max( w, h ) >> n > 0 ) {
+			++n;
+		}
+		return n;
+	}
+
+	// maps a rect of level 0 to the texels of level i which depend on it.
+	static rfb::Rect level_rect( rfb::Rect const& r, int const i ) {
+		int const m = (1 << i) - 1;
+		return { r.tl.x >> i, r.tl.y >> i, (r.br.x + m) >> i, (r.br.y + m) >> i };
+	}
+
+	void resize( int const w, int const h ) {
+		_w = w;
+		_h = h;
+		_levels.resize( std::max( count_levels( w, h ) - 1, 0 ) );
+		for( size_t i = 0; i < _levels.size(); ++i ) {
+			_levels[i].w = std::max( 1, w >> (i + 1) );
+			_levels[i].h = std::max( 1, h >> (i + 1) );
+			_levels[i].pixels.assign( _levels[i].w * _levels[i].h, 0 );
+		}
+	}
+
+	int w() const {
+		return _w;
+	}
+
+	int h() const {
+		return _h;
+	}
+
+	// levels()[i] is level i + 1.
+	std::vector<level_t> const& levels() const {
+		return _levels;
+	}
+
+	// base: the level 0 of the size given to resize(), row by row.
+	void update( uint32_t const* const base, std::vector<rfb::Rect> const& rects ) {
+		for( auto const& r: rects ) {
+			uint32_t const* src = base;
+			int src_w = _w, src_h = _h;
+			for( size_t i = 0; i < _levels.size(); ++i ) {
+				level_t& dst = _levels[i];
+				rfb::Rect const d = level_rect( r, i + 1 );
+				_reduce( src, src_w, src_h, dst, std::min( d.tl.x, dst.w ), std::min( d.tl.y, dst.h ), std::min( d.br.x, dst.w ), std::min( d.br.y, dst.h ) );
+				src   = dst.pixels.data();
+				src_w = dst.w;
+				src_h = dst.h;
+			}
+		}
+	}
+
+	// the reference: recomputes every texel.
+	void rebuild( uint32_t const* const base ) {
+		update( base, { rfb::Rect( 0, 0, _w, _h ) } );
+	}
+
+private:
+	// each level reads the one below and the table.  a texel is over 2 x 2
+	// texels, except on a level below which is 1 texel wide or high: the
+	// texels on that side are taken twice, which averages the same.  no
+	// scratch: the sums of a texel stay in registers.
+	static void _reduce( uint32_t const* const src, int const src_w, int const src_h, level_t& dst, int const x0, int const y0, int const x1, int const y1 ) {
+		auto const& table = srgb_table_t::get();
+		int const du = std::min( src_w, 2 ) - 1;
+		int const dv = std::min( src_h, 2 ) - 1;
+		for( int y = y0; y < y1; ++y ) {
+			uint32_t const* const r0 = src + src_w * (2 * y);
+			uint32_t const* const r1 = r0 + src_w * dv;
+			// opaque like the level 0.
+			uint32_t* const out = dst.pixels.data() + dst.w * y;
+			for( int x = x0; x < x1; ++x ) {
+				uint32_t const p[4] = { r0[2 * x], r0[2 * x + du], r1[2 * x], r1[2 * x + du] };
+				uint32_t sr = 2, sg = 2, sb = 2;
+				for( uint32_t const q: p ) {
+					sr += table.to_linear[(q >>  0) & 0xff];
+					sg += table.to_linear[(q >>  8) & 0xff];
+					sb += table.to_linear[(q >> 16) & 0xff];
+				}
+				out[x] = table.to_srgb[sr >> 2] | (table.to_srgb[sg >> 2] << 8) | (table.to_srgb[sb >> 2] << 16) | 0xff000000u;
+			}
+		}
+	}
+
+	int                  _w = 0;
+	int                  _h = 0;
+	std::vector<level_t> _levels;
+};
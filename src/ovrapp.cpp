@@ -1,6 +1,8 @@
 // (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <unistd.h>
@@ -20,6 +22,49 @@
 struct application_t: OVR::VrAppInterface {
 	application_t( std::string const& ext_path ) {
 		_config = config_load( ext_path + "/ovrvnc.toml" );
+		if( _config.trace ) {
+			latency_trace_t::get().enable( _config.trace_path );
+		}
+		// decoded while the solid color shows.
+		if( !_config.bg_image.empty() ) {
+			_background.load( _config.bg_image, _config.bg_cache ? ext_path + "/ovrvnc-cache" : "", _config.bg_mipmap );
+		}
+
+		// the connections need no GL context: start them before entering VR mode.
+		for( auto const& screen: _config.screens ) {
+			auto vnc = std::make_unique<vnc_layer_t>();
+			vnc->resolution = _config.resolution / screen.pixel_scaling;
+			auto const place = []( float const latitude, float const longitude ) {
+				return
+					OVR::Matrix4f::RotationY( float( M_PI / 180.0 ) * longitude ) *
+					OVR::Matrix4f::RotationX( float( M_PI / 180.0 ) * latitude  ) *
+					OVR::Matrix4f::Scaling( 10.0f );
+			};
+			vnc->transform = place( screen.latitude, screen.longitude );
+			for( auto const& monitor: screen.monitors ) {
+				vnc->monitor_transforms.push_back( place( monitor.latitude, monitor.longitude ) );
+			}
+			vnc->use_pointer = screen.use_pointer;
+			// decode at the largest power-of-two reduction not below the display
+			// resolution; mipmaps take the rest.
+			int const scale = screen.scaled_decode ? std::min( std::max( int( std::floor( -std::log2( screen.pixel_scaling ) ) ), 0 ), 3 ) : 0;
+			vnc->decode_scale = scale;
+			vnc->use_mipmap   = std::ldexp( screen.pixel_scaling, scale ) < 1.0f;
+			vnc->use_h264     = screen.h264;
+			vnc->use_rgb565   = screen.pixel_format == "rgb565";
+			vnc->cull_updates           = screen.cull_updates;
+			vnc->congestion_control     = screen.congestion_control;
+			vnc->quality.adaptive       = screen.adaptive_quality;
+			vnc->quality.lossy          = screen.lossy;
+			vnc->quality.quality_min    = std::min( std::max( screen.quality_min, 0 ), 9 );
+			vnc->quality.quality_max    = std::min( std::max( screen.quality_max, vnc->quality.quality_min ), 9 );
+			vnc->quality.compress_min   = std::min( std::max( screen.compress_min, 0 ), 9 );
+			vnc->quality.compress_max   = std::min( std::max( screen.compress_max, vnc->quality.compress_min ), 9 );
+			vnc->quality.lossless       = screen.lossless_refresh;
+			vnc->quality.target_latency = 1e-3f * screen.target_latency;
+			vnc->run( _vnc_engine, screen.host, screen.port, screen.password, screen.record );
+			_vnc_layers.push_back( std::move( vnc ) );
+		}
 	}
 
 	virtual void Configure( OVR::ovrSettings& settings ) override {
@@ -34,26 +79,6 @@ struct application_t: OVR::VrAppInterface {
 		if( intent_type == OVR::INTENT_LAUNCH ) {
 			vrapi_SetPropertyInt( app->GetJava(), VRAPI_REORIENT_HMD_ON_CONTROLLER_RECENTER, 1 );
 			vrapi_SetDisplayRefreshRate( app->GetOvrMobile(), 72.0f );
-
-			for( auto const& screen: _config.screens ) {
-				auto vnc = std::make_unique<vnc_layer_t>();
-				vnc->resolution = _config.resolution / screen.pixel_scaling;
-				vnc->transform =
-					OVR::Matrix4f::RotationY( float( M_PI / 180.0 ) * screen.longitude ) *
-					OVR::Matrix4f::RotationX( float( M_PI / 180.0 ) * screen.latitude  ) *
-					OVR::Matrix4f::Scaling( 10.0f );
-				vnc->use_pointer = screen.use_pointer;
-				vnc->use_mipmap  = screen.pixel_scaling < 1.0;
-				vnc->run( screen.host, screen.port, screen.password, screen.lossy );
-				_vnc_layers.push_back( std::move( vnc ) );
-			}
-			if( !_config.bg_image.empty() ) {
-				try {
-					_background = equirect_layer_t::load( _config.bg_image );
-				}
-				catch( std::exception const & ) {
-				}
-			}
 		}
 	}
 
@@ -76,6 +101,7 @@ struct application_t: OVR::VrAppInterface {
 			}
 		}
 
+		_background.update();
 		if( _background ) {
 			res.Layers[res.LayerCount++].Equirect = _background.layer( frame.Tracking );
 		}
@@ -93,13 +119,32 @@ struct application_t: OVR::VrAppInterface {
 			}
 		}
 
+		// the tiles of all screens share the budget of a frame, nearest to the
+		// pointer or the center of the view first.
+		std::vector<upload_queue_t*> queues;
+		for( auto const& vnc: _vnc_layers ) {
+			vnc->update( frame.Tracking );
+			queues.push_back( &vnc->queue() );
+		}
+		int64_t const deadline = trace_now() + int64_t( 1e6 * _config.upload_time );
+		drain_uploads( queues,
+			_config.upload_size > 0.0f ? size_t( 1e6 * _config.upload_size ) : SIZE_MAX,
+			[&]() { return _config.upload_time > 0.0f && trace_now() > deadline; },
+			[&]( size_t const i, upload_queue_t::tile_t const& t ) { _vnc_layers[i]->upload( t ); }
+		);
+
 		for( auto const& vnc: _vnc_layers ) {
-			vnc->update();
-			if( auto layer = vnc->layer( frame.Tracking ) ) {
+			vnc->finish( frame.PredictedDisplayTimeInSeconds );
+			for( auto const& layer: vnc->layers( frame.Tracking ) ) {
+				res.Layers[res.LayerCount++].Cylinder = layer;
+			}
+			if( auto layer = vnc->cursor_layer( frame.Tracking ) ) {
 				res.Layers[res.LayerCount++].Cylinder = *layer;
 			}
 		}
 
+		latency_trace_t::get().poll( trace_now() );
+
 		return res;
 	}
 
@@ -163,6 +208,7 @@ private:
 
 	config_t                                  _config;
 	OVR::OvrSceneView                         _scene;
+	vnc_engine_t                              _vnc_engine; // outlives the layers, which share the screens with it.
 	std::vector<std::unique_ptr<vnc_layer_t>> _vnc_layers;
 	equirect_layer_t                          _background;
 };
@@ -0,0 +1,189 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <sys/ioctl.h>
+
+
+struct pointer_event_t {
+	uint16_t x       = 0;
+	uint16_t y       = 0;
+	uint8_t  buttons = 0;
+
+	bool operator==( pointer_event_t const& e ) const {
+		return x == e.x && y == e.y && buttons == e.buttons;
+	}
+
+	bool operator!=( pointer_event_t const& e ) const {
+		return !(*this == e);
+	}
+};
+
+// pointer events from the render thread to the sender of a connection.
+// motion collapses to the latest position, which the sender reads when it is
+// able to write; button transitions (with the motion between them) go
+// through a ring in order and are never dropped.  push() is lock-free apart
+// from notify, which wakes the sender.
+struct pointer_queue_t {
+	pointer_queue_t( std::function<void()> notify ):
+		_notify( std::move( notify ) )
+	{
+	}
+
+	pointer_queue_t( pointer_queue_t&& )                 = delete;
+	pointer_queue_t( pointer_queue_t const& )            = delete;
+	pointer_queue_t& operator=( pointer_queue_t&& )      = delete;
+	pointer_queue_t& operator=( pointer_queue_t const& ) = delete;
+
+	// render thread.
+	void push( pointer_event_t const& e ) {
+		bool const flushed = _flush();
+		if( e == _last ) {
+			if( flushed ) {
+				_publish();
+			}
+			return;
+		}
+		bool const edge = e.buttons != _last.buttons;
+		_last = e;
+		_seq  = (_seq + 1) & _seq_mask;
+
+		if( _stash.empty() && (!edge || _push( { e, _seq } )) ) {
+			_publish();
+			return;
+		}
+		// the ring has filled up: keep the order here until the sender catches up.
+		if( !edge && !_stash.empty() && _stash_motion ) {
+			_stash.back() = { e, _seq };
+		}
+		else {
+			_stash.push_back( { e, _seq } );
+		}
+		_stash_motion = !edge;
+	}
+
+	// sender.  the next event to write, if any.
+	bool pop( pointer_event_t& e ) {
+		// read the latest first: the ring entries pushed before it are visible.
+		uint64_t const latest = _latest.load( std::memory_order_acquire );
+		size_t tail = _tail.load( std::memory_order_relaxed );
+		while( tail != _head.load( std::memory_order_acquire ) ) {
+			entry_t const entry = _ring[tail % _ring.size()];
+			_tail.store( ++tail, std::memory_order_release );
+			_sent_seq = entry.seq;
+			// the collapsed motion may come back to where it was.
+			if( entry.event != _sent ) {
+				e     = entry.event;
+				_sent = entry.event;
+				return true;
+			}
+		}
+		if( latest == _none ) {
+			return false;
+		}
+		// the latest may be older than what came through the ring.
+		uint32_t const seq  = uint32_t( latest >> 40 );
+		uint32_t const diff = (seq - _sent_seq) & _seq_mask;
+		if( diff == 0 || diff > _seq_mask / 2 ) {
+			return false;
+		}
+		_sent_seq = seq;
+		e = _unpack( latest );
+		if( e == _sent ) {
+			return false;
+		}
+		_sent = e;
+		return true;
+	}
+
+private:
+	// every pushed event is numbered (mod 2^24) to order the latest against the ring.
+	struct entry_t {
+		pointer_event_t event;
+		uint32_t        seq;
+	};
+
+	static constexpr uint64_t _none     = ~uint64_t( 0 );
+	static constexpr uint32_t _seq_mask = (1u << 24) - 1;
+
+	static uint64_t _pack( pointer_event_t const& e, uint32_t const seq ) {
+		return uint64_t( e.x ) | (uint64_t( e.y ) << 16) | (uint64_t( e.buttons ) << 32) | (uint64_t( seq ) << 40);
+	}
+
+	static pointer_event_t _unpack( uint64_t const v ) {
+		pointer_event_t e;
+		e.x       = uint16_t( v );
+		e.y       = uint16_t( v >> 16 );
+		e.buttons = uint8_t( v >> 32 );
+		return e;
+	}
+
+	bool _push( entry_t const& e ) {
+		size_t const head = _head.load( std::memory_order_relaxed );
+		if( head - _tail.load( std::memory_order_acquire ) >= _ring.size() ) {
+			return false;
+		}
+		_ring[head % _ring.size()] = e;
+		_head.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	// moves the stash into the ring as far as it fits.  true if it has become empty.
+	bool _flush() {
+		if( _stash.empty() ) {
+			return false;
+		}
+		size_t n = 0;
+		while( n < _stash.size() && _push( _stash[n] ) ) {
+			++n;
+		}
+		_stash.erase( _stash.begin(), _stash.begin() + n );
+		if( n > 0 ) {
+			_notify();
+		}
+		return _stash.empty();
+	}
+
+	// while the stash holds events, the latest position must not overtake them.
+	void _publish() {
+		_latest.store( _pack( _last, _seq ), std::memory_order_release );
+		_notify();
+	}
+
+	std::function<void()> _notify;
+	// render thread.
+	pointer_event_t       _last;
+	uint32_t              _seq = 0;
+	std::vector<entry_t>  _stash;
+	bool                  _stash_motion = false;
+	// shared.
+	std::array<entry_t, 64> _ring;
+	std::atomic<size_t>     _head   = { 0 };
+	std::atomic<size_t>     _tail   = { 0 };
+	std::atomic<uint64_t>   _latest = { _none };
+	// sender.
+	pointer_event_t _sent;
+	uint32_t        _sent_seq = 0;
+};
+
+// sender.  pops and writes the events while fewer than backlog bytes wait in
+// the send buffer of fd.  false: it is backed up; the motion collapses in the
+// queue until the next call.
+template<class F>
+bool send_pointer_events( pointer_queue_t& queue, int const fd, F const& write, int const backlog = 2048 ) {
+	while( true ) {
+		int remaining = 0;
+		if( ioctl( fd, TIOCOUTQ, &remaining ) < 0 || remaining >= backlog ) {
+			return false;
+		}
+		pointer_event_t e;
+		if( !queue.pop( e ) ) {
+			return true;
+		}
+		write( e );
+	}
+}
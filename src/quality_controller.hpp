@@ -0,0 +1,133 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+
+// the range the controller moves in.  when it is disabled, the screen is
+// encoded with quality_max and compress_min as it is.
+struct quality_bounds_t {
+	bool  adaptive       = false;
+	bool  lossy          = true;  // false: the quality stays lossless, only the compression moves.
+	int   quality_min    = 2;     // JPEG quality level, 0 - 9.
+	int   quality_max    = 8;
+	int   compress_min   = 1;     // zlib compression level, 0 - 9.
+	int   compress_max   = 6;
+	bool  lossless       = false; // switch to lossless (quality -1) while the link idles at quality_max.
+	float target_latency = 0.05f; // [s] from the first byte of an update to the end of its decoding.
+};
+
+// one framebuffer update as the connection has seen it.
+struct quality_sample_t {
+	double time    = 0.0;   // [s] the end of the update.
+	double wire    = 0.0;   // [s] its first byte .. its last byte received.
+	double decode  = 0.0;   // [s] its last byte received .. decoded.
+	size_t bytes   = 0;
+	size_t backlog = 0;     // [bytes] received, not yet parsed.
+	bool   behind  = false; // the render thread had not taken or uploaded the previous update.
+};
+
+// picks the JPEG quality and the compression level of Tight from the time
+// each update takes against the target.  it backs off quickly (two levels
+// when far over the target) and probes upwards slowly, so a congested link
+// does not oscillate.  raising the compression helps when the link is the
+// bottleneck, lowering it when the decoding is.
+struct quality_controller_t {
+	quality_controller_t( quality_bounds_t const& bounds ):
+		_bounds( bounds ),
+		_quality( bounds.lossy ? bounds.quality_max : -1 ),
+		_compress( bounds.compress_min )
+	{
+	}
+
+	// -1: lossless.
+	int quality() const {
+		return _quality;
+	}
+
+	int compress() const {
+		return _compress;
+	}
+
+	// [bytes / s], 0 while unknown.
+	double bandwidth() const {
+		return _bandwidth;
+	}
+
+	// true if quality() or compress() has changed.
+	bool update( quality_sample_t const& s ) {
+		if( !_bounds.adaptive ) {
+			return false;
+		}
+		if( s.wire > 1e-3 ) {
+			double const bw = double( s.bytes ) / s.wire;
+			_bandwidth = _bandwidth == 0.0 ? bw : 0.8 * _bandwidth + 0.2 * bw;
+		}
+		double const queued  = _bandwidth > 0.0 ? double( s.backlog ) / _bandwidth : 0.0;
+		double const latency = s.wire + s.decode + queued;
+		double const target  = _bounds.target_latency;
+		int const quality  = _quality;
+		int const compress = _compress;
+
+		if( latency > target || s.behind ) {
+			_good_since = -1.0;
+			// a single slow update (a full screen of new content) is not congestion.
+			if( ++_bad < 2 || s.time - _changed_at < 0.25 ) {
+				return false;
+			}
+			_bad = 0;
+			if( _quality < 0 && _bounds.lossy ) {
+				_quality = _bounds.quality_max;
+			}
+			else if( _quality >= 0 ) {
+				_quality = std::max( _quality - (latency > 2.0 * target ? 2 : 1), _bounds.quality_min );
+			}
+			if( s.wire + queued >= s.decode ) {
+				_compress = std::min( _compress + 1, _bounds.compress_max );
+			}
+			else {
+				_compress = std::max( _compress - 1, _bounds.compress_min );
+			}
+			_down_at = s.time;
+		}
+		else {
+			_bad = 0;
+			if( latency > 0.5 * target ) {
+				_good_since = -1.0;
+				return false;
+			}
+			if( _good_since < 0.0 ) {
+				_good_since = s.time;
+			}
+			// probe upwards after 2 s without congestion, 4 s after backing off.
+			if( s.time - _good_since < 2.0 || s.time - _down_at < 4.0 || s.time - _changed_at < 2.0 ) {
+				return false;
+			}
+			if( _quality >= 0 && _quality < _bounds.quality_max ) {
+				++_quality;
+			}
+			else if( _quality >= 0 && _bounds.lossless ) {
+				_quality = -1;
+			}
+			// the link has room: spare the CPU of the server.
+			_compress = std::max( _compress - 1, _bounds.compress_min );
+		}
+
+		if( _quality == quality && _compress == compress ) {
+			return false;
+		}
+		_changed_at = s.time;
+		return true;
+	}
+
+private:
+	quality_bounds_t _bounds;
+	int              _quality;
+	int              _compress;
+	double           _bandwidth  = 0.0;
+	int              _bad        = 0;
+	double           _good_since = -1.0;
+	double           _changed_at = -1e9;
+	double           _down_at    = -1e9;
+};
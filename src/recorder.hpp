@@ -0,0 +1,167 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <rdr/Exception.h>
+#include <rdr/InStream.h>
+#include <rdr/OutStream.h>
+
+// recording file format (native endian):
+//     "ovrvnc-rfb-1\n"
+//     repeat { uint64_t usec since start; uint32_t size; uint8_t data[size]; }
+// data is the raw server-to-client byte stream as it was read from the socket.
+constexpr char recording_magic[] = "ovrvnc-rfb-1\n";
+
+
+// appends chunks of the server-to-client stream to a recording.
+struct recording_file_t {
+	recording_file_t( std::string const& path ):
+		_file( std::fopen( path.c_str(), "wb" ) ),
+		_start( std::chrono::steady_clock::now() )
+	{
+		if( _file != nullptr ) {
+			std::fwrite( recording_magic, 1, sizeof( recording_magic ) - 1, _file );
+		}
+	}
+
+	recording_file_t( recording_file_t&& )                 = delete;
+	recording_file_t( recording_file_t const& )            = delete;
+	recording_file_t& operator=( recording_file_t&& )      = delete;
+	recording_file_t& operator=( recording_file_t const& ) = delete;
+
+	~recording_file_t() {
+		if( _file != nullptr ) {
+			std::fclose( _file );
+		}
+	}
+
+	bool is_recording() const {
+		return _file != nullptr;
+	}
+
+	void write( uint8_t const* const data, uint32_t const size ) {
+		if( _file == nullptr ) {
+			return;
+		}
+		auto const dt = std::chrono::steady_clock::now() - _start;
+		uint64_t const usec = std::chrono::duration_cast<std::chrono::microseconds>( dt ).count();
+		std::fwrite( &usec, sizeof( usec ), 1, _file );
+		std::fwrite( &size, sizeof( size ), 1, _file );
+		std::fwrite( data, 1, size, _file );
+	}
+
+private:
+	FILE*                                 _file;
+	std::chrono::steady_clock::time_point _start;
+};
+
+// feeds a recording back, either as fast as possible or paced by its timestamps.
+struct replay_in_stream_t: rdr::InStream {
+	replay_in_stream_t( std::string const& path, bool const paced ):
+		_paced( paced )
+	{
+		FILE* const file = std::fopen( path.c_str(), "rb" );
+		if( file == nullptr ) {
+			throw rdr::Exception( "cannot open %s", path.c_str() );
+		}
+
+		char magic[sizeof( recording_magic ) - 1];
+		if( std::fread( magic, sizeof( magic ), 1, file ) != 1 || std::memcmp( magic, recording_magic, sizeof( magic ) ) != 0 ) {
+			std::fclose( file );
+			throw rdr::Exception( "%s is not a recording", path.c_str() );
+		}
+		uint64_t usec;
+		uint32_t size;
+		while( std::fread( &usec, sizeof( usec ), 1, file ) == 1 && std::fread( &size, sizeof( size ), 1, file ) == 1 ) {
+			size_t const offset = _data.size();
+			_data.resize( offset + size );
+			if( std::fread( _data.data() + offset, 1, size, file ) != size ) {
+				_data.resize( offset );
+				break;
+			}
+			_chunks.push_back( { usec, offset + size } );
+		}
+		std::fclose( file );
+
+		ptr = _data.data();
+		end = _paced ? _data.data() : _data.data() + _data.size();
+		_start = std::chrono::steady_clock::now();
+	}
+
+	virtual int pos() override {
+		return int( ptr - _data.data() );
+	}
+
+	// recording time of the last byte consumed so far.
+	uint64_t time_usec() const {
+		size_t const p = ptr - _data.data();
+		auto const it = std::lower_bound( _chunks.begin(), _chunks.end(), p, []( chunk_t const& c, size_t const x ) {
+			return c.end < x;
+		} );
+		return it != _chunks.end() ? it->usec : 0;
+	}
+
+	uint64_t duration_usec() const {
+		return _chunks.empty() ? 0 : _chunks.back().usec;
+	}
+
+	size_t size() const {
+		return _data.size();
+	}
+
+private:
+	struct chunk_t {
+		uint64_t usec;
+		size_t   end;
+	};
+
+	virtual int overrun( int const item_size, int const n_items, bool const wait ) override {
+		while( end < ptr + item_size ) {
+			if( !_paced || _next >= _chunks.size() ) {
+				throw rdr::EndOfStream();
+			}
+
+			auto const t = _start + std::chrono::microseconds( _chunks[_next].usec );
+			if( !wait && std::chrono::steady_clock::now() < t ) {
+				return 0;
+			}
+			std::this_thread::sleep_until( t );
+			end = _data.data() + _chunks[_next].end;
+			++_next;
+		}
+
+		return std::min<int>( n_items, (end - ptr) / item_size );
+	}
+
+	bool                                  _paced;
+	std::vector<uint8_t>                  _data;
+	std::vector<chunk_t>                  _chunks;
+	size_t                                _next = 0;
+	std::chrono::steady_clock::time_point _start;
+};
+
+// the replayed server does not listen to us.
+struct null_out_stream_t: rdr::OutStream {
+	null_out_stream_t() {
+		ptr = _buf;
+		end = _buf + sizeof( _buf );
+	}
+
+	virtual int length() override {
+		return 0;
+	}
+
+private:
+	virtual int overrun( int const item_size, int const n_items ) override {
+		ptr = _buf;
+		return std::min<int>( n_items, (end - ptr) / item_size );
+	}
+
+	uint8_t _buf[1 << 12];
+};
@@ -0,0 +1,314 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// replays a session recorded with `record = "..."` through the same decoding
+// path as the app, without VrApi or GL, and reports decoding throughput.
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include <os/Thread.h>
+#include <rdr/MemOutStream.h>
+#include <rfb/Decoder.h>
+#include <rfb/encodings.h>
+#include "vnc_thread.hpp"
+#include "recorder.hpp"
+
+
+using clock_type = std::chrono::steady_clock;
+
+inline double seconds( clock_type::duration const d ) {
+	return std::chrono::duration<double>( d ).count();
+}
+
+struct replay_connection_t: client_connection_t {
+	struct encoding_stats_t {
+		uint64_t             rects  = 0;
+		uint64_t             pixels = 0;
+		uint64_t             bytes  = 0;
+		clock_type::duration time   = {};
+	};
+
+	struct update_stats_t {
+		double   update_time;
+		double   lag;
+		uint64_t damaged;
+		uint64_t uploaded;
+		uint64_t copied;
+	};
+
+	replay_connection_t( region_mailbox_t* const mailbox, replay_in_stream_t* const is, rdr::OutStream* const os, std::string pass, connection_options_t const& options, bool const serial ):
+		client_connection_t( mailbox, is, os, std::move( pass ), options ),
+		_mailbox( mailbox ),
+		_replay( is ),
+		_serial( serial )
+	{
+	}
+
+	virtual void framebufferUpdateStart() override {
+		client_connection_t::framebufferUpdateStart();
+		_update_start   = clock_type::now();
+		_update_damaged = 0;
+	}
+
+	virtual void framebufferUpdateEnd() override {
+		client_connection_t::framebufferUpdateEnd();
+
+		update_stats_t stats;
+		stats.update_time = seconds( clock_type::now() - _update_start );
+		stats.lag         = seconds( clock_type::now() - _start ) - 1e-6 * double( _replay->time_usec() );
+		stats.damaged     = _update_damaged;
+		stats.uploaded    = 0;
+		stats.copied      = 0;
+		if( auto region = _mailbox->take() ) {
+			stats.uploaded = region->pixels.size();
+			for( auto const& c: region->copies ) {
+				stats.copied += c.rect.area();
+			}
+			_apply( *region );
+			_mailbox->recycle( std::move( region ) );
+		}
+		updates.push_back( stats );
+	}
+
+	virtual void dataRect( rfb::Rect const& r, int const encoding ) override {
+		int const pos = getInStream()->pos();
+		auto const t0 = clock_type::now();
+		if( _serial ) {
+			// decode on this thread so that the time can be charged to the encoding.
+			if( !rfb::Decoder::supported( encoding ) ) {
+				throw rdr::Exception( "unsupported encoding %d", encoding );
+			}
+			if( _decoders[encoding] == nullptr ) {
+				_decoders[encoding] = std::unique_ptr<rfb::Decoder>( rfb::Decoder::createDecoder( encoding ) );
+			}
+			_buf.clear();
+			_decoders[encoding]->readRect( r, getInStream(), cp, &_buf );
+			_decoders[encoding]->decodeRect( r, _buf.data(), _buf.length(), cp, getFramebuffer() );
+		}
+		else {
+			client_connection_t::dataRect( r, encoding );
+		}
+
+		encoding_stats_t& stats = encodings[encoding];
+		stats.rects  += 1;
+		stats.pixels += r.area();
+		stats.bytes  += getInStream()->pos() - pos;
+		stats.time   += clock_type::now() - t0;
+		_update_damaged += r.area();
+	}
+
+	encoding_stats_t            encodings[rfb::encodingMax + 1];
+	std::vector<update_stats_t> updates;
+	std::vector<uint32_t>       texture; // level 0, as the render thread would have it.
+
+private:
+	void _apply( region_t const& region ) {
+		if( texture.size() != size_t( region.w * region.h ) ) {
+			texture.assign( region.w * region.h, 0 );
+		}
+		for( auto const& c: region.copies ) {
+			rfb::Rect const src = c.source();
+			std::vector<uint32_t> tmp;
+			for( int y = src.tl.y; y < src.br.y; ++y ) {
+				tmp.insert( tmp.end(), &texture[region.w * y + src.tl.x], &texture[region.w * y + src.br.x] );
+			}
+			for( int y = c.rect.tl.y; y < c.rect.br.y; ++y ) {
+				std::copy_n( &tmp[c.rect.width() * (y - c.rect.tl.y)], c.rect.width(), &texture[region.w * y + c.rect.tl.x] );
+			}
+		}
+		uint32_t const* buf = region.pixels.data();
+		for( auto const& r: region.rects ) {
+			for( int y = r.tl.y; y < r.br.y; ++y ) {
+				std::copy_n( buf, r.width(), &texture[region.w * y + r.tl.x] );
+				buf += r.width();
+			}
+		}
+	}
+
+	region_mailbox_t*             _mailbox;
+	replay_in_stream_t*           _replay;
+	bool                          _serial;
+	std::unique_ptr<rfb::Decoder> _decoders[rfb::encodingMax + 1];
+	rdr::MemOutStream             _buf;
+	clock_type::time_point        _start = clock_type::now();
+	clock_type::time_point        _update_start;
+	uint64_t                      _update_damaged = 0;
+};
+
+template<class T, class F>
+double percentile( std::vector<T> const& xs, F const& f, double const p ) {
+	if( xs.empty() ) {
+		return 0.0;
+	}
+	std::vector<double> ys;
+	for( auto const& x: xs ) {
+		ys.push_back( f( x ) );
+	}
+	size_t const i = std::min( size_t( p * double( ys.size() ) ), ys.size() - 1 );
+	std::nth_element( ys.begin(), ys.begin() + i, ys.end() );
+	return ys[i];
+}
+
+void report( replay_connection_t const& conn, replay_in_stream_t const& is, bool const paced, bool const serial, double const wall ) {
+	// as DecodeManager sizes its pool.  one core: it decodes on the connection thread, as -s does.
+	size_t const threads = std::min( std::max( os::Thread::getSystemCPUCount(), size_t( 1 ) ), size_t( 4 ) );
+	// otherwise dataRect() only reads the rects and queues them for the
+	// decoder threads: the time is not the encoding's, and neither are rates.
+	bool const timed = serial || threads == 1;
+	if( timed ) {
+		std::printf( "%-10s %10s %10s %10s %10s %10s %10s %10s\n", "encoding", "rects", "Mpixels", "MB", "time [s]", "MB/s", "Mpixels/s", "rects/s" );
+	}
+	else {
+		std::printf( "%-10s %10s %10s %10s %10s\n", "encoding", "rects", "Mpixels", "MB", "read [s]" );
+	}
+	for( int i = 0; i <= rfb::encodingMax; ++i ) {
+		auto const& e = conn.encodings[i];
+		if( e.rects == 0 ) {
+			continue;
+		}
+		double const t = seconds( e.time );
+		std::printf( "%-10s %10llu %10.2f %10.2f %10.3f",
+			i == rfb::encodingH264 ? "H.264" : rfb::encodingName( i ), (unsigned long long)e.rects, 1e-6 * double( e.pixels ), 1e-6 * double( e.bytes ), t
+		);
+		if( timed ) {
+			std::printf( " %10.2f %10.2f %10.0f", 1e-6 * double( e.bytes ) / t, 1e-6 * double( e.pixels ) / t, double( e.rects ) / t );
+		}
+		std::printf( "\n" );
+	}
+
+	auto const& us = conn.updates;
+	uint64_t damaged = 0, uploaded = 0, copied = 0;
+	for( auto const& u: us ) {
+		damaged  += u.damaged;
+		uploaded += u.uploaded;
+		copied   += u.copied;
+	}
+	double const n = std::max( double( us.size() ), 1.0 );
+	std::printf( "\n" );
+	std::printf( "recording:        %.2f MB, %.2f s\n", 1e-6 * double( is.size() ), 1e-6 * double( is.duration_usec() ) );
+	if( timed ) {
+		std::printf( "decoding:         on the connection thread\n" );
+	}
+	else {
+		std::printf( "decoding:         on %zu threads (-s for the time per encoding)\n", threads );
+	}
+	std::printf( "replay:           %.2f s, %.2f MB/s\n", wall, 1e-6 * double( is.size() ) / wall );
+	std::printf( "updates:          %zu, %.1f updates/s\n", us.size(), double( us.size() ) / wall );
+	std::printf( "update time:      p50 %.2f ms, p95 %.2f ms, max %.2f ms\n",
+		1e3 * percentile( us, []( auto const& u ) { return u.update_time; }, 0.50 ),
+		1e3 * percentile( us, []( auto const& u ) { return u.update_time; }, 0.95 ),
+		1e3 * percentile( us, []( auto const& u ) { return u.update_time; }, 1.00 )
+	);
+	if( paced ) {
+		std::printf( "lag:              p50 %.2f ms, p95 %.2f ms, max %.2f ms\n",
+			1e3 * percentile( us, []( auto const& u ) { return u.lag; }, 0.50 ),
+			1e3 * percentile( us, []( auto const& u ) { return u.lag; }, 0.95 ),
+			1e3 * percentile( us, []( auto const& u ) { return u.lag; }, 1.00 )
+		);
+	}
+	std::printf( "damage / update:  %.0f pixels decoded, %.0f pixels uploaded, %.0f pixels copied\n", double( damaged ) / n, double( uploaded ) / n, double( copied ) / n );
+	std::printf( "unchanged tiles:  %.2f MB skipped, %.2f MB uploaded\n", 1e-6 * double( conn.skipped() ), 1e-6 * double( conn.uploaded() ) );
+}
+
+// the incrementally built mipmap must equal the one rebuilt from the final framebuffer.
+bool check_mipmap( replay_connection_t& conn ) {
+	auto const fb = static_cast<pixel_buffer_t const*>( conn.getFramebuffer() );
+	if( fb == nullptr ) {
+		return true;
+	}
+	mip_pyramid_t ref;
+	ref.resize( fb->size_w(), fb->size_h() );
+	ref.rebuild( fb->buffer.data() );
+
+	auto const& xs = conn.pyramid().levels();
+	auto const& ys = ref.levels();
+	bool ok = xs.size() == ys.size();
+	for( size_t i = 0; ok && i < xs.size(); ++i ) {
+		if( xs[i].pixels != ys[i].pixels ) {
+			std::printf( "mipmap:           level %zu differs from the full rebuild\n", i + 1 );
+			ok = false;
+		}
+	}
+	if( ok ) {
+		std::printf( "mipmap:           %zu levels equal to the full rebuild\n", xs.size() );
+	}
+	return ok;
+}
+
+// the texture, which the updates have been applied to with their copies,
+// must equal the final framebuffer.
+bool check_texture( replay_connection_t& conn ) {
+	auto const fb = static_cast<pixel_buffer_t const*>( conn.getFramebuffer() );
+	if( fb == nullptr || conn.updates.empty() ) {
+		return true;
+	}
+	bool ok = conn.texture.size() == fb->buffer.size();
+	for( size_t i = 0; ok && i < fb->buffer.size(); ++i ) {
+		ok = conn.texture[i] == (fb->buffer[i] | 0xff000000u);
+	}
+	std::printf( "texture:          %s\n", ok ? "equal to the framebuffer" : "differs from the framebuffer" );
+	return ok;
+}
+
+int main( int const argc, char** const argv ) {
+	bool                 paced  = false;
+	bool                 serial = false;
+	connection_options_t options;
+	std::string          pass;
+	for( int opt; (opt = getopt( argc, argv, "rsm5d:p:" )) != -1; ) {
+		switch( opt ) {
+			case 'r': paced          = true;                break;
+			case 's': serial         = true;                break;
+			case 'm': options.mipmap = true;                break;
+			case '5': options.rgb565 = true;                break;
+			case 'd': options.scale  = std::atoi( optarg ); break;
+			case 'p': pass           = optarg;              break;
+			default:
+				std::fprintf( stderr, "usage: %s [-r] [-s] [-m] [-5] [-d scale] [-p password] recording.rfb\n", argv[0] );
+				std::fprintf( stderr, "  -r  pace the replay by the recorded timestamps.\n" );
+				std::fprintf( stderr, "  -s  decode serially to measure the time per encoding.\n" );
+				std::fprintf( stderr, "  -m  build the mipmap incrementally and check it against a full rebuild.\n" );
+				std::fprintf( stderr, "  -5  the session was recorded with pixel_format = \"rgb565\".\n" );
+				std::fprintf( stderr, "  -d  decode the desktop reduced by 2^scale, as scaled_decode does.\n" );
+				return 1;
+		}
+	}
+	if( optind + 1 != argc ) {
+		std::fprintf( stderr, "usage: %s [-r] [-s] [-m] [-5] [-d scale] [-p password] recording.rfb\n", argv[0] );
+		return 1;
+	}
+	options.scale = std::min( std::max( options.scale, 0 ), 3 );
+
+	try {
+		replay_in_stream_t  is( argv[optind], paced );
+		null_out_stream_t   os;
+		region_mailbox_t    mailbox;
+		replay_connection_t conn( &mailbox, &is, &os, pass, options, serial );
+		auto const t0 = clock_type::now();
+		try {
+			while( true ) {
+				conn.processMsg();
+			}
+		}
+		catch( rdr::EndOfStream const& ) {
+		}
+		report( conn, is, paced, serial, seconds( clock_type::now() - t0 ) );
+		if( !check_texture( conn ) ) {
+			return 1;
+		}
+		if( options.mipmap && !check_mipmap( conn ) ) {
+			return 1;
+		}
+	}
+	catch( rdr::Exception const& e ) {
+		std::fprintf( stderr, "%s\n", e.str() );
+		return 1;
+	}
+
+	return 0;
+}
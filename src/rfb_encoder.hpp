@@ -0,0 +1,92 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the server side of RFB, as much as the host tools which play a server need.
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <jpeglib.h>
+
+
+// a message being built, in network byte order.
+struct rfb_buffer_t {
+	void u8( uint8_t const x ) {
+		data.push_back( x );
+	}
+
+	void u16( uint16_t const x ) {
+		u8( uint8_t( x >> 8 ) );
+		u8( uint8_t( x ) );
+	}
+
+	void u32( uint32_t const x ) {
+		u16( uint16_t( x >> 16 ) );
+		u16( uint16_t( x ) );
+	}
+
+	void bytes( uint8_t const* const src, size_t const size ) {
+		data.insert( data.end(), src, src + size );
+	}
+
+	// the header of a rect in a FramebufferUpdate.
+	void rect( int const x, int const y, int const w, int const h, int32_t const encoding ) {
+		u16( x );
+		u16( y );
+		u16( w );
+		u16( h );
+		u32( uint32_t( encoding ) );
+	}
+
+	// Tight: 7 bits a byte.
+	void compact_length( size_t const size ) {
+		u8( (size & 0x7f) | (size >= (1 << 7) ? 0x80 : 0) );
+		if( size >= (1 << 7) ) {
+			u8( ((size >> 7) & 0x7f) | (size >= (1 << 14) ? 0x80 : 0) );
+		}
+		if( size >= (1 << 14) ) {
+			u8( size >> 14 );
+		}
+	}
+
+	std::vector<uint8_t> data;
+};
+
+// TigerVNC's JPEG quality of each quality level.
+int const jpeg_quality[10] = { 15, 29, 41, 42, 62, 77, 79, 86, 92, 100 };
+
+// rgb: 3 bytes a pixel, stride bytes a row.
+inline std::vector<uint8_t> encode_jpeg( uint8_t const* const rgb, int const stride, int const w, int const h, int const quality ) {
+	jpeg_compress_struct cinfo;
+	jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error( &jerr );
+	jpeg_create_compress( &cinfo );
+
+	unsigned char* buf  = nullptr;
+	unsigned long  size = 0;
+	jpeg_mem_dest( &cinfo, &buf, &size );
+	cinfo.image_width      = w;
+	cinfo.image_height     = h;
+	cinfo.input_components = 3;
+	cinfo.in_color_space   = JCS_RGB;
+	jpeg_set_defaults( &cinfo ); // 4:2:0, as the H.264 streams.
+	jpeg_set_quality( &cinfo, quality, TRUE );
+	cinfo.dct_method = JDCT_FASTEST;
+	jpeg_start_compress( &cinfo, TRUE );
+	while( cinfo.next_scanline < cinfo.image_height ) {
+		JSAMPROW row = const_cast<uint8_t*>( rgb + size_t( stride ) * cinfo.next_scanline );
+		jpeg_write_scanlines( &cinfo, &row, 1 );
+	}
+	jpeg_finish_compress( &cinfo );
+	jpeg_destroy_compress( &cinfo );
+
+	std::vector<uint8_t> result( buf, buf + size );
+	std::free( buf );
+	return result;
+}
+
+// the data of a Tight rect compressed as JPEG.
+inline void tight_jpeg( rfb_buffer_t& out, std::vector<uint8_t> const& jpeg ) {
+	out.u8( 0x90 );
+	out.compact_length( jpeg.size() );
+	out.bytes( jpeg.data(), jpeg.size() );
+}
@@ -0,0 +1,139 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <rfb/Region.h>
+
+
+// not cryptographic: each step is a bijection of the state, so the pixels of
+// a tile changing alone always changes its hash; only different contents may collide.
+inline uint64_t tile_hash( uint32_t const* const buf, int const stride, rfb::Rect const& r ) {
+	uint64_t const k = 0x9e3779b97f4a7c15u;
+	auto const mix = [&]( uint64_t const h, uint64_t const v ) {
+		uint64_t const x = (h ^ v) * k;
+		return (x << 31) | (x >> 33);
+	};
+
+	// four lanes of two pixels each, which do not wait for each other.
+	uint64_t h[4] = { 1, 2, 3, 4 };
+	for( int y = r.tl.y; y < r.br.y; ++y ) {
+		uint32_t const* const row = buf + stride * y;
+		int x = r.tl.x;
+		for( ; x + 8 <= r.br.x; x += 8 ) {
+			for( int i = 0; i < 4; ++i ) {
+				uint64_t v;
+				std::memcpy( &v, row + x + 2 * i, sizeof( v ) );
+				h[i] = mix( h[i], v );
+			}
+		}
+		for( ; x < r.br.x; ++x ) {
+			h[0] = mix( h[0], row[x] );
+		}
+	}
+	return mix( mix( mix( h[0], h[1] ), h[2] ), h[3] );
+}
+
+inline uint64_t region_area( rfb::Region const& region ) {
+	std::vector<rfb::Rect> rects;
+	region.get_rects( &rects );
+	uint64_t area = 0;
+	for( auto const& r: rects ) {
+		area += r.area();
+	}
+	return area;
+}
+
+// the hash of each size x size tile of a framebuffer as it was last handed
+// to the render thread.  servers which poll the screen (x0vncserver, most
+// on Windows) resend pixels which have not changed: their tiles are dropped
+// from the damage.
+struct tile_hashes_t {
+	static int const size = 64;
+
+	void resize( int const w, int const h ) {
+		_w    = w;
+		_h    = h;
+		_cols = (w + size - 1) / size;
+		_rows = (h + size - 1) / size;
+		_hashes.assign( _cols * _rows, 0 );
+		_known.assign( _cols * _rows, false );
+		_seen.assign( _cols * _rows, 0 );
+		_generation = 0;
+	}
+
+	// buf is what the render thread has: every tile is known.
+	void reset( uint32_t const* const buf ) {
+		for( int ty = 0; ty < _rows; ++ty ) {
+			for( int tx = 0; tx < _cols; ++tx ) {
+				_hashes[_cols * ty + tx] = tile_hash( buf, _w, _tile( tx, ty ) );
+				_known [_cols * ty + tx] = true;
+			}
+		}
+	}
+
+	// the pixels of r have changed behind filter(): its tiles go through next time.
+	void forget( rfb::Rect const& r ) {
+		if( r.is_empty() ) {
+			return;
+		}
+		for( int ty = r.tl.y / size; ty <= (r.br.y - 1) / size; ++ty ) {
+			for( int tx = r.tl.x / size; tx <= (r.br.x - 1) / size; ++tx ) {
+				_known[_cols * ty + tx] = false;
+			}
+		}
+	}
+
+	// the part of damaged in the tiles which have changed since the last
+	// call, whose hashes are updated.  buf: w x h pixels.
+	rfb::Region filter( uint32_t const* const buf, rfb::Region const& damaged ) {
+		if( ++_generation == 0 ) {
+			std::fill( _seen.begin(), _seen.end(), 0 );
+			_generation = 1;
+		}
+
+		std::vector<rfb::Rect> rects;
+		damaged.get_rects( &rects );
+		rfb::Region changed;
+		for( auto const& r: rects ) {
+			if( r.is_empty() ) {
+				continue;
+			}
+			for( int ty = r.tl.y / size; ty <= (r.br.y - 1) / size; ++ty ) {
+				for( int tx = r.tl.x / size; tx <= (r.br.x - 1) / size; ++tx ) {
+					size_t const i = _cols * ty + tx;
+					if( _seen[i] == _generation ) {
+						continue;
+					}
+					_seen[i] = _generation;
+
+					rfb::Rect const t = _tile( tx, ty );
+					uint64_t const hash = tile_hash( buf, _w, t );
+					if( _known[i] && _hashes[i] == hash ) {
+						continue;
+					}
+					_hashes[i] = hash;
+					_known [i] = true;
+					changed.assign_union( t );
+				}
+			}
+		}
+		return changed.intersect( damaged );
+	}
+
+private:
+	rfb::Rect _tile( int const tx, int const ty ) const {
+		return { size * tx, size * ty, std::min( size * (tx + 1), _w ), std::min( size * (ty + 1), _h ) };
+	}
+
+	int                   _w    = 0;
+	int                   _h    = 0;
+	int                   _cols = 0;
+	int                   _rows = 0;
+	std::vector<uint64_t> _hashes;
+	std::vector<bool>     _known;
+	std::vector<uint32_t> _seen; // == _generation: hashed in this call.
+	uint32_t              _generation = 0;
+};
@@ -0,0 +1,184 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <rfb/Rect.h>
+#include "copy_rect.hpp"
+
+
+// the pixels of the regions still to be uploaded, in tiles.  the render
+// thread uploads the tiles of all screens within a budget a frame, those
+// nearest to where the user looks first.  a region taken while the tiles of
+// earlier ones are left goes on top of them: its copies move them along and
+// its pixels replace those they cover.
+struct upload_queue_t {
+	struct tile_t {
+		rfb::Rect       rect;       // in texels of level.
+		int             level  = 0;
+		uint32_t const* pixels = nullptr; // the top left of rect.
+		int             stride = 0;       // [pixels] a row.
+		uint32_t        region = 0;       // the pixels belong to.
+		float           cost   = 0.0f;    // the least first.
+
+		// the part r of the tile.
+		tile_t part( rfb::Rect const& r ) const {
+			tile_t t = *this;
+			t.rect   = r;
+			t.pixels = pixels + size_t( stride ) * (r.tl.y - rect.tl.y) + (r.tl.x - rect.tl.x);
+			return t;
+		}
+	};
+
+	// rects: packed row by row in pixels, one after another, as region_t has them.
+	void push( std::vector<rfb::Rect> const& rects, uint32_t const* pixels, int const level, uint32_t const region = 0 ) {
+		for( auto const& r: rects ) {
+			for( int y = r.tl.y; y < r.br.y; y += tile_size ) {
+				for( int x = r.tl.x; x < r.br.x; x += tile_size ) {
+					tile_t t;
+					t.rect   = { x, y, std::min( x + tile_size, r.br.x ), std::min( y + tile_size, r.br.y ) };
+					t.level  = level;
+					t.pixels = pixels + size_t( r.width() ) * (y - r.tl.y) + (x - r.tl.x);
+					t.stride = r.width();
+					t.region = region;
+					_tiles.push_back( t );
+				}
+			}
+			pixels += r.area();
+		}
+	}
+
+	// the tiles of level under rects, which newer pixels replace, go.
+	void cover( std::vector<rfb::Rect> const& rects, int const level ) {
+		for( auto const& r: rects ) {
+			_cut( r, level );
+		}
+	}
+
+	// a copy on level 0 of the texture: the tiles it copies out of are moved
+	// along, as move_damage() does, and those it copies over go.
+	void move( copy_rect_t const& copy ) {
+		std::vector<tile_t> moved;
+		rfb::Rect const src = copy.source();
+		for( auto const& t: _tiles ) {
+			rfb::Rect const r = t.rect.intersect( src );
+			if( t.level == 0 && !r.is_empty() ) {
+				tile_t m = t.part( r );
+				m.rect = r.translate( copy.delta );
+				moved.push_back( m );
+			}
+		}
+		_cut( copy.rect, 0 );
+		_tiles.insert( _tiles.end(), moved.begin(), moved.end() );
+	}
+
+	// whether any tile of region is left.
+	bool has( uint32_t const region ) const {
+		return std::any_of( _tiles.begin(), _tiles.end(), [&]( tile_t const& t ) {
+			return t.region == region;
+		} );
+	}
+
+	// cost( tile ) -> float: where the tile is, relative to the user.
+	template<class F>
+	void prioritize( F const& cost ) {
+		for( auto& t: _tiles ) {
+			t.cost = cost( t );
+		}
+		// the least at the back.
+		std::sort( _tiles.begin(), _tiles.end(), []( tile_t const& x, tile_t const& y ) {
+			return x.cost > y.cost;
+		} );
+	}
+
+	bool empty() const {
+		return _tiles.empty();
+	}
+
+	tile_t const& top() const {
+		return _tiles.back();
+	}
+
+	void pop() {
+		_tiles.pop_back();
+	}
+
+	void clear() {
+		_tiles.clear();
+	}
+
+	int tile_size = 256; // [texels].
+
+private:
+	// the parts of the tiles of level out of r.
+	void _cut( rfb::Rect const& r, int const level ) {
+		size_t const n = _tiles.size();
+		for( size_t i = 0; i < n; ++i ) {
+			tile_t const t = _tiles[i];
+			rfb::Rect const c = t.rect.intersect( r );
+			if( t.level != level || c.is_empty() ) {
+				continue;
+			}
+			// above, below, left and right of c.
+			rfb::Rect const parts[4] = {
+				{ t.rect.tl.x, t.rect.tl.y, t.rect.br.x, c.tl.y      },
+				{ t.rect.tl.x, c.br.y,      t.rect.br.x, t.rect.br.y },
+				{ t.rect.tl.x, c.tl.y,      c.tl.x,      c.br.y      },
+				{ c.br.x,      c.tl.y,      t.rect.br.x, c.br.y      },
+			};
+			_tiles[i].rect = {};
+			for( auto const& p: parts ) {
+				if( !p.is_empty() ) {
+					_tiles.push_back( t.part( p ) );
+				}
+			}
+		}
+		_tiles.erase( std::remove_if( _tiles.begin(), _tiles.end(), []( tile_t const& t ) {
+			return t.rect.is_empty();
+		} ), _tiles.end() );
+	}
+
+	std::vector<tile_t> _tiles;
+};
+
+// the angle [radians] from the point the user looks at (fx, fy; NaN: none) to
+// a tile of level 0, plus a half turn if it is out of the visible rect, so
+// that the tiles in view go first.  radians: per texel.
+inline float tile_cost( rfb::Rect const& tile, rfb::Rect const& visible, float const fx, float const fy, float const radians ) {
+	float cost = visible.intersect( tile ).is_empty() ? float( M_PI ) : 0.0f;
+	if( !std::isnan( fx ) ) {
+		float const dx = std::max( std::max( float( tile.tl.x ) - fx, fx - float( tile.br.x ) ), 0.0f );
+		float const dy = std::max( std::max( float( tile.tl.y ) - fy, fy - float( tile.br.y ) ), 0.0f );
+		cost += radians * std::hypot( dx, dy );
+	}
+	return cost;
+}
+
+// uploads the tiles of the queues, the least cost first, until bytes run out
+// or out_of_time() holds; at least one tile, so that they always progress.
+// upload( i, tile ): a tile of queues[i].  returns the bytes uploaded.
+template<class T, class F>
+inline size_t drain_uploads( std::vector<upload_queue_t*> const& queues, size_t const bytes, T const& out_of_time, F const& upload ) {
+	size_t done = 0;
+	while( true ) {
+		size_t best = queues.size();
+		for( size_t i = 0; i < queues.size(); ++i ) {
+			if( !queues[i]->empty() && (best == queues.size() || queues[i]->top().cost < queues[best]->top().cost) ) {
+				best = i;
+			}
+		}
+		if( best == queues.size() ) {
+			return done;
+		}
+		size_t const size = 4 * size_t( queues[best]->top().rect.area() );
+		if( done > 0 && (done + size > bytes || out_of_time()) ) {
+			return done;
+		}
+		upload( best, queues[best]->top() );
+		queues[best]->pop();
+		done += size;
+	}
+}
@@ -0,0 +1,228 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <rfb/Rect.h>
+#include <rfb/ScreenSet.h>
+
+
+// a view in the frame of a cylinder layer: the columns of the head rotation
+// (right, up, the view axis), as vnc_layer_t::handle_pointer() takes them,
+// and the tangents of the half field of view.
+struct view_t {
+	float right[3];
+	float up[3];
+	float axis[3];
+	float tan_x;
+	float tan_y;
+};
+
+// where a direction hits the cylinder, in texels of a w x h texture with
+// resolution texels per pi radians.  the same mapping as the pointer, except
+// that u is not wrapped to [-pi, pi).
+inline void cylinder_texel( float const d[3], float const u, float const resolution, int const w, int const h, float& tu, float& tv ) {
+	float const r = std::hypot( d[0], d[2] );
+	float const v = std::min( std::max( d[1] / std::max( r, 1e-6f ), -1e4f ), 1e4f );
+	tu = float( -resolution / M_PI ) * u + 0.5f * float( w );
+	tv = float( +resolution / M_PI ) * v + 0.5f * float( h );
+}
+
+// where the direction d, in the frame of the cylinder over monitor rect,
+// hits the monitor, in texels with resolution texels per pi radians.  clamp:
+// onto the monitor.  false if it misses the monitor.
+inline bool monitor_hit( float const d[3], rfb::Rect const& rect, float const resolution, bool const clamp, int& iu, int& iv ) {
+	float tu, tv;
+	cylinder_texel( d, std::atan2( d[0], d[2] ), resolution, rect.width(), rect.height(), tu, tv );
+	iu = rect.tl.x + int( std::floor( tu ) );
+	iv = rect.tl.y + int( std::floor( tv ) );
+	if( clamp ) {
+		iu = std::min( std::max( iu, rect.tl.x ), rect.br.x - 1 );
+		iv = std::min( std::max( iv, rect.tl.y ), rect.br.y - 1 );
+	}
+	return rect.tl.x <= iu && iu < rect.br.x && rect.tl.y <= iv && iv < rect.br.y;
+}
+
+// the monitor of n which the pointer is on, where hit( i, clamp, iu, iv )
+// maps the head ray onto monitor i as monitor_hit() does: the first one hit,
+// or while a button is held, the monitor it was pressed on (captured),
+// clamped to it.  n if none.
+template<class F>
+size_t pointer_monitor( size_t const n, F const& hit, bool const capturing, size_t const captured, int& iu, int& iv ) {
+	for( size_t i = 0; i < n; ++i ) {
+		if( capturing && i != captured ) {
+			continue;
+		}
+		if( hit( i, capturing, iu, iv ) ) {
+			return i;
+		}
+	}
+	return n;
+}
+
+// the monitors of a w x h desktop in texels reduced by 2^scale, from the
+// left; empty if the server has not sent a layout of several.
+inline std::vector<rfb::Rect> monitor_layout( rfb::ScreenSet const& screens, int const w, int const h, int const scale ) {
+	std::vector<rfb::Rect> monitors;
+	if( screens.num_screens() > 1 ) {
+		for( auto const& s: screens ) {
+			rfb::Rect const r = s.dimensions.intersect( { 0, 0, w, h } );
+			rfb::Rect const t = { r.tl.x >> scale, r.tl.y >> scale, r.br.x >> scale, r.br.y >> scale };
+			if( !r.is_empty() && !t.is_empty() ) {
+				monitors.push_back( t );
+			}
+		}
+		std::sort( monitors.begin(), monitors.end(), []( rfb::Rect const& x, rfb::Rect const& y ) {
+			return x.tl.x != y.tl.x ? x.tl.x < y.tl.x : x.tl.y < y.tl.y;
+		} );
+	}
+	// the others are off the desktop: one, as without a layout.
+	if( monitors.size() == 1 && monitors[0].equals( { 0, 0, w >> scale, h >> scale } ) ) {
+		monitors.clear();
+	}
+	return monitors;
+}
+
+// the monitors shown, M{ rect, transform }: layout[i] placed by transforms[i],
+// for those which have one, or the whole w x h texture placed by transform if
+// there is no layout or no transforms.
+template<class M, class T>
+std::vector<M> place_monitors( std::vector<rfb::Rect> const& layout, std::vector<T> const& transforms, T const& transform, int const w, int const h ) {
+	std::vector<M> monitors;
+	if( layout.empty() || transforms.empty() ) {
+		monitors.push_back( { { 0, 0, w, h }, transform } );
+		return monitors;
+	}
+	for( size_t i = 0; i < std::min( layout.size(), transforms.size() ); ++i ) {
+		monitors.push_back( { layout[i], transforms[i] } );
+	}
+	return monitors;
+}
+
+// the texels of a w x h cylinder layer which the view may see; empty if none.
+// the boundary of the view is sampled, as the mapping bends straight lines.
+inline rfb::Rect visible_rect( view_t const& view, float const resolution, int const w, int const h ) {
+	int const n = 8;
+	float const u0 = std::atan2( view.axis[0], view.axis[2] );
+	float x0 = +INFINITY, y0 = +INFINITY;
+	float x1 = -INFINITY, y1 = -INFINITY;
+	for( int i = 0; i <= n; ++i ) {
+		for( int j = 0; j <= n; ++j ) {
+			// the boundary and the center.
+			if( i != 0 && i != n && j != 0 && j != n && !(2 * i == n && 2 * j == n) ) {
+				continue;
+			}
+			float const a = view.tan_x * (2.0f * float( i ) / float( n ) - 1.0f);
+			float const b = view.tan_y * (2.0f * float( j ) / float( n ) - 1.0f);
+			float d[3];
+			for( int k = 0; k < 3; ++k ) {
+				d[k] = view.axis[k] + a * view.right[k] + b * view.up[k];
+			}
+			// unwrapped around the view axis, so that a view behind the
+			// layer does not span it.
+			float u = std::atan2( d[0], d[2] );
+			u -= float( 2.0 * M_PI ) * std::round( (u - u0) / float( 2.0 * M_PI ) );
+			float tu, tv;
+			cylinder_texel( d, u, resolution, w, h, tu, tv );
+			x0 = std::min( x0, tu );
+			x1 = std::max( x1, tu );
+			y0 = std::min( y0, tv );
+			y1 = std::max( y1, tv );
+		}
+	}
+
+	// a pole in the view, which its boundary does not show: all around, up to
+	// the top or the bottom.
+	for( float const s: { -1.0f, +1.0f } ) {
+		float const z = s * view.axis[1];
+		if( z > 0.0f && std::abs( view.right[1] ) <= view.tan_x * z && std::abs( view.up[1] ) <= view.tan_y * z ) {
+			float const d[3] = { 0.0f, s, 0.0f };
+			for( float const u: { u0 - float( M_PI ), u0 + float( M_PI ) } ) {
+				float tu, tv;
+				cylinder_texel( d, u, resolution, w, h, tu, tv );
+				x0 = std::min( x0, tu );
+				x1 = std::max( x1, tu );
+				y0 = std::min( y0, tv );
+				y1 = std::max( y1, tv );
+			}
+		}
+	}
+
+	// a layer wider than 2 pi minus the view is seen at both ends.
+	float const turn = 2.0f * resolution;
+	int rx0 = w, rx1 = 0;
+	for( int k = -1; k <= 1; ++k ) {
+		int const a = std::max( int( std::floor( x0 + float( k ) * turn ) ), 0 );
+		int const b = std::min( int( std::ceil ( x1 + float( k ) * turn ) ), w );
+		if( a < b ) {
+			rx0 = std::min( rx0, a );
+			rx1 = std::max( rx1, b );
+		}
+	}
+	rfb::Rect const r( rx0, std::max( int( std::floor( y0 ) ), 0 ), rx1, std::min( int( std::ceil( y1 ) ), h ) );
+	return r.is_empty() ? rfb::Rect() : r;
+}
+
+// widens the half field of view by an angle [radians].
+inline float widen_tan( float const t, float const margin ) {
+	return std::tan( std::min( std::atan( t ) + margin, float( 0.49 * M_PI ) ) );
+}
+
+// the desktop rect requested for a rect of texels reduced by 2^scale, on a
+// grid of g pixels not to change it on every small turn.
+inline rfb::Rect view_request( rfb::Rect const& r, int const scale, int const g = 64 ) {
+	return {
+		(r.tl.x << scale) / g * g, (r.tl.y << scale) / g * g,
+		((r.br.x << scale) + g - 1) / g * g, ((r.br.y << scale) + g - 1) / g * g
+	};
+}
+
+// the texture coordinates of a cylinder layer, in units of the texture size:
+// scale * (the coordinates on the cylinder) + offset, clipped to rect
+// (x, y, width, height).
+struct texture_map_t {
+	float scale[2];
+	float offset[2];
+	float rect[4];
+};
+
+// the cylinder over monitor r of a tw x th texture reduced by 2^scale, with
+// resolution desktop pixels per pi radians, clipped not to show its neighbors.
+inline texture_map_t monitor_texture( rfb::Rect const& r, float const resolution, int const scale, int const tw, int const th ) {
+	float const sx = resolution / std::ldexp( float( r.width() ), scale );
+	texture_map_t m;
+	m.scale[0]  = sx * float( r.width() ) / float( tw );
+	m.scale[1]  = float( r.height() ) / float( th );
+	m.offset[0] = ((-0.5f * sx + 0.5f) * float( r.width() ) + float( r.tl.x )) / float( tw );
+	m.offset[1] = float( r.tl.y ) / float( th );
+	m.rect[0]   = float( r.tl.x ) / float( tw );
+	m.rect[1]   = float( r.tl.y ) / float( th );
+	m.rect[2]   = float( r.width() ) / float( tw );
+	m.rect[3]   = float( r.height() ) / float( th );
+	return m;
+}
+
+// m of monitor r moved to a cw x ch cursor whose hotspot (hot_x, hot_y) is at
+// the pointer (px, py) in desktop pixels, clipped to the monitor.
+inline texture_map_t cursor_texture( texture_map_t const& m, rfb::Rect const& r, int const scale, int const tw, int const th, int const px, int const py, int const cw, int const ch, int const hot_x, int const hot_y ) {
+	// the corner of the cursor.
+	float const x = float( px - hot_x );
+	float const y = float( py - hot_y );
+	float const w = std::ldexp( float( tw ), scale );
+	float const h = std::ldexp( float( th ), scale );
+	texture_map_t c;
+	c.scale[0]  = m.scale[0] * w / float( cw );
+	c.scale[1]  = m.scale[1] * h / float( ch );
+	c.offset[0] = (m.offset[0] * w - x) / float( cw );
+	c.offset[1] = (m.offset[1] * h - y) / float( ch );
+	float const x0 = std::max( (std::ldexp( float( r.tl.x ), scale ) - x) / float( cw ), 0.0f );
+	float const y0 = std::max( (std::ldexp( float( r.tl.y ), scale ) - y) / float( ch ), 0.0f );
+	float const x1 = std::min( (std::ldexp( float( r.br.x ), scale ) - x) / float( cw ), 1.0f );
+	float const y1 = std::min( (std::ldexp( float( r.br.y ), scale ) - y) / float( ch ), 1.0f );
+	c.rect[0] = x0;
+	c.rect[1] = y0;
+	c.rect[2] = std::max( x1 - x0, 0.0f );
+	c.rect[3] = std::max( y1 - y0, 0.0f );
+	return c;
+}
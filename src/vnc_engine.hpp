@@ -0,0 +1,816 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <rdr/Exception.h>
+#include <rdr/OutStream.h>
+#include "vnc_thread.hpp"
+#include "pointer_queue.hpp"
+#include "recorder.hpp"
+
+
+// the input of a connection, fed by the engine as the socket becomes readable.
+// a message which has not fully arrived throws underflow_t; the engine then
+// rewinds to where the message started and tries again with more data.
+// TightDecoder and DecodeManager only act on a rect once it has been read,
+// so reading a message again has no side effect.
+struct resumable_in_stream_t: rdr::InStream {
+	struct underflow_t {};
+
+	resumable_in_stream_t():
+		_buf( 1 << 16 )
+	{
+		ptr = _buf.data();
+		end = _buf.data();
+	}
+
+	virtual int pos() override {
+		return int( offset() );
+	}
+
+	// pos() without the wrap around.
+	size_t offset() const {
+		return _offset + (ptr - _buf.data());
+	}
+
+	size_t available() const {
+		return end - ptr;
+	}
+
+	// space for n more bytes to be commit()ed.  not while a message is read.
+	uint8_t* reserve( size_t const n ) {
+		size_t const p = ptr - _buf.data();
+		size_t const e = end - _buf.data();
+		if( _buf.size() < e + n ) {
+			_buf.resize( std::max( e + n, 2 * _buf.size() ) );
+		}
+		ptr = _buf.data() + p;
+		end = _buf.data() + e;
+		return _buf.data() + e;
+	}
+
+	// at: when the bytes were received (trace_now()), to be told by arrival().  0: not traced.
+	void commit( size_t const n, int64_t const at = 0 ) {
+		end += n;
+		if( at != 0 ) {
+			_arrivals.emplace_back( offset() + available(), at );
+		}
+	}
+
+	// when the byte at the current position was received, if commit() was told.
+	int64_t arrival() {
+		size_t const p = offset();
+		while( !_arrivals.empty() && _arrivals.front().first <= p ) {
+			_arrivals.pop_front();
+		}
+		return _arrivals.empty() ? 0 : _arrivals.front().second;
+	}
+
+	// when the last byte available was received.
+	int64_t last_arrival() const {
+		return _arrivals.empty() ? 0 : _arrivals.back().second;
+	}
+
+	void mark() {
+		_mark = ptr;
+	}
+
+	void rewind() {
+		ptr = _mark;
+	}
+
+	// the size the last rewound message has at least, from its start.
+	size_t required() const {
+		return _required;
+	}
+
+	// drops the consumed bytes.
+	void compact() {
+		size_t const n = end - ptr;
+		_offset += ptr - _buf.data();
+		std::memmove( _buf.data(), ptr, n );
+		ptr = _buf.data();
+		end = _buf.data() + n;
+	}
+
+private:
+	virtual int overrun( int const item_size, int, bool const wait ) override {
+		if( !wait ) {
+			return 0;
+		}
+		_required = ptr + item_size - _mark;
+		throw underflow_t();
+	}
+
+	std::vector<uint8_t> _buf;
+	uint8_t const*       _mark     = nullptr;
+	size_t               _offset   = 0;
+	size_t               _required = 0;
+	std::deque<std::pair<size_t, int64_t>> _arrivals; // the end of each received chunk (as pos()) and its time.
+};
+
+// the output of a connection, which never blocks.  what the socket does not
+// take at once waits here until it becomes writable; watch( true ) asks the
+// engine to tell (EPOLLOUT) and watch( false ) that everything has been sent.
+// guarded by writer_mutex of the connection, as the writers are.
+struct nonblocking_out_stream_t: rdr::OutStream {
+	nonblocking_out_stream_t( int const fd, std::function<void( bool )> watch ):
+		_fd( fd ),
+		_watch( std::move( watch ) ),
+		_buf( 1 << 12 )
+	{
+		ptr = _buf.data();
+		end = _buf.data() + _buf.size();
+	}
+
+	virtual int length() override {
+		return int( _offset + (ptr - _buf.data()) );
+	}
+
+	// sends what the socket takes.
+	virtual void flush() override {
+		_send();
+		bool const waiting = pending() > 0;
+		if( waiting != _waiting ) {
+			_waiting = waiting;
+			_watch( waiting );
+		}
+	}
+
+	size_t pending() const {
+		return (ptr - _buf.data()) - _sent;
+	}
+
+private:
+	// sends what it can, then makes room for at least one item.  a server
+	// which stops reading is given up at 4 MB.
+	virtual int overrun( int const item_size, int const n_items ) override {
+		_send();
+		size_t const n = pending();
+		std::memmove( _buf.data(), _buf.data() + _sent, n );
+		_offset += _sent;
+		_sent    = 0;
+		if( _buf.size() < n + item_size ) {
+			if( n + item_size > (4 << 20) ) {
+				throw rdr::Exception( "the server does not read" );
+			}
+			_buf.resize( std::max( n + item_size, 2 * _buf.size() ) );
+		}
+		ptr = _buf.data() + n;
+		end = _buf.data() + _buf.size();
+		return std::min<int>( n_items, (end - ptr) / item_size );
+	}
+
+	void _send() {
+		size_t const size = ptr - _buf.data();
+		while( _sent < size ) {
+			ssize_t const n = send( _fd, _buf.data() + _sent, size - _sent, MSG_DONTWAIT | MSG_NOSIGNAL );
+			if( n > 0 ) {
+				_sent += n;
+			}
+			else if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+				return;
+			}
+			else if( errno != EINTR ) {
+				throw rdr::SystemException( "send", errno );
+			}
+		}
+		_offset += _sent;
+		_sent    = 0;
+		ptr      = _buf.data();
+	}
+
+	int                         _fd;
+	std::function<void( bool )> _watch;
+	std::vector<uint8_t>        _buf;
+	size_t                      _sent    = 0; // of the bytes before ptr.
+	size_t                      _offset  = 0; // the bytes dropped from _buf.
+	bool                        _waiting = false;
+};
+
+// a few threads which run the jobs in the order queued.  done() is called
+// after each, once its future is ready.
+struct worker_pool_t {
+	worker_pool_t( size_t const n, std::function<void()> done ):
+		_done( std::move( done ) )
+	{
+		for( size_t i = 0; i < n; ++i ) {
+			_threads.emplace_back( &worker_pool_t::_run, this );
+		}
+	}
+
+	worker_pool_t( worker_pool_t&& )                 = delete;
+	worker_pool_t( worker_pool_t const& )            = delete;
+	worker_pool_t& operator=( worker_pool_t&& )      = delete;
+	worker_pool_t& operator=( worker_pool_t const& ) = delete;
+
+	// runs the jobs queued before.
+	~worker_pool_t() {
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_stop = true;
+		}
+		_cond.notify_all();
+		for( auto& t: _threads ) {
+			t.join();
+		}
+	}
+
+	std::future<void> run( std::function<void()> f ) {
+		std::packaged_task<void()> job( std::move( f ) );
+		std::future<void> result = job.get_future();
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_jobs.push_back( std::move( job ) );
+		}
+		_cond.notify_one();
+		return result;
+	}
+
+private:
+	void _run() {
+		while( true ) {
+			std::packaged_task<void()> job;
+			{
+				std::unique_lock<std::mutex> lock( _mutex );
+				_cond.wait( lock, [this]() { return _stop || !_jobs.empty(); } );
+				if( _jobs.empty() ) {
+					return;
+				}
+				job = std::move( _jobs.front() );
+				_jobs.pop_front();
+			}
+			job();
+			_done();
+		}
+	}
+
+	std::function<void()>                  _done;
+	std::mutex                             _mutex;
+	std::condition_variable                _cond;
+	std::deque<std::packaged_task<void()>> _jobs;
+	bool                                   _stop = false;
+	std::vector<std::thread>               _threads;
+};
+
+// the wait [ms] before the next attempt after failures in a row: 125 ms -
+// 250 ms, doubling up to 4 s - 8 s.  the jitter keeps the screens of a
+// restarted server from retrying together.
+inline int reconnect_delay( int const failures, std::mt19937& random ) {
+	int const ms = 250 << std::min( std::max( failures, 0 ), 5 );
+	return std::uniform_int_distribution<int>( ms / 2, ms )( random );
+}
+
+struct vnc_params_t: connection_options_t {
+	std::string host;
+	int         port = 5900;
+	std::string password;
+	std::string record; // path prefix of the recordings, if not empty.
+};
+
+// what a layer (render thread) and the engine share for one screen.
+struct vnc_screen_t {
+	vnc_screen_t( vnc_params_t p, std::function<void()> notify ):
+		params( std::move( p ) ),
+		pointer( notify ),
+		_notify( std::move( notify ) )
+	{
+	}
+
+	// render thread.  the desktop pixels in view, which the server is asked
+	// to keep up to date; empty: none.
+	void set_view( rfb::Rect const& r ) {
+		uint64_t const v = _pack( r );
+		if( _view.exchange( v, std::memory_order_relaxed ) != v ) {
+			_notify();
+		}
+	}
+
+	rfb::Rect view() const {
+		uint64_t const v = _view.load( std::memory_order_relaxed );
+		return { int( v & 0xffff ), int( (v >> 16) & 0xffff ), int( (v >> 32) & 0xffff ), int( v >> 48 ) };
+	}
+
+	vnc_params_t const params;
+	region_mailbox_t   mailbox;
+	pointer_queue_t    pointer;
+
+private:
+	static uint64_t _pack( rfb::Rect const& r ) {
+		auto const c = []( int const x ) {
+			return uint64_t( std::min( std::max( x, 0 ), 0xffff ) );
+		};
+		return c( r.tl.x ) | (c( r.tl.y ) << 16) | (c( r.br.x ) << 32) | (c( r.br.y ) << 48);
+	}
+
+	std::function<void()> const _notify;
+	std::atomic<uint64_t>       _view = { _pack( { 0, 0, 0xffff, 0xffff } ) }; // all of the desktop.
+};
+
+// runs the connections of all screens on one thread with epoll: connecting,
+// reading, reconnecting after a failure and sending the pointer events.  the
+// decoding is done by the thread pool of each rfb::DecodeManager, publishing
+// the updates by a pool shared by the connections.
+struct vnc_engine_t {
+	vnc_engine_t():
+		_epoll( epoll_create1( EPOLL_CLOEXEC ) ),
+		_event( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ),
+		_workers( std::min( std::max( std::thread::hardware_concurrency(), 1u ), 4u ), [this]() { _signal(); } )
+	{
+		epoll_event ev = {};
+		ev.events   = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl( _epoll, EPOLL_CTL_ADD, _event, &ev );
+		_thread = std::thread( &vnc_engine_t::_process, this );
+	}
+
+	vnc_engine_t( vnc_engine_t&& )                 = delete;
+	vnc_engine_t( vnc_engine_t const& )            = delete;
+	vnc_engine_t& operator=( vnc_engine_t&& )      = delete;
+	vnc_engine_t& operator=( vnc_engine_t const& ) = delete;
+
+	// closes every connection, including the decoder threads.
+	~vnc_engine_t() {
+		_stop = true;
+		_signal();
+		_thread.join();
+		close( _event );
+		close( _epoll );
+	}
+
+	std::shared_ptr<vnc_screen_t> add( vnc_params_t params ) {
+		auto screen = std::make_shared<vnc_screen_t>( std::move( params ), [this]() {
+			_wake();
+		} );
+		{
+			std::lock_guard<std::mutex> lock( _added_mutex );
+			_added.push_back( screen );
+		}
+		_signal();
+		return screen;
+	}
+
+private:
+	using clock_type = std::chrono::steady_clock;
+
+	static constexpr clock_type::time_point _never = clock_type::time_point::max();
+
+	struct address_t {
+		sockaddr_storage addr = {};
+		socklen_t        size = 0;
+	};
+
+	struct session_t {
+		enum state_t { idle, resolving, connecting, connected };
+
+		std::shared_ptr<vnc_screen_t>             screen;
+		state_t                                   state = idle;
+		std::future<address_t>                    resolved;   // resolving.
+		std::future<void>                         resolver;   // the thread of the last resolution.
+		address_t                                 address;    // the last one resolved; size = 0: none.
+		int                                       fd    = -1;
+		std::unique_ptr<resumable_in_stream_t>    in;
+		std::unique_ptr<nonblocking_out_stream_t> out;
+		std::unique_ptr<recording_file_t>         recording;
+		std::unique_ptr<client_connection_t>      conn;
+		std::future<void>                         published;  // connected: the update handed to a worker.
+		retained_frame_t                          frame;      // the pixels of the last connection.
+		size_t                                    retry_size = 0;
+		int                                       failures   = 0;  // in a row, without an update.
+		bool                                      updated    = false;
+		clock_type::time_point                    added_at   = {};
+		clock_type::time_point                    attempt_at = {}; // the start of the current attempt.
+		clock_type::time_point                    connect_at = {};     // idle: the next attempt.  connecting: the time out.
+		clock_type::time_point                    process_at = _never; // connected: a message arrived in small pieces.
+		clock_type::time_point                    pointer_at = _never; // connected: the socket was backed up.
+		clock_type::time_point                    resume_at  = _never; // connected: the updates are paused for congestion.
+	};
+
+	// render thread.  a pointer event has been pushed.
+	void _wake() {
+		if( !_woken.exchange( true ) ) {
+			_signal();
+		}
+	}
+
+	void _signal() {
+		uint64_t const one = 1;
+		ssize_t const n = write( _event, &one, sizeof( one ) );
+		(void)n;
+	}
+
+	void _process() {
+		std::vector<epoll_event> events( 64 );
+		while( !_stop ) {
+			auto const now = clock_type::now();
+			auto next = _never;
+			for( auto const& s: _sessions ) {
+				bool const waiting = s->state == session_t::idle || s->state == session_t::connecting;
+				next = std::min( { next, waiting ? s->connect_at : _never, s->process_at, s->pointer_at, s->resume_at } );
+			}
+			int timeout = -1;
+			if( next != _never ) {
+				auto const dt = std::chrono::duration_cast<std::chrono::milliseconds>( next - now ).count();
+				timeout = int( std::max<int64_t>( dt + 1, 0 ) );
+			}
+
+			int const n = epoll_wait( _epoll, events.data(), int( events.size() ), timeout );
+			for( int i = 0; i < n; ++i ) {
+				auto const s = static_cast<session_t*>( events[i].data.ptr );
+				if( s == nullptr ) {
+					uint64_t count;
+					ssize_t const r = read( _event, &count, sizeof( count ) );
+					(void)r;
+					_woken = false;
+					_add_sessions();
+					for( auto const& t: _sessions ) {
+						// a worker may have published the update.
+						if( t->state == session_t::connected && t->published.valid() ) {
+							_parse( *t );
+						}
+						_send_view( *t );
+						_send_pointer( *t );
+					}
+				}
+				else if( s->state == session_t::connecting ) {
+					_finish_connect( *s );
+				}
+				else if( s->state == session_t::connected ) {
+					if( events[i].events & EPOLLOUT ) {
+						_flush( *s );
+					}
+					if( s->state == session_t::connected && events[i].events & ~EPOLLOUT ) {
+						_receive( *s, events[i].events );
+					}
+				}
+			}
+
+			for( auto const& s: _sessions ) {
+				auto const t = clock_type::now();
+				if( s->state == session_t::idle && s->connect_at <= t ) {
+					_connect( *s );
+				}
+				if( s->state == session_t::connecting && s->connect_at <= t ) {
+					_fail( *s, "timed out" );
+				}
+				if( s->state == session_t::resolving && s->resolved.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+					s->address = s->resolved.get();
+					_connect( *s );
+				}
+				if( s->state == session_t::connected && s->process_at <= t ) {
+					_parse( *s );
+				}
+				if( s->state == session_t::connected && s->pointer_at <= t ) {
+					_send_pointer( *s );
+				}
+				if( s->state == session_t::connected && s->resume_at <= t ) {
+					_resume( *s );
+				}
+			}
+		}
+
+		for( auto const& s: _sessions ) {
+			_disconnect( *s );
+		}
+		// waits for the resolutions, which signal the event.
+		_sessions.clear();
+	}
+
+	void _add_sessions() {
+		std::lock_guard<std::mutex> lock( _added_mutex );
+		for( auto& screen: _added ) {
+			auto s = std::make_unique<session_t>();
+			s->screen     = std::move( screen );
+			s->added_at   = clock_type::now();
+			s->connect_at = s->added_at;
+			_sessions.push_back( std::move( s ) );
+		}
+		_added.clear();
+	}
+
+	// resolves the name on another thread first, unless it is known.  all
+	// screens resolve and connect at the same time.
+	void _connect( session_t& s ) {
+		auto const& p = s.screen->params;
+		if( s.state == session_t::idle ) {
+			s.attempt_at = clock_type::now();
+		}
+		if( s.address.size == 0 ) {
+			if( s.state == session_t::resolving ) {
+				_fail( s, "cannot resolve the host name" );
+				return;
+			}
+			s.state    = session_t::resolving;
+			std::promise<address_t> promise;
+			s.resolved = promise.get_future();
+			s.resolver = std::async( std::launch::async, [this, promise = std::move( promise ), host = p.host, port = p.port]() mutable {
+				address_t address;
+				addrinfo hints = {};
+				hints.ai_family   = AF_UNSPEC;
+				hints.ai_socktype = SOCK_STREAM;
+				addrinfo* addr = nullptr;
+				if( getaddrinfo( host.c_str(), std::to_string( port ).c_str(), &hints, &addr ) == 0 && addr != nullptr ) {
+					std::memcpy( &address.addr, addr->ai_addr, addr->ai_addrlen );
+					address.size = addr->ai_addrlen;
+					freeaddrinfo( addr );
+				}
+				// ready before the signal, which the engine thread may take at once.
+				promise.set_value( address );
+				_signal();
+			} );
+			return;
+		}
+
+		s.fd = socket( s.address.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+		if( s.fd < 0 || (connect( s.fd, reinterpret_cast<sockaddr const*>( &s.address.addr ), s.address.size ) < 0 && errno != EINPROGRESS) ) {
+			_fail( s, std::strerror( errno ) );
+			return;
+		}
+
+		int const one = 1;
+		setsockopt( s.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+		epoll_event ev = {};
+		ev.events   = EPOLLOUT;
+		ev.data.ptr = &s;
+		epoll_ctl( _epoll, EPOLL_CTL_ADD, s.fd, &ev );
+		s.state      = session_t::connecting;
+		s.connect_at = clock_type::now() + std::chrono::seconds( 5 );
+	}
+
+	void _finish_connect( session_t& s ) {
+		int err = 0;
+		socklen_t len = sizeof( err );
+		if( getsockopt( s.fd, SOL_SOCKET, SO_ERROR, &err, &len ) < 0 || err != 0 ) {
+			_fail( s, std::strerror( err != 0 ? err : errno ) );
+			return;
+		}
+
+		epoll_event ev = {};
+		ev.events   = EPOLLIN;
+		ev.data.ptr = &s;
+		epoll_ctl( _epoll, EPOLL_CTL_MOD, s.fd, &ev );
+		s.state = session_t::connected;
+
+		auto const& p = s.screen->params;
+		if( !p.record.empty() ) {
+			std::string const path = p.record + "-" + std::to_string( std::time( nullptr ) ) + ".rfb";
+			s.recording = std::make_unique<recording_file_t>( path );
+			if( !s.recording->is_recording() ) {
+				__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "cannot record to %s", path.c_str() );
+			}
+		}
+		try {
+			s.in   = std::make_unique<resumable_in_stream_t>();
+			s.out  = std::make_unique<nonblocking_out_stream_t>( s.fd, [this, &s]( bool const waiting ) {
+				epoll_event ev = {};
+				ev.events   = waiting ? EPOLLIN | EPOLLOUT : EPOLLIN;
+				ev.data.ptr = &s;
+				epoll_ctl( _epoll, EPOLL_CTL_MOD, s.fd, &ev );
+			} );
+			s.conn = std::make_unique<client_connection_t>( &s.screen->mailbox, s.in.get(), s.out.get(), p.password, p, &s.frame );
+			s.conn->executor = [this, &s]( std::function<void()> job ) {
+				s.published = _workers.run( std::move( job ) );
+			};
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+		}
+	}
+
+	void _receive( session_t& s, uint32_t const events ) {
+		// bounded, so that a fast server does not starve the others.
+		for( size_t total = 0; total < (1 << 20); ) {
+			uint8_t* const buf = s.in->reserve( 1 << 16 );
+			ssize_t const n = recv( s.fd, buf, 1 << 16, 0 );
+			if( n > 0 ) {
+				s.in->commit( n, trace_now() );
+				if( s.recording != nullptr ) {
+					s.recording->write( buf, uint32_t( n ) );
+				}
+				total += n;
+			}
+			else if( n == 0 ) {
+				_fail( s, "closed by the server" );
+				return;
+			}
+			else if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+				break;
+			}
+			else if( errno != EINTR ) {
+				_fail( s, std::strerror( errno ) );
+				return;
+			}
+		}
+		if( events & (EPOLLERR | EPOLLHUP) && s.in->available() == 0 ) {
+			_fail( s, "socket error" );
+			return;
+		}
+
+		// a large rect comes in many pieces: reading it again on every piece
+		// would be quadratic, so wait for a quarter more or for a short pause.
+		size_t const size = s.in->available();
+		if( size >= s.retry_size ) {
+			_parse( s );
+		}
+		else if( size >= s.in->required() ) {
+			s.process_at = clock_type::now() + std::chrono::milliseconds( 2 );
+		}
+	}
+
+	void _parse( session_t& s ) {
+		s.process_at = _never;
+		try {
+			// the worker signals when it is done.
+			if( !_published( s ) ) {
+				return;
+			}
+			while( true ) {
+				size_t const size  = s.in->available();
+				auto const   state = s.conn->state();
+				s.in->mark();
+				try {
+					s.conn->process_msg( { s.in->arrival(), s.in->last_arrival(), s.in->available() } );
+				}
+				catch( resumable_in_stream_t::underflow_t const& ) {
+					s.in->rewind();
+					s.retry_size = std::max( s.in->required(), size + size / 4 );
+					break;
+				}
+				s.retry_size = 0;
+				// the connection is the worker's until it has published the update.
+				if( s.published.valid() || (s.in->available() == size && s.conn->state() == state) ) {
+					break;
+				}
+			}
+			s.in->compact();
+			if( s.conn->writer_mt != nullptr ) {
+				s.conn->set_view( s.screen->view() );
+			}
+			// the server should answer the fence of a pause within a few seconds.
+			if( !s.conn->paused() ) {
+				s.resume_at = _never;
+			}
+			else if( s.resume_at == _never ) {
+				s.resume_at = clock_type::now() + std::chrono::seconds( 5 );
+			}
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+		}
+	}
+
+	// false while a worker publishes the last update.  rethrows what it has thrown.
+	bool _published( session_t& s ) {
+		if( !s.published.valid() ) {
+			return true;
+		}
+		if( s.published.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) {
+			return false;
+		}
+		s.published.get();
+
+		// time to first pixels.
+		if( !s.updated && s.conn->updates() > 0 ) {
+			auto const now = clock_type::now();
+			auto const ms = []( clock_type::duration const d ) {
+				return int( std::chrono::duration_cast<std::chrono::milliseconds>( d ).count() );
+			};
+			__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "%s:%d: the first update in %d ms (%d ms after the start)",
+				s.screen->params.host.c_str(), s.screen->params.port, ms( now - s.attempt_at ), ms( now - s.added_at )
+			);
+			s.updated  = true;
+			s.failures = 0;
+		}
+		return true;
+	}
+
+	// the socket has room again for what the out stream holds.
+	void _flush( session_t& s ) {
+		try {
+			std::lock_guard<std::mutex> lock( s.conn->writer_mutex );
+			s.out->flush();
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+			return;
+		}
+		_send_pointer( s );
+	}
+
+	void _send_view( session_t& s ) {
+		if( s.state != session_t::connected || s.conn->writer_mt == nullptr ) {
+			return;
+		}
+		try {
+			s.conn->set_view( s.screen->view() );
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+		}
+	}
+
+	void _resume( session_t& s ) {
+		s.resume_at = _never;
+		try {
+			s.conn->resume();
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+		}
+	}
+
+	void _send_pointer( session_t& s ) {
+		s.pointer_at = _never;
+		if( s.state != session_t::connected || s.conn->writer_mt == nullptr ) {
+			return;
+		}
+		try {
+			// EPOLLOUT sends the rest first.
+			{
+				std::lock_guard<std::mutex> lock( s.conn->writer_mutex );
+				if( s.out->pending() > 0 ) {
+					return;
+				}
+			}
+			bool const drained = send_pointer_events( s.screen->pointer, s.fd, [&]( pointer_event_t const& e ) {
+				std::lock_guard<std::mutex> lock( s.conn->writer_mutex );
+				s.conn->writer_mt->writePointerEvent( { e.x, e.y }, e.buttons );
+			} );
+			if( !drained ) {
+				// let the motion collapse until the socket drains.
+				s.pointer_at = clock_type::now() + std::chrono::milliseconds( 2 );
+			}
+		}
+		catch( rdr::Exception const& e ) {
+			_fail( s, e.str() );
+		}
+	}
+
+	// retries after reconnect_delay(), which resets once an update is shown.
+	void _fail( session_t& s, char const* const why ) {
+		__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "%s:%d: %s", s.screen->params.host.c_str(), s.screen->params.port, why );
+		if( s.state != session_t::connected ) {
+			s.address = address_t(); // it may have moved.
+		}
+		_disconnect( s );
+		s.connect_at = clock_type::now() + std::chrono::milliseconds( reconnect_delay( s.failures, _random ) );
+		++s.failures;
+	}
+
+	void _disconnect( session_t& s ) {
+		// the connection waits for its decoder threads, but not for its worker.
+		if( s.published.valid() ) {
+			s.published.wait();
+			s.published = std::future<void>();
+		}
+		s.conn.reset();
+		s.out.reset();
+		s.in.reset();
+		s.recording.reset();
+		if( s.fd >= 0 ) {
+			epoll_ctl( _epoll, EPOLL_CTL_DEL, s.fd, nullptr );
+			close( s.fd );
+			s.fd = -1;
+		}
+		s.state      = session_t::idle;
+		s.updated    = false;
+		s.retry_size = 0;
+		s.process_at = _never;
+		s.pointer_at = _never;
+		s.resume_at  = _never;
+	}
+
+	int                                     _epoll;
+	int                                     _event;
+	worker_pool_t                           _workers;
+	std::atomic<bool>                       _stop  = { false };
+	std::atomic<bool>                       _woken = { false };
+	std::mutex                              _added_mutex;
+	std::vector<std::shared_ptr<vnc_screen_t>> _added;
+	std::vector<std::unique_ptr<session_t>> _sessions; // the engine thread only.
+	std::mt19937                            _random = std::mt19937( std::random_device()() );
+	std::thread                             _thread;
+};
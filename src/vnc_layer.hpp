@@ -1,7 +1,9 @@
 // (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
 #pragma once
 #include <optional>
-#include "vnc_thread.hpp"
+#include "vnc_engine.hpp"
+#include "view_geometry.hpp"
+#include "upload_queue.hpp"
 
 
 namespace std {
@@ -14,159 +16,426 @@ namespace std {
 }
 
 struct vnc_layer_t {
-	~vnc_layer_t() {
-		if( _back_fbo != 0 ) {
-			glDeleteFramebuffers( 1, &_back_fbo );
+	void run( vnc_engine_t& engine, std::string host, int const port, std::string password, std::string record ) {
+		vnc_params_t params;
+		params.host     = std::move( host );
+		params.port     = port;
+		params.password = std::move( password );
+		params.quality  = quality;
+		params.scale    = decode_scale;
+		params.mipmap   = use_mipmap;
+		params.h264     = use_h264;
+		params.cursor   = use_pointer;
+		params.rgb565   = use_rgb565;
+		params.throttle = congestion_control;
+		params.record   = std::move( record );
+		_screen = engine.add( std::move( params ) );
+	}
+
+	// render thread, every frame before the queues are drained: takes the next
+	// region, whose copies and cursor go at once, and orders the tiles left
+	// by where the user looks.
+	void update( ovrTracking2 const& tracking ) {
+		if( _screen == nullptr ) {
+			return;
 		}
-		if( _frnt_fbo != 0 ) {
-			glDeleteFramebuffers( 1, &_frnt_fbo );
+		if( auto region = _screen->mailbox.take() ) {
+			_begin( *region );
+			_regions.push_back( { _serial, std::move( region ) } );
+		}
+
+		float fx, fy;
+		_update_view( tracking, fx, fy );
+		if( _queue.empty() ) {
+			return;
 		}
+		float const radians = float( M_PI ) / std::ldexp( resolution, -_scale );
+		_queue.prioritize( [&]( upload_queue_t::tile_t const& t ) {
+			rfb::Rect const r = { t.rect.tl.x << t.level, t.rect.tl.y << t.level, t.rect.br.x << t.level, t.rect.br.y << t.level };
+			return tile_cost( r, _visible, fx, fy, radians );
+		} );
 	}
 
-	void run( std::string host, int const port, std::string password, bool lossy ) {
-		_thread.run( std::move( host ), port, std::move( password ), lossy );
+	upload_queue_t& queue() {
+		return _queue;
 	}
 
-	void update() {
-		region_t const region = _thread.get_update_region();
-		if( region.buf == nullptr ) {
+	// a tile of queue().
+	void upload( upload_queue_t::tile_t const& t ) {
+		// the pixels are opaque (alpha = 1) as they come: they go straight
+		// into the texture which the layer shows.  no back chain, clear and
+		// blit: for 1920x1080, an estimated 4 B of GPU traffic a damaged
+		// texel instead of ~20, and 8-11 MB less texture memory (worked out
+		// from the formats, not measured on a device).
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, t.stride );
+		glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _chain.get(), 0 ) );
+		glTexSubImage2D( GL_TEXTURE_2D, t.level, t.rect.tl.x, t.rect.tl.y, t.rect.width(), t.rect.height(), GL_RGBA, GL_UNSIGNED_BYTE, t.pixels );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+		glBindTexture( GL_TEXTURE_2D, 0 );
+	}
+
+	// render thread, after the queues have been drained.  a region is done
+	// once none of its tiles is left, uploaded or replaced by newer ones.
+	// display_time: the predicted display time of the frame [s], for the trace.
+	void finish( double const display_time ) {
+		bool generate = false;
+		for( auto it = _regions.begin(); it != _regions.end(); ) {
+			region_t const& region = *it->region;
+			if( _queue.has( it->serial ) ) {
+				++it;
+				continue;
+			}
+
+			generate = generate || (use_mipmap && region.mips.empty() && (!region.rects.empty() || !region.copies.empty()));
+			if( region.read_at != 0 ) {
+				int64_t const now     = trace_now();
+				int64_t const display = int64_t( display_time * 1e9 );
+				latency_trace_t::record( trace_kind_t::queue,   region.decoded_at, now );
+				latency_trace_t::record( trace_kind_t::display, now,               display );
+				latency_trace_t::record( trace_kind_t::total,   region.read_at,    display );
+			}
+			// glTexSubImage2D() has already copied the pixels.
+			_screen->mailbox.recycle( std::move( it->region ) );
+			it = _regions.erase( it );
+		}
+
+		if( generate ) {
+			glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _chain.get(), 0 ) );
+			glGenerateMipmap( GL_TEXTURE_2D );
+			glBindTexture( GL_TEXTURE_2D, 0 );
+		}
+		if( _screen != nullptr ) {
+			_screen->mailbox.set_uploading( !_queue.empty() );
+		}
+	}
+
+	void handle_pointer( ovrTracking const& tracking, uint32_t const buttons ) {
+		if( !use_pointer || _screen == nullptr ) {
 			return;
 		}
 
-		if( _back_fbo == 0 ) {
-			glGenFramebuffers( 1, &_back_fbo );
+		OVR::Matrix4f const m = ovrMatrix4f_CreateFromQuaternion( &tracking.HeadPose.Pose.Orientation );
+		int iu = 0;
+		int iv = 0;
+		// while a button is held, the pointer stays on its monitor.
+		size_t const i = pointer_monitor( _monitors.size(), [&]( size_t const j, bool const clamp, int& u, int& v ) {
+			return _hit( _monitors[j], m, clamp, u, v );
+		}, _capturing, _pointer_monitor, iu, iv );
+		_pointer_in      = i < _monitors.size();
+		_pointer_monitor = _pointer_in ? i : _pointer_monitor;
+		if( _pointer_in ) {
+			bool button_0 = (buttons & ovrButton_A    ) != 0;
+			bool button_1 = (buttons & ovrButton_Enter) != 0;
+			pointer_event_t e;
+			e.x       = uint16_t( iu << _scale );
+			e.y       = uint16_t( iv << _scale );
+			e.buttons = (button_0 ? 1 : 0) | (button_1 ? 4 : 0);
+			_screen->pointer.push( e );
+			_capturing = button_0 || button_1;
+			_pointer_x = e.x;
+			_pointer_y = e.y;
+		}
+	}
+
+	// a cylinder for each monitor shown, all on the same texture.
+	std::vector<ovrLayerCylinder2> layers( ovrTracking2 const& tracking ) const {
+		std::vector<ovrLayerCylinder2> result;
+		if( _chain == nullptr ) {
+			return result;
+		}
+		for( auto const& monitor: _monitors ) {
+			result.push_back( _layer( tracking, _chain.get(), monitor ) );
 		}
-		if( _frnt_fbo == 0 ) {
-			glGenFramebuffers( 1, &_frnt_fbo );
+		return result;
+	}
+
+	// the cursor at the pointer, to be composited over layers(): the same
+	// cylinder as the monitor under it, whose texture coordinates are moved
+	// to the cursor.
+	std::optional<ovrLayerCylinder2> cursor_layer( ovrTracking2 const& tracking ) const {
+		if( _chain == nullptr || _cursor_chain == nullptr || !_pointer_in || _pointer_monitor >= _monitors.size() ) {
+			return std::nullopt;
 		}
+
+		monitor_t const& monitor = _monitors[_pointer_monitor];
+		ovrLayerCylinder2 layer = _layer( tracking, _cursor_chain.get(), monitor );
+		_set_texture( layer, cursor_texture(
+			monitor_texture( monitor.rect, resolution, _scale, _size_w, _size_h ),
+			monitor.rect, _scale, _size_w, _size_h, _pointer_x, _pointer_y, _cursor_w, _cursor_h, _cursor_hot_x, _cursor_hot_y
+		) );
+		return layer;
+	}
+
+	float            resolution         = std::numeric_limits<float>::quiet_NaN(); // [pixels / pi radians].
+	OVR::Matrix4f    transform;
+	// monitor i of the layout (from the left) is placed by monitor_transforms[i]
+	// instead, if the server has sent a layout of several; those without one
+	// are not shown.
+	std::vector<OVR::Matrix4f> monitor_transforms;
+	bool             use_pointer        = true;
+	bool             use_mipmap         = false;
+	bool             use_h264           = false;
+	bool             use_rgb565         = false;
+	int              decode_scale       = 0; // the desktop is decoded reduced by 2^decode_scale.
+	quality_bounds_t quality;
+	bool             cull_updates       = false;
+	bool             congestion_control = false;
+	float            view_margin        = float( M_PI / 12.0 ); // [radians] around the field of view.
+
+private:
+	// a part of the texture shown on its own cylinder.
+	struct monitor_t {
+		rfb::Rect     rect; // in texels.
+		OVR::Matrix4f transform;
+	};
+
+	// a region whose tiles are in the queue.
+	struct taken_t {
+		uint32_t                  serial;
+		std::unique_ptr<region_t> region;
+	};
+
+	// the copies and the cursor go at once, the pixels into the queue over
+	// the tiles left of the earlier regions.
+	void _begin( region_t& region ) {
+		_serial += 1;
 		if( _size_w != region.w || _size_h != region.h ) {
+			// the tiles left are of the old texture.
+			_queue.clear();
+			for( auto& taken: _regions ) {
+				_screen->mailbox.recycle( std::move( taken.region ) );
+			}
+			_regions.clear();
 			_size_w = region.w;
 			_size_h = region.h;
-
-			_back_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
-				VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, region.w, region.h, 1, 1
-			) );
-			unsigned const btex = vrapi_GetTextureSwapChainHandle( _back_chain.get(), 0 );
-			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, _back_fbo );
-			glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, btex, 0 );
+			_scale  = region.scale;
 
 			int const level = 1 + int( std::floor( std::log2( std::max( region.w, region.h ) ) ) );
-			_frnt_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
+			_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
 				VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, region.w, region.h, use_mipmap ? level : 1, 1
 			) );
-			unsigned const ftex = vrapi_GetTextureSwapChainHandle( _frnt_chain.get(), 0 );
-			glBindTexture( GL_TEXTURE_2D, ftex );
+			glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _chain.get(), 0 ) );
 			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );
 			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
-			GLfloat borderColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			GLfloat borderColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 			glTexParameterfv( GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor );
 			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, use_mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
 			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 2.0f );
-			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, _frnt_fbo );
-			glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ftex, 0 );
-		}
-		if( region.x0 < region.x1 && region.y0 < region.y1 ) {
-			uint32_t const* const buf = region.buf->data() + region.w * region.y0 + region.x0;
-			int const w = region.x1 - region.x0;
-			int const h = region.y1 - region.y0;
-			glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
-			glPixelStorei( GL_UNPACK_ROW_LENGTH, region.w );
-			glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _back_chain.get(), 0 ) );
-			glTexSubImage2D( GL_TEXTURE_2D, 0, region.x0, region.y0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf );
-
-			// XXX: use shaders.
-			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, _back_fbo );
-			glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
-			glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE );
-			glClear( GL_COLOR_BUFFER_BIT );
-			glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
-
-			glBindFramebuffer( GL_READ_FRAMEBUFFER, _back_fbo );
-			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, _frnt_fbo );
-			glBlitFramebuffer(
-				region.x0, region.y0, region.x1, region.y1,
-				region.x0, region.y0, region.x1, region.y1,
-				GL_COLOR_BUFFER_BIT, GL_NEAREST
-			);
-
-			if( use_mipmap ) {
-				glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _frnt_chain.get(), 0 ) );
-				glGenerateMipmap( GL_TEXTURE_2D );
+			_place();
+		}
+		if( region.monitors ) {
+			_layout = std::move( *region.monitors );
+			_place();
+		}
+		// the texels which the tiles left would have are moved with them.
+		if( !region.copies.empty() ) {
+			_copy_texels( region.copies );
+			for( auto const& c: region.copies ) {
+				_queue.move( c );
 			}
 		}
-
-		glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
-		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+		if( region.cursor != nullptr ) {
+			_set_cursor( *region.cursor );
+		}
 		glBindTexture( GL_TEXTURE_2D, 0 );
+
+		_queue.cover( region.rects, 0 );
+		_queue.push( region.rects, region.pixels.data(), 0, _serial );
+		// the decoder thread has reduced the damaged texels of each level.
+		for( size_t i = 0; i < region.mips.size(); ++i ) {
+			_queue.cover( region.mips[i].rects, int( i + 1 ) );
+			_queue.push( region.mips[i].rects, region.mips[i].pixels.data(), int( i + 1 ), _serial );
+		}
 	}
 
-	void handle_pointer( ovrTracking const& tracking, uint32_t const buttons ) {
-		if( !use_pointer ) {
+	// where the head ray m hits the monitor, in texels.  clamp: onto the monitor.
+	bool _hit( monitor_t const& monitor, OVR::Matrix4f const& m, bool const clamp, int& iu, int& iv ) const {
+		OVR::Matrix4f const n = monitor.transform.Inverted() * m;
+		float const d[3] = { n.M[0][2], n.M[1][2], n.M[2][2] };
+		// resolution is in desktop pixels.
+		return monitor_hit( d, monitor.rect, std::ldexp( resolution, -_scale ), clamp, iu, iv );
+	}
+
+	// the texels which the head may see before the next update arrives, and
+	// the point the user looks at (fx, fy): the pointer, or else the center of
+	// the view; NaN if neither is on the screen.  with cull_updates, the
+	// server is asked only for them.
+	void _update_view( ovrTracking2 const& tracking, float& fx, float& fy ) {
+		fx = std::numeric_limits<float>::quiet_NaN();
+		fy = std::numeric_limits<float>::quiet_NaN();
+		_visible = rfb::Rect();
+		if( _size_w == 0 ) {
 			return;
 		}
 
-		OVR::Matrix4f const m = transform.Inverted() * ovrMatrix4f_CreateFromQuaternion( &tracking.HeadPose.Pose.Orientation );
-		float const x = m.M[0][2];
-		float const y = m.M[1][2];
-		float const z = m.M[2][2];
-		float const u = std::atan2( x, z );
-		float const v = y / std::hypot( x, z );
-		int iu = int( std::floor( float( -resolution / M_PI ) * u + 0.5f * float( _size_w ) ) );
-		int iv = int( std::floor( float( +resolution / M_PI ) * v + 0.5f * float( _size_h ) ) );
-		if( _capturing ) {
-			iu = std::min( std::max( iu, 0 ), _size_w - 1 );
-			iv = std::min( std::max( iv, 0 ), _size_h - 1 );
+		float tan_x = 0.0f;
+		float tan_y = 0.0f;
+		for( size_t eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye ) {
+			ovrMatrix4f const& p = tracking.Eye[eye].ProjectionMatrix;
+			tan_x = std::max( tan_x, (1.0f + std::abs( p.M[0][2] )) / p.M[0][0] );
+			tan_y = std::max( tan_y, (1.0f + std::abs( p.M[1][2] )) / p.M[1][1] );
 		}
-		if( 0 <= iu && iu < _size_w && 0 <= iv && iv < _size_h ) {
-			bool button_0 = (buttons & ovrButton_A    ) != 0;
-			bool button_1 = (buttons & ovrButton_Enter) != 0;
-			_thread.push_mouse_event( iu, iv, button_0, button_1 );
-			_capturing = button_0 || button_1;
+
+		// the union of what the view may see of each monitor.
+		OVR::Matrix4f const head = ovrMatrix4f_CreateFromQuaternion( &tracking.HeadPose.Pose.Orientation );
+		rfb::Rect& r = _visible;
+		for( auto const& monitor: _monitors ) {
+			OVR::Matrix4f const m = monitor.transform.Inverted() * head;
+			view_t view;
+			for( int i = 0; i < 3; ++i ) {
+				view.right[i] = m.M[i][0];
+				view.up[i]    = m.M[i][1];
+				view.axis[i]  = m.M[i][2];
+			}
+			view.tan_x = widen_tan( tan_x, view_margin );
+			view.tan_y = widen_tan( tan_y, view_margin );
+
+			rfb::Rect const v = visible_rect( view, std::ldexp( resolution, -_scale ), monitor.rect.width(), monitor.rect.height() );
+			if( !v.is_empty() ) {
+				rfb::Rect const t = v.translate( monitor.rect.tl );
+				r = r.is_empty() ? t : r.union_boundary( t );
+			}
+			int iu, iv;
+			if( std::isnan( fx ) && _hit( monitor, head, false, iu, iv ) ) {
+				fx = float( iu );
+				fy = float( iv );
+			}
+		}
+		if( _pointer_in ) {
+			fx = std::ldexp( float( _pointer_x ), -_scale );
+			fy = std::ldexp( float( _pointer_y ), -_scale );
 		}
-	}
 
-	std::optional<ovrLayerCylinder2> layer( ovrTracking2 const& tracking ) const {
-		if( _frnt_chain == nullptr ) {
-			return std::nullopt;
+		if( !cull_updates ) {
+			return;
 		}
+		if( r.is_empty() ) {
+			_screen->set_view( rfb::Rect() );
+			return;
+		}
+		_screen->set_view( view_request( r, _scale ) );
+	}
+
+	void _place() {
+		_monitors = place_monitors<monitor_t>( _layout, monitor_transforms, transform, _size_w, _size_h );
+	}
 
-		float const sx = resolution / float( _size_w );
+	ovrLayerCylinder2 _layer( ovrTracking2 const& tracking, ovrTextureSwapChain* const chain, monitor_t const& monitor ) const {
+		rfb::Rect const& r = monitor.rect;
 		// the shape of cylinder is hard-coded in SDK: the header comment says it
 		// is 180 deg around, 60 deg vertical FOV.
 		//float const fy = float( std::sqrt( 3.0 ) * M_PI / 2.0 ) * float( _size_h ) / resolution;
 		// but actually it seems to have 90 deg vertical FOV...
-		float const fy = float( M_PI ) * float( _size_h ) / resolution;
-		OVR::Matrix4f const m_m = transform * OVR::Matrix4f::Scaling( 1.0f, fy, 1.0f );
+		float const fy = float( M_PI ) * std::ldexp( float( r.height() ), _scale ) / resolution;
+		OVR::Matrix4f const m_m = monitor.transform * OVR::Matrix4f::Scaling( 1.0f, fy, 1.0f );
 
 		ovrLayerCylinder2 layer = vrapi_DefaultLayerCylinder2();
 		layer.Header.SrcBlend = VRAPI_FRAME_LAYER_BLEND_ONE;
-		layer.Header.DstBlend = VRAPI_FRAME_LAYER_BLEND_SRC_ALPHA;
+		layer.Header.DstBlend = VRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA;
 		layer.Header.Flags |= VRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
 		layer.HeadPose = tracking.HeadPose;
 		for( size_t eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye ) {
-			layer.Textures[eye].ColorSwapChain = _frnt_chain.get();
+			layer.Textures[eye].ColorSwapChain = chain;
 			layer.Textures[eye].SwapChainIndex = 0;
 
 			layer.Textures[eye].TexCoordsFromTanAngles = (OVR::Matrix4f( tracking.Eye[eye].ViewMatrix ) * m_m).Inverted();
-			layer.Textures[eye].TextureMatrix.M[0][0] = sx;
-			layer.Textures[eye].TextureMatrix.M[0][2] = -0.5f * sx + 0.5f;
 		}
+		_set_texture( layer, monitor_texture( r, resolution, _scale, _size_w, _size_h ) );
 		return layer;
 	}
 
-	float         resolution  = std::numeric_limits<float>::quiet_NaN(); // [pixels / pi radians].
-	OVR::Matrix4f transform;
-	bool          use_pointer = true;
-	bool          use_mipmap  = false;
+	static void _set_texture( ovrLayerCylinder2& layer, texture_map_t const& t ) {
+		for( size_t eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye ) {
+			ovrMatrix4f& m = layer.Textures[eye].TextureMatrix;
+			m.M[0][0] = t.scale[0];
+			m.M[0][2] = t.offset[0];
+			m.M[1][1] = t.scale[1];
+			m.M[1][2] = t.offset[1];
+			layer.Textures[eye].TextureRect = { t.rect[0], t.rect[1], t.rect[2], t.rect[3] };
+		}
+	}
+
+	// the source and the destination of a copy overlap when scrolling, which
+	// glCopyImageSubData() does not allow: those go through a scratch texture.
+	void _copy_texels( std::vector<copy_rect_t> const& copies ) {
+		GLuint const tex = vrapi_GetTextureSwapChainHandle( _chain.get(), 0 );
+		for( auto const& c: copies ) {
+			rfb::Rect const src = c.source();
+			int const w = c.rect.width();
+			int const h = c.rect.height();
+			if( !src.overlaps( c.rect ) ) {
+				glCopyImageSubData( tex, GL_TEXTURE_2D, 0, src.tl.x, src.tl.y, 0, tex, GL_TEXTURE_2D, 0, c.rect.tl.x, c.rect.tl.y, 0, w, h, 1 );
+				continue;
+			}
+
+			if( _scratch_chain == nullptr || _scratch_w < w || _scratch_h < h ) {
+				_scratch_w = std::max( _scratch_w, w );
+				_scratch_h = std::max( _scratch_h, h );
+				_scratch_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
+					VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, _scratch_w, _scratch_h, 1, 1
+				) );
+			}
+			GLuint const tmp = vrapi_GetTextureSwapChainHandle( _scratch_chain.get(), 0 );
+			glCopyImageSubData( tex, GL_TEXTURE_2D, 0, src.tl.x, src.tl.y, 0, tmp, GL_TEXTURE_2D, 0, 0, 0, 0, w, h, 1 );
+			glCopyImageSubData( tmp, GL_TEXTURE_2D, 0, 0, 0, 0, tex, GL_TEXTURE_2D, 0, c.rect.tl.x, c.rect.tl.y, 0, w, h, 1 );
+		}
+	}
+
+	void _set_cursor( cursor_t const& cursor ) {
+		if( cursor.w == 0 || cursor.h == 0 ) {
+			_cursor_chain.reset();
+			return;
+		}
+
+		if( _cursor_chain == nullptr || _cursor_w != cursor.w || _cursor_h != cursor.h ) {
+			_cursor_chain = std::unique_ptr<ovrTextureSwapChain>( vrapi_CreateTextureSwapChain3(
+				VRAPI_TEXTURE_TYPE_2D, GL_SRGB8_ALPHA8, cursor.w, cursor.h, 1, 1
+			) );
+			glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _cursor_chain.get(), 0 ) );
+			// transparent around the cursor, which the layer covers the screen with.
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
+			GLfloat borderColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			glTexParameterfv( GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		}
+		_cursor_w     = cursor.w;
+		_cursor_h     = cursor.h;
+		_cursor_hot_x = cursor.hot_x;
+		_cursor_hot_y = cursor.hot_y;
+
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+		glBindTexture( GL_TEXTURE_2D, vrapi_GetTextureSwapChainHandle( _cursor_chain.get(), 0 ) );
+		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, cursor.w, cursor.h, GL_RGBA, GL_UNSIGNED_BYTE, cursor.pixels.data() );
+	}
 
-private:
 	int                                  _size_w = 0;
 	int                                  _size_h = 0;
-	std::unique_ptr<ovrTextureSwapChain> _back_chain;
-	std::unique_ptr<ovrTextureSwapChain> _frnt_chain;
-	unsigned                             _back_fbo = 0;
-	unsigned                             _frnt_fbo = 0;
-	vnc_thread_t                         _thread;
+	int                                  _scale  = 0;
+	std::unique_ptr<ovrTextureSwapChain> _chain;
+	std::unique_ptr<ovrTextureSwapChain> _scratch_chain; // for _copy_texels().
+	int                                  _scratch_w = 0;
+	int                                  _scratch_h = 0;
+	std::shared_ptr<vnc_screen_t>        _screen;
+	std::vector<taken_t>                 _regions; // taken, being uploaded, the oldest first.
+	uint32_t                             _serial = 0; // of the last region taken.
+	upload_queue_t                       _queue;  // the tiles of _regions not uploaded yet.
+	rfb::Rect                            _visible; // in texels, as of the last update().
+	std::vector<rfb::Rect>               _layout;   // the monitors sent by the server, in texels.
+	std::vector<monitor_t>               _monitors; // shown, each on its own cylinder.
 	bool                                 _capturing = false;
+	// the cursor which the server has sent, drawn at the pointer.
+	std::unique_ptr<ovrTextureSwapChain> _cursor_chain;
+	int                                  _cursor_w        = 0;
+	int                                  _cursor_h        = 0;
+	int                                  _cursor_hot_x    = 0;
+	int                                  _cursor_hot_y    = 0;
+	int                                  _pointer_x       = 0; // in desktop pixels.
+	int                                  _pointer_y       = 0;
+	bool                                 _pointer_in      = false;
+	size_t                               _pointer_monitor = 0; // in _monitors.
 };
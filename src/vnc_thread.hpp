@@ -1,52 +1,346 @@
 // (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
-#include <thread>
+#include <utility>
 #include <mutex>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <network/TcpSocket.h>
+#include <atomic>
 #include <rfb/Exception.h>
 #include <rfb/CConnection.h>
 #include <rfb/CMsgWriter.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/PixelFormat.h>
+#include <rfb/Region.h>
+#include <rfb/ScaledPixelBuffer.h>
 #include <rfb/CSecurity.h>
 #include <rfb/fenceTypes.h>
+#include <rfb/encodings.h>
+#include "mipmap.hpp"
+#include "tile_hash.hpp"
+#include "copy_rect.hpp"
+#include "zero_page.hpp"
+#include "quality_controller.hpp"
+#include "congestion_controller.hpp"
+#include "latency_trace.hpp"
+#include "view_geometry.hpp"
 
 using std::swap;
 
 
+struct mip_level_t {
+	std::vector<rfb::Rect> rects;
+	std::vector<uint32_t>  pixels;
+};
+
+// the cursor which the client draws at the pointer, in desktop pixels.
+struct cursor_t {
+	int                   w     = 0; // 0: hidden.
+	int                   h     = 0;
+	int                   hot_x = 0;
+	int                   hot_y = 0;
+	std::vector<uint32_t> pixels; // RGBA, premultiplied.
+};
+
+// a copy of the damaged part of a completed framebuffer update.
 struct region_t {
-	std::shared_ptr<std::vector<uint32_t>> buf;
-	int w  = 0;
-	int h  = 0;
-	int x0 = 0;
-	int y0 = 0;
-	int x1 = 0;
-	int y1 = 0;
+	int                                   w = 0;
+	int                                   h = 0;
+	int                                   scale = 0; // w, h and rects are in the desktop reduced by 2^scale.
+	std::vector<copy_rect_t>              copies; // applied to level 0 of the texture in order, before rects.
+	std::vector<rfb::Rect>                rects;
+	std::vector<uint32_t>                 pixels; // rects[i] packed row by row, one after another.
+	std::vector<mip_level_t>              mips;   // levels 1.. over rects, if the connection builds them.
+	std::unique_ptr<cursor_t>             cursor; // the new shape of the cursor, if it has changed.
+	std::optional<std::vector<rfb::Rect>> monitors; // the new layout of the monitors, if it has changed.
+	int64_t                               read_at    = 0; // trace: the first byte of the oldest update in it.  0: not traced.
+	int64_t                               decoded_at = 0; // trace: the end of the newest update in it.
+};
+
+// hands the newest region_t from the decoder thread to the render thread.
+// neither side ever waits for the other: both only exchange pointers.  the
+// render thread gives consumed regions back to reuse their storage.
+struct region_mailbox_t {
+	region_mailbox_t()                                     = default;
+	region_mailbox_t( region_mailbox_t&& )                 = delete;
+	region_mailbox_t( region_mailbox_t const& )            = delete;
+	region_mailbox_t& operator=( region_mailbox_t&& )      = delete;
+	region_mailbox_t& operator=( region_mailbox_t const& ) = delete;
+
+	~region_mailbox_t() {
+		delete _full.exchange( nullptr );
+		delete _free.exchange( nullptr );
+	}
+
+	// render thread.
+	std::unique_ptr<region_t> take() {
+		return std::unique_ptr<region_t>( _full.exchange( nullptr ) );
+	}
+
+	// render thread.
+	void recycle( std::unique_ptr<region_t> region ) {
+		delete _free.exchange( region.release() );
+	}
+
+	// decoder thread: the region which has not been taken yet, if any.
+	std::unique_ptr<region_t> take_back() {
+		return std::unique_ptr<region_t>( _full.exchange( nullptr ) );
+	}
+
+	// decoder thread.
+	std::unique_ptr<region_t> allocate() {
+		if( auto region = std::unique_ptr<region_t>( _free.exchange( nullptr ) ) ) {
+			return region;
+		}
+		return std::make_unique<region_t>();
+	}
+
+	// decoder thread.  must follow take_back(), so the slot is empty.
+	void publish( std::unique_ptr<region_t> region ) {
+		delete _full.exchange( region.release() );
+	}
+
+	// render thread, every frame: the tiles of the regions taken are not all
+	// uploaded yet.
+	void set_uploading( bool const uploading ) {
+		_uploading.store( uploading, std::memory_order_relaxed );
+	}
+
+	// decoder thread.
+	bool uploading() const {
+		return _uploading.load( std::memory_order_relaxed );
+	}
+
+private:
+	std::atomic<region_t*> _full      = { nullptr };
+	std::atomic<region_t*> _free      = { nullptr };
+	std::atomic<bool>      _uploading = { false };
 };
 
-struct pixel_buffer_t: rfb::FullFramePixelBuffer {
-	pixel_buffer_t( int const w, int const h ):
-		rfb::FullFramePixelBuffer( { 32, 24, false, true, 255, 255, 255, 0, 8, 16 }, w, h, nullptr, w ),
-		_damaged( INT_MAX, INT_MAX, 0, 0 )
+// the size x size tiles which rects touch, within bound: the runs of them
+// along each row, each merged into the run of the same columns above.
+inline std::vector<rfb::Rect> cover_tiles( std::vector<rfb::Rect> const& rects, rfb::Rect const& bound, int const size ) {
+	int const tx0 = bound.tl.x / size;
+	int const ty0 = bound.tl.y / size;
+	int const cols = (bound.br.x + size - 1) / size - tx0;
+	int const rows = (bound.br.y + size - 1) / size - ty0;
+	std::vector<uint8_t> marked( cols * rows );
+	for( auto const& r: rects ) {
+		for( int ty = r.tl.y / size; ty <= (r.br.y - 1) / size; ++ty ) {
+			for( int tx = r.tl.x / size; tx <= (r.br.x - 1) / size; ++tx ) {
+				marked[cols * (ty - ty0) + (tx - tx0)] = 1;
+			}
+		}
+	}
+
+	std::vector<rfb::Rect> tiles;
+	std::vector<size_t> above, below; // the runs which end on the row above, this row.
+	for( int ty = 0; ty < rows; ++ty ) {
+		for( int tx = 0; tx < cols; ) {
+			if( !marked[cols * ty + tx] ) {
+				++tx;
+				continue;
+			}
+			int const x0 = tx;
+			while( tx < cols && marked[cols * ty + tx] ) {
+				++tx;
+			}
+			rfb::Rect const t = rfb::Rect( (tx0 + x0) * size, (ty0 + ty) * size, (tx0 + tx) * size, (ty0 + ty + 1) * size ).intersect( bound );
+			auto const it = std::find_if( above.begin(), above.end(), [&]( size_t const i ) {
+				return tiles[i].tl.x == t.tl.x && tiles[i].br.x == t.br.x;
+			} );
+			if( it != above.end() ) {
+				tiles[*it].br.y = t.br.y;
+				below.push_back( *it );
+			}
+			else {
+				below.push_back( tiles.size() );
+				tiles.push_back( t );
+			}
+		}
+		swap( above, below );
+		below.clear();
+	}
+	return tiles;
+}
+
+// each rectangle costs a GL call.  a region covering most of its bounding
+// box is sent as the bounding box, and one made of many pieces as the tiles
+// which they touch, coarser until there are few.
+inline std::vector<rfb::Rect> simplify_region( rfb::Region const& region, int const max_rects = 16 ) {
+	std::vector<rfb::Rect> rects;
+	if( region.is_empty() ) {
+		return rects;
+	}
+
+	rfb::Rect const bound = region.get_bounding_rect();
+	region.get_rects( &rects );
+	int area = 0;
+	for( auto const& r: rects ) {
+		area += r.area();
+	}
+	if( 2 * area >= bound.area() ) {
+		rects.assign( 1, bound );
+		return rects;
+	}
+
+	// tiles beyond the bottom right of the bound make one rectangle at last.
+	for( int size = 32; int( rects.size() ) > max_rects; size *= 2 ) {
+		rects = cover_tiles( rects, bound, size );
+	}
+	return rects;
+}
+
+// the pixels of a closed connection, which the next one starts with.
+struct retained_frame_t {
+	int                  w     = 0;
+	int                  h     = 0;
+	int                  scale = 0;
+	framebuffer_pixels_t pixels;
+};
+
+// stores the desktop reduced by 2^scale in each direction (scale = 0: as is).
+// the partial blocks on the right and bottom edges of the desktop are dropped.
+struct pixel_buffer_t: rfb::ModifiablePixelBuffer, rfb::ScaledPixelBuffer {
+	pixel_buffer_t( int const w, int const h, int const scale ):
+		rfb::ModifiablePixelBuffer( { 32, 24, false, true, 255, 255, 255, 0, 8, 16 }, w, h ),
+		buffer( size_t( w >> scale ) * size_t( h >> scale ) ),
+		_scale( scale ),
+		_damaged( rfb::Rect( 0, 0, w >> scale, h >> scale ) )
 	{
-		buffer = std::make_shared<std::vector<uint32_t>>( w * h );
-		data = reinterpret_cast<uint8_t*>( buffer->data() );
+		_tiles.resize( size_w(), size_h() );
 	}
 
-	virtual void commitBufferRW( rfb::Rect const& rect ) override {
-		FullFramePixelBuffer::commitBufferRW( rect );
+	// takes over the pixels, which the render thread already has: nothing is damaged.
+	pixel_buffer_t( retained_frame_t&& frame ):
+		rfb::ModifiablePixelBuffer( { 32, 24, false, true, 255, 255, 255, 0, 8, 16 }, frame.w, frame.h ),
+		buffer( std::move( frame.pixels ) ),
+		_scale( frame.scale )
+	{
+		assert( int( buffer.size() ) == size_w() * size_h() );
+		_tiles.resize( size_w(), size_h() );
+		_tiles.reset( buffer.data() );
+	}
 
-		std::lock_guard<std::mutex> lock( _damaged_mutex );
-		_damaged = _damaged.union_boundary( rect );
+	// gives the pixels to keep, if set, on destruction.  CConnection has
+	// waited for the decoder threads before.
+	virtual ~pixel_buffer_t() {
+		if( keep != nullptr ) {
+			keep->w      = width();
+			keep->h      = height();
+			keep->scale  = _scale;
+			keep->pixels = std::move( buffer );
+		}
+	}
+
+	int size_w() const {
+		return width() >> _scale;
 	}
 
-	rfb::Rect damaged() {
-		rfb::Rect tmp( INT_MAX, INT_MAX, 0, 0 );
+	int size_h() const {
+		return height() >> _scale;
+	}
+
+	virtual rfb::ScaledPixelBuffer* getScaledPixelBuffer() override {
+		return this;
+	}
+
+	virtual int getScale() const override {
+		return _scale;
+	}
+
+	// CopyRect: the blocks move as they are if it is on their grid, which the
+	// render thread repeats on the texture.  ModifiablePixelBuffer moves the
+	// pixels of those off the grid, which are damage.
+	virtual void copyRect( rfb::Rect const& r, rfb::Point const& delta ) override {
+		int const m = (1 << _scale) - 1;
+		bool const aligned =
+			((r.tl.x | r.tl.y | delta.x | delta.y) & m) == 0 &&
+			((r.br.x & m) == 0 || r.br.x == width()) &&
+			((r.br.y & m) == 0 || r.br.y == height());
+		if( !aligned || !r.enclosed_by( getRect() ) || !r.translate( delta.negate() ).enclosed_by( getRect() ) ) {
+			rfb::ModifiablePixelBuffer::copyRect( r, delta );
+			return;
+		}
+
+		copy_rect_t const c = {
+			{ r.tl.x >> _scale, r.tl.y >> _scale, std::min( (r.br.x + m) >> _scale, size_w() ), std::min( (r.br.y + m) >> _scale, size_h() ) },
+			{ delta.x >> _scale, delta.y >> _scale },
+		};
+		if( c.rect.is_empty() ) {
+			return;
+		}
+		// the source and the destination overlap when scrolling.
+		rfb::Rect const src = c.source();
+		for( int i = 0; i < c.rect.height(); ++i ) {
+			int const y = c.delta.y > 0 ? c.rect.height() - 1 - i : i;
+			std::memmove(
+				buffer.data() + size_w() * (c.rect.tl.y + y) + c.rect.tl.x,
+				buffer.data() + size_w() * (src.tl.y + y) + src.tl.x,
+				sizeof( uint32_t ) * c.rect.width()
+			);
+		}
+		_copy( c );
+	}
+
+	// only CopyRect off the grid of the blocks reads the framebuffer back: the
+	// reduced pixels are expanded.
+	virtual rdr::U8 const* getBuffer( rfb::Rect const& r, int* const stride ) const override {
+		if( _scale == 0 ) {
+			*stride = width();
+			return reinterpret_cast<uint8_t const*>( buffer.data() + width() * r.tl.y + r.tl.x );
+		}
+
+		auto& tmp = _scratch[0];
+		tmp.resize( r.area() );
+		// the blocks on the edges of r may be being reduced by another thread.
+		std::lock_guard<std::mutex> lock( _edge_mutex );
+		for( int y = r.tl.y; y < r.br.y; ++y ) {
+			int const sy = std::min( y >> _scale, size_h() - 1 );
+			for( int x = r.tl.x; x < r.br.x; ++x ) {
+				int const sx = std::min( x >> _scale, size_w() - 1 );
+				tmp[(y - r.tl.y) * r.width() + (x - r.tl.x)] = buffer[size_w() * sy + sx];
+			}
+		}
+		*stride = r.width();
+		return reinterpret_cast<uint8_t const*>( tmp.data() );
+	}
+
+	// note: called concurrently from the decoder threads of rfb::DecodeManager.
+	virtual rdr::U8* getBufferRW( rfb::Rect const& r, int* const stride ) override {
+		if( _scale == 0 ) {
+			*stride = width();
+			return reinterpret_cast<uint8_t*>( buffer.data() + width() * r.tl.y + r.tl.x );
+		}
+
+		auto& tmp = _scratch[1];
+		tmp.resize( r.area() );
+		*stride = r.width();
+		return reinterpret_cast<uint8_t*>( tmp.data() );
+	}
+
+	virtual void commitBufferRW( rfb::Rect const& r ) override {
+		_damage( _scale == 0 ? r : _reduce( r, _scratch[1].data() ) );
+	}
+
+	// JPEG decoded with DCT scaling.  r is aligned to 2^scale.
+	virtual rdr::U8* getScaledBufferRW( rfb::Rect const& r, int* const stride ) override {
+		*stride = size_w();
+		return reinterpret_cast<uint8_t*>( buffer.data() + size_w() * (r.tl.y >> _scale) + (r.tl.x >> _scale) );
+	}
+
+	virtual void commitScaledBufferRW( rfb::Rect const& r ) override {
+		_damage( { r.tl.x >> _scale, r.tl.y >> _scale, r.br.x >> _scale, r.br.y >> _scale } );
+	}
+
+	// in reduced pixels.
+	rfb::Region damaged() {
+		rfb::Region tmp;
 		{
 			std::lock_guard<std::mutex> lock( _damaged_mutex );
 			swap( tmp, _damaged );
@@ -54,11 +348,137 @@ struct pixel_buffer_t: rfb::FullFramePixelBuffer {
 		return tmp;
 	}
 
-	std::shared_ptr<std::vector<uint32_t>> buffer;
+	// in reduced pixels, in order.  the damage has moved along with them:
+	// take this after damaged().  note: the decoder threads must be idle.
+	std::vector<copy_rect_t> copies() {
+		std::vector<copy_rect_t> tmp;
+		swap( tmp, _copies );
+		for( auto const& c: tmp ) {
+			_tiles.forget( c.rect );
+		}
+		return tmp;
+	}
+
+	// damaged less the tiles whose pixels are those copied out last time.
+	// note: the decoder threads must be idle.
+	rfb::Region changed( rfb::Region const& damaged ) {
+		return _tiles.filter( buffer.data(), damaged );
+	}
+
+	// note: the decoder threads must be idle, i.e. between framebuffer updates.
+	void copy_rects( std::vector<rfb::Rect> const& rects, region_t& dst ) const {
+		size_t size = 0;
+		for( auto const& r: rects ) {
+			size += r.area();
+		}
+		dst.w     = size_w();
+		dst.h     = size_h();
+		dst.scale = _scale;
+		dst.rects = rects;
+		dst.pixels.resize( size );
+
+		uint32_t* ptr = dst.pixels.data();
+		for( auto const& r: rects ) {
+			for( int y = r.tl.y; y < r.br.y; ++y ) {
+				// the decoders leave the 4th byte as it happens to be (0 or 0xff):
+				// make the texels opaque on the way.
+				uint32_t const* const src = buffer.data() + size_w() * y;
+				for( int x = r.tl.x; x < r.br.x; ++x ) {
+					*ptr++ = src[x] | 0xff000000u;
+				}
+			}
+		}
+	}
+
+	framebuffer_pixels_t buffer;
+	retained_frame_t*    keep = nullptr;
 
 private:
-	rfb::Rect  _damaged;
-	std::mutex _damaged_mutex;
+	void _damage( rfb::Rect const& r ) {
+		if( r.is_empty() ) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock( _damaged_mutex );
+		_damaged.assign_union( r );
+	}
+
+	void _copy( copy_rect_t const& c ) {
+		if( c.rect.is_empty() || (c.delta.x == 0 && c.delta.y == 0) ) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock( _damaged_mutex );
+		move_damage( _damaged, c );
+		_copies.push_back( c );
+	}
+
+	// box filter.  a block which r covers partly keeps its old value for the
+	// share outside r: a block split between rects ends up close to, but not
+	// exactly, the average of its pixels.
+	rfb::Rect _reduce( rfb::Rect const& r, uint32_t const* const src ) {
+		int const n = 1 << _scale;
+		rfb::Rect const d = {
+			r.tl.x >> _scale, r.tl.y >> _scale,
+			std::min( (r.br.x + n - 1) >> _scale, size_w() ), std::min( (r.br.y + n - 1) >> _scale, size_h() ),
+		};
+		// the blocks which r covers whole, [x0, x1) x [y0, y1), are its own.
+		int const x0 = std::min( (r.tl.x + n - 1) >> _scale, d.br.x );
+		int const y0 = std::min( (r.tl.y + n - 1) >> _scale, d.br.y );
+		int const x1 = std::max( r.br.x >> _scale, x0 );
+		int const y1 = std::max( r.br.y >> _scale, y0 );
+		for( int y = y0; y < y1; ++y ) {
+			for( int x = x0; x < x1; ++x ) {
+				_reduce_block( r, src, x, y );
+			}
+		}
+
+		// those on its edges are shared with the rects beside it, which the
+		// other decoder threads may commit at the same time.
+		std::lock_guard<std::mutex> lock( _edge_mutex );
+		for( int y = d.tl.y; y < d.br.y; ++y ) {
+			bool const inner = y0 <= y && y < y1;
+			for( int x = d.tl.x; x < (inner ? x0 : d.br.x); ++x ) {
+				_reduce_block( r, src, x, y );
+			}
+			for( int x = inner ? x1 : d.br.x; x < d.br.x; ++x ) {
+				_reduce_block( r, src, x, y );
+			}
+		}
+		return d;
+	}
+
+	void _reduce_block( rfb::Rect const& r, uint32_t const* const src, int const x, int const y ) {
+		int const n  = 1 << _scale;
+		int const u0 = std::max( x << _scale, r.tl.x );
+		int const u1 = std::min( (x + 1) << _scale, r.br.x );
+		int const v0 = std::max( y << _scale, r.tl.y );
+		int const v1 = std::min( (y + 1) << _scale, r.br.y );
+		uint32_t& dst = buffer[size_w() * y + x];
+		uint32_t const rest = n * n - (v1 - v0) * (u1 - u0);
+		uint32_t sr = rest * ((dst >>  0) & 0xff);
+		uint32_t sg = rest * ((dst >>  8) & 0xff);
+		uint32_t sb = rest * ((dst >> 16) & 0xff);
+		for( int v = v0; v < v1; ++v ) {
+			uint32_t const* const row = src + r.width() * (v - r.tl.y) - r.tl.x;
+			for( int u = u0; u < u1; ++u ) {
+				sr += (row[u] >>  0) & 0xff;
+				sg += (row[u] >>  8) & 0xff;
+				sb += (row[u] >> 16) & 0xff;
+			}
+		}
+		int const s = 2 * _scale;
+		uint32_t const half = (n * n) / 2;
+		dst = ((sr + half) >> s) | (((sg + half) >> s) << 8) | (((sb + half) >> s) << 16) | 0xff000000u;
+	}
+
+	// per decoder thread: [0] for getBuffer(), [1] for getBufferRW().
+	inline static thread_local std::vector<uint32_t> _scratch[2];
+
+	int                      _scale;
+	rfb::Region              _damaged;
+	std::vector<copy_rect_t> _copies; // guarded by _damaged_mutex, as they go together.
+	std::mutex               _damaged_mutex;
+	mutable std::mutex       _edge_mutex; // the blocks which rects share when reduced.
+	tile_hashes_t            _tiles;
 };
 
 struct user_password_getter_t: rfb::UserPasswdGetter {
@@ -74,42 +494,83 @@ struct user_password_getter_t: rfb::UserPasswdGetter {
 	}
 };
 
+// what the reader of the socket knows about the bytes a message is read from.
+struct receive_info_t {
+	int64_t arrived   = 0; // trace_now() when the first byte of the message was received.  0: unknown.
+	int64_t received  = 0; // when the last byte available was received.
+	size_t  available = 0; // the bytes available.
+};
+
+// what a connection asks the server for and does with the updates.
+struct connection_options_t {
+	quality_bounds_t quality;
+	int              scale    = 0;     // decode the desktop reduced by 2^scale.
+	bool             mipmap   = false; // build the mipmap of the updates on the CPU (region_t::mips).
+	bool             h264     = false; // prefer the Open H.264 encoding, if the server offers it, to Tight.
+	bool             cursor   = false; // the server sends the cursor shape (region_t::cursor) instead of drawing it.
+	bool             rgb565   = false; // 16 bits a pixel on the wire, which the decoders expand into the framebuffer.
+	bool             throttle = false; // pause the continuous updates while the link is congested (congestion_controller_t).
+};
+
 struct client_connection_t: rfb::CConnection {
 	inline static user_password_getter_t user_password_getter;
 
-	client_connection_t( std::string const& host, int const port, std::string pass, bool const lossy ):
-		socket( host.c_str(), port ),
-		_damaged( INT_MAX, INT_MAX, 0, 0 )
+	// is, os and frame are not owned.  see vnc_engine.hpp and replay.cpp.
+	// frame: the pixels of the previous connection, if any, are reused when the
+	// desktop has the same size.  it receives the pixels of this one in turn.
+	client_connection_t( region_mailbox_t* const mailbox, rdr::InStream* const is, rdr::OutStream* const os, std::string pass, connection_options_t const& options, retained_frame_t* const frame = nullptr ):
+		_mailbox( mailbox ),
+		_frame( frame ),
+		_pass( std::move( pass ) ),
+		_scale( options.scale ),
+		_mipmap( options.mipmap ),
+		_rgb565( options.rgb565 ),
+		_throttle( options.throttle ),
+		_encoding( options.h264 ? rfb::encodingH264 : rfb::encodingTight ),
+		_quality( options.quality )
 	{
-		user_password_getter_t::pass = std::move( pass );
-		cp.compressLevel = 1;
-		cp.qualityLevel  = lossy ? 8 : -1;
-		setStreams( &socket.inStream(), &socket.outStream() );
+		cp.compressLevel = _quality.compress();
+		cp.qualityLevel  = _quality.quality();
+		cp.supportsLocalCursor = options.cursor;
+		setStreams( is, os );
+		user_password_getter_t::pass = _pass;
 		initialiseProtocol();
 	}
 
-	region_t get_update_region() {
-		region_t region;
-		{
-			std::lock_guard<std::mutex> lock( _damaged_mutex );
-			if( auto fb = static_cast<pixel_buffer_t*>( getFramebuffer() ) ) {
-				region.buf = fb->buffer;
-				region.w   = fb->width();
-				region.h   = fb->height();
-				region.x0  = _damaged.tl.x;
-				region.y0  = _damaged.tl.y;
-				region.x1  = _damaged.br.x;
-				region.y1  = _damaged.br.y;
-				_damaged = { INT_MAX, INT_MAX, 0, 0 };
-			}
+	virtual ~client_connection_t() {
+		if( _uploaded + _skipped + _copied > 0 ) {
+			__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "uploaded %.1f MB, skipped %.1f MB of unchanged tiles, copied %.1f MB", 1e-6 * double( _uploaded ), 1e-6 * double( _skipped ), 1e-6 * double( _copied ) );
+		}
+		if( _congestion.pauses() > 0 ) {
+			__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "paused the updates %zu times for congestion (%.1f MB/s)", _congestion.pauses(), _congestion.bandwidth() * 1e-6 );
 		}
-		return region;
+		if( auto const fb = static_cast<pixel_buffer_t*>( getFramebuffer() ) ) {
+			fb->keep = _frame;
+		}
+	}
+
+	// processMsg() for one of the connections sharing a thread.
+	void process_msg( receive_info_t const& info = receive_info_t() ) {
+		user_password_getter_t::pass = _pass;
+		_receive     = info;
+		_receive_pos = unsigned( getInStream()->pos() );
+		processMsg();
 	}
 
 	virtual void serverInit() override {
 		CConnection::serverInit();
-		writer()->writeSetEncodings( rfb::encodingTight, true );
+		// the raw and zlib pixels come in this format; JPEG and H.264 are
+		// decoded into the framebuffer as they are.
+		if( _rgb565 ) {
+			rfb::PixelFormat const pf( 16, 16, false, true, 31, 63, 31, 11, 5, 0 );
+			cp.setPF( pf );
+			writer()->writeSetPixelFormat( pf );
+		}
+		// the others follow in the list, Tight first: a server without the
+		// preferred one falls back to it.
+		writer()->writeSetEncodings( _encoding, true );
 		writer()->writeFramebufferUpdateRequest( { 0, 0, cp.width, cp.height }, false );
+		_sent_view = { 0, 0, cp.width, cp.height };
 
 		{
 			std::lock_guard<std::mutex> lock( writer_mutex );
@@ -118,44 +579,75 @@ struct client_connection_t: rfb::CConnection {
 		setWriter( nullptr );
 	}
 
+	// the desktop pixels to keep up to date; empty: none, the updates pause.
+	// the pixels which come into view catch up with one update.
+	void set_view( rfb::Rect const& view ) {
+		_view = view;
+		if( writer_mt != nullptr ) {
+			_send_view();
+		}
+	}
+
 	// note: also called on serverInit message.
 	virtual void setDesktopSize( int const w, int const h ) override {
 		CConnection::setDesktopSize( w, h );
 		_resize();
+		_set_layout();
 	}
 
+	// cp.screenLayout is left as it was if the server has refused our request.
 	virtual void setExtendedDesktopSize( unsigned const reason, unsigned const result, int const w, int const h, rfb::ScreenSet const& layout ) override {
 		CConnection::setExtendedDesktopSize( reason, result, w, h, layout );
 		_resize();
+		_set_layout();
 	}
 
 	virtual void endOfContinuousUpdates() override {
 		CConnection::endOfContinuousUpdates(); // cp.supportsContinuousUpdates = true.
 
-		std::lock_guard<std::mutex> lock( writer_mutex );
-		writer_mt->writeEnableContinuousUpdates( true, 0, 0, cp.width, cp.height );
+		// also the response to pausing them.
+		rfb::Rect const r = _visible();
+		if( !r.is_empty() ) {
+			std::lock_guard<std::mutex> lock( writer_mutex );
+			writer_mt->writeEnableContinuousUpdates( true, r.tl.x, r.tl.y, r.width(), r.height() );
+		}
+		_sent_view = r;
 	}
 
 	virtual void framebufferUpdateStart() override {
 		CConnection::framebufferUpdateStart();
 
-		if( !cp.supportsContinuousUpdates ) {
+		if( !cp.supportsContinuousUpdates && !_sent_view.is_empty() ) {
 			std::lock_guard<std::mutex> lock( writer_mutex );
-			writer_mt->writeFramebufferUpdateRequest( { 0, 0, cp.width, cp.height }, true );
+			writer_mt->writeFramebufferUpdateRequest( _sent_view, true );
 		}
+		_update_at  = _receive.arrived != 0 ? _receive.arrived : trace_now();
+		_update_pos = unsigned( getInStream()->pos() );
 	}
 
+	// publishes the damaged pixels; CConnection has waited for the decoder
+	// threads.  what reads the stream stays here, the rest goes to executor.
 	virtual void framebufferUpdateEnd() override {
 		CConnection::framebufferUpdateEnd();
 
-		rfb::Rect new_damaged = static_cast<pixel_buffer_t*>( getFramebuffer() )->damaged();
-		{
-			std::lock_guard<std::mutex> lock( _damaged_mutex );
-			_damaged = _damaged.union_boundary( new_damaged );
+		int64_t const now     = trace_now();
+		int64_t const read_at = latency_trace_t::enabled() ? _update_at : 0;
+		if( read_at != 0 ) {
+			_probe_rtt();
+		}
+		_control_congestion( now );
+		quality_sample_t const sample = _sample( now );
+		if( executor ) {
+			executor( [this, now, read_at, sample]() {
+				_publish( now, read_at, sample );
+			} );
+		}
+		else {
+			_publish( now, read_at, sample );
 		}
 	}
 
-	// XXX
+	// the requests of the server are answered at once, as nothing is queued.
 	virtual void fence( rdr::U32 const flags, unsigned const len, char const* const data ) override {
 		CMsgHandler::fence( flags, len, data );
 
@@ -163,96 +655,342 @@ struct client_connection_t: rfb::CConnection {
 			std::lock_guard<std::mutex> lock( writer_mutex );
 			writer_mt->writeFence( flags & ~rfb::fenceFlagRequest, len, data );
 		}
+		// the response to _probe_rtt().
+		else if( _probe_at != 0 && len == sizeof( _probe_at ) && std::memcmp( data, &_probe_at, len ) == 0 ) {
+			latency_trace_t::record( trace_kind_t::rtt, _probe_at, trace_now() );
+			_probe_at = 0;
+		}
+		// the response to _control_congestion(): the data before it has arrived.
+		else if( _throttle && len == sizeof( _fence_seq ) && std::memcmp( data, &_fence_seq, len ) == 0 ) {
+			bool const paused = _congestion.paused();
+			int64_t const at = _receive.arrived != 0 ? _receive.arrived : trace_now();
+			_congestion.acknowledge( double( at ) * 1e-9, _receive_pos );
+			if( paused ) {
+				_send_view();
+			}
+		}
+	}
+
+	// the updates are paused until the server answers a fence.
+	bool paused() const {
+		return _congestion.paused();
+	}
+
+	// gives up waiting for the fence of the pause.
+	void resume() {
+		if( _congestion.paused() ) {
+			_congestion.reset();
+			_send_view();
+		}
 	}
 
 	virtual void setColourMapEntries( int, int, rdr::U16* ) override {}
 	virtual void bell() override {}
 	virtual void serverCutText( char const*, rdr::U32 ) override {}
-	virtual void setCursor( int, int, const rfb::Point&, rdr::U8 const* ) override {}
+	// in a framebuffer update, which publishes it.  data: RGBA, not premultiplied.
+	virtual void setCursor( int const w, int const h, rfb::Point const& hotspot, rdr::U8 const* const data ) override {
+		_cursor = std::make_unique<cursor_t>();
+		_cursor->w     = w;
+		_cursor->h     = h;
+		_cursor->hot_x = hotspot.x;
+		_cursor->hot_y = hotspot.y;
+		_cursor->pixels.resize( w * h );
+		for( int i = 0; i < w * h; ++i ) {
+			uint32_t const a = data[4 * i + 3];
+			uint32_t const r = (data[4 * i + 0] * a + 127) / 255;
+			uint32_t const g = (data[4 * i + 1] * a + 127) / 255;
+			uint32_t const b = (data[4 * i + 2] * a + 127) / 255;
+			_cursor->pixels[i] = r | (g << 8) | (b << 16) | (a << 24);
+		}
+	}
+
+	// the number of regions published.
+	size_t updates() const {
+		return _updates;
+	}
+
+	// [bytes] of level 0 handed to the render thread to upload.
+	uint64_t uploaded() const {
+		return _uploaded;
+	}
+
+	// [bytes] decoded, but not uploaded as their tiles have not changed.
+	uint64_t skipped() const {
+		return _skipped;
+	}
+
+	// [bytes] of level 0 moved within the texture instead of uploaded.
+	uint64_t copied() const {
+		return _copied;
+	}
+
+	mip_pyramid_t const& pyramid() const {
+		return _pyramid;
+	}
 
-	network::TcpSocket               socket;
 	std::mutex                       writer_mutex;
 	std::unique_ptr<rfb::CMsgWriter> writer_mt;
+	// runs the publishing of each update, e.g. on a worker thread; at once if
+	// empty.  no message may be processed until it has run.
+	std::function<void( std::function<void()> )> executor;
 
 private:
+
 	void _resize() {
-		{
-			auto pb = std::make_unique<pixel_buffer_t>( cp.width, cp.height );
-			std::lock_guard<std::mutex> lock( _damaged_mutex );
-			setFramebuffer( pb.release() );
-			_damaged = { INT_MAX, INT_MAX, 0, 0 };
+		auto const fb = static_cast<pixel_buffer_t*>( getFramebuffer() );
+		if( fb != nullptr && fb->width() == cp.width && fb->height() == cp.height ) {
+			// the same size again: the pixels are still valid.
+		}
+		else if( fb == nullptr && _frame != nullptr && _frame->w == cp.width && _frame->h == cp.height && _frame->scale == _scale ) {
+			setFramebuffer( new pixel_buffer_t( std::move( *_frame ) ) );
+			if( _mipmap ) {
+				auto const nfb = static_cast<pixel_buffer_t*>( getFramebuffer() );
+				_pyramid.resize( nfb->size_w(), nfb->size_h() );
+				_pyramid.rebuild( nfb->buffer.data() );
+			}
+		}
+		else {
+			setFramebuffer( new pixel_buffer_t( cp.width, cp.height, _scale ) );
+		}
+		if( _frame != nullptr ) {
+			*_frame = retained_frame_t();
 		}
 
 		if( cp.supportsContinuousUpdates ) {
 			assert( state() == RFBSTATE_NORMAL );
-			std::lock_guard<std::mutex> lock( writer_mutex );
-			writer_mt->writeEnableContinuousUpdates( true, 0, 0, cp.width, cp.height );
+			_sent_view = rfb::Rect();
+			_send_view();
 		}
 	}
 
-	std::mutex _damaged_mutex;
-	rfb::Rect  _damaged;
-};
+	// the screens of the layout in texels, from the left; empty if there is
+	// only one, which covers the desktop.
+	void _set_layout() {
+		std::vector<rfb::Rect> monitors = monitor_layout( cp.screenLayout, cp.width, cp.height, _scale );
+		auto const same = []( rfb::Rect const& x, rfb::Rect const& y ) {
+			return x.equals( y );
+		};
+		if( !_layout || !std::equal( monitors.begin(), monitors.end(), _layout->begin(), _layout->end(), same ) ) {
+			_layout   = monitors;
+			_monitors = std::move( monitors );
+		}
+	}
 
-struct vnc_thread_t {
-	vnc_thread_t()                                 = default;
-	vnc_thread_t( vnc_thread_t&& )                 = delete;
-	vnc_thread_t( vnc_thread_t const& )            = delete;
-	vnc_thread_t& operator=( vnc_thread_t&& )      = delete;
-	vnc_thread_t& operator=( vnc_thread_t const& ) = delete;
+	// empty while paused.
+	rfb::Rect _visible() const {
+		if( _congestion.paused() ) {
+			return rfb::Rect();
+		}
+		rfb::Rect const r = _view.intersect( { 0, 0, cp.width, cp.height } );
+		return r.is_empty() ? rfb::Rect() : r;
+	}
 
-	region_t get_update_region() {
-		if( auto const conn = std::atomic_load( &_connection ) ) {
-			return conn->get_update_region();
+	void _send_view() {
+		rfb::Rect const r = _visible();
+		if( r.equals( _sent_view ) ) {
+			return;
 		}
-		else {
-			return {};
+		std::lock_guard<std::mutex> lock( writer_mutex );
+		if( cp.supportsContinuousUpdates ) {
+			writer_mt->writeEnableContinuousUpdates( !r.is_empty(), r.tl.x, r.tl.y, r.width(), r.height() );
+		}
+		// the server has kept track of what has changed out of the view.
+		// without continuous updates, the requests are chained from framebufferUpdateStart().
+		bool const catch_up = cp.supportsContinuousUpdates ? !r.enclosed_by( _sent_view ) : _sent_view.is_empty();
+		if( !r.is_empty() && catch_up ) {
+			writer_mt->writeFramebufferUpdateRequest( r, true );
 		}
+		_sent_view = r;
 	}
 
-	void run( std::string host, int const port, std::string pass, bool const lossy ) {
-		std::thread( &vnc_thread_t::_process, this, std::move( host ), port, std::move( pass ), lossy ).detach();
-	}
+	// compares the tiles, updates the mipmap and hands the pixels to the
+	// render thread.  no message is processed meanwhile.
+	void _publish( int64_t const now, int64_t const read_at, quality_sample_t const& sample ) {
+		auto const fb = static_cast<pixel_buffer_t*>( getFramebuffer() );
+		rfb::Region const decoded = fb->damaged();
+		std::vector<copy_rect_t> copies = fb->copies();
+		rfb::Region damaged = fb->changed( decoded );
+		_skipped += 4 * (region_area( decoded ) - region_area( damaged ));
+		_copied  += 4 * region_area( copy_destinations( copies ) );
+		if( damaged.is_empty() && copies.empty() && _cursor == nullptr && !_monitors ) {
+			_adapt( sample, false );
+			return;
+		}
+		if( _mipmap ) {
+			if( _pyramid.w() != fb->size_w() || _pyramid.h() != fb->size_h() ) {
+				_pyramid.resize( fb->size_w(), fb->size_h() );
+			}
+			_pyramid.update( fb->buffer.data(), simplify_region( damaged.union_( copy_destinations( copies ) ) ) );
+		}
 
-	void push_mouse_event( uint16_t const x, uint16_t const y, bool const b0, bool const b1 ) {
-		if( auto const conn = std::atomic_load( &_connection ) ) {
-			std::lock_guard<std::mutex> lock( conn->writer_mutex );
-			int remaining = 0;
-			if( ioctl( conn->socket.getFd(), TIOCOUTQ, &remaining ) < 0 || remaining >= 2048 ) {
-				__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "ioctl()" );
-				return;
+		// the render thread has not taken the previous one: send both at once.
+		std::unique_ptr<region_t> region = _mailbox->take_back();
+		_adapt( sample, region != nullptr || _mailbox->uploading() );
+		if( region == nullptr ) {
+			region = _mailbox->allocate();
+			region->read_at  = read_at;
+			region->cursor   = std::move( _cursor );
+			region->copies   = std::move( copies );
+			region->monitors = std::exchange( _monitors, std::nullopt );
+		}
+		else {
+			if( _cursor != nullptr ) {
+				region->cursor = std::move( _cursor );
 			}
-			try {
-				conn->writer_mt->writePointerEvent( { x, y }, (b0 ? 1 : 0) | (b1 ? 4 : 0) );
+			if( _monitors ) {
+				region->monitors = std::exchange( _monitors, std::nullopt );
 			}
-			catch( rfb::Exception const& e ) {
-				__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "%s", e.str() );
+			// it is not uploaded after all.
+			_uploaded -= 4 * region->pixels.size();
+			if( region->w == fb->size_w() && region->h == fb->size_h() ) {
+				// its pixels are uploaded after its copies, so before these.
+				rfb::Region pending;
+				for( auto const& r: region->rects ) {
+					pending.assign_union( r );
+				}
+				for( auto const& c: copies ) {
+					move_damage( pending, c );
+				}
+				damaged.assign_union( pending );
+				region->copies.insert( region->copies.end(), copies.begin(), copies.end() );
 			}
+			else {
+				region->read_at = read_at;
+				region->copies  = std::move( copies );
+			}
+		}
+		region->decoded_at = 0;
+		if( read_at != 0 ) {
+			region->decoded_at = now;
+			latency_trace_t::record( trace_kind_t::decode, read_at, now );
 		}
+		std::vector<rfb::Rect> const rects = simplify_region( damaged );
+		fb->copy_rects( rects, *region );
+		_copy_mips( _mipmap ? simplify_region( damaged.union_( copy_destinations( region->copies ) ) ) : rects, *region );
+		_uploaded += 4 * region->pixels.size();
+		_mailbox->publish( std::move( region ) );
+		++_updates;
 	}
 
-private:
-	void _process( std::string const host, int const port, std::string const pass, bool const lossy ) {
-		while( true ) {
-			try {
-				auto const conn = std::make_shared<client_connection_t>( host, port, pass, lossy );
-				while( conn->state() != client_connection_t::RFBSTATE_NORMAL ) {
-					conn->processMsg();
-				}
-				assert( conn->writer_mt != nullptr );
-				std::atomic_store( &_connection, conn );
-				while( true ) {
-					conn->processMsg();
+	// the update which has just ended, for _adapt().
+	quality_sample_t _sample( int64_t const now ) {
+		int64_t const received = _receive.received != 0 ? std::max( _receive.received, _update_at ) : now;
+		// pos() wraps around after 2 GB.
+		unsigned const pos = unsigned( getInStream()->pos() );
+		size_t const consumed = pos - _receive_pos;
+		quality_sample_t s;
+		s.time    = double( now ) * 1e-9;
+		s.wire    = double( received - _update_at ) * 1e-9;
+		s.decode  = double( now - received ) * 1e-9;
+		s.bytes   = pos - _update_pos;
+		s.backlog = _receive.available > consumed ? _receive.available - consumed : 0;
+		return s;
+	}
+
+	// feeds the update to the controller and asks the server for its choice.
+	// behind: the render thread has not taken or not uploaded the last one.
+	void _adapt( quality_sample_t s, bool const behind ) {
+		s.behind = behind;
+		if( !_quality.update( s ) ) {
+			return;
+		}
+
+		__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "quality %d, compression %d (%.1f MB/s)", _quality.quality(), _quality.compress(), _quality.bandwidth() * 1e-6 );
+		cp.qualityLevel  = _quality.quality();
+		cp.compressLevel = _quality.compress();
+		std::lock_guard<std::mutex> lock( writer_mutex );
+		writer_mt->writeSetEncodings( _encoding, true );
+	}
+
+	// a fence request, at most once a second, which the server answers
+	// after all it has queued before.  a lost response is given up after 10 s.
+	void _probe_rtt() {
+		int64_t const now = trace_now();
+		bool const waiting = _probe_at != 0 && now - _probe_at < 10'000'000'000;
+		if( !cp.supportsFence || waiting || now - _probed_at < 1'000'000'000 ) {
+			return;
+		}
+		_probe_at  = now;
+		_probed_at = now;
+		std::lock_guard<std::mutex> lock( writer_mutex );
+		writer_mt->writeFence( rfb::fenceFlagRequest, sizeof( _probe_at ), reinterpret_cast<char const*>( &_probe_at ) );
+	}
+
+	// a fence after each update (one at a time) to measure the link, and a
+	// pause of the continuous updates before it while the link is congested.
+	void _control_congestion( int64_t const now ) {
+		if( !_throttle || !cp.supportsFence || !cp.supportsContinuousUpdates || _sent_view.is_empty() ) {
+			return;
+		}
+		unsigned const pos      = unsigned( getInStream()->pos() );
+		unsigned const received = _receive_pos + unsigned( _receive.available );
+		if( !_congestion.update( double( now ) * 1e-9, received, pos - _update_pos ) ) {
+			return;
+		}
+		if( _congestion.paused() ) {
+			_send_view();
+		}
+		++_fence_seq;
+		std::lock_guard<std::mutex> lock( writer_mutex );
+		writer_mt->writeFence( rfb::fenceFlagRequest, sizeof( _fence_seq ), reinterpret_cast<char const*>( &_fence_seq ) );
+	}
+
+	void _copy_mips( std::vector<rfb::Rect> const& rects, region_t& dst ) const {
+		auto const& levels = _pyramid.levels();
+		dst.mips.resize( _mipmap ? levels.size() : 0 );
+		for( size_t i = 0; i < dst.mips.size(); ++i ) {
+			auto const& src = levels[i];
+			auto& mip = dst.mips[i];
+			mip.rects.clear();
+			size_t size = 0;
+			for( auto const& r: rects ) {
+				rfb::Rect const d = mip_pyramid_t::level_rect( r, i + 1 ).intersect( { 0, 0, src.w, src.h } );
+				if( !d.is_empty() ) {
+					mip.rects.push_back( d );
+					size += d.area();
 				}
 			}
-			catch( rfb::Exception const& e ) {
-				__android_log_print( ANDROID_LOG_INFO, "ovrvnc", "%s", e.str() );
+			mip.pixels.resize( size );
+
+			uint32_t* ptr = mip.pixels.data();
+			for( auto const& r: mip.rects ) {
+				for( int y = r.tl.y; y < r.br.y; ++y ) {
+					uint32_t const* const row = src.pixels.data() + src.w * y;
+					std::copy( row + r.tl.x, row + r.br.x, ptr );
+					ptr += r.width();
+				}
 			}
-
-			std::atomic_store( &_connection, {} );
-			sleep( 1 );
 		}
 	}
 
-	std::shared_ptr<client_connection_t> _connection;
+	region_mailbox_t*       _mailbox;
+	retained_frame_t*       _frame;
+	std::string             _pass;
+	int                     _scale;
+	bool                    _mipmap;
+	bool                    _rgb565;
+	bool                    _throttle;
+	int                     _encoding; // preferred.
+	mip_pyramid_t           _pyramid;
+	size_t                  _updates  = 0;
+	uint64_t                _uploaded = 0;
+	uint64_t                _skipped  = 0;
+	uint64_t                _copied   = 0;
+	quality_controller_t    _quality;
+	congestion_controller_t _congestion;
+	uint32_t                _fence_seq = 0; // of the last fence of _congestion.
+	receive_info_t          _receive;
+	unsigned                _receive_pos = 0;
+	int64_t                 _update_at   = 0; // the first byte of the current update.
+	unsigned                _update_pos  = 0;
+	rfb::Rect               _view = { 0, 0, 0xffff, 0xffff }; // asked for by set_view().
+	rfb::Rect               _sent_view;                       // asked of the server.
+	// set by setCursor(), not published yet.
+	std::unique_ptr<cursor_t> _cursor;
+	// the layout of the monitors: the last one published, and the one not published yet.
+	std::optional<std::vector<rfb::Rect>> _layout;
+	std::optional<std::vector<rfb::Rect>> _monitors;
+	// trace.
+	int64_t                 _probe_at  = 0; // the fence request in flight.
+	int64_t                 _probed_at = 0;
 };
@@ -0,0 +1,107 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+
+// a zero-filled framebuffer, sized once on construction.  a large one takes
+// anonymous pages, which the OS maps to the zero page until they are written:
+// 8K costs nothing before its pixels come, and a resize does not stall the
+// connection to clear 130 MB.  a small one comes from calloc(), as the
+// syscall and the faults of a mapping of its own cost more than clearing it.
+// there is no resize(): the pixels are never cleared, so a buffer which shrank
+// and grew again would show the old ones.
+struct framebuffer_pixels_t {
+	// [bytes] from which the pixels are mapped.
+	static constexpr size_t mmap_threshold = 1 << 20;
+
+	framebuffer_pixels_t() = default;
+
+	explicit framebuffer_pixels_t( size_t const size ):
+		_size( size )
+	{
+		if( _mapped() ) {
+			void* const p = mmap( nullptr, size * sizeof( uint32_t ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if( p == MAP_FAILED ) {
+				throw std::bad_alloc();
+			}
+			_data = static_cast<uint32_t*>( p );
+		}
+		else if( size != 0 ) {
+			_data = static_cast<uint32_t*>( std::calloc( size, sizeof( uint32_t ) ) );
+			if( _data == nullptr ) {
+				throw std::bad_alloc();
+			}
+		}
+	}
+
+	framebuffer_pixels_t( framebuffer_pixels_t&& other ):
+		_data( std::exchange( other._data, nullptr ) ),
+		_size( std::exchange( other._size, 0 ) )
+	{
+	}
+
+	framebuffer_pixels_t& operator=( framebuffer_pixels_t&& other ) {
+		std::swap( _data, other._data );
+		std::swap( _size, other._size );
+		return *this;
+	}
+
+	// a moved one has no size, and free( nullptr ) does nothing.
+	~framebuffer_pixels_t() {
+		if( _mapped() ) {
+			munmap( _data, _size * sizeof( uint32_t ) );
+		}
+		else {
+			std::free( _data );
+		}
+	}
+
+	uint32_t* data() {
+		return _data;
+	}
+
+	uint32_t const* data() const {
+		return _data;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	uint32_t& operator[]( size_t const i ) {
+		return _data[i];
+	}
+
+	uint32_t const& operator[]( size_t const i ) const {
+		return _data[i];
+	}
+
+	uint32_t* begin() {
+		return _data;
+	}
+
+	uint32_t* end() {
+		return _data + _size;
+	}
+
+	uint32_t const* begin() const {
+		return _data;
+	}
+
+	uint32_t const* end() const {
+		return _data + _size;
+	}
+
+private:
+	bool _mapped() const {
+		return _size * sizeof( uint32_t ) >= mmap_threshold;
+	}
+
+	uint32_t* _data = nullptr;
+	size_t    _size = 0;
+};
@@ -0,0 +1,10 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the host tests (make check): a check which fails ends the test with 1.
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+
+#define CHECK( cond ) \
+	( (cond) ? void() : ( std::fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond ), std::exit( 1 ) ) )
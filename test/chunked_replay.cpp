@@ -0,0 +1,248 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// a server's stream fed to client_connection_t through resumable_in_stream_t
+// in chunks of random sizes, as the socket may give it, against the same
+// stream fed at once: each message which has not fully arrived is rewound and
+// read again, and the framebuffer at the end of every update must be the
+// same.  the stream has every rect the decoders read in pieces: Tight JPEG on
+// and off the grid of the reduced desktop (scale 1 and 2 decode it with DCT
+// scaling), fill and basic through zlib, CopyRect, Raw, H.264 (with
+// libavcodec), a resize, Bell and ServerCutText.  recordings given as the
+// arguments (host/replay's format) are fed the same way.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "vnc_engine.hpp"
+#include "recorder.hpp"
+#include "server_stream.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+// the stream of the Tight rects of zlib stream 0.
+struct deflater_t {
+	deflater_t() {
+		_zlib = {};
+		CHECK( deflateInit( &_zlib, 6 ) == Z_OK );
+	}
+
+	deflater_t( deflater_t const& )            = delete;
+	deflater_t& operator=( deflater_t const& ) = delete;
+
+	~deflater_t() {
+		deflateEnd( &_zlib );
+	}
+
+	// a basic Tight rect of r without a filter, whose pixels are at rgb, stride bytes a row.
+	void basic( server_stream_t& out, rfb::Rect const& r, uint8_t const* const rgb, int const stride ) {
+		std::vector<uint8_t> raw;
+		for( int y = 0; y < r.height(); ++y ) {
+			raw.insert( raw.end(), rgb + stride * y, rgb + stride * y + 3 * r.width() );
+		}
+		std::vector<uint8_t> z( deflateBound( &_zlib, raw.size() ) + 16 );
+		_zlib.next_in   = raw.data();
+		_zlib.avail_in  = raw.size();
+		_zlib.next_out  = z.data();
+		_zlib.avail_out = z.size();
+		CHECK( deflate( &_zlib, Z_SYNC_FLUSH ) == Z_OK );
+		size_t const size = z.size() - _zlib.avail_out;
+		out.rect( r.tl.x, r.tl.y, r.width(), r.height(), rfb::encodingTight );
+		out.u8( 0x00 );
+		out.compact_length( size );
+		out.bytes( z.data(), size );
+	}
+
+private:
+	z_stream _zlib;
+};
+
+std::vector<uint8_t> synthetic_stream() {
+	int w = 320, h = 240;
+	server_stream_t s;
+	s.handshake( w, h );
+	deflater_t zlib;
+#if defined( HAVE_H264 )
+	std::unique_ptr<h264_encoder_t> encoder;
+#endif
+	for( int t = 0; t < 24; ++t ) {
+		if( t == 12 ) {
+			w = 256;
+			h = 192;
+			s.update( 1 );
+			s.rect( 0, 0, w, h, rfb::pseudoEncodingDesktopSize );
+		}
+		std::vector<uint8_t> const rgb = moving_picture( w, h, t );
+		auto const at = [&]( int const x, int const y ) {
+			return rgb.data() + 3 * (w * y + x);
+		};
+
+		s.update( 7 );
+		// the corner: H.264, a stream from each desktop size on.
+		rfb::Rect const corner( 0, 0, 128, 96 );
+#if defined( HAVE_H264 )
+		if( h264_encoder_t::available() ) {
+			if( t % 12 == 0 ) {
+				encoder.reset( new h264_encoder_t( corner.width(), corner.height() ) );
+			}
+			std::vector<uint8_t> pixels;
+			for( int y = 0; y < corner.height(); ++y ) {
+				pixels.insert( pixels.end(), at( 0, y ), at( corner.width(), y ) );
+			}
+			s.h264( corner, encoder->encode( pixels ), t % 12 == 0 ? 1 : 0 );
+		}
+		else
+#endif
+		{
+			s.jpeg( corner, at( 0, 0 ), 3 * w, 8 );
+		}
+		// JPEG on the grid of 4 x 4, and off it.
+		s.jpeg( { 128, 0, w, h / 2 }, at( 128, 0 ), 3 * w, 8 );
+		s.jpeg( { 33, h / 2 + 1, 128, h / 2 + 64 }, at( 33, h / 2 + 1 ), 3 * w, 3 + t % 6 );
+		// a fill.
+		s.rect( w - 40, h - 40, 32, 32, rfb::encodingTight );
+		s.u8( 0x80 );
+		s.u8( uint8_t( 10 * t ) ); s.u8( 0x80 ); s.u8( uint8_t( 255 - 10 * t ) );
+		// basic, through the zlib stream which goes on across the updates.
+		zlib.basic( s, { 8, h - 24, 72, h - 8 }, at( 8, h - 24 ), 3 * w );
+		// a copy of what the corner has just decoded.
+		s.rect( w / 2, h / 2 + 8, 48, 32, rfb::encodingCopyRect );
+		s.u16( 16 );
+		s.u16( 16 + t % 8 );
+		// Raw, in the client's format.
+		s.rect( w - 72, h / 2 + 8, 64, 24, rfb::encodingRaw );
+		for( int y = 0; y < 24; ++y ) {
+			for( int x = 0; x < 64; ++x ) {
+				s.bytes( at( w - 72 + x, h / 2 + 8 + y ), 3 );
+				s.u8( 0 );
+			}
+		}
+
+		if( t % 5 == 0 ) {
+			s.u8( 2 ); // Bell.
+		}
+		if( t % 7 == 0 ) {
+			char const text[] = "the clipboard of the server";
+			s.u8( 3 ); // ServerCutText.
+			s.u8( 0 ); s.u8( 0 ); s.u8( 0 );
+			s.u32( sizeof( text ) - 1 );
+			s.bytes( reinterpret_cast<uint8_t const*>( text ), sizeof( text ) - 1 );
+		}
+	}
+	return s.data;
+}
+
+// the bytes a recording of host/replay's format holds.
+std::vector<uint8_t> recorded_stream( std::string const& path ) {
+	replay_in_stream_t is( path, false );
+	std::vector<uint8_t> data( is.size() );
+	is.readBytes( data.data(), int( data.size() ) );
+	return data;
+}
+
+// the framebuffer at the end of each update.
+struct hashing_connection_t: client_connection_t {
+	using client_connection_t::client_connection_t;
+
+	virtual void framebufferUpdateEnd() override {
+		client_connection_t::framebufferUpdateEnd();
+		auto const fb = static_cast<pixel_buffer_t const*>( getFramebuffer() );
+		// FNV-1a.
+		uint64_t hash = 14695981039346656037ull;
+		auto const add = [&]( uint32_t const x ) {
+			hash = (hash ^ x) * 1099511628211ull;
+		};
+		add( fb->size_w() );
+		add( fb->size_h() );
+		for( uint32_t const p: fb->buffer ) {
+			add( p );
+		}
+		hashes.push_back( hash );
+	}
+
+	std::vector<uint64_t> hashes;
+};
+
+struct replay_t {
+	std::vector<uint64_t> hashes;
+	std::vector<uint32_t> pixels; // the last framebuffer.
+	size_t                chunks  = 0;
+	size_t                rewinds = 0;
+};
+
+// stream in chunks of the sizes chunk() gives, parsed after each as the loop
+// of vnc_engine_t::_parse() does.  the engine waits for more of a large rect
+// before it tries again; here every chunk is tried, which rewinds more.
+replay_t replay( std::vector<uint8_t> const& stream, connection_options_t const& options, std::function<size_t()> const& chunk ) {
+	resumable_in_stream_t in;
+	null_out_stream_t     out;
+	region_mailbox_t      mailbox;
+	hashing_connection_t  conn( &mailbox, &in, &out, "", options );
+	replay_t result;
+	for( size_t p = 0; p < stream.size(); ) {
+		size_t const n = std::min( chunk(), stream.size() - p );
+		std::memcpy( in.reserve( n ), stream.data() + p, n );
+		in.commit( n );
+		p += n;
+		result.chunks += 1;
+		while( true ) {
+			size_t const size  = in.available();
+			auto const   state = conn.state();
+			in.mark();
+			try {
+				conn.process_msg();
+			}
+			catch( resumable_in_stream_t::underflow_t const& ) {
+				in.rewind();
+				result.rewinds += 1;
+				break;
+			}
+			if( in.available() == size && conn.state() == state ) {
+				break;
+			}
+		}
+		in.compact();
+		mailbox.recycle( mailbox.take() );
+	}
+	// the stream ends with a whole message.
+	CHECK( in.available() == 0 );
+	result.hashes = conn.hashes;
+	auto const& buffer = static_cast<pixel_buffer_t const*>( conn.getFramebuffer() )->buffer;
+	result.pixels.assign( buffer.begin(), buffer.end() );
+	return result;
+}
+
+void test_chunked( char const* const name, std::vector<uint8_t> const& stream ) {
+	for( int const scale: { 0, 1, 2 } ) {
+		connection_options_t options;
+		options.scale = scale;
+		replay_t const whole = replay( stream, options, [&]() {
+			return stream.size();
+		} );
+		CHECK( !whole.hashes.empty() );
+		for( int i = 0; i < 3; ++i ) {
+			// a few bytes now and then, as a message straddles two reads.
+			replay_t const chunked = replay( stream, options, [&]() {
+				return rng() % 4 == 0 ? 1 + rng() % 16 : 1 + rng() % 8192;
+			} );
+			std::printf( "%s, scale %d: %zu updates in %zu chunks, %zu messages rewound\n", name, scale, chunked.hashes.size(), chunked.chunks, chunked.rewinds );
+			CHECK( chunked.rewinds > 0 );
+			CHECK( chunked.hashes == whole.hashes && chunked.pixels == whole.pixels );
+		}
+	}
+}
+
+int main( int const argc, char** const argv ) {
+	std::vector<uint8_t> const stream = synthetic_stream();
+	CHECK( stream.size() > 0 );
+	test_chunked( "synthetic", stream );
+	for( int i = 1; i < argc; ++i ) {
+		test_chunked( argv[i], recorded_stream( argv[i] ) );
+	}
+	return 0;
+}
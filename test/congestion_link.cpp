@@ -0,0 +1,246 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// client_connection_t on a shaped link: host/load_server plays video at
+// 1280x720 through an emulated link of 3 MB/s, which queues whatever goes
+// beyond it as the buffers of Wi-Fi do.  the connection runs as vnc_engine_t
+// runs it, parsing what arrives in pieces through resumable_in_stream_t and
+// writing through nonblocking_out_stream_t, with the round trip probe of the
+// trace on: the fences of _probe_rtt() (8 bytes) and of the controller (4
+// bytes) must each reach their own path, and the pauses must go to the server
+// as EnableContinuousUpdates.  the time queued behind the updates is measured
+// by fences of the test's own, sent 10 times a second while the updates flow.
+// with the controller it must stay within a few updates; without it, it grows
+// to seconds.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "vnc_engine.hpp"
+#include "load_server.hpp"
+#include "check.hpp"
+
+
+double now() {
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+struct socket_t {
+	socket_t( int const port ) {
+		fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+		sockaddr_in addr = {};
+		addr.sin_family      = AF_INET;
+		addr.sin_port        = htons( port );
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		CHECK( connect( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0 );
+		int const one = 1;
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+		fcntl( fd, F_SETFL, O_NONBLOCK );
+	}
+
+	~socket_t() {
+		close( fd );
+	}
+
+	int fd;
+};
+
+// the test's probes: when each was sent, and a length of their own.
+size_t const probe_size = 12;
+
+// the fences and the ends of the continuous updates, as they arrive.
+struct probed_connection_t: client_connection_t {
+	using client_connection_t::client_connection_t;
+
+	virtual void fence( rdr::U32 const flags, unsigned const len, char const* const data ) override {
+		if( !(flags & rfb::fenceFlagRequest) ) {
+			if( len == sizeof( int64_t ) ) {
+				probes += 1;
+			}
+			else if( len == sizeof( uint32_t ) ) {
+				acknowledged += 1;
+			}
+			else if( len == probe_size ) {
+				int64_t at;
+				std::memcpy( &at, data, sizeof( at ) );
+				queued.push_back( 1e-9 * double( trace_now() - at ) );
+			}
+		}
+		client_connection_t::fence( flags, len, data );
+	}
+
+	virtual void endOfContinuousUpdates() override {
+		ends += 1;
+		client_connection_t::endOfContinuousUpdates();
+	}
+
+	size_t              probes       = 0; // the answers to _probe_rtt().
+	size_t              acknowledged = 0; // the answers to _control_congestion().
+	size_t              ends         = 0;
+	std::vector<double> queued; // [s] the round trips of the test's probes.
+};
+
+// a connection as vnc_engine_t runs it, on this thread.
+struct session_t {
+	session_t( int const port, connection_options_t const& options ):
+		sock( port ),
+		out( sock.fd, [this]( bool const w ) { waiting = w; } ),
+		conn( &mailbox, &in, &out, "", options )
+	{
+	}
+
+	// as vnc_engine_t::_receive() and _parse().
+	void receive() {
+		while( true ) {
+			uint8_t* const buf = in.reserve( 1 << 16 );
+			ssize_t const n = recv( sock.fd, buf, 1 << 16, 0 );
+			if( n > 0 ) {
+				in.commit( n, trace_now() );
+				received += n;
+				continue;
+			}
+			CHECK( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) );
+			if( errno != EINTR ) {
+				break;
+			}
+		}
+		while( true ) {
+			size_t const size  = in.available();
+			auto const   state = conn.state();
+			in.mark();
+			try {
+				conn.process_msg( { in.arrival(), in.last_arrival(), in.available() } );
+			}
+			catch( resumable_in_stream_t::underflow_t const& ) {
+				in.rewind();
+				break;
+			}
+			if( in.available() == size && conn.state() == state ) {
+				break;
+			}
+		}
+		in.compact();
+		if( conn.writer_mt != nullptr ) {
+			conn.set_view( { 0, 0, 0xffff, 0xffff } );
+		}
+	}
+
+	void flush() {
+		std::lock_guard<std::mutex> lock( conn.writer_mutex );
+		out.flush();
+	}
+
+	void probe() {
+		char data[probe_size] = {};
+		int64_t const at = trace_now();
+		std::memcpy( data, &at, sizeof( at ) );
+		std::lock_guard<std::mutex> lock( conn.writer_mutex );
+		conn.writer_mt->writeFence( rfb::fenceFlagRequest, probe_size, data );
+	}
+
+	socket_t                 sock;
+	bool                     waiting  = false;
+	size_t                   received = 0;
+	resumable_in_stream_t    in;
+	nonblocking_out_stream_t out;
+	region_mailbox_t         mailbox;
+	probed_connection_t      conn;
+};
+
+struct result_t {
+	double              bandwidth    = 0.0; // [bytes / s] received.
+	std::vector<double> queued;             // [s] sorted.
+	size_t              pauses       = 0;
+	size_t              ends         = 0;
+	size_t              probes       = 0;
+	size_t              acknowledged = 0;
+
+	double percentile( double const p ) const {
+		return queued[size_t( p * double( queued.size() - 1 ) )];
+	}
+};
+
+// secs: from the first update on.
+result_t run( int const port, double const secs, bool const throttle ) {
+	connection_options_t options;
+	options.throttle = throttle;
+	session_t s( port, options );
+	result_t result;
+	double t0         = 0.0;
+	size_t received0  = 0;
+	double next_probe = 0.0;
+	double paused_at  = 0.0; // 0: flowing.
+	while( t0 == 0.0 || now() - t0 < secs ) {
+		pollfd p = { s.sock.fd, short( POLLIN | (s.waiting ? POLLOUT : 0) ), 0 };
+		CHECK( poll( &p, 1, 10 ) >= 0 );
+		if( p.revents & POLLOUT ) {
+			s.flush();
+		}
+		if( p.revents & ~POLLOUT ) {
+			CHECK( !(p.revents & (POLLERR | POLLHUP)) );
+			s.receive();
+		}
+		// the render thread.
+		if( auto region = s.mailbox.take() ) {
+			if( t0 == 0.0 ) {
+				t0        = now();
+				received0 = s.received;
+			}
+			s.mailbox.recycle( std::move( region ) );
+		}
+
+		double const t = now();
+		if( s.conn.paused() ) {
+			result.pauses += paused_at == 0.0;
+			paused_at = paused_at == 0.0 ? t : paused_at;
+			// as vnc_engine_t, which gives up the fence after 5 s.
+			CHECK( t - paused_at < 5.0 );
+		}
+		else {
+			paused_at = 0.0;
+			if( t0 != 0.0 && t >= next_probe ) {
+				s.probe();
+				next_probe = t + 0.1;
+			}
+		}
+	}
+	result.bandwidth    = double( s.received - received0 ) / (now() - t0);
+	result.queued       = s.conn.queued;
+	result.ends         = s.conn.ends;
+	result.probes       = s.conn.probes;
+	result.acknowledged = s.conn.acknowledged;
+	std::sort( result.queued.begin(), result.queued.end() );
+	return result;
+}
+
+int main( int const argc, char** const argv ) {
+	load_server_t server( argv[0], { "-w", "video", "-s", "1280x720", "-b", "3" } );
+	// _probe_rtt() only runs while the latency is traced.
+	latency_trace_t::get().enable( "" );
+
+	double const link = 3e6;
+	result_t const paced   = run( test_port(), 5.0, true );
+	result_t const flowing = run( test_port(), 5.0, false );
+
+	std::printf( "with:    %.2f MB/s, queued p50 %.0f, p90 %.0f, max %.0f ms, %zu pauses\n", 1e-6 * paced.bandwidth, 1e3 * paced.percentile( 0.5 ), 1e3 * paced.percentile( 0.9 ), 1e3 * paced.queued.back(), paced.pauses );
+	std::printf( "without: %.2f MB/s, queued p50 %.0f, p90 %.0f, max %.0f ms\n", 1e-6 * flowing.bandwidth, 1e3 * flowing.percentile( 0.5 ), 1e3 * flowing.percentile( 0.9 ), 1e3 * flowing.queued.back() );
+	CHECK( paced.queued.size() >= 10 && flowing.queued.size() >= 10 );
+	// each fence to its own path.
+	CHECK( paced.probes >= 2 && flowing.probes >= 2 );
+	CHECK( paced.acknowledged > paced.pauses && flowing.acknowledged == 0 );
+	// each pause is answered with EndOfContinuousUpdates, as is the first SetEncodings.
+	CHECK( paced.pauses > 0 && paced.ends >= paced.pauses && flowing.ends == 1 );
+	// the link is used, not left idle by the pauses.
+	CHECK( paced.bandwidth > 0.75 * link && flowing.bandwidth > 0.9 * link );
+	// the buffers stay short with it and fill up without.
+	CHECK( paced.percentile( 0.9 ) < 0.5 );
+	CHECK( flowing.queued.back() > 1.0 && flowing.queued.back() > 3.0 * paced.percentile( 0.9 ) );
+	return 0;
+}
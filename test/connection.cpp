@@ -0,0 +1,256 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// client_connection_t without a server: the calls which CMsgReader makes as
+// it reads the messages, made directly, and the decoders' writes into the
+// framebuffer.  the shape of the cursor (pseudo-encoding Cursor) is published
+// premultiplied with its hotspot, even in an update of nothing else, and with
+// the pixels of an update the render thread has not taken yet.  an update
+// which changes nothing is not published.  the framebuffer across a resize to
+// the same size and across connections: a retained_frame_t of the same size
+// and scale is adopted as it is, with nothing to upload again.
+#include <random>
+#include <rdr/MemInStream.h>
+#include "vnc_thread.hpp"
+#include "recorder.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+// a connection whose server has sent nothing but what the test calls.
+struct connection_t {
+	connection_t( connection_options_t const& options, retained_frame_t* const frame = nullptr ):
+		is( nullptr, 0 ),
+		conn( &mailbox, &is, &os, "", options, frame )
+	{
+	}
+
+	pixel_buffer_t& fb() {
+		return *static_cast<pixel_buffer_t*>( conn.getFramebuffer() );
+	}
+
+	// as a decoder: r filled with colour.
+	void decode( rfb::Rect const& r, uint32_t const colour ) {
+		int stride;
+		uint32_t* const dst = reinterpret_cast<uint32_t*>( fb().getBufferRW( r, &stride ) );
+		for( int y = 0; y < r.height(); ++y ) {
+			std::fill( dst + stride * y, dst + stride * y + r.width(), colour );
+		}
+		fb().commitBufferRW( r );
+	}
+
+	region_mailbox_t    mailbox;
+	rdr::MemInStream    is;
+	null_out_stream_t   os;
+	client_connection_t conn;
+};
+
+// RGBA, not premultiplied, as CMsgReader gives the cursor.
+std::vector<rdr::U8> cursor_data( int const w, int const h ) {
+	std::vector<rdr::U8> data( 4 * w * h );
+	for( auto& x: data ) {
+		x = rdr::U8( rng() );
+	}
+	// the ends of each channel and of alpha.
+	rdr::U8 const ends[][4] = { { 255, 255, 255, 255 }, { 255, 255, 255, 0 }, { 0, 0, 0, 255 }, { 255, 0, 128, 1 }, { 200, 100, 50, 128 } };
+	for( size_t i = 0; i < sizeof( ends ) / sizeof( ends[0] ); ++i ) {
+		std::copy_n( ends[i], 4, &data[4 * i] );
+	}
+	return data;
+}
+
+void check_cursor( cursor_t const& cursor, int const w, int const h, rfb::Point const& hot, std::vector<rdr::U8> const& data ) {
+	CHECK( cursor.w == w && cursor.h == h && cursor.hot_x == hot.x && cursor.hot_y == hot.y );
+	CHECK( cursor.pixels.size() == size_t( w * h ) );
+	for( int i = 0; i < w * h; ++i ) {
+		uint32_t const p = cursor.pixels[i];
+		uint32_t const a = data[4 * i + 3];
+		CHECK( p >> 24 == a );
+		for( int c = 0; c < 3; ++c ) {
+			// rounded to the nearest.
+			double const exact = double( data[4 * i + c] ) * double( a ) / 255.0;
+			double const got   = double( (p >> (8 * c)) & 0xff );
+			CHECK( std::abs( got - exact ) <= 0.5 && got <= double( a ) );
+		}
+	}
+	CHECK( cursor.pixels[0] == 0xffffffffu );
+	CHECK( cursor.pixels[1] == 0x00000000u );
+	CHECK( cursor.pixels[2] == 0xff000000u );
+	CHECK( cursor.pixels[3] == 0x01010001u );
+	CHECK( cursor.pixels[4] == 0x80193264u );
+}
+
+void test_cursor() {
+	connection_options_t options;
+	options.cursor = true;
+	connection_t c( options );
+	rfb::ModifiablePixelBuffer* const fb = nullptr;
+	CHECK( c.conn.getFramebuffer() == fb );
+	c.conn.setDesktopSize( 64, 48 );
+
+	// the first update: the whole desktop.
+	c.conn.framebufferUpdateStart();
+	c.decode( { 0, 0, 64, 48 }, 0xff102030u );
+	c.conn.framebufferUpdateEnd();
+	auto region = c.mailbox.take();
+	CHECK( region != nullptr && region->cursor == nullptr && region->rects.size() == 1 && region->rects[0].equals( { 0, 0, 64, 48 } ) );
+	c.mailbox.recycle( std::move( region ) );
+	CHECK( c.conn.updates() == 1 );
+
+	// nothing but the cursor.
+	int const w = 24, h = 17;
+	rfb::Point const hot( 5, 11 );
+	std::vector<rdr::U8> const data = cursor_data( w, h );
+	c.conn.framebufferUpdateStart();
+	c.conn.setCursor( w, h, hot, data.data() );
+	c.conn.framebufferUpdateEnd();
+	region = c.mailbox.take();
+	CHECK( region != nullptr && region->rects.empty() && region->pixels.empty() && region->copies.empty() );
+	CHECK( region->cursor != nullptr );
+	check_cursor( *region->cursor, w, h, hot, data );
+	c.mailbox.recycle( std::move( region ) );
+	CHECK( c.conn.updates() == 2 );
+
+	// nothing new: the same pixels again, and no cursor.
+	c.conn.framebufferUpdateStart();
+	c.decode( { 8, 8, 16, 16 }, 0xff102030u );
+	c.conn.framebufferUpdateEnd();
+	CHECK( c.mailbox.take() == nullptr && c.conn.updates() == 2 );
+
+	// the cursor on top of pixels not taken yet: both arrive.
+	c.conn.framebufferUpdateStart();
+	c.decode( { 0, 0, 8, 8 }, 0xff405060u );
+	c.conn.framebufferUpdateEnd();
+	c.conn.framebufferUpdateStart();
+	c.conn.setCursor( w, h, hot, data.data() );
+	c.conn.framebufferUpdateEnd();
+	region = c.mailbox.take();
+	CHECK( region != nullptr && region->cursor != nullptr && region->rects.size() == 1 && region->rects[0].equals( { 0, 0, 8, 8 } ) );
+	check_cursor( *region->cursor, w, h, hot, data );
+	CHECK( region->pixels.size() == 64 && region->pixels[0] == 0xff405060u );
+	c.mailbox.recycle( std::move( region ) );
+
+	// and the other way around: the newer shape wins.
+	std::vector<rdr::U8> const other = cursor_data( 8, 9 );
+	c.conn.framebufferUpdateStart();
+	c.conn.setCursor( w, h, hot, data.data() );
+	c.conn.framebufferUpdateEnd();
+	c.conn.framebufferUpdateStart();
+	c.decode( { 8, 0, 16, 8 }, 0xff405060u );
+	c.conn.setCursor( 8, 9, { 0, 0 }, other.data() );
+	c.conn.framebufferUpdateEnd();
+	region = c.mailbox.take();
+	CHECK( region != nullptr && region->cursor != nullptr && region->rects.size() == 1 );
+	check_cursor( *region->cursor, 8, 9, { 0, 0 }, other );
+	c.mailbox.recycle( std::move( region ) );
+
+	// hidden.
+	c.conn.framebufferUpdateStart();
+	c.conn.setCursor( 0, 0, { 0, 0 }, nullptr );
+	c.conn.framebufferUpdateEnd();
+	region = c.mailbox.take();
+	CHECK( region != nullptr && region->cursor != nullptr && region->cursor->w == 0 && region->rects.empty() );
+}
+
+// a desktop of w x h, filled by the first update with colour, which is taken.
+void first_update( connection_t& c, int const w, int const h, uint32_t const colour ) {
+	c.conn.setDesktopSize( w, h );
+	c.conn.framebufferUpdateStart();
+	c.decode( { 0, 0, w, h }, colour );
+	c.conn.framebufferUpdateEnd();
+	int const sw = c.fb().size_w(), sh = c.fb().size_h();
+	auto region = c.mailbox.take();
+	CHECK( region != nullptr && region->w == sw && region->h == sh && region->rects.size() == 1 && region->rects[0].equals( { 0, 0, sw, sh } ) );
+	c.mailbox.recycle( std::move( region ) );
+}
+
+void test_resize() {
+	connection_t c( connection_options_t{} );
+	first_update( c, 64, 48, 0xff102030u );
+	pixel_buffer_t* const fb = &c.fb();
+	uint32_t* const pixels = fb->buffer.data();
+
+	// the same size again, as a server sends on a change of the layout: the
+	// same buffer with its pixels, and nothing to upload.
+	c.conn.setDesktopSize( 64, 48 );
+	CHECK( &c.fb() == fb && c.fb().buffer.data() == pixels && c.fb().buffer[64 * 48 - 1] == 0xff102030u );
+	CHECK( c.mailbox.take() == nullptr );
+	c.conn.framebufferUpdateStart();
+	c.decode( { 0, 0, 64, 48 }, 0xff102030u );
+	c.conn.framebufferUpdateEnd();
+	CHECK( c.mailbox.take() == nullptr && c.conn.updates() == 1 );
+
+	// another size: a new buffer, all of it damaged.
+	first_update( c, 80, 48, 0xff102030u );
+	CHECK( c.fb().width() == 80 && c.conn.updates() == 2 );
+}
+
+void test_retained() {
+	retained_frame_t frame;
+	connection_options_t options;
+	uint32_t const* pixels;
+	{
+		connection_t c( options, &frame );
+		first_update( c, 256, 128, 0xff102030u );
+		c.conn.framebufferUpdateStart();
+		c.decode( { 8, 8, 16, 16 }, 0xff405060u );
+		c.conn.framebufferUpdateEnd();
+		c.mailbox.recycle( c.mailbox.take() );
+		pixels = c.fb().buffer.data();
+		// not before the connection closes.
+		CHECK( frame.pixels.size() == 0 );
+	}
+	CHECK( frame.w == 256 && frame.h == 128 && frame.scale == 0 && frame.pixels.data() == pixels && frame.pixels.size() == 256 * 128 );
+
+	// the next connection to a desktop of the same size starts from it.
+	{
+		connection_t c( options, &frame );
+		c.conn.setDesktopSize( 256, 128 );
+		CHECK( c.fb().buffer.data() == pixels && frame.pixels.size() == 0 && frame.w == 0 );
+		CHECK( c.fb().buffer[0] == 0xff102030u && c.fb().buffer[256 * 8 + 8] == 0xff405060u );
+		// the server sends it all again: no pixels to upload, only the layout
+		// of the new connection.
+		c.conn.framebufferUpdateStart();
+		c.decode( { 0, 0, 256, 128 }, 0xff102030u );
+		c.decode( { 8, 8, 16, 16 }, 0xff405060u );
+		c.conn.framebufferUpdateEnd();
+		auto region = c.mailbox.take();
+		CHECK( region != nullptr && region->rects.empty() && region->pixels.empty() && region->copies.empty() );
+		CHECK( region->monitors && region->monitors->empty() );
+		c.mailbox.recycle( std::move( region ) );
+		// the pixels which differ from those of the last connection.
+		c.conn.framebufferUpdateStart();
+		c.decode( { 0, 0, 256, 128 }, 0xff102030u );
+		c.conn.framebufferUpdateEnd();
+		region = c.mailbox.take();
+		CHECK( region != nullptr && region->rects.size() == 1 && region->rects[0].equals( { 0, 0, 64, 64 } ) );
+		CHECK( region->pixels.size() == 64 * 64 && region->pixels[64 * 8 + 8] == 0xff102030u );
+	}
+	CHECK( frame.pixels.data() == pixels );
+
+	// another size or another scale: a new buffer, and the frame is dropped.
+	options.scale = 1;
+	for( int const w: { 256, 320 } ) {
+		{
+			connection_t c( w == 256 ? options : connection_options_t{}, &frame );
+			uint32_t const* const kept = frame.pixels.data();
+			CHECK( kept != nullptr );
+			first_update( c, w, 128, 0xff102030u );
+			CHECK( c.fb().buffer.data() != kept && c.fb().size_w() == w >> (w == 256) );
+			CHECK( frame.pixels.size() == 0 && frame.w == 0 );
+		}
+		CHECK( frame.w == w && frame.scale == (w == 256) );
+	}
+
+	// closed before the desktop size: the frame is left for the next one.
+	{
+		connection_t c( options, &frame );
+	}
+	CHECK( frame.w == 320 && frame.pixels.size() == 320 * 128 );
+}
+
+int main() {
+	test_cursor();
+	test_resize();
+	test_retained();
+	return 0;
+}
@@ -0,0 +1,194 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// CopyRect without uploads.  move_damage() and copy_destinations() on their
+// own, then pixel_buffer_t given random sequences of rects, copies (scrolls
+// overlapping their source among them) and deliveries to a simulated texture,
+// which repeats the copies and uploads the damage: the texture must end up as
+// the framebuffer each time.  copies off the grid of the reduced blocks are
+// damage instead.
+#include <random>
+#include "vnc_thread.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+bool contains( rfb::Region const& region, rfb::Rect const& r ) {
+	return region.intersect( r ).equals( rfb::Region( r ) );
+}
+
+void check_move_damage() {
+	// the damage copied out of moves along, that covered goes.
+	{
+		rfb::Region damage( rfb::Rect( 0, 0, 10, 10 ) );
+		move_damage( damage, { { 20, 0, 30, 10 }, { 20, 0 } } );
+		CHECK( damage.equals( rfb::Region( rfb::Rect( 0, 0, 10, 10 ) ).union_( rfb::Rect( 20, 0, 30, 10 ) ) ) );
+		move_damage( damage, { { 0, 0, 10, 10 }, { -40, 0 } } );
+		CHECK( damage.equals( rfb::Region( rfb::Rect( 20, 0, 30, 10 ) ) ) );
+	}
+	// a scroll by 4 rows of a rect damaged in part.
+	{
+		rfb::Region damage( rfb::Rect( 0, 10, 100, 12 ) );
+		move_damage( damage, { { 0, 4, 100, 100 }, { 0, 4 } } );
+		CHECK( damage.equals( rfb::Region( rfb::Rect( 0, 14, 100, 16 ) ) ) );
+	}
+	// undamaged pixels copied over damage: none left.
+	{
+		rfb::Region damage( rfb::Rect( 5, 5, 8, 8 ) );
+		move_damage( damage, { { 0, 0, 10, 10 }, { 0, 50 } } );
+		CHECK( damage.is_empty() );
+	}
+
+	std::vector<copy_rect_t> const copies = {
+		{ { 0, 0, 10, 10 }, { 1, 1 } },
+		{ { 5, 5, 20, 20 }, { -3, 0 } },
+	};
+	rfb::Region expected( rfb::Rect( 0, 0, 10, 10 ) );
+	expected.assign_union( rfb::Rect( 5, 5, 20, 20 ) );
+	CHECK( copy_destinations( copies ).equals( expected ) );
+	CHECK( copy_destinations( {} ).is_empty() );
+}
+
+// the texture of the render thread, which has pixels of w x h.
+struct texture_t {
+	texture_t( int const w, int const h ):
+		w( w ),
+		pixels( w * h, 0 )
+	{
+	}
+
+	void copy( copy_rect_t const& c ) {
+		std::vector<uint32_t> const old = pixels;
+		rfb::Rect const s = c.source();
+		for( int y = 0; y < c.rect.height(); ++y ) {
+			for( int x = 0; x < c.rect.width(); ++x ) {
+				pixels[w * (c.rect.tl.y + y) + c.rect.tl.x + x] = old[w * (s.tl.y + y) + s.tl.x + x];
+			}
+		}
+	}
+
+	void upload( framebuffer_pixels_t const& src, rfb::Region const& damage ) {
+		std::vector<rfb::Rect> rects;
+		damage.get_rects( &rects );
+		for( auto const& r: rects ) {
+			for( int y = r.tl.y; y < r.br.y; ++y ) {
+				for( int x = r.tl.x; x < r.br.x; ++x ) {
+					pixels[w * y + x] = src[w * y + x];
+				}
+			}
+		}
+	}
+
+	int                   w;
+	std::vector<uint32_t> pixels;
+};
+
+void commit( pixel_buffer_t& pb, rfb::Rect const& r ) {
+	int stride;
+	uint32_t* const dst = reinterpret_cast<uint32_t*>( pb.getBufferRW( r, &stride ) );
+	for( int y = 0; y < r.height(); ++y ) {
+		for( int x = 0; x < r.width(); ++x ) {
+			dst[stride * y + x] = rng() | 0xff000000u;
+		}
+	}
+	pb.commitBufferRW( r );
+}
+
+// the texture is the framebuffer once the copies are repeated in order and
+// the damage, taken first, is uploaded.  returns the number of the copies.
+size_t deliver( pixel_buffer_t& pb, texture_t& tex ) {
+	rfb::Region const damage = pb.damaged();
+	std::vector<copy_rect_t> const copies = pb.copies();
+	rfb::Rect const all( 0, 0, pb.size_w(), pb.size_h() );
+	for( auto const& c: copies ) {
+		CHECK( c.delta.x != 0 || c.delta.y != 0 );
+		CHECK( c.rect.enclosed_by( all ) && c.source().enclosed_by( all ) );
+		tex.copy( c );
+	}
+	tex.upload( pb.buffer, damage );
+	CHECK( tex.pixels.size() == pb.buffer.size() );
+	CHECK( std::equal( tex.pixels.begin(), tex.pixels.end(), pb.buffer.begin() ) );
+	return copies.size();
+}
+
+rfb::Rect random_rect( int const w, int const h ) {
+	int const x0 = uniform( 0, w - 1 );
+	int const y0 = uniform( 0, h - 1 );
+	return { x0, y0, uniform( x0 + 1, w ), uniform( y0 + 1, h ) };
+}
+
+void check_pixel_buffer( int const scale ) {
+	int const w = 97;
+	int const h = 61;
+	int const n = 1 << scale;
+	size_t copied = 0;
+	for( int i = 0; i < 300; ++i ) {
+		pixel_buffer_t pb( w, h, scale );
+		texture_t tex( pb.size_w(), pb.size_h() );
+		commit( pb, { 0, 0, w, h } );
+		deliver( pb, tex );
+		for( int j = 0; j < 30; ++j ) {
+			switch( uniform( 0, 3 ) ) {
+				case 0:
+					commit( pb, random_rect( w, h ) );
+					break;
+				case 1:
+				case 2: {
+					// on the grid of the blocks mostly, off it now and then.
+					bool const aligned = uniform( 0, 3 ) != 0;
+					int const g = aligned ? n : 1;
+					rfb::Rect r = random_rect( w / g, h / g );
+					r = { r.tl.x * g, r.tl.y * g, r.br.x * g, r.br.y * g };
+					// scrolls by a few blocks, the source overlapping.
+					rfb::Point const d = uniform( 0, 1 ) == 0 ?
+						rfb::Point( g * uniform( -2, 2 ), g * uniform( -2, 2 ) ) :
+						rfb::Point( g * uniform( -w / g, w / g ), g * uniform( -h / g, h / g ) );
+					r = r.intersect( rfb::Rect( 0, 0, w, h ).translate( d ) );
+					if( r.is_empty() ) {
+						break;
+					}
+					bool const off_grid = scale > 0 && ((r.tl.x | r.tl.y | d.x | d.y) & (n - 1)) != 0;
+					if( off_grid ) {
+						copied += deliver( pb, tex );
+					}
+					std::vector<uint32_t> const before( pb.buffer.begin(), pb.buffer.end() );
+					pb.copyRect( r, d );
+					if( scale == 0 ) {
+						// the pixels moved.
+						for( int y = r.tl.y; y < r.br.y; ++y ) {
+							for( int x = r.tl.x; x < r.br.x; ++x ) {
+								CHECK( pb.buffer[w * y + x] == before[w * (y - d.y) + x - d.x] );
+							}
+						}
+					}
+					if( off_grid ) {
+						// off the grid: damage, not a copy.
+						rfb::Region const damage = pb.damaged();
+						CHECK( pb.copies().empty() );
+						rfb::Rect const b = { r.tl.x >> scale, r.tl.y >> scale, std::min( (r.br.x + n - 1) >> scale, pb.size_w() ), std::min( (r.br.y + n - 1) >> scale, pb.size_h() ) };
+						CHECK( b.is_empty() || contains( damage, b ) );
+						tex.upload( pb.buffer, damage );
+					}
+					break;
+				}
+				case 3:
+					copied += deliver( pb, tex );
+					break;
+			}
+		}
+		copied += deliver( pb, tex );
+	}
+	// most of them were copies, not damage.
+	CHECK( copied > 1000 );
+}
+
+int main() {
+	check_move_damage();
+	for( int scale = 0; scale <= 2; ++scale ) {
+		check_pixel_buffer( scale );
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the parts of vnc_engine.hpp which do not need a server.
+// nonblocking_out_stream_t on one thread against a socketpair with a small
+// buffer: the reader stalls now and then, so the stream must keep what the
+// socket does not take, ask for EPOLLOUT and send it in order once flushed
+// again.  a blocking write would hang the test.  then a reader which never
+// reads: the stream gives up at 4 MB instead of growing without a bound.
+// worker_pool_t: every job runs once, its future is ready before done() and
+// carries what it throws.
+#include <atomic>
+#include <random>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "vnc_engine.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+struct socket_pair_t {
+	socket_pair_t() {
+		CHECK( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == 0 );
+		int const size = 1 << 12;
+		setsockopt( fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) );
+		fcntl( fds[1], F_SETFL, O_NONBLOCK );
+	}
+
+	~socket_pair_t() {
+		close( fds[0] );
+		close( fds[1] );
+	}
+
+	int fds[2];
+};
+
+bool writable( int const fd ) {
+	pollfd p = { fd, POLLOUT, 0 };
+	return poll( &p, 1, 0 ) == 1 && (p.revents & POLLOUT);
+}
+
+void read_some( int const fd, std::vector<uint8_t>& out, size_t const max ) {
+	std::vector<uint8_t> buf( max );
+	ssize_t const n = read( fd, buf.data(), buf.size() );
+	if( n > 0 ) {
+		out.insert( out.end(), buf.begin(), buf.begin() + n );
+	}
+}
+
+void test_stalled() {
+	socket_pair_t sp;
+	bool watching = false;
+	int  watches  = 0;
+	nonblocking_out_stream_t os( sp.fds[0], [&]( bool const w ) {
+		CHECK( w != watching );
+		watching = w;
+		watches += w;
+	} );
+
+	std::vector<uint8_t> sent;
+	std::vector<uint8_t> received;
+	for( int i = 0; i < 4000; ++i ) {
+		// a message, as CMsgWriter writes it: bytes, then a flush.
+		std::vector<uint8_t> msg( rng() % 2000 + 1 );
+		for( auto& x: msg ) {
+			x = uint8_t( rng() );
+		}
+		os.writeBytes( msg.data(), int( msg.size() ) );
+		os.flush();
+		sent.insert( sent.end(), msg.begin(), msg.end() );
+		CHECK( watching == (os.pending() > 0) );
+
+		bool const stalled = (i / 200) % 2 == 1;
+		if( !stalled ) {
+			read_some( sp.fds[1], received, rng() % 8192 );
+		}
+		// the engine on EPOLLOUT.
+		if( watching && writable( sp.fds[0] ) ) {
+			os.flush();
+		}
+	}
+	while( received.size() < sent.size() ) {
+		read_some( sp.fds[1], received, 1 << 16 );
+		if( watching ) {
+			os.flush();
+		}
+	}
+	CHECK( !watching );
+	CHECK( watches > 0 );
+	CHECK( received == sent );
+	CHECK( size_t( os.length() ) == sent.size() );
+}
+
+void test_given_up() {
+	socket_pair_t sp;
+	nonblocking_out_stream_t os( sp.fds[0], []( bool ) {} );
+	std::vector<uint8_t> const msg( 1 << 16 );
+	bool thrown = false;
+	try {
+		for( int i = 0; i < 128; ++i ) {
+			os.writeBytes( msg.data(), int( msg.size() ) );
+			os.flush();
+		}
+	}
+	catch( rdr::Exception const& ) {
+		thrown = true;
+	}
+	CHECK( thrown );
+}
+
+void test_pool() {
+	std::atomic<int> ran  = { 0 };
+	std::atomic<int> done = { 0 };
+	std::vector<std::future<void>> results;
+	{
+		worker_pool_t pool( 4, [&]() { done.fetch_add( 1 ); } );
+		for( int i = 0; i < 1000; ++i ) {
+			results.push_back( pool.run( [&ran, i]() {
+				ran.fetch_add( 1 );
+				if( i % 100 == 0 ) {
+					throw rdr::Exception( "job" );
+				}
+			} ) );
+		}
+		// each future is ready before its done().
+		while( done < 1000 ) {
+			int const n = done;
+			int ready = 0;
+			for( auto& r: results ) {
+				ready += r.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+			}
+			CHECK( ready >= n );
+			std::this_thread::yield();
+		}
+	}
+	CHECK( ran == 1000 );
+	for( size_t i = 0; i < results.size(); ++i ) {
+		bool thrown = false;
+		try {
+			results[i].get();
+		}
+		catch( rdr::Exception const& ) {
+			thrown = true;
+		}
+		CHECK( thrown == (i % 100 == 0) );
+	}
+}
+
+int main() {
+	test_stalled();
+	test_given_up();
+	test_pool();
+	return 0;
+}
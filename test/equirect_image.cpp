@@ -0,0 +1,188 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the background on the host: JPEG files decoded with their mipmap levels,
+// and the cache, which must find an image by its path, size and time without
+// hashing it, by its contents when touched or moved, and nothing when the
+// contents, the levels or the file itself differ.
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sys/time.h>
+#include "equirect_image.hpp"
+#include "rfb_encoder.hpp"
+#include "check.hpp"
+
+
+std::string const tmp = [] {
+	char dir[] = "/tmp/equirect_image.XXXXXX";
+	return std::string( mkdtemp( dir ) );
+}();
+
+// a smooth RGB image, the phase to tell them apart.
+std::vector<uint8_t> image( int const w, int const h, double const phase ) {
+	std::vector<uint8_t> rgb( 3 * w * h );
+	for( int y = 0; y < h; ++y ) {
+		for( int x = 0; x < w; ++x ) {
+			rgb[3 * (w * y + x) + 0] = uint8_t( 255 * x / w );
+			rgb[3 * (w * y + x) + 1] = uint8_t( 255 * y / h );
+			rgb[3 * (w * y + x) + 2] = uint8_t( 127.5 + 127.5 * std::sin( 0.05 * (x + y) + phase ) );
+		}
+	}
+	return rgb;
+}
+
+void write( std::string const& path, std::vector<uint8_t> const& data ) {
+	std::ofstream( path, std::ios::binary ).write( reinterpret_cast<char const*>( data.data() ), data.size() );
+}
+
+std::vector<uint8_t> read( std::string const& path ) {
+	std::ifstream is( path, std::ios::binary );
+	return { std::istreambuf_iterator<char>( is ), std::istreambuf_iterator<char>() };
+}
+
+void touch( std::string const& path, int const sec ) {
+	timeval const t[2] = { { sec, 0 }, { sec, 0 } };
+	CHECK( utimes( path.c_str(), t ) == 0 );
+}
+
+void check_decode() {
+	int const w = 203;
+	int const h = 101;
+	std::vector<uint8_t> const rgb = image( w, h, 0.0 );
+	std::string const path = tmp + "/a.jpg";
+	write( path, encode_jpeg( rgb.data(), 3 * w, w, h, 95 ) );
+
+	auto const flat = equirect_decode( path, false );
+	CHECK( !flat->compressed && !flat->mapped() );
+	CHECK( flat->levels.size() == 1 );
+	CHECK( flat->levels[0].w == w && flat->levels[0].h == h );
+	auto const* const px = static_cast<uint32_t const*>( flat->levels[0].data );
+	int error = 0;
+	for( int i = 0; i < w * h; ++i ) {
+		CHECK( px[i] >> 24 == 0xff );
+		for( int c = 0; c < 3; ++c ) {
+			error = std::max( error, std::abs( int( (px[i] >> (8 * c)) & 0xff ) - int( rgb[3 * i + c] ) ) );
+		}
+	}
+	CHECK( error < 24 );
+
+	auto const mip = equirect_decode( path, true );
+	CHECK( int( mip->levels.size() ) == mip_pyramid_t::count_levels( w, h ) );
+	for( size_t i = 0; i < mip->levels.size(); ++i ) {
+		CHECK( mip->levels[i].w == std::max( 1, w >> i ) && mip->levels[i].h == std::max( 1, h >> i ) );
+	}
+	CHECK( std::equal( px, px + w * h, static_cast<uint32_t const*>( mip->levels[0].data ) ) );
+
+	// not an image, and a JPEG cut short.
+	std::string const text = tmp + "/a.txt";
+	write( text, { 'n', 'o', 't', '\n' } );
+	bool thrown = false;
+	try {
+		equirect_decode( text, false );
+	}
+	catch( std::runtime_error const& ) {
+		thrown = true;
+	}
+	CHECK( thrown );
+	std::vector<uint8_t> cut = read( path );
+	cut.resize( cut.size() / 2 );
+	write( text, cut );
+	thrown = false;
+	try {
+		equirect_decode( text, false );
+	}
+	catch( std::runtime_error const& ) {
+		thrown = true;
+	}
+	// libjpeg pads a truncated stream with a warning: a picture or an error, not a crash.
+	CHECK( thrown || equirect_decode( text, false )->levels[0].w == w );
+}
+
+// the mapped levels are the decoded ones compressed.
+void check_levels( equirect_image_t const& mapped, equirect_image_t const& decoded ) {
+	CHECK( mapped.compressed && mapped.mapped() );
+	CHECK( mapped.levels.size() == decoded.levels.size() );
+	for( size_t i = 0; i < mapped.levels.size(); ++i ) {
+		auto const& m = mapped.levels[i];
+		auto const& d = decoded.levels[i];
+		CHECK( m.w == d.w && m.h == d.h );
+		std::vector<uint8_t> blocks( etc2_size( d.w, d.h ) );
+		etc2_encode( static_cast<uint32_t const*>( d.data ), d.w, d.h, blocks.data() );
+		CHECK( std::equal( blocks.begin(), blocks.end(), static_cast<uint8_t const*>( m.data ) ) );
+	}
+}
+
+void check_cache() {
+	int const w = 130;
+	int const h = 66;
+	std::string const dir  = tmp + "/cache";
+	std::string const path = tmp + "/b.jpg";
+	std::vector<uint8_t> const rgb = image( w, h, 1.0 );
+	write( path, encode_jpeg( rgb.data(), 3 * w, w, h, 90 ) );
+	touch( path, 1000 );
+
+	// a miss, then stored: the next is found without hashing.
+	equirect_cache_t cache( dir );
+	CHECK( cache.map( path, true ) == nullptr );
+	auto const decoded = equirect_decode( path, true );
+	CHECK( cache.store( *decoded ) );
+	CHECK( !cache.store( *cache.map( path, true ) ) );
+	CHECK( !cache.hashed );
+	check_levels( *equirect_cache_t( dir ).map( path, true ), *decoded );
+
+	// touched: hashed once, then found by the new time.
+	touch( path, 2000 );
+	CHECK( cache.map( path, true ) != nullptr && cache.hashed );
+	CHECK( cache.map( path, true ) != nullptr && !cache.hashed );
+
+	// copied elsewhere with the same contents: hashed, then by its path.
+	std::string const copy = tmp + "/c.jpg";
+	write( copy, read( path ) );
+	CHECK( cache.map( copy, true ) != nullptr && cache.hashed );
+	CHECK( cache.map( copy, true ) != nullptr && !cache.hashed );
+
+	// without the levels, or with other contents of the same size or not: nothing.
+	CHECK( cache.map( copy, false ) == nullptr );
+	std::vector<uint8_t> bytes = read( path );
+	bytes[bytes.size() / 2] ^= 1;
+	write( copy, bytes );
+	CHECK( cache.map( copy, true ) == nullptr && cache.hashed );
+	std::vector<uint8_t> const other = image( w, h, 2.0 );
+	write( copy, encode_jpeg( other.data(), 3 * w, w, h, 90 ) );
+	touch( copy, 2000 );
+	CHECK( cache.map( copy, true ) == nullptr && cache.hashed );
+	auto const decoded_other = equirect_decode( copy, false );
+	CHECK( cache.store( *decoded_other ) );
+	check_levels( *cache.map( copy, false ), *decoded_other );
+	CHECK( cache.map( path, true ) == nullptr );
+
+	// one file: the older one and stray temporaries are gone.
+	write( dir + "/equirect-0123456789abcdef.bin", { 1, 2, 3 } );
+	CHECK( cache.map( path, false ) == nullptr );
+	CHECK( cache.store( *equirect_decode( path, false ) ) );
+	CHECK( read( dir + "/equirect-0123456789abcdef.bin" ).empty() );
+	CHECK( cache.map( path, false ) != nullptr );
+
+	// a file cut short or changed under the same key is not mapped.
+	std::string const file = dir + "/" + equirect_cache_t::name;
+	bytes = read( file );
+	write( file, std::vector<uint8_t>( bytes.begin(), bytes.end() - 1 ) );
+	CHECK( cache.map( path, false ) == nullptr );
+	bytes[0] ^= 1;
+	write( file, bytes );
+	CHECK( cache.map( path, false ) == nullptr );
+
+	// nowhere to write.
+	equirect_cache_t none( "/proc/equirect_image" );
+	CHECK( none.map( path, false ) == nullptr );
+	CHECK( !none.store( *equirect_decode( path, false ) ) );
+	// no source.
+	CHECK( cache.map( tmp + "/none.jpg", false ) == nullptr );
+	CHECK( !cache.store( *equirect_decode( path, false ) ) );
+}
+
+int main() {
+	check_decode();
+	check_cache();
+	std::system( ("rm -rf " + tmp).c_str() );
+	return 0;
+}
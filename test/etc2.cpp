@@ -0,0 +1,170 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the ETC2 encoder against a decoder written from the specification, which
+// also rejects a differential block whose second color overflows (a mode of
+// ETC2 which the encoder does not mean): flat blocks of any color, smooth
+// gradients and noise, the edges of sizes which are not multiples of 4, and
+// the threads giving the same blocks as one.
+#include <cmath>
+#include <random>
+#include "etc2.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int const modifiers[8][4] = {
+	{ 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+	{ 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 },
+};
+
+void decode_block( uint8_t const* const src, uint32_t px[16] ) {
+	uint64_t v = 0;
+	for( int i = 0; i < 8; ++i ) {
+		v = (v << 8) | src[i];
+	}
+	bool const diff = (v >> 33) & 1;
+	bool const flip = (v >> 32) & 1;
+	int base[2][3];
+	for( int c = 0; c < 3; ++c ) {
+		if( diff ) {
+			int const c1 = int( v >> (59 - 8 * c) ) & 31;
+			int const d  = int( v >> (56 - 8 * c) ) & 7;
+			int const c2 = c1 + (d >= 4 ? d - 8 : d);
+			CHECK( 0 <= c2 && c2 <= 31 );
+			base[0][c] = (c1 << 3) | (c1 >> 2);
+			base[1][c] = (c2 << 3) | (c2 >> 2);
+		}
+		else {
+			int const c1 = int( v >> (60 - 8 * c) ) & 15;
+			int const c2 = int( v >> (56 - 8 * c) ) & 15;
+			base[0][c] = c1 * 17;
+			base[1][c] = c2 * 17;
+		}
+	}
+	int const table[2] = { int( v >> 37 ) & 7, int( v >> 34 ) & 7 };
+	for( int y = 0; y < 4; ++y ) {
+		for( int x = 0; x < 4; ++x ) {
+			int const j    = 4 * x + y;
+			int const idx  = int( ((v >> (16 + j)) & 1) << 1 | ((v >> j) & 1) );
+			int const half = flip ? y / 2 : x / 2;
+			uint32_t p = 0xff000000u;
+			for( int c = 0; c < 3; ++c ) {
+				p |= uint32_t( std::min( std::max( base[half][c] + modifiers[table[half]][idx], 0 ), 255 ) ) << (8 * c);
+			}
+			px[4 * y + x] = p;
+		}
+	}
+}
+
+std::vector<uint32_t> decode( std::vector<uint8_t> const& src, int const w, int const h ) {
+	int const bw = (w + 3) / 4;
+	std::vector<uint32_t> dst( w * h );
+	for( int y = 0; y < h; ++y ) {
+		for( int x = 0; x < w; ++x ) {
+			uint32_t px[16];
+			decode_block( src.data() + 8 * (bw * (y / 4) + x / 4), px );
+			dst[w * y + x] = px[4 * (y % 4) + x % 4];
+		}
+	}
+	return dst;
+}
+
+int max_error( std::vector<uint32_t> const& a, std::vector<uint32_t> const& b ) {
+	int e = 0;
+	for( size_t i = 0; i < a.size(); ++i ) {
+		for( int c = 0; c < 3; ++c ) {
+			e = std::max( e, std::abs( int( (a[i] >> (8 * c)) & 0xff ) - int( (b[i] >> (8 * c)) & 0xff ) ) );
+		}
+	}
+	return e;
+}
+
+double psnr( std::vector<uint32_t> const& a, std::vector<uint32_t> const& b ) {
+	double sse = 0.0;
+	for( size_t i = 0; i < a.size(); ++i ) {
+		for( int c = 0; c < 3; ++c ) {
+			double const d = double( (a[i] >> (8 * c)) & 0xff ) - double( (b[i] >> (8 * c)) & 0xff );
+			sse += d * d;
+		}
+	}
+	return 10.0 * std::log10( 255.0 * 255.0 * 3.0 * double( a.size() ) / std::max( sse, 1e-9 ) );
+}
+
+std::vector<uint32_t> encode_decode( std::vector<uint32_t> const& src, int const w, int const h ) {
+	std::vector<uint8_t> etc( etc2_size( w, h ) );
+	etc2_encode( src.data(), w, h, etc.data() );
+	return decode( etc, w, h );
+}
+
+int main() {
+	// flat: within the step of the 5 bit colors and the least offset.
+	for( int i = 0; i < 20000; ++i ) {
+		std::vector<uint32_t> const src( 16, rng() | 0xff000000u );
+		CHECK( max_error( src, encode_decode( src, 4, 4 ) ) <= 6 );
+	}
+	// two colors, one in each half: the individual mode is exact to 4 bits.
+	for( int i = 0; i < 4096; ++i ) {
+		uint32_t const a = 0xff000000u | (i & 15) * 0x11u | ((i >> 4) & 15) * 0x1100u | ((i >> 8) & 15) * 0x110000u;
+		uint32_t const b = 0xff000000u | (15 - (i & 15)) * 0x11u | (15 - ((i >> 4) & 15)) * 0x1100u | ((i >> 8) & 15) * 0x110000u;
+		std::vector<uint32_t> src( 16 );
+		for( int j = 0; j < 16; ++j ) {
+			src[j] = j % 4 < 2 ? a : b;
+		}
+		CHECK( max_error( src, encode_decode( src, 4, 4 ) ) <= 2 );
+	}
+
+	// a smooth gradient, and the same with noise.
+	int const w = 256;
+	int const h = 192;
+	std::vector<uint32_t> smooth( w * h ), noisy( w * h );
+	for( int y = 0; y < h; ++y ) {
+		for( int x = 0; x < w; ++x ) {
+			int const r = x;
+			int const g = y;
+			int const b = int( 127.5 + 127.5 * std::sin( 0.05 * (x + y) ) );
+			smooth[w * y + x] = 0xff000000u | r | g << 8 | b << 16;
+			uint32_t q = 0xff000000u;
+			for( int c = 0; c < 3; ++c ) {
+				int const v = int( (smooth[w * y + x] >> (8 * c)) & 0xff ) + int( rng() % 17 ) - 8;
+				q |= uint32_t( std::min( std::max( v, 0 ), 255 ) ) << (8 * c);
+			}
+			noisy[w * y + x] = q;
+		}
+	}
+	CHECK( psnr( smooth, encode_decode( smooth, w, h ) ) > 36.0 );
+	CHECK( psnr( noisy, encode_decode( noisy, w, h ) ) > 30.0 );
+
+	// the edges: the texels beyond them are the last ones repeated.
+	for( int sh = 1; sh <= 9; ++sh ) {
+		for( int sw = 1; sw <= 9; ++sw ) {
+			std::vector<uint32_t> src( sw * sh );
+			for( int y = 0; y < sh; ++y ) {
+				for( int x = 0; x < sw; ++x ) {
+					src[sw * y + x] = smooth[w * (y + 50) + x + 50];
+				}
+			}
+			CHECK( etc2_size( sw, sh ) == 8 * size_t( (sw + 3) / 4 ) * size_t( (sh + 3) / 4 ) );
+			CHECK( psnr( src, encode_decode( src, sw, sh ) ) > 36.0 );
+		}
+	}
+
+	// the threads split the rows of blocks.
+	{
+		int const bw = 1001;
+		int const bh = 999;
+		std::vector<uint32_t> src( bw * bh );
+		for( auto& p: src ) {
+			p = rng();
+		}
+		std::vector<uint8_t> all( etc2_size( bw, bh ) );
+		etc2_encode( src.data(), bw, bh, all.data() );
+		std::vector<uint8_t> rows( etc2_size( bw, bh ) );
+		size_t const row = etc2_size( bw, 4 );
+		for( int y = 0; y < bh; y += 4 ) {
+			int const n = std::min( 4, bh - y );
+			etc2_encode( src.data() + bw * y, bw, n, rows.data() + row * (y / 4) );
+		}
+		CHECK( all == rows );
+	}
+	return 0;
+}
@@ -0,0 +1,295 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the Open H.264 encoding through client_connection_t, as a server sends it:
+// frames encoded by libavcodec's libx264 (as host/encode_clip's input is) in
+// rects of the encoding 50, parsed through resumable_in_stream_t.  the pixels
+// must match the source frames, as the same frames sent as Tight JPEG do; it
+// prints the bytes, the time to decode and the PSNR of both.  SetEncodings
+// names H.264 first and Tight next, the fallback for a server without it,
+// which then decodes as ever.  the flags reset the context of the rect (1) or
+// all of them (2); a stream which goes on after a reset has nothing to refer
+// to and leaves the rect as it was.  up to 64 contexts are kept, the least
+// recently used one dropped for a new one.  only built with libavcodec.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "check.hpp"
+
+#if defined( HAVE_H264 )
+#include <rdr/MemOutStream.h>
+#include "vnc_engine.hpp"
+#include "server_stream.hpp"
+
+
+double now() {
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// [dB] of rgb (r.width() x r.height()) against r of the framebuffer.
+double psnr( pixel_buffer_t const& fb, rfb::Rect const& r, std::vector<uint8_t> const& rgb ) {
+	double sum = 0.0;
+	for( int y = 0; y < r.height(); ++y ) {
+		for( int x = 0; x < r.width(); ++x ) {
+			uint32_t const p = fb.buffer[size_t( fb.size_w() ) * (r.tl.y + y) + (r.tl.x + x)];
+			for( int c = 0; c < 3; ++c ) {
+				double const d = double( (p >> (8 * c)) & 0xff ) - double( rgb[3 * (r.width() * y + x) + c] );
+				sum += d * d;
+			}
+		}
+	}
+	double const mse = sum / double( 3 * r.area() );
+	return mse == 0.0 ? 99.0 : 10.0 * std::log10( 255.0 * 255.0 / mse );
+}
+
+// a connection fed what the server has sent, as vnc_engine_t feeds it.
+struct client_t {
+	client_t( connection_options_t const& options ):
+		conn( &mailbox, &in, &out, "", options )
+	{
+	}
+
+	pixel_buffer_t const& fb() {
+		return *static_cast<pixel_buffer_t*>( conn.getFramebuffer() );
+	}
+
+	// all of it, which ends with whole messages.
+	void receive( server_stream_t& server ) {
+		std::memcpy( in.reserve( server.data.size() ), server.data.data(), server.data.size() );
+		in.commit( server.data.size() );
+		server.data.clear();
+		while( in.available() > 0 ) {
+			size_t const size  = in.available();
+			auto const   state = conn.state();
+			in.mark();
+			try {
+				conn.process_msg();
+			}
+			catch( resumable_in_stream_t::underflow_t const& ) {
+				CHECK( false );
+			}
+			if( in.available() == size && conn.state() == state ) {
+				break;
+			}
+		}
+		CHECK( in.available() == 0 );
+		in.compact();
+		mailbox.recycle( mailbox.take() );
+	}
+
+	// the encodings of SetEncodings, but the pseudo-encodings and CopyRect.
+	std::vector<int32_t> encodings() {
+		// ProtocolVersion, the security type and ClientInit come first.
+		uint8_t const* const p = static_cast<uint8_t const*>( out.data() ) + 12 + 1 + 1;
+		CHECK( out.length() >= 12 + 1 + 1 + 4 && p[0] == 2 );
+		int const n = (p[2] << 8) | p[3];
+		CHECK( out.length() >= 12 + 1 + 1 + 4 + 4 * n );
+		std::vector<int32_t> result;
+		for( int i = 0; i < n; ++i ) {
+			uint8_t const* const e = p + 4 + 4 * i;
+			int32_t const encoding = int32_t( (uint32_t( e[0] ) << 24) | (e[1] << 16) | (e[2] << 8) | e[3] );
+			if( encoding >= 0 && encoding != rfb::encodingCopyRect ) {
+				result.push_back( encoding );
+			}
+		}
+		return result;
+	}
+
+	resumable_in_stream_t in;
+	rdr::MemOutStream     out;
+	region_mailbox_t      mailbox;
+	client_connection_t   conn;
+};
+
+struct stats_t {
+	size_t bytes    = 0;
+	double secs     = 0.0;
+	double psnr     = 0.0;
+	double min_psnr = 99.0;
+	int    frames   = 0;
+
+	void add( size_t const b, double const s, double const p ) {
+		bytes    += b;
+		secs     += s;
+		psnr     += p;
+		min_psnr  = std::min( min_psnr, p );
+		frames   += 1;
+	}
+
+	void print( char const* const name, int const w, int const h ) const {
+		std::printf( "%-5s %d frames of %dx%d: %6zu bytes, %5.2f ms a frame, PSNR %.1f dB (min %.1f)\n",
+			name, frames, w, h, bytes / frames, 1e3 * secs / frames, psnr / frames, min_psnr );
+	}
+};
+
+// a clip sent both ways to a client which prefers H.264.
+void test_frames() {
+	int const w = 320, h = 240, frames = 30;
+	connection_options_t options;
+	options.h264 = true;
+
+	client_t h264( options );
+	server_stream_t server;
+	server.handshake( w, h );
+	h264.receive( server );
+	std::vector<int32_t> const encodings = h264.encodings();
+	CHECK( encodings.size() >= 2 && encodings[0] == rfb::encodingH264 && encodings[1] == rfb::encodingTight );
+
+	// the fallback: a server which does not know H.264.
+	client_t tight( options );
+	server.handshake( w, h );
+	tight.receive( server );
+
+	h264_encoder_t encoder( w, h );
+	stats_t h264_stats, tight_stats;
+	for( int t = 0; t < frames; ++t ) {
+		std::vector<uint8_t> const rgb = moving_picture( w, h, t );
+
+		server.update( 1 );
+		server.h264( { 0, 0, w, h }, encoder.encode( rgb ), t == 0 ? 1 : 0 );
+		size_t bytes = server.data.size();
+		double t0 = now();
+		h264.receive( server );
+		h264_stats.add( bytes, now() - t0, psnr( h264.fb(), { 0, 0, w, h }, rgb ) );
+
+		server.tight( w, h, rgb, 8 );
+		bytes = server.data.size();
+		t0 = now();
+		tight.receive( server );
+		tight_stats.add( bytes, now() - t0, psnr( tight.fb(), { 0, 0, w, h }, rgb ) );
+	}
+	h264_stats.print( "H.264", w, h );
+	tight_stats.print( "Tight", w, h );
+	CHECK( h264_stats.min_psnr >= 30.0 && tight_stats.min_psnr >= 30.0 );
+	// the P frames carry the difference only.
+	CHECK( h264_stats.bytes < tight_stats.bytes );
+
+	// without the option, Tight comes first.
+	client_t plain( connection_options_t{} );
+	server.handshake( w, h );
+	plain.receive( server );
+	CHECK( !plain.encodings().empty() && plain.encodings()[0] == rfb::encodingTight );
+}
+
+// the stream of a rect of 32 x 32: an IDR frame of a, then P frames of b and of c.
+struct clip_t {
+	clip_t() {
+		h264_encoder_t encoder( n, n );
+		for( int i = 0; i < 3; ++i ) {
+			frames[i] = moving_picture( n, n, 20 * i );
+			aus[i] = encoder.encode( frames[i] );
+		}
+		CHECK( psnr_of( frames[0], frames[1] ) < 20.0 && psnr_of( frames[1], frames[2] ) < 20.0 );
+	}
+
+	static double psnr_of( std::vector<uint8_t> const& a, std::vector<uint8_t> const& b ) {
+		double sum = 0.0;
+		for( size_t i = 0; i < a.size(); ++i ) {
+			double const d = double( a[i] ) - double( b[i] );
+			sum += d * d;
+		}
+		return 10.0 * std::log10( 255.0 * 255.0 * double( a.size() ) / sum );
+	}
+
+	// the i-th rect of the desktop, 10 in a row.
+	static rfb::Rect rect( int const i ) {
+		return { n * (i % 10), n * (i / 10), n * (i % 10 + 1), n * (i / 10 + 1) };
+	}
+
+	static int const     n = 32;
+	std::vector<uint8_t> frames[3];
+	std::vector<uint8_t> aus[3];
+};
+
+// rects of the clip: (the rect, the frame, the flags).
+struct send_t {
+	int      rect;
+	int      frame;
+	uint32_t flags;
+};
+
+void send( client_t& c, server_stream_t& server, clip_t const& clip, std::vector<send_t> const& rects ) {
+	server.update( rects.size() );
+	for( auto const& s: rects ) {
+		server.h264( clip_t::rect( s.rect ), s.frame < 0 ? std::vector<uint8_t>() : clip.aus[s.frame], s.flags );
+	}
+	c.receive( server );
+}
+
+// whether rect i shows the frame of the clip.
+bool shows( client_t& c, clip_t const& clip, int const i, int const frame ) {
+	return psnr( c.fb(), clip_t::rect( i ), clip.frames[frame] ) >= 30.0;
+}
+
+void test_resets( clip_t const& clip ) {
+	connection_options_t options;
+	options.h264 = true;
+	client_t c( options );
+	server_stream_t server;
+	server.handshake( 320, 240 );
+	c.receive( server );
+
+	send( c, server, clip, { { 0, 0, 1 }, { 1, 0, 1 } } );
+	send( c, server, clip, { { 0, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 1 ) && shows( c, clip, 1, 0 ) );
+
+	// the context of rect 0 only (an empty rect): its P frame has no reference.
+	send( c, server, clip, { { 0, -1, 1 } } );
+	send( c, server, clip, { { 0, 2, 0 }, { 1, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 1 ) && shows( c, clip, 1, 1 ) );
+
+	// the stream starts over.
+	send( c, server, clip, { { 0, 0, 1 } } );
+	send( c, server, clip, { { 0, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 1 ) );
+
+	// all of them, from another rect which starts over itself.
+	send( c, server, clip, { { 2, 0, 2 } } );
+	send( c, server, clip, { { 0, 2, 0 }, { 1, 2, 0 }, { 2, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 1 ) && shows( c, clip, 1, 1 ) && shows( c, clip, 2, 1 ) );
+}
+
+void test_contexts( clip_t const& clip ) {
+	connection_options_t options;
+	options.h264 = true;
+	client_t c( options );
+	server_stream_t server;
+	server.handshake( 320, 240 );
+	c.receive( server );
+
+	// 64 rects; rect 0 is used again, so rect 1 is the least recent.
+	std::vector<send_t> rects;
+	for( int i = 0; i < 64; ++i ) {
+		rects.push_back( { i, 0, 1 } );
+	}
+	send( c, server, clip, rects );
+	send( c, server, clip, { { 0, 1, 0 } } );
+	// the 65th drops rect 1.
+	send( c, server, clip, { { 64, 0, 1 } } );
+	send( c, server, clip, { { 2, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 1 ) && shows( c, clip, 64, 0 ) && shows( c, clip, 2, 1 ) );
+	send( c, server, clip, { { 1, 1, 0 } } );
+	CHECK( shows( c, clip, 1, 0 ) );
+	// rect 1 has taken the place of rect 3; rect 0 is still there.
+	send( c, server, clip, { { 0, 2, 0 }, { 3, 1, 0 } } );
+	CHECK( shows( c, clip, 0, 2 ) && shows( c, clip, 3, 0 ) );
+}
+
+int main() {
+	if( !h264_encoder_t::available() ) {
+		std::printf( "libavcodec is built without libx264: skipped\n" );
+		return 0;
+	}
+	test_frames();
+	clip_t const clip;
+	test_resets( clip );
+	test_contexts( clip );
+	return 0;
+}
+#else
+int main() {
+	std::printf( "built without libavcodec: skipped\n" );
+	return 0;
+}
+#endif
@@ -0,0 +1,210 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// latency_trace.hpp.  trace_ring_t between a producer and a consumer thread:
+// every span arrives once and in order, and a full ring refuses a span
+// instead of overwriting one.  trace_histogram_t against known durations.
+// then latency_trace_t: what record() does while disabled (nothing, and it
+// costs little), and spans from several threads, collected by poll() and
+// written as a Chrome trace, which is read back.  run it under
+// -fsanitize=thread too.
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "latency_trace.hpp"
+#include "check.hpp"
+
+
+void test_ring() {
+	trace_ring_t ring;
+	// full: refused, not overwritten.
+	size_t pushed = 0;
+	while( ring.push( { int64_t( pushed ), 0, trace_kind_t::decode, 0 } ) ) {
+		++pushed;
+	}
+	CHECK( pushed == 4096 );
+	int64_t next = 0;
+	ring.drain( [&]( trace_span_t const& s ) {
+		CHECK( s.begin == next++ );
+	} );
+	CHECK( next == 4096 );
+
+	// concurrently; the producer retries what is refused.
+	int64_t const n = 1'000'000;
+	std::thread producer( [&]() {
+		for( int64_t i = 0; i < n; ++i ) {
+			while( !ring.push( { i, i + 1, trace_kind_t::queue, 7 } ) ) {
+				std::this_thread::yield();
+			}
+		}
+	} );
+	next = 0;
+	while( next < n ) {
+		ring.drain( [&]( trace_span_t const& s ) {
+			CHECK( s.begin == next && s.end == next + 1 && s.kind == trace_kind_t::queue && s.tid == 7 );
+			++next;
+		} );
+	}
+	producer.join();
+}
+
+void test_histogram() {
+	trace_histogram_t h;
+	CHECK( h.total() == 0 );
+	// 1 .. 1000 ms.
+	for( int i = 1; i <= 1000; ++i ) {
+		h.add( int64_t( i ) * 1'000'000 );
+	}
+	CHECK( h.total() == 1000 );
+	CHECK( h.max() == 1000.0 );
+	// the upper bound of the bucket: at most 2^(1/8) above.
+	for( double const p: { 0.5, 0.9, 0.99 } ) {
+		double const x = p * 1000.0;
+		CHECK( x <= h.percentile( p ) && h.percentile( p ) <= x * 1.091 );
+	}
+	// not beyond the largest.
+	CHECK( h.percentile( 1.0 ) == 1000.0 );
+
+	// below a us and beyond the last bucket.
+	h.clear();
+	CHECK( h.total() == 0 && h.max() == 0.0 );
+	h.add( 0 );
+	h.add( 100 );
+	CHECK( h.percentile( 1.0 ) <= 1e-3 );
+	h.add( int64_t( 3600 ) * 1'000'000'000 );
+	CHECK( h.percentile( 1.0 ) == 3600e3 );
+}
+
+// the events of a Chrome trace, as latency_trace_t writes it.
+struct event_t {
+	std::string name;
+	unsigned    tid;
+	double      ts;
+	double      dur;
+};
+
+// false until the file is complete: it is written on another thread.
+bool read_trace( std::string const& path, std::vector<event_t>& events ) {
+	std::string text;
+	if( std::FILE* const fp = std::fopen( path.c_str(), "r" ) ) {
+		char buf[4096];
+		while( size_t const n = std::fread( buf, 1, sizeof( buf ), fp ) ) {
+			text.append( buf, n );
+		}
+		std::fclose( fp );
+	}
+	std::string const head = "{\"traceEvents\":[\n";
+	std::string const tail = "],\"displayTimeUnit\":\"ms\"}\n";
+	if( text.size() < head.size() + tail.size() || text.compare( text.size() - tail.size(), tail.size(), tail ) != 0 ) {
+		return false;
+	}
+	CHECK( text.compare( 0, head.size(), head ) == 0 );
+	events.clear();
+	for( size_t i = head.size(); i < text.size() - tail.size(); i = text.find( '\n', i ) + 1 ) {
+		// after the first, each begins with a comma.
+		CHECK( events.empty() || text[i] == ',' );
+		char name[32];
+		event_t e;
+		CHECK( std::sscanf( text.c_str() + i + (events.empty() ? 0 : 1), "{\"name\":\"%31[a-z]\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lf,\"dur\":%lf}\n", name, &e.tid, &e.ts, &e.dur ) == 4 );
+		e.name = name;
+		events.push_back( e );
+	}
+	return true;
+}
+
+void test_trace() {
+	auto& trace = latency_trace_t::get();
+
+	// disabled: a flag is tested, nothing more.
+	CHECK( !latency_trace_t::enabled() );
+	int64_t const t0 = trace_now();
+	int const calls = 10'000'000;
+	for( int i = 0; i < calls; ++i ) {
+		latency_trace_t::record( trace_kind_t::rtt, 1, 2 );
+	}
+	double const ns = double( trace_now() - t0 ) / double( calls );
+	std::printf( "record() disabled: %.2f ns\n", ns );
+#if !defined( __SANITIZE_THREAD__ )
+	CHECK( ns < 20.0 );
+#endif
+
+	char dir[] = "/tmp/latency_trace.XXXXXX";
+	CHECK( mkdtemp( dir ) != nullptr );
+	std::string const path = std::string( dir ) + "/trace.json";
+	trace.enable( path );
+	CHECK( latency_trace_t::enabled() );
+
+	// from several threads, as the decoder, the workers and the render thread.
+	int const threads = 4;
+	int const spans   = 1000;
+	std::vector<std::thread> producers;
+	for( int t = 0; t < threads; ++t ) {
+		producers.emplace_back( [t]() {
+			for( int i = 0; i < spans; ++i ) {
+				// begin: which thread and which span, in ms.
+				int64_t const begin = (int64_t( t ) * spans + i) * 1'000'000;
+				latency_trace_t::record( t % 2 == 0 ? trace_kind_t::decode : trace_kind_t::total, begin, begin + 2000 * (i + 1) );
+			}
+		} );
+	}
+	// collected while the producers run: only after 5 s.
+	trace.poll( trace_now() );
+	for( auto& p: producers ) {
+		p.join();
+	}
+	CHECK( access( path.c_str(), F_OK ) != 0 );
+	trace.poll( trace_now() + 6'000'000'000 );
+
+	std::vector<event_t> events;
+	for( int i = 0; !read_trace( path, events ); ++i ) {
+		CHECK( i < 500 );
+		usleep( 10000 );
+	}
+	CHECK( events.size() == size_t( threads * spans ) );
+	std::vector<int> seen( threads * spans );
+	std::vector<unsigned> tids( threads, 0 );
+	for( auto const& e: events ) {
+		int const k = int( e.ts / 1000.0 + 0.5 );
+		CHECK( 0 <= k && k < threads * spans );
+		int const t = k / spans;
+		int const i = k % spans;
+		seen[k] += 1;
+		CHECK( e.name == (t % 2 == 0 ? "decode" : "total") );
+		// in us.
+		CHECK( std::abs( e.ts - 1000.0 * k ) < 1e-3 && std::abs( e.dur - 2.0 * (i + 1) ) < 1e-3 );
+		// each thread has its own id.
+		CHECK( tids[t] == 0 || tids[t] == e.tid );
+		tids[t] = e.tid;
+	}
+	for( int const n: seen ) {
+		CHECK( n == 1 );
+	}
+	for( int t = 0; t < threads; ++t ) {
+		for( int u = 0; u < t; ++u ) {
+			CHECK( tids[t] != tids[u] );
+		}
+	}
+
+	// the spans of a thread beyond its ring are dropped, not blocked on.
+	std::thread( []() {
+		for( int i = 0; i < 5000; ++i ) {
+			latency_trace_t::record( trace_kind_t::rtt, 0, 1000 );
+		}
+	} ).join();
+	trace.poll( trace_now() + 12'000'000'000 );
+	for( int i = 0; !read_trace( path, events ) || events.size() != size_t( threads * spans + 4096 ); ++i ) {
+		CHECK( i < 500 );
+		usleep( 10000 );
+	}
+	std::remove( path.c_str() );
+	rmdir( dir );
+}
+
+int main() {
+	test_ring();
+	test_histogram();
+	test_trace();
+	return 0;
+}
@@ -0,0 +1,81 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the host tests which play against host/load_server (make builds it first):
+// the server runs, next to the test, on a port of the test's own while the
+// object lives, and listens once it is constructed.
+#pragma once
+
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "check.hpp"
+
+
+// a port which the tests running at the same time do not share.
+inline int test_port( int const i = 0 ) {
+	return 20000 + (getpid() % 10000) * 2 + i;
+}
+
+struct load_server_t {
+	// self: argv[0] of the test.  args: the options but -p.
+	load_server_t( std::string const& self, std::vector<std::string> args, int const port = test_port() ) {
+		std::string const path = self.substr( 0, self.find_last_of( '/' ) + 1 ) + "load_server";
+		args.insert( args.begin(), path );
+		args.push_back( "-p" );
+		args.push_back( std::to_string( port ) );
+		std::vector<char*> argv;
+		for( auto& a: args ) {
+			argv.push_back( &a[0] );
+		}
+		argv.push_back( nullptr );
+
+		_pid = fork();
+		if( _pid == 0 ) {
+			// also when a check fails and the test exits.
+			prctl( PR_SET_PDEATHSIG, SIGTERM );
+			int const null = open( "/dev/null", O_WRONLY );
+			dup2( null, 1 );
+			dup2( null, 2 );
+			execv( path.c_str(), argv.data() );
+			_exit( 127 );
+		}
+		CHECK( _pid > 0 );
+
+		// a connection which is closed at once: the server only logs it.
+		sockaddr_in addr = {};
+		addr.sin_family      = AF_INET;
+		addr.sin_port        = htons( port );
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		for( int i = 0; true; ++i ) {
+			int const fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+			bool const listening = connect( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0;
+			close( fd );
+			if( listening ) {
+				break;
+			}
+			CHECK( i < 250 );
+			std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+		}
+	}
+
+	load_server_t( load_server_t&& )                 = delete;
+	load_server_t( load_server_t const& )            = delete;
+	load_server_t& operator=( load_server_t&& )      = delete;
+	load_server_t& operator=( load_server_t const& ) = delete;
+
+	~load_server_t() {
+		kill( _pid, SIGTERM );
+		waitpid( _pid, nullptr, 0 );
+	}
+
+private:
+	pid_t _pid;
+};
@@ -0,0 +1,83 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the decoder thread publishes numbered updates as fast as it can, taking
+// back and extending the one not taken yet, while the render thread takes and
+// recycles them.  each region must arrive whole: the updates in it in order,
+// its pixels those of its rects, and every update in exactly one region.
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "vnc_thread.hpp"
+#include "check.hpp"
+
+
+int const updates = 200'000;
+
+// update i: a rect of i + 1 pixels at x = i, each of them i.
+void append( region_t& region, int const i ) {
+	region.w = i;
+	region.rects.push_back( { i, 0, i + 1 + i % 7, 1 } );
+	region.pixels.insert( region.pixels.end(), 1 + i % 7, uint32_t( i ) );
+}
+
+void check_whole( region_t const& region ) {
+	CHECK( !region.rects.empty() );
+	CHECK( region.w == region.rects.back().tl.x );
+	size_t offset = 0;
+	for( auto const& r: region.rects ) {
+		for( int j = 0; j < r.area(); ++j ) {
+			CHECK( offset + j < region.pixels.size() );
+			CHECK( region.pixels[offset + j] == uint32_t( r.tl.x ) );
+		}
+		offset += r.area();
+	}
+	CHECK( offset == region.pixels.size() );
+}
+
+int main() {
+	region_mailbox_t mailbox;
+	std::atomic<bool> done = { false };
+
+	std::thread decoder( [&]() {
+		for( int i = 0; i < updates; ++i ) {
+			std::unique_ptr<region_t> region = mailbox.take_back();
+			if( region == nullptr ) {
+				region = mailbox.allocate();
+				region->rects.clear();
+				region->pixels.clear();
+			}
+			append( *region, i );
+			mailbox.publish( std::move( region ) );
+			// lets the render thread in now and then, as the socket does: some
+			// regions are taken back before they are taken, some not.
+			if( i % 4 == 0 ) {
+				std::this_thread::yield();
+			}
+		}
+		done = true;
+	} );
+
+	int next = 0;
+	size_t taken = 0;
+	while( true ) {
+		bool const last = done;
+		while( std::unique_ptr<region_t> region = mailbox.take() ) {
+			check_whole( *region );
+			for( auto const& r: region->rects ) {
+				CHECK( r.tl.x == next );
+				++next;
+			}
+			++taken;
+			mailbox.recycle( std::move( region ) );
+		}
+		if( last ) {
+			break;
+		}
+		std::this_thread::yield();
+	}
+	decoder.join();
+
+	CHECK( next == updates );
+	CHECK( mailbox.take() == nullptr );
+	std::printf( "%d updates in %zu regions\n", updates, taken );
+	return 0;
+}
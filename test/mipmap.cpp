@@ -0,0 +1,99 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// mip_pyramid_t against the definition, texel by texel: the average in linear
+// light of the 2x2 texels below which exist.  then random rects damaged one
+// after another, updated incrementally, against a full rebuild.
+#include <random>
+#include <vector>
+#include "mipmap.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+// the level below level i of p, with base as level 0.
+std::vector<uint32_t> const& below( mip_pyramid_t const& p, std::vector<uint32_t> const& base, size_t const i ) {
+	return i == 0 ? base : p.levels()[i - 1].pixels;
+}
+
+void check_definition( mip_pyramid_t const& p, std::vector<uint32_t> const& base ) {
+	auto const& table = srgb_table_t::get();
+	int src_w = p.w();
+	int src_h = p.h();
+	for( size_t i = 0; i < p.levels().size(); ++i ) {
+		auto const& src = below( p, base, i );
+		auto const& dst = p.levels()[i];
+		CHECK( dst.w == std::max( 1, p.w() >> (i + 1) ) );
+		CHECK( dst.h == std::max( 1, p.h() >> (i + 1) ) );
+		for( int y = 0; y < dst.h; ++y ) {
+			for( int x = 0; x < dst.w; ++x ) {
+				uint32_t sums[3] = {};
+				uint32_t count = 0;
+				for( int v = 2 * y; v < std::min( 2 * y + 2, src_h ); ++v ) {
+					for( int u = 2 * x; u < std::min( 2 * x + 2, src_w ); ++u ) {
+						for( int c = 0; c < 3; ++c ) {
+							sums[c] += table.to_linear[(src[src_w * v + u] >> (8 * c)) & 0xff];
+						}
+						count += 1;
+					}
+				}
+				uint32_t expected = 0xff000000u;
+				for( int c = 0; c < 3; ++c ) {
+					expected |= uint32_t( table.to_srgb[(sums[c] + count / 2) / count] ) << (8 * c);
+				}
+				CHECK( dst.pixels[dst.w * y + x] == expected );
+			}
+		}
+		src_w = dst.w;
+		src_h = dst.h;
+	}
+}
+
+int main() {
+	// a black and white checker is 0xbc in sRGB, not 0x80.
+	{
+		mip_pyramid_t p;
+		p.resize( 2, 2 );
+		std::vector<uint32_t> const base = { 0xff000000u, 0xffffffffu, 0xffffffffu, 0xff000000u };
+		p.rebuild( base.data() );
+		CHECK( p.levels().size() == 1 );
+		CHECK( p.levels()[0].pixels[0] == 0xffbcbcbcu );
+	}
+
+	// sizes down to 1 texel wide or high, odd and even.
+	for( int i = 0; i < 200; ++i ) {
+		int const w = i < 20 ? 1 + i % 4 : uniform( 1, 300 );
+		int const h = i < 20 ? 1 + i / 4 : uniform( 1, 300 );
+		std::vector<uint32_t> base( w * h );
+		for( auto& q: base ) {
+			q = rng() | 0xff000000u;
+		}
+		mip_pyramid_t p;
+		p.resize( w, h );
+		CHECK( int( p.levels().size() ) == mip_pyramid_t::count_levels( w, h ) - 1 );
+		p.rebuild( base.data() );
+		check_definition( p, base );
+
+		mip_pyramid_t ref;
+		ref.resize( w, h );
+		for( int j = 0; j < 20; ++j ) {
+			int const x0 = uniform( 0, w - 1 );
+			int const y0 = uniform( 0, h - 1 );
+			rfb::Rect const r = { x0, y0, uniform( x0 + 1, w ), uniform( y0 + 1, h ) };
+			for( int y = r.tl.y; y < r.br.y; ++y ) {
+				for( int x = r.tl.x; x < r.br.x; ++x ) {
+					base[w * y + x] = rng() | 0xff000000u;
+				}
+			}
+			p.update( base.data(), { r } );
+			ref.rebuild( base.data() );
+			for( size_t k = 0; k < p.levels().size(); ++k ) {
+				CHECK( p.levels()[k].pixels == ref.levels()[k].pixels );
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the monitors of a desktop as vnc_layer_t shows them: the layout the server
+// sends, reduced to texels and ordered from the left, the fallback to one
+// cylinder over the whole desktop without a layout, and the pointer over
+// monitors placed side by side: which one the head ray hits, where, and
+// that a held button keeps the pointer on its monitor.
+#include <random>
+#include "view_geometry.hpp"
+#include "check.hpp"
+
+
+rfb::ScreenSet screens( std::initializer_list<rfb::Rect> const rects ) {
+	rfb::ScreenSet set;
+	rdr::U32 id = 0;
+	for( auto const& r: rects ) {
+		set.screens.push_back( rfb::Screen( id++, r.tl.x, r.tl.y, r.width(), r.height(), 0 ) );
+	}
+	return set;
+}
+
+bool same( std::vector<rfb::Rect> const& xs, std::initializer_list<rfb::Rect> const ys ) {
+	return std::equal( xs.begin(), xs.end(), ys.begin(), ys.end(), []( rfb::Rect const& x, rfb::Rect const& y ) {
+		return x.equals( y );
+	} );
+}
+
+void check_layout() {
+	// two monitors, sent from the right: from the left, the shorter one at the top.
+	auto const two = screens( { { 1920, 0, 3200, 1024 }, { 0, 0, 1920, 1080 } } );
+	CHECK( same( monitor_layout( two, 3200, 1080, 0 ), { { 0, 0, 1920, 1080 }, { 1920, 0, 3200, 1024 } } ) );
+	// reduced: the edges go down, so that no texel has two monitors.
+	CHECK( same( monitor_layout( two, 3200, 1080, 2 ), { { 0, 0, 480, 270 }, { 480, 0, 800, 256 } } ) );
+	auto const odd = screens( { { 0, 0, 1281, 1025 }, { 1281, 0, 2561, 1025 } } );
+	CHECK( same( monitor_layout( odd, 2561, 1025, 1 ), { { 0, 0, 640, 512 }, { 640, 0, 1280, 512 } } ) );
+	// one above the other, at the same x.
+	auto const stacked = screens( { { 0, 1080, 1920, 2160 }, { 0, 0, 1920, 1080 } } );
+	CHECK( same( monitor_layout( stacked, 1920, 2160, 0 ), { { 0, 0, 1920, 1080 }, { 0, 1080, 1920, 2160 } } ) );
+
+	// beyond the desktop: clipped to it, or dropped.
+	auto const beyond = screens( { { 0, 0, 1920, 1080 }, { 1800, 0, 3000, 1080 }, { 4000, 0, 5000, 1080 } } );
+	CHECK( same( monitor_layout( beyond, 2560, 1080, 0 ), { { 0, 0, 1920, 1080 }, { 1800, 0, 2560, 1080 } } ) );
+	// smaller than a texel: dropped.
+	auto const thin = screens( { { 0, 0, 1920, 1080 }, { 1920, 0, 1922, 1080 }, { 1922, 0, 3842, 1080 } } );
+	CHECK( same( monitor_layout( thin, 3842, 1080, 2 ), { { 0, 0, 480, 270 }, { 480, 0, 960, 270 } } ) );
+	// then the one left may be the desktop.
+	CHECK( monitor_layout( screens( { { 0, 0, 1920, 1080 }, { 1920, 0, 1923, 1080 } } ), 1923, 1080, 2 ).empty() );
+
+	// no layout of several: none, and the desktop is one monitor.
+	CHECK( monitor_layout( rfb::ScreenSet(), 1920, 1080, 0 ).empty() );
+	CHECK( monitor_layout( screens( { { 0, 0, 1920, 1080 } } ), 1920, 1080, 0 ).empty() );
+	CHECK( monitor_layout( screens( { { 0, 0, 1280, 720 } } ), 1920, 1080, 0 ).empty() );
+	// nor when the others are off the desktop.
+	CHECK( monitor_layout( screens( { { 0, 0, 1920, 1080 }, { 1920, 0, 3840, 1080 } } ), 1920, 1080, 1 ).empty() );
+}
+
+// as vnc_layer_t::monitor_t, placed by a yaw [radians] to the left.
+struct monitor_t {
+	rfb::Rect rect;
+	float     transform;
+};
+
+void check_place() {
+	std::vector<rfb::Rect> const layout = { { 0, 0, 960, 540 }, { 960, 0, 1600, 512 }, { 1600, 0, 2000, 540 } };
+	// without a layout, or with no placement for its monitors: the whole texture.
+	for( auto const& m: { place_monitors<monitor_t>( {}, std::vector<float>{ 0.5f, -0.5f }, 0.1f, 2000, 540 ), place_monitors<monitor_t>( layout, std::vector<float>{}, 0.1f, 2000, 540 ) } ) {
+		CHECK( m.size() == 1 && m[0].rect.equals( { 0, 0, 2000, 540 } ) && m[0].transform == 0.1f );
+	}
+	// the monitors without a placement are not shown.
+	auto const m = place_monitors<monitor_t>( layout, std::vector<float>{ 0.5f, -0.5f }, 0.1f, 2000, 540 );
+	CHECK( m.size() == 2 && m[0].rect.equals( layout[0] ) && m[0].transform == 0.5f && m[1].rect.equals( layout[1] ) && m[1].transform == -0.5f );
+}
+
+// the head ray at yaw a to the left and pitch p up, in the frame of a
+// cylinder placed by yaw t.
+void ray( float const a, float const p, float const t, float d[3] ) {
+	d[0] = std::sin( a - t ) * std::cos( p );
+	d[1] = std::sin( p );
+	d[2] = std::cos( a - t ) * std::cos( p );
+}
+
+void check_pointer() {
+	float const res = 1000.0f; // texels per pi: a monitor 500 texels wide is 90 deg around.
+	float const deg = float( M_PI / 180.0 );
+	// two monitors 500 x 400, the left one 30 deg to the left, the right one
+	// 70 deg to the right: 10 deg apart.
+	auto const monitors = place_monitors<monitor_t>( { { 0, 0, 500, 400 }, { 500, 0, 1000, 400 } }, std::vector<float>{ 30.0f * deg, -70.0f * deg }, 0.0f, 1000, 400 );
+	auto const pointer = [&]( float const a, float const p, bool const capturing, size_t const captured, int& iu, int& iv ) {
+		return pointer_monitor( monitors.size(), [&]( size_t const i, bool const clamp, int& u, int& v ) {
+			float d[3];
+			ray( a, p, monitors[i].transform, d );
+			return monitor_hit( d, monitors[i].rect, res, clamp, u, v );
+		}, capturing, captured, iu, iv );
+	};
+
+	int iu, iv;
+	// at the center of each.
+	CHECK( pointer( 30.0f * deg, 0.0f, false, 0, iu, iv ) == 0 && iu == 250 && iv == 200 );
+	CHECK( pointer( -70.0f * deg, 0.0f, false, 0, iu, iv ) == 1 && iu == 750 && iv == 200 );
+	// 9 deg to the right of the center and up: 50 texels to the right, and
+	// tan( 9 deg ) * 1000 / pi above.
+	CHECK( pointer( 21.0f * deg, 9.0f * deg, false, 0, iu, iv ) == 0 && iu == 300 );
+	CHECK( iv == 200 + int( std::floor( std::tan( 9.0f * deg ) * res / float( M_PI ) ) ) );
+	// on the left edge of the right monitor: its own left column.
+	CHECK( pointer( -25.5f * deg, 0.0f, false, 0, iu, iv ) == 1 && iu == 502 );
+	// in the gap between them, over the top, behind: on none.
+	CHECK( pointer( -20.0f * deg, 0.0f, false, 0, iu, iv ) == 2 );
+	CHECK( pointer( 30.0f * deg, 40.0f * deg, false, 0, iu, iv ) == 2 );
+	CHECK( pointer( 180.0f * deg, 0.0f, false, 0, iu, iv ) == 2 );
+
+	// pressed on the left one: clamped to it wherever the head turns, even
+	// onto the other one.
+	CHECK( pointer( -70.0f * deg, 0.0f, true, 0, iu, iv ) == 0 && iu == 499 && iv == 200 );
+	CHECK( pointer( 100.0f * deg, 60.0f * deg, true, 0, iu, iv ) == 0 && iu == 0 && iv == 399 );
+	CHECK( pointer( 30.0f * deg, -60.0f * deg, true, 0, iu, iv ) == 0 && iu == 250 && iv == 0 );
+	CHECK( pointer( 30.0f * deg, 0.0f, true, 1, iu, iv ) == 1 && iu == 500 );
+
+	// overlapping: the first from the left.
+	auto const overlapping = place_monitors<monitor_t>( { { 0, 0, 500, 400 }, { 500, 0, 1000, 400 } }, std::vector<float>{ 30.0f * deg, -30.0f * deg }, 0.0f, 1000, 400 );
+	CHECK( pointer_monitor( overlapping.size(), [&]( size_t const i, bool const clamp, int& u, int& v ) {
+		float d[3];
+		ray( 0.0f, 0.0f, overlapping[i].transform, d );
+		return monitor_hit( d, overlapping[i].rect, res, clamp, u, v );
+	}, false, 0, iu, iv ) == 0 && iu == 250 + 166 );
+
+	// without a layout: the one cylinder over the whole desktop, as before.
+	auto const one = place_monitors<monitor_t>( monitor_layout( rfb::ScreenSet(), 1000, 400, 0 ), std::vector<float>{ 30.0f * deg }, 0.0f, 1000, 400 );
+	CHECK( one.size() == 1 );
+	float d[3];
+	ray( 0.0f, 0.0f, one[0].transform, d );
+	CHECK( monitor_hit( d, one[0].rect, res, false, iu, iv ) && iu == 500 && iv == 200 );
+	ray( 89.0f * deg, 0.0f, one[0].transform, d );
+	CHECK( monitor_hit( d, one[0].rect, res, false, iu, iv ) && iu == 5 );
+	ray( 91.0f * deg, 0.0f, one[0].transform, d );
+	CHECK( !monitor_hit( d, one[0].rect, res, false, iu, iv ) );
+
+	// at random: a texel hit is on the monitor, and where the texture of
+	// the monitor shows that direction.
+	std::mt19937 rng( 1 );
+	std::uniform_real_distribution<float> angle( float( -M_PI ), float( M_PI ) );
+	for( int i = 0; i < 10000; ++i ) {
+		float const a = angle( rng );
+		float const p = 0.4f * angle( rng );
+		size_t const k = pointer( a, p, false, 0, iu, iv );
+		if( k == monitors.size() ) {
+			continue;
+		}
+		rfb::Rect const& r = monitors[k].rect;
+		CHECK( r.tl.x <= iu && iu < r.br.x && r.tl.y <= iv && iv < r.br.y );
+		texture_map_t const m = monitor_texture( r, res, 0, 1000, 400 );
+		float const s = 0.5f - (a - monitors[k].transform) / float( M_PI );
+		float const tu = (m.scale[0] * s + m.offset[0]) * 1000.0f;
+		CHECK( iu <= tu + 0.01f && tu - 0.01f < float( iu + 1 ) );
+	}
+}
+
+int main() {
+	check_layout();
+	check_place();
+	check_pointer();
+	return 0;
+}
@@ -0,0 +1,90 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the texels go straight into the texture the layer shows, blended with
+// ONE / ONE_MINUS_SRC_ALPHA: whatever the decoders leave in the 4th byte (0,
+// 0xff or anything), pixel_buffer_t::copy_rects and the mip levels must hand
+// out opaque texels, with the colour untouched.
+#include <random>
+#include <vector>
+#include "vnc_thread.hpp"
+#include "mipmap.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+// as a decoder writes: the 4th byte 0, 0xff or random.
+uint32_t decoded() {
+	uint32_t const rgb = rng() & 0xffffffu;
+	switch( uniform( 0, 2 ) ) {
+		case 0:  return rgb;
+		case 1:  return rgb | 0xff000000u;
+		default: return rgb | (rng() & 0xff000000u);
+	}
+}
+
+rfb::Rect random_rect( int const w, int const h ) {
+	int const x0 = uniform( 0, w - 1 );
+	int const y0 = uniform( 0, h - 1 );
+	return { x0, y0, uniform( x0 + 1, w ), uniform( y0 + 1, h ) };
+}
+
+int main() {
+	for( int scale = 0; scale <= 2; ++scale ) {
+		int const w = 301;
+		int const h = 97;
+		pixel_buffer_t pb( w, h, scale );
+		std::vector<uint32_t> desktop( w * h );
+		for( int i = 0; i < 50; ++i ) {
+			// a decoder commits a rect.
+			rfb::Rect const r = i == 0 ? rfb::Rect( 0, 0, w, h ) : random_rect( w, h );
+			int stride;
+			uint32_t* const dst = reinterpret_cast<uint32_t*>( pb.getBufferRW( r, &stride ) );
+			for( int y = r.tl.y; y < r.br.y; ++y ) {
+				for( int x = r.tl.x; x < r.br.x; ++x ) {
+					desktop[w * y + x] = dst[stride * (y - r.tl.y) + (x - r.tl.x)] = decoded();
+				}
+			}
+			pb.commitBufferRW( r );
+
+			// some rects of the reduced framebuffer, as the connection sends them.
+			std::vector<rfb::Rect> rects;
+			for( int j = uniform( 1, 4 ); j > 0; --j ) {
+				rects.push_back( random_rect( pb.size_w(), pb.size_h() ) );
+			}
+			region_t region;
+			pb.copy_rects( rects, region );
+			CHECK( region.w == pb.size_w() && region.h == pb.size_h() && region.scale == scale && region.rects.size() == rects.size() );
+			uint32_t const* p = region.pixels.data();
+			for( auto const& q: rects ) {
+				for( int y = q.tl.y; y < q.br.y; ++y ) {
+					for( int x = q.tl.x; x < q.br.x; ++x ) {
+						uint32_t const texel = *p++;
+						CHECK( texel >> 24 == 0xff );
+						// unreduced, the colour is the decoder's.
+						CHECK( (texel & 0xffffffu) == ((scale == 0 ? desktop[w * y + x] : pb.buffer[pb.size_w() * y + x]) & 0xffffffu) );
+					}
+				}
+			}
+			CHECK( p == region.pixels.data() + region.pixels.size() );
+		}
+	}
+
+	// the mip levels over texels which are not opaque are opaque all the same.
+	mip_pyramid_t mips;
+	mips.resize( 37, 23 );
+	std::vector<uint32_t> base( 37 * 23 );
+	for( auto& q: base ) {
+		q = decoded();
+	}
+	mips.rebuild( base.data() );
+	for( auto const& level: mips.levels() ) {
+		for( uint32_t const texel: level.pixels ) {
+			CHECK( texel >> 24 == 0xff );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// two decoder threads commit the halves of a reduced framebuffer at once,
+// split off the grid of the blocks, as rfb::DecodeManager does with the rects
+// beside each other.  the blocks on the seam take their pixels from both, in
+// either order: each of them must end up as one of the two orders leaves it,
+// not with one half lost.  run it under -fsanitize=thread too.
+#include <algorithm>
+#include <random>
+#include <thread>
+#include "vnc_thread.hpp"
+#include "check.hpp"
+
+
+int const iterations = 2000;
+
+void commit( pixel_buffer_t& pb, rfb::Rect const& r, uint32_t const colour ) {
+	int stride;
+	uint32_t* const dst = reinterpret_cast<uint32_t*>( pb.getBufferRW( r, &stride ) );
+	for( int y = 0; y < r.height(); ++y ) {
+		std::fill( dst + stride * y, dst + stride * y + r.width(), colour );
+	}
+	pb.commitBufferRW( r );
+}
+
+int main() {
+	std::mt19937 rng( 1 );
+	for( int scale = 1; scale <= 3; ++scale ) {
+		int const w = 256;
+		int const h = 64;
+		pixel_buffer_t pb( w, h, scale );
+		pixel_buffer_t left_first( w, h, scale );
+		pixel_buffer_t right_first( w, h, scale );
+		for( int i = 0; i < iterations; ++i ) {
+			uint32_t const before = rng() | 0xff000000u;
+			uint32_t const after  = rng() | 0xff000000u;
+			int const x = 1 + rng() % (w - 1);
+			rfb::Rect const l = { 0, 0, x, h };
+			rfb::Rect const r = { x, 0, w, h };
+			for( auto* const p: { &pb, &left_first, &right_first } ) {
+				commit( *p, { 0, 0, w, h }, before );
+			}
+			commit( left_first, l, after );
+			commit( left_first, r, after );
+			commit( right_first, r, after );
+			commit( right_first, l, after );
+
+			std::thread left( [&]() {
+				commit( pb, l, after );
+			} );
+			std::thread right( [&]() {
+				commit( pb, r, after );
+			} );
+			left.join();
+			right.join();
+			for( size_t j = 0; j < pb.buffer.size(); ++j ) {
+				CHECK( pb.buffer[j] == left_first.buffer[j] || pb.buffer[j] == right_first.buffer[j] );
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,221 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// pointer_queue_t and send_pointer_events() against a socketpair, read back as
+// PointerEvent messages.  whatever the reader's pace, what arrives must be in
+// the order pushed (motion may be skipped, never reordered), without repeats,
+// with every button transition, and ending at the last event pushed.  first
+// on one thread with the reader stalled at will, then the render thread, the
+// sender and the reader on their own threads.
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "pointer_queue.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+// motion mostly, on a small area so that it comes back where it was.
+pointer_event_t random_event( pointer_event_t e ) {
+	if( rng() % 8 == 0 ) {
+		e.buttons ^= uint8_t( 1 << (rng() % 3) );
+	}
+	else {
+		e.x = uint16_t( rng() % 4 );
+		e.y = uint16_t( rng() % 4 );
+	}
+	return e;
+}
+
+// off the area of random_event(): the reader knows it has everything.
+pointer_event_t last_event( pointer_event_t e ) {
+	e.x = 1000;
+	e.y = 1000;
+	return e;
+}
+
+void write_event( int const fd, pointer_event_t const& e ) {
+	uint8_t const msg[6] = { 5, e.buttons, uint8_t( e.x >> 8 ), uint8_t( e.x ), uint8_t( e.y >> 8 ), uint8_t( e.y ) };
+	CHECK( write( fd, msg, sizeof( msg ) ) == ssize_t( sizeof( msg ) ) );
+}
+
+// all the messages which have arrived, without blocking.
+void read_events( int const fd, std::vector<uint8_t>& partial, std::vector<pointer_event_t>& out ) {
+	uint8_t buf[4096];
+	ssize_t n;
+	while( (n = read( fd, buf, sizeof( buf ) )) > 0 ) {
+		partial.insert( partial.end(), buf, buf + n );
+	}
+	size_t i = 0;
+	for( ; i + 6 <= partial.size(); i += 6 ) {
+		CHECK( partial[i] == 5 );
+		pointer_event_t e;
+		e.buttons = partial[i + 1];
+		e.x       = uint16_t( (partial[i + 2] << 8) | partial[i + 3] );
+		e.y       = uint16_t( (partial[i + 4] << 8) | partial[i + 5] );
+		out.push_back( e );
+	}
+	partial.erase( partial.begin(), partial.begin() + i );
+}
+
+std::vector<uint8_t> button_states( std::vector<pointer_event_t> const& es ) {
+	std::vector<uint8_t> states;
+	for( auto const& e: es ) {
+		if( states.empty() || states.back() != e.buttons ) {
+			states.push_back( e.buttons );
+		}
+	}
+	return states;
+}
+
+// pushed: the events as pushed, each different from the one before.
+void check_received( std::vector<pointer_event_t> const& pushed, std::vector<pointer_event_t> const& received ) {
+	CHECK( !received.empty() );
+	CHECK( received.back() == pushed.back() );
+	for( size_t i = 1; i < received.size(); ++i ) {
+		CHECK( received[i] != received[i - 1] );
+	}
+	// a subsequence.
+	size_t j = 0;
+	for( auto const& e: received ) {
+		while( j < pushed.size() && pushed[j] != e ) {
+			++j;
+		}
+		CHECK( j < pushed.size() );
+		++j;
+	}
+	CHECK( button_states( received ) == button_states( pushed ) );
+}
+
+struct socket_pair_t {
+	socket_pair_t() {
+		CHECK( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == 0 );
+		fcntl( fds[1], F_SETFL, O_NONBLOCK );
+	}
+
+	~socket_pair_t() {
+		close( fds[0] );
+		close( fds[1] );
+	}
+
+	int fds[2];
+};
+
+// the reader stalls for a while now and then: the sender backs up and the
+// motion collapses, more than 64 button transitions wait in the stash.
+void test_stalled() {
+	socket_pair_t sp;
+	pointer_queue_t queue( []() {} );
+	std::vector<pointer_event_t> pushed;
+	std::vector<pointer_event_t> received;
+	std::vector<uint8_t> partial;
+	pointer_event_t e;
+	bool backed_up = false;
+
+	for( int i = 0; i < 20000; ++i ) {
+		// pushing the same event again is no event.
+		pointer_event_t const next = i % 5 == 0 ? e : random_event( e );
+		if( next != e ) {
+			pushed.push_back( next );
+		}
+		queue.push( next );
+		e = next;
+
+		// once the reader is back, the sender may also empty the ring in one
+		// go while the stash still holds transitions newer than the latest.
+		bool const stalled = (i / 1000) % 2 == 1;
+		int const backlog = stalled || i % 2 == 0 ? 2048 : 1 << 20;
+		if( i % 3 == 0 || !stalled ) {
+			backed_up |= !send_pointer_events( queue, sp.fds[0], [&]( pointer_event_t const& x ) { write_event( sp.fds[0], x ); }, backlog );
+		}
+		if( !stalled ) {
+			read_events( sp.fds[1], partial, received );
+		}
+	}
+	e = last_event( e );
+	pushed.push_back( e );
+	// the render thread pushes the last event again each frame while the
+	// sender catches up, which moves the stash into the ring.
+	do {
+		queue.push( e );
+		send_pointer_events( queue, sp.fds[0], [&]( pointer_event_t const& x ) { write_event( sp.fds[0], x ); } );
+		read_events( sp.fds[1], partial, received );
+	} while( received.empty() || received.back() != e );
+
+	CHECK( backed_up );
+	CHECK( partial.empty() );
+	CHECK( received.size() < pushed.size() );
+	check_received( pushed, received );
+
+	pointer_event_t x;
+	CHECK( !queue.pop( x ) );
+}
+
+void test_threads() {
+	pointer_event_t e;
+	std::vector<pointer_event_t> pushed;
+	for( int i = 0; i < 20000; ++i ) {
+		pointer_event_t const next = random_event( e );
+		if( next != e ) {
+			pushed.push_back( next );
+		}
+		e = next;
+	}
+	pushed.push_back( last_event( e ) );
+
+	socket_pair_t sp;
+	std::atomic<bool> pending = { false };
+	std::atomic<bool> arrived = { false };
+	pointer_queue_t queue( [&]() { pending.store( true, std::memory_order_release ); } );
+	std::vector<pointer_event_t> received;
+
+	std::thread sender( [&]() {
+		auto const write = [&]( pointer_event_t const& x ) {
+			write_event( sp.fds[0], x );
+		};
+		while( !arrived.load( std::memory_order_acquire ) ) {
+			// backed up: retries, as the engine does after 2 ms.
+			if( pending.exchange( false, std::memory_order_acquire ) && !send_pointer_events( queue, sp.fds[0], write ) ) {
+				pending.store( true, std::memory_order_relaxed );
+			}
+			std::this_thread::yield();
+		}
+	} );
+	std::thread reader( [&]() {
+		std::mt19937 local( 2 );
+		std::vector<uint8_t> partial;
+		while( received.empty() || received.back() != pushed.back() ) {
+			if( local() % 64 == 0 ) {
+				std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			}
+			read_events( sp.fds[1], partial, received );
+			std::this_thread::yield();
+		}
+		arrived.store( true, std::memory_order_release );
+	} );
+
+	for( size_t i = 0; i < pushed.size(); ++i ) {
+		queue.push( pushed[i] );
+		if( i % 16 == 0 ) {
+			std::this_thread::yield();
+		}
+	}
+	// a frame after another with the pointer at rest.
+	while( !arrived.load( std::memory_order_acquire ) ) {
+		queue.push( pushed.back() );
+		std::this_thread::yield();
+	}
+	sender.join();
+	reader.join();
+	check_received( pushed, received );
+}
+
+int main() {
+	test_stalled();
+	test_threads();
+	return 0;
+}
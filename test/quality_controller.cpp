@@ -0,0 +1,188 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// quality_controller_t fed with sequences of updates at 50 per second: when it
+// backs off and by how much, when it probes upwards again, and that it stays
+// within its bounds however long the link is congested or idle.
+#include "quality_controller.hpp"
+#include "check.hpp"
+
+
+double const dt = 0.02;
+
+struct feeder_t {
+	feeder_t( quality_bounds_t const& bounds ):
+		controller( bounds )
+	{
+	}
+
+	// an update which took latency [s], on the wire or in the decoder.
+	bool update( double const latency, bool const wire = true, bool const behind = false ) {
+		time += dt;
+		quality_sample_t s;
+		s.time   = time;
+		s.wire   = wire ? latency : 0.0;
+		s.decode = wire ? 0.0 : latency;
+		s.bytes  = 100'000;
+		s.behind = behind;
+		return controller.update( s );
+	}
+
+	// the time of the first change within secs, or < 0.
+	double until_change( double const latency, double const secs ) {
+		for( double const end = time + secs; time < end; ) {
+			if( update( latency ) ) {
+				return time;
+			}
+		}
+		return -1.0;
+	}
+
+	quality_controller_t controller;
+	double               time = 100.0;
+};
+
+quality_bounds_t adaptive() {
+	quality_bounds_t b;
+	b.adaptive = true;
+	return b;
+}
+
+int main() {
+	double const target = adaptive().target_latency;
+	double const slow   = 1.5 * target; // over the target.
+	double const awful  = 3.0 * target; // over twice the target.
+	double const good   = 0.2 * target; // under half the target.
+
+	// disabled: the bounds as they are.
+	{
+		feeder_t f( quality_bounds_t{} );
+		for( int i = 0; i < 100; ++i ) {
+			CHECK( !f.update( awful ) );
+		}
+		CHECK( f.controller.quality() == quality_bounds_t().quality_max );
+		CHECK( f.controller.compress() == quality_bounds_t().compress_min );
+	}
+	// not lossy: starts lossless and stays so.
+	{
+		quality_bounds_t b = adaptive();
+		b.lossy = false;
+		feeder_t f( b );
+		CHECK( f.controller.quality() == -1 );
+		for( int i = 0; i < 100; ++i ) {
+			f.update( awful );
+			CHECK( f.controller.quality() == -1 );
+		}
+		CHECK( f.controller.compress() == b.compress_max );
+	}
+
+	// a single slow update is not congestion; two in a row back off one level,
+	// the compression up as the wire is slow.
+	{
+		quality_bounds_t const b = adaptive();
+		feeder_t f( b );
+		CHECK( !f.update( slow ) );
+		CHECK( !f.update( good ) );
+		CHECK( !f.update( slow ) );
+		CHECK( f.update( slow ) );
+		CHECK( f.controller.quality() == b.quality_max - 1 );
+		CHECK( f.controller.compress() == b.compress_min + 1 );
+		// not again within 0.25 s.
+		double const changed = f.time;
+		double const next = f.until_change( slow, 1.0 );
+		CHECK( next - changed >= 0.25 - 1e-9 );
+		CHECK( next - changed < 0.25 + 3 * dt );
+	}
+	// far over the target: two levels at once.
+	{
+		quality_bounds_t const b = adaptive();
+		feeder_t f( b );
+		f.update( awful );
+		CHECK( f.update( awful ) );
+		CHECK( f.controller.quality() == b.quality_max - 2 );
+	}
+	// the decoder is slow: the compression goes down, within its bound.
+	{
+		quality_bounds_t b = adaptive();
+		b.compress_min = 3;
+		feeder_t f( b );
+		f.update( slow, false );
+		CHECK( f.update( slow, false ) );
+		CHECK( f.controller.compress() == 3 );
+		CHECK( f.controller.quality() == b.quality_max - 1 );
+	}
+	// the render thread falling behind is congestion, whatever the latency.
+	{
+		feeder_t f( adaptive() );
+		f.update( good, true, true );
+		CHECK( f.update( good, true, true ) );
+	}
+	// the bytes waiting to be parsed count at the measured bandwidth.
+	{
+		quality_bounds_t const b = adaptive();
+		quality_controller_t c( b );
+		quality_sample_t s;
+		s.wire    = 0.01;
+		s.bytes   = 10'000; // 1 MB / s.
+		s.backlog = 100'000;
+		for( int i = 1; i <= 2; ++i ) {
+			s.time = i * dt;
+			CHECK( c.update( s ) == (i == 2) );
+		}
+		CHECK( c.bandwidth() > 0.99e6 && c.bandwidth() < 1.01e6 );
+	}
+
+	// congested for long: down to the bounds and no further.
+	{
+		quality_bounds_t const b = adaptive();
+		feeder_t f( b );
+		for( int i = 0; i < 1000; ++i ) {
+			f.update( awful );
+			CHECK( f.controller.quality() >= b.quality_min );
+			CHECK( f.controller.compress() <= b.compress_max );
+		}
+		CHECK( f.controller.quality() == b.quality_min );
+		CHECK( f.controller.compress() == b.compress_max );
+
+		// probes upwards 4 s after the last back off at the earliest, then
+		// every 2 s, one level each, the compression down each time.
+		double const down = f.time;
+		double at = f.until_change( good, 10.0 );
+		CHECK( at - down >= 4.0 - 1e-9 && at - down < 4.0 + 2 * dt );
+		CHECK( f.controller.quality() == b.quality_min + 1 );
+		CHECK( f.controller.compress() == b.compress_max - 1 );
+		for( int q = b.quality_min + 2; q <= b.quality_max; ++q ) {
+			double const next = f.until_change( good, 10.0 );
+			CHECK( next - at >= 2.0 - 1e-9 && next - at < 2.0 + 2 * dt );
+			CHECK( f.controller.quality() == q );
+			at = next;
+		}
+		// idle for long: up to the bounds and no further.
+		CHECK( f.until_change( good, 30.0 ) < 0.0 );
+		CHECK( f.controller.quality() == b.quality_max );
+		CHECK( f.controller.compress() == b.compress_min );
+	}
+	// between half the target and the target, it holds; that restarts the 2 s.
+	{
+		quality_bounds_t const b = adaptive();
+		feeder_t f( b );
+		f.update( slow );
+		f.update( slow );
+		CHECK( f.until_change( good, 3.9 ) < 0.0 );
+		CHECK( f.until_change( 0.7 * target, 1.0 ) < 0.0 );
+		double const start = f.time;
+		double const at = f.until_change( good, 10.0 );
+		CHECK( at - start >= 2.0 - 1e-9 && at - start < 2.0 + 2 * dt );
+	}
+	// lossless once idle at quality_max, if allowed; lossy again on congestion.
+	{
+		quality_bounds_t b = adaptive();
+		b.lossless = true;
+		feeder_t f( b );
+		CHECK( f.until_change( good, 10.0 ) > 0.0 );
+		CHECK( f.controller.quality() == -1 );
+		CHECK( f.until_change( good, 10.0 ) < 0.0 );
+		f.update( slow );
+		CHECK( f.update( slow ) );
+		CHECK( f.controller.quality() == b.quality_max );
+	}
+	return 0;
+}
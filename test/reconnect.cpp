@@ -0,0 +1,120 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// vnc_engine_t across reconnections.  reconnect_delay(): within its bounds,
+// doubling up to 4 s - 8 s and spread over them.  then on the loopback: a
+// server which closes every connection at once is retried on that schedule,
+// and host/load_server's disconnect workload, which closes each connection
+// after 1 - 4 s, is back after the shortest delay since an update came.  it
+// prints the time to the first pixels of the first connection and of the
+// ones after (each from the last pixels before).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "vnc_engine.hpp"
+#include "load_server.hpp"
+#include "check.hpp"
+
+
+double now() {
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void test_delay() {
+	std::mt19937 rng( 1 );
+	for( int failures = 0; failures < 10; ++failures ) {
+		int const ms = 250 << std::min( failures, 5 );
+		int lo = ms, hi = 0;
+		for( int i = 0; i < 10000; ++i ) {
+			int const d = reconnect_delay( failures, rng );
+			lo = std::min( lo, d );
+			hi = std::max( hi, d );
+		}
+		CHECK( ms / 2 <= lo && lo < ms / 2 + ms / 50 && ms - ms / 50 < hi && hi <= ms );
+	}
+}
+
+// a server which accepts and closes: the time of each attempt.
+void test_schedule() {
+	int const port = test_port( 1 );
+	int const fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	int const one = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	sockaddr_in addr = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons( port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	CHECK( bind( fd, reinterpret_cast<sockaddr*>( &addr ), sizeof( addr ) ) == 0 && listen( fd, 4 ) == 0 );
+
+	vnc_params_t params;
+	params.host = "127.0.0.1";
+	params.port = port;
+	std::vector<double> attempts;
+	{
+		vnc_engine_t engine;
+		auto const screen = engine.add( params );
+		while( attempts.size() < 4 ) {
+			pollfd p = { fd, POLLIN, 0 };
+			CHECK( poll( &p, 1, 5000 ) == 1 );
+			attempts.push_back( now() );
+			close( accept( fd, nullptr, nullptr ) );
+		}
+	}
+	close( fd );
+
+	// 125 ms - 250 ms, 250 ms - 500 ms, 500 ms - 1 s: they do not overlap.
+	for( size_t i = 0; i + 1 < attempts.size(); ++i ) {
+		double const ms = 0.250 * double( 1 << i );
+		double const gap = attempts[i + 1] - attempts[i];
+		std::printf( "attempt %zu: %.0f ms after the one before\n", i + 1, 1e3 * gap );
+		CHECK( ms / 2 <= gap && gap < ms + 0.1 );
+	}
+}
+
+void test_reconnect( char const* const self ) {
+	load_server_t server( self, { "-w", "disconnect", "-s", "640x360" } );
+	vnc_params_t params;
+	params.host = "127.0.0.1";
+	params.port = test_port();
+	vnc_engine_t engine;
+	double const t0 = now();
+	auto const screen = engine.add( params );
+
+	// the first update of a connection publishes its layout of the monitors.
+	std::vector<double> firsts; // [s] the first pixels, from the last before.
+	double last = t0;
+	while( firsts.size() < 3 ) {
+		CHECK( now() - t0 < 20.0 );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		auto region = screen->mailbox.take();
+		if( region == nullptr ) {
+			continue;
+		}
+		double const t = now();
+		CHECK( region->w == 640 && region->h == 360 );
+		if( region->monitors ) {
+			firsts.push_back( t - last );
+		}
+		last = t;
+		screen->mailbox.recycle( std::move( region ) );
+	}
+
+	std::printf( "the first pixels in %.0f ms, again %.0f ms and %.0f ms after the last ones\n", 1e3 * firsts[0], 1e3 * firsts[1], 1e3 * firsts[2] );
+	CHECK( firsts[0] < 1.0 );
+	// 125 ms - 250 ms each time, not doubling: an update has come before.
+	// a frame (33 ms) before the close, and the handshake after.
+	CHECK( 0.125 <= firsts[1] && firsts[1] < 0.5 && 0.125 <= firsts[2] && firsts[2] < 0.5 );
+}
+
+int main( int const argc, char** const argv ) {
+	test_delay();
+	test_schedule();
+	test_reconnect( argv[0] );
+	return 0;
+}
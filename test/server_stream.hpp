@@ -0,0 +1,162 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the host tests which play a server without a socket: what it sends, from
+// the handshake on, built up as host/encode_clip builds a recording, and
+// fed to client_connection_t by the test.  with libavcodec (HAVE_H264),
+// libx264 encodes the H.264 rects.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <rfb/Rect.h>
+#include <rfb/encodings.h>
+#include "rfb_encoder.hpp"
+#include "check.hpp"
+
+#if defined( HAVE_H264 )
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+
+// a smooth picture moving with t, 3 bytes a pixel.
+inline std::vector<uint8_t> moving_picture( int const w, int const h, int const t ) {
+	std::vector<uint8_t> rgb( 3 * w * h );
+	for( int y = 0; y < h; ++y ) {
+		for( int x = 0; x < w; ++x ) {
+			uint8_t* const p = &rgb[3 * (w * y + x)];
+			p[0] = uint8_t( 128.0 + 100.0 * std::sin( double( x + 3 * t ) / 17.0 ) );
+			p[1] = uint8_t( 128.0 + 100.0 * std::sin( double( y + 2 * t ) / 13.0 ) );
+			p[2] = uint8_t( 128.0 + 100.0 * std::sin( double( x + y + 5 * t ) / 23.0 ) );
+		}
+	}
+	return rgb;
+}
+
+struct server_stream_t: rfb_buffer_t {
+	// up to ServerInit: RFB 3.8 without authentication.
+	void handshake( int const w, int const h ) {
+		char const version[] = "RFB 003.008\n";
+		bytes( reinterpret_cast<uint8_t const*>( version ), sizeof( version ) - 1 );
+		u8( 1 ); // security types.
+		u8( 1 ); // none.
+		u32( 0 ); // SecurityResult: OK.
+		u16( w );
+		u16( h );
+		// 32 bpp, depth 24, little endian, true colour, the same as pixel_buffer_t.
+		u8( 32 ); u8( 24 ); u8( 0 ); u8( 1 );
+		u16( 255 ); u16( 255 ); u16( 255 );
+		u8( 0 ); u8( 8 ); u8( 16 );
+		u8( 0 ); u8( 0 ); u8( 0 );
+		char const name[] = "host test";
+		u32( sizeof( name ) - 1 );
+		bytes( reinterpret_cast<uint8_t const*>( name ), sizeof( name ) - 1 );
+	}
+
+	// the header of a FramebufferUpdate of n rects, which follow.
+	void update( int const n ) {
+		u8( 0 );
+		u8( 0 );
+		u16( n );
+	}
+
+	// a Tight JPEG rect of r, whose pixels are at rgb, stride bytes a row.
+	void jpeg( rfb::Rect const& r, uint8_t const* const rgb, int const stride, int const level ) {
+		rect( r.tl.x, r.tl.y, r.width(), r.height(), rfb::encodingTight );
+		tight_jpeg( *this, encode_jpeg( rgb, stride, r.width(), r.height(), jpeg_quality[level] ) );
+	}
+
+	// an update of the whole of rgb (w x h) in rects of at most 65536 pixels,
+	// as TigerVNC's EncodeManager splits it.
+	void tight( int const w, int const h, std::vector<uint8_t> const& rgb, int const level ) {
+		int const rh = 65536 / w;
+		update( (h + rh - 1) / rh );
+		for( int y = 0; y < h; y += rh ) {
+			jpeg( { 0, y, w, std::min( y + rh, h ) }, rgb.data() + 3 * w * y, 3 * w, level );
+		}
+	}
+
+	// an Open H.264 rect: the access unit au continues the stream of r.
+	void h264( rfb::Rect const& r, std::vector<uint8_t> const& au, uint32_t const flags = 0 ) {
+		rect( r.tl.x, r.tl.y, r.width(), r.height(), rfb::encodingH264 );
+		u32( au.size() );
+		u32( flags );
+		bytes( au.data(), au.size() );
+	}
+};
+
+#if defined( HAVE_H264 )
+// libx264 as a server runs it: an access unit out for each frame in, the
+// first an IDR frame and P frames after it.
+struct h264_encoder_t {
+	h264_encoder_t( int const w, int const h ) {
+		AVCodec const* const codec = avcodec_find_encoder_by_name( "libx264" );
+		CHECK( codec != nullptr );
+		_ctx = avcodec_alloc_context3( codec );
+		CHECK( _ctx != nullptr );
+		_ctx->width        = w;
+		_ctx->height       = h;
+		_ctx->pix_fmt      = AV_PIX_FMT_YUV420P;
+		_ctx->time_base    = { 1, 30 };
+		_ctx->gop_size     = 1 << 16;
+		_ctx->max_b_frames = 0;
+		av_opt_set( _ctx->priv_data, "preset", "ultrafast", 0 );
+		av_opt_set( _ctx->priv_data, "tune", "zerolatency", 0 );
+		av_opt_set( _ctx->priv_data, "crf", "18", 0 );
+		av_opt_set( _ctx->priv_data, "x264-params", "scenecut=0", 0 );
+		CHECK( avcodec_open2( _ctx, codec, nullptr ) == 0 );
+
+		_frame = av_frame_alloc();
+		_frame->format = AV_PIX_FMT_YUV420P;
+		_frame->width  = w;
+		_frame->height = h;
+		CHECK( av_frame_get_buffer( _frame, 0 ) == 0 );
+		_packet = av_packet_alloc();
+		_sws = sws_getContext( w, h, AV_PIX_FMT_RGB24, w, h, AV_PIX_FMT_YUV420P, SWS_BICUBIC, nullptr, nullptr, nullptr );
+		CHECK( _packet != nullptr && _sws != nullptr );
+	}
+
+	h264_encoder_t( h264_encoder_t const& )            = delete;
+	h264_encoder_t& operator=( h264_encoder_t const& ) = delete;
+
+	~h264_encoder_t() {
+		sws_freeContext( _sws );
+		av_packet_free( &_packet );
+		av_frame_free( &_frame );
+		avcodec_free_context( &_ctx );
+	}
+
+	// whether libavcodec is built with it; the tests skip H.264 if not.
+	static bool available() {
+		return avcodec_find_encoder_by_name( "libx264" ) != nullptr;
+	}
+
+	// the Annex B stream of rgb, 3 bytes a pixel.
+	std::vector<uint8_t> encode( std::vector<uint8_t> const& rgb ) {
+		CHECK( av_frame_make_writable( _frame ) == 0 );
+		uint8_t const* const src[1] = { rgb.data() };
+		int const stride[1] = { 3 * _ctx->width };
+		sws_scale( _sws, src, stride, 0, _ctx->height, _frame->data, _frame->linesize );
+		_frame->pts = _pts++;
+		CHECK( avcodec_send_frame( _ctx, _frame ) == 0 );
+		std::vector<uint8_t> au;
+		while( avcodec_receive_packet( _ctx, _packet ) == 0 ) {
+			au.insert( au.end(), _packet->data, _packet->data + _packet->size );
+			av_packet_unref( _packet );
+		}
+		CHECK( !au.empty() );
+		return au;
+	}
+
+private:
+	AVCodecContext* _ctx    = nullptr;
+	AVFrame*        _frame  = nullptr;
+	AVPacket*       _packet = nullptr;
+	SwsContext*     _sws    = nullptr;
+	int64_t         _pts    = 0;
+};
+#endif
@@ -0,0 +1,184 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the SIMD kernels of the Tight filters (TigerVNC patch, rfb/TightFilter.h)
+// which this CPU runs, against the scalar ones on random rects: odd sizes for
+// the tails, a stride wider than the rect, and every layout of R, G and B.
+// the output starts as the same garbage for both, so the texels beside the
+// rect must stay as they were.
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <rfb/TightFilter.h>
+#include "check.hpp"
+
+
+template<class F>
+struct kernel_t {
+	char const* name;
+	bool        supported;
+	F           f;
+};
+
+using gradient_t = void (*)( rdr::U8 const*, rdr::U32*, int, int, int, rfb::TightFilterLayout const& );
+using palette1_t = void (*)( rdr::U32 const*, rdr::U8 const*, rdr::U32*, int, int, int );
+using palette8_t = void (*)( rdr::U32 const*, int, rdr::U8 const*, rdr::U32*, int, int, int );
+
+#if defined( TIGHT_FILTER_X86 )
+bool const has_sse2  = __builtin_cpu_supports( "sse2" );
+bool const has_ssse3 = __builtin_cpu_supports( "ssse3" );
+bool const has_avx2  = __builtin_cpu_supports( "avx2" );
+#endif
+
+std::vector<kernel_t<gradient_t>> const gradients = {
+	{ "selected", true, rfb::tightFilterKernels().gradient24 },
+#if defined( TIGHT_FILTER_X86 )
+	{ "SSSE3", has_ssse3, rfb::tightGradient24SSSE3 },
+#elif defined( TIGHT_FILTER_NEON )
+	{ "NEON", true, rfb::tightGradient24NEON },
+#endif
+};
+
+std::vector<kernel_t<palette1_t>> const palettes1 = {
+	{ "selected", true, rfb::tightFilterKernels().palette1 },
+#if defined( TIGHT_FILTER_X86 )
+	{ "SSE2", has_sse2, rfb::tightPalette1SSE2 },
+	{ "AVX2", has_avx2, rfb::tightPalette1AVX2 },
+#elif defined( TIGHT_FILTER_NEON )
+	{ "NEON", true, rfb::tightPalette1NEON },
+#endif
+};
+
+std::vector<kernel_t<palette8_t>> const palettes8 = {
+	{ "selected", true, rfb::tightFilterKernels().palette8 },
+#if defined( TIGHT_FILTER_X86 )
+	{ "SSSE3", has_ssse3, rfb::tightPalette8SSSE3 },
+	{ "AVX2", has_avx2, rfb::tightPalette8AVX2 },
+#elif defined( TIGHT_FILTER_NEON )
+	{ "NEON", true, rfb::tightPalette8NEON },
+#endif
+};
+
+int const iterations = 2000;
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+std::vector<rdr::U8> random_bytes( size_t const n, int const hi = 0xff ) {
+	std::vector<rdr::U8> xs( n );
+	for( auto& x: xs ) {
+		x = rdr::U8( uniform( 0, hi ) );
+	}
+	return xs;
+}
+
+std::vector<rdr::U32> random_pixels( size_t const n ) {
+	std::vector<rdr::U32> xs( n );
+	for( auto& x: xs ) {
+		x = rng();
+	}
+	return xs;
+}
+
+// w up to 67: the 8 and 16 pixel loops of the kernels and their tails.
+struct rect_t {
+	int w      = uniform( 1, 67 );
+	int h      = uniform( 1, 9 );
+	int stride = w + uniform( 0, 5 );
+};
+
+void test_gradient( kernel_t<gradient_t> const& kernel ) {
+	for( int i = 0; i < iterations; ++i ) {
+		rect_t const r;
+		// the three bytes of R, G and B out of the four, in any order.
+		rfb::TightFilterLayout layout;
+		int const skip = uniform( 0, 3 );
+		int offsets[3] = { 0, 1, 2 };
+		for( auto& o: offsets ) {
+			o += o >= skip;
+		}
+		std::shuffle( offsets, offsets + 3, rng );
+		std::copy( offsets, offsets + 3, layout.offset );
+
+		std::vector<rdr::U8> const in = random_bytes( 3 * r.w * r.h );
+		std::vector<rdr::U32> expected = random_pixels( r.stride * r.h );
+		std::vector<rdr::U32> actual   = expected;
+		rfb::tightGradient24Scalar( in.data(), expected.data(), r.stride, r.w, r.h, layout );
+		kernel.f( in.data(), actual.data(), r.stride, r.w, r.h, layout );
+		if( actual != expected ) {
+			std::fprintf( stderr, "gradient %s: %dx%d, stride %d\n", kernel.name, r.w, r.h, r.stride );
+		}
+		CHECK( actual == expected );
+	}
+}
+
+void test_palette1( kernel_t<palette1_t> const& kernel ) {
+	for( int i = 0; i < iterations; ++i ) {
+		rect_t const r;
+		std::vector<rdr::U32> const palette = random_pixels( 2 );
+		std::vector<rdr::U8> const in = random_bytes( (r.w + 7) / 8 * r.h );
+		std::vector<rdr::U32> expected = random_pixels( r.stride * r.h );
+		std::vector<rdr::U32> actual   = expected;
+		rfb::tightPalette1Scalar( palette.data(), in.data(), expected.data(), r.stride, r.w, r.h );
+		kernel.f( palette.data(), in.data(), actual.data(), r.stride, r.w, r.h );
+		if( actual != expected ) {
+			std::fprintf( stderr, "palette1 %s: %dx%d, stride %d\n", kernel.name, r.w, r.h, r.stride );
+		}
+		CHECK( actual == expected );
+	}
+}
+
+// the indices are in the palette, as the protocol requires.  the palette
+// itself has 256 entries, as TightDecoder's.
+void test_palette8( kernel_t<palette8_t> const& kernel ) {
+	for( int i = 0; i < iterations; ++i ) {
+		rect_t const r;
+		int const size = i % 2 == 0 ? uniform( 3, 16 ) : uniform( 17, 256 );
+		std::vector<rdr::U32> const palette = random_pixels( 256 );
+		std::vector<rdr::U8> const in = random_bytes( r.w * r.h, size - 1 );
+		std::vector<rdr::U32> expected = random_pixels( r.stride * r.h );
+		std::vector<rdr::U32> actual   = expected;
+		rfb::tightPalette8Scalar( palette.data(), size, in.data(), expected.data(), r.stride, r.w, r.h );
+		kernel.f( palette.data(), size, in.data(), actual.data(), r.stride, r.w, r.h );
+		if( actual != expected ) {
+			std::fprintf( stderr, "palette8 %s: %d colours, %dx%d, stride %d\n", kernel.name, size, r.w, r.h, r.stride );
+		}
+		CHECK( actual == expected );
+	}
+}
+
+void check_layout( rfb::PixelFormat const& pf, int const r, int const g, int const b ) {
+	rfb::TightFilterLayout const layout = rfb::tightFilterLayout( pf );
+	CHECK( layout.offset[0] == r );
+	CHECK( layout.offset[1] == g );
+	CHECK( layout.offset[2] == b );
+}
+
+int main() {
+	for( auto const& k: gradients ) {
+		if( k.supported ) {
+			test_gradient( k );
+			std::printf( "gradient24 %s\n", k.name );
+		}
+	}
+	for( auto const& k: palettes1 ) {
+		if( k.supported ) {
+			test_palette1( k );
+			std::printf( "palette1 %s\n", k.name );
+		}
+	}
+	for( auto const& k: palettes8 ) {
+		if( k.supported ) {
+			test_palette8( k );
+			std::printf( "palette8 %s\n", k.name );
+		}
+	}
+
+	// pixel_buffer_t's format, BGRX, and XBGR as the bytes are stored.
+	check_layout( { 32, 24, false, true, 255, 255, 255,  0,  8, 16 }, 0, 1, 2 );
+	check_layout( { 32, 24, false, true, 255, 255, 255, 16,  8,  0 }, 2, 1, 0 );
+	check_layout( { 32, 24, false, true, 255, 255, 255, 24, 16,  8 }, 3, 2, 1 );
+	return 0;
+}
@@ -0,0 +1,102 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// tile_hashes_t on a framebuffer whose size is not a multiple of the tiles:
+// pixels sent again unchanged are dropped, one pixel changed anywhere
+// (including the partial tiles on the right and bottom edges) lets exactly
+// its tile through, clipped to the damage, and resize(), reset() and forget()
+// decide what is known.
+#include <random>
+#include <vector>
+#include "tile_hash.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+bool same( rfb::Region const& a, rfb::Region const& b ) {
+	return a.equals( b ) || (a.is_empty() && b.is_empty());
+}
+
+int const w = 203; // 3 tiles and 11 pixels: a lane of 8 and 3 on their own.
+int const h = 130; // 2 tiles and 2 pixels.
+int const size = tile_hashes_t::size;
+
+rfb::Rect tile_of( int const x, int const y ) {
+	return rfb::Rect( x / size * size, y / size * size, x / size * size + size, y / size * size + size ).intersect( { 0, 0, w, h } );
+}
+
+int main() {
+	std::vector<uint32_t> buf( w * h );
+	for( auto& p: buf ) {
+		p = rng();
+	}
+	rfb::Region const all( rfb::Rect( 0, 0, w, h ) );
+
+	tile_hashes_t tiles;
+	tiles.resize( w, h );
+	// nothing is known at first.
+	CHECK( same( tiles.filter( buf.data(), all ), all ) );
+	// sent again unchanged.
+	CHECK( tiles.filter( buf.data(), all ).is_empty() );
+
+	// one pixel, inside a tile and on each partial edge.
+	for( auto const& p: { rfb::Point( 70, 10 ), rfb::Point( w - 1, 10 ), rfb::Point( 10, h - 1 ), rfb::Point( w - 1, h - 1 ), rfb::Point( 192, 128 ) } ) {
+		buf[w * p.y + p.x] ^= 1;
+		CHECK( same( tiles.filter( buf.data(), all ), tile_of( p.x, p.y ) ) );
+		CHECK( tiles.filter( buf.data(), all ).is_empty() );
+	}
+
+	// at random: a one-bit change always changes the hash of its tile.
+	for( int i = 0; i < 2000; ++i ) {
+		int const x = uniform( 0, w - 1 );
+		int const y = uniform( 0, h - 1 );
+		buf[w * y + x] ^= 1u << uniform( 0, 31 );
+		// the damage is a rect around the pixel, which the result is clipped to.
+		rfb::Rect const d = rfb::Rect( x - uniform( 0, 80 ), y - uniform( 0, 80 ), x + 1 + uniform( 0, 80 ), y + 1 + uniform( 0, 80 ) ).intersect( { 0, 0, w, h } );
+		CHECK( same( tiles.filter( buf.data(), d ), rfb::Region( tile_of( x, y ) ).intersect( d ) ) );
+	}
+
+	// damage in several rects over the same tile hashes it once.
+	buf[w * 5 + 5] ^= 1;
+	rfb::Region split;
+	split.assign_union( rfb::Rect( 0, 0, 10, 4 ) );
+	split.assign_union( rfb::Rect( 0, 4, 20, 8 ) );
+	CHECK( same( tiles.filter( buf.data(), split ), split ) );
+
+	// the damage outside a changed tile is dropped, not its share of the tile.
+	buf[w * 100 + 100] ^= 1;
+	CHECK( same( tiles.filter( buf.data(), all ), tile_of( 100, 100 ) ) );
+
+	// forget(): the tiles which r touches go through, unchanged.
+	tiles.forget( { 60, 60, 70, 70 } );
+	rfb::Region expected;
+	for( auto const& p: { rfb::Point( 0, 0 ), rfb::Point( 64, 0 ), rfb::Point( 0, 64 ), rfb::Point( 64, 64 ) } ) {
+		expected.assign_union( tile_of( p.x, p.y ) );
+	}
+	CHECK( same( tiles.filter( buf.data(), all ), expected ) );
+	CHECK( tiles.filter( buf.data(), all ).is_empty() );
+
+	// resize() forgets everything, even at the same size.
+	tiles.resize( w, h );
+	CHECK( same( tiles.filter( buf.data(), all ), all ) );
+
+	// reset(): what the render thread already has is known.
+	tiles.resize( w, h );
+	tiles.reset( buf.data() );
+	CHECK( tiles.filter( buf.data(), all ).is_empty() );
+	buf[0] ^= 1;
+	CHECK( same( tiles.filter( buf.data(), all ), tile_of( 0, 0 ) ) );
+
+	// a new size: the old hashes do not apply to the new grid.
+	int const w2 = 130;
+	int const h2 = 70;
+	std::vector<uint32_t> small( buf.begin(), buf.begin() + w2 * h2 );
+	tiles.resize( w2, h2 );
+	rfb::Region const all2( rfb::Rect( 0, 0, w2, h2 ) );
+	CHECK( same( tiles.filter( small.data(), all2 ), all2 ) );
+	CHECK( tiles.filter( small.data(), all2 ).is_empty() );
+	return 0;
+}
@@ -0,0 +1,288 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the tiles of the uploads without GL: the split into tiles, their order by
+// tile_cost(), drain_uploads() across queues within the bytes and the time,
+// and regions taken every frame on top of the tiles left of earlier ones,
+// whose copies move them and whose pixels replace them.  the simulated
+// texture must end up as the framebuffer, and no tile may point into a
+// region which has been given back.
+#include <limits>
+#include <memory>
+#include <random>
+#include "upload_queue.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+int uniform( int const lo, int const hi ) {
+	return std::uniform_int_distribution<int>( lo, hi )( rng );
+}
+
+std::vector<upload_queue_t::tile_t> drain( upload_queue_t& queue ) {
+	std::vector<upload_queue_t::tile_t> tiles;
+	for( ; !queue.empty(); queue.pop() ) {
+		tiles.push_back( queue.top() );
+	}
+	return tiles;
+}
+
+void check_push() {
+	// 600 x 300 at (10, 20): 3 x 2 tiles, the last ones cut.
+	std::vector<rfb::Rect> const rects = { { 10, 20, 610, 320 }, { 0, 0, 5, 5 } };
+	std::vector<uint32_t> pixels( 600 * 300 + 25 );
+	for( size_t i = 0; i < pixels.size(); ++i ) {
+		pixels[i] = uint32_t( i );
+	}
+	upload_queue_t queue;
+	queue.push( rects, pixels.data(), 2, 7 );
+	std::vector<upload_queue_t::tile_t> const tiles = drain( queue );
+	CHECK( tiles.size() == 7 );
+	rfb::Region covered;
+	for( auto const& t: tiles ) {
+		CHECK( t.level == 2 && t.region == 7 );
+		CHECK( t.rect.width() <= 256 && t.rect.height() <= 256 );
+		CHECK( covered.intersect( t.rect ).is_empty() );
+		covered.assign_union( t.rect );
+		// the pixel at (x, y) is where rects[i] packs it.
+		auto const& r = t.rect.enclosed_by( rects[0] ) ? rects[0] : rects[1];
+		size_t const base = &r == &rects[0] ? 0 : 600 * 300;
+		for( int y = t.rect.tl.y; y < t.rect.br.y; ++y ) {
+			for( int x = t.rect.tl.x; x < t.rect.br.x; ++x ) {
+				CHECK( t.pixels[size_t( t.stride ) * (y - t.rect.tl.y) + (x - t.rect.tl.x)] == base + size_t( r.width() ) * (y - r.tl.y) + (x - r.tl.x) );
+			}
+		}
+	}
+	CHECK( covered.equals( rfb::Region( rects[0] ).union_( rects[1] ) ) );
+}
+
+void check_cost() {
+	rfb::Rect const visible( 1000, 0, 2000, 1000 );
+	float const radians = 0.001f;
+	float const nan = std::numeric_limits<float>::quiet_NaN();
+	// in view, nothing else known: all the same.
+	CHECK( tile_cost( { 1000, 0, 1256, 256 }, visible, nan, nan, radians ) == 0.0f );
+	CHECK( tile_cost( { 0, 0, 256, 256 }, visible, nan, nan, radians ) == float( M_PI ) );
+	// at the point, then by the angle to it.
+	CHECK( tile_cost( { 1000, 0, 1256, 256 }, visible, 1100.0f, 100.0f, radians ) == 0.0f );
+	CHECK( std::abs( tile_cost( { 1400, 500, 1656, 756 }, visible, 1100.0f, 100.0f, radians ) - radians * std::hypot( 300.0f, 400.0f ) ) < 1e-6f );
+	// out of view, even if nearer.
+	CHECK( tile_cost( { 744, 0, 1000, 256 }, visible, 1000.0f, 100.0f, radians ) > tile_cost( { 1744, 744, 2000, 1000 }, visible, 1000.0f, 100.0f, radians ) );
+
+	// prioritize(): the least first.
+	upload_queue_t queue;
+	queue.tile_size = 16;
+	std::vector<uint32_t> pixels( 256 * 256 );
+	queue.push( { { 0, 0, 256, 256 } }, pixels.data(), 0 );
+	queue.prioritize( [&]( upload_queue_t::tile_t const& t ) {
+		return tile_cost( t.rect, { 128, 0, 256, 256 }, 200.0f, 30.0f, radians );
+	} );
+	float last = -1.0f;
+	int seen = 0;
+	for( auto const& t: drain( queue ) ) {
+		CHECK( t.cost >= last );
+		// the tiles in view all go before those out of it.
+		CHECK( (t.rect.tl.x >= 128) == (seen < 128) );
+		last = t.cost;
+		seen += 1;
+	}
+	CHECK( seen == 256 );
+}
+
+void check_drain() {
+	std::vector<uint32_t> pixels( 256 * 256 );
+	upload_queue_t a, b;
+	a.tile_size = b.tile_size = 16;
+	auto const fill = [&]() {
+		a.clear();
+		b.clear();
+		a.push( { { 0, 0, 64, 64 } }, pixels.data(), 0 );
+		b.push( { { 0, 0, 64, 64 } }, pixels.data(), 0 );
+		// a: 0, 2, 4, ..; b: 1, 3, 5, ..
+		a.prioritize( []( upload_queue_t::tile_t const& t ) {
+			return float( 2 * (t.rect.tl.y / 16 * 4 + t.rect.tl.x / 16) );
+		} );
+		b.prioritize( []( upload_queue_t::tile_t const& t ) {
+			return float( 2 * (t.rect.tl.y / 16 * 4 + t.rect.tl.x / 16) + 1 );
+		} );
+	};
+	size_t const tile = 4 * 16 * 16;
+
+	// across the queues, the least cost first, all of them.
+	fill();
+	std::vector<float> costs;
+	size_t done = drain_uploads( { &a, &b }, SIZE_MAX, []() { return false; }, [&]( size_t const i, upload_queue_t::tile_t const& t ) {
+		CHECK( (i == 0 ? &a : &b)->top().cost == t.cost );
+		costs.push_back( t.cost );
+	} );
+	CHECK( done == 32 * tile && a.empty() && b.empty() );
+	for( size_t i = 0; i < costs.size(); ++i ) {
+		CHECK( costs[i] == float( i ) );
+	}
+
+	// the bytes: no more than them, ..
+	fill();
+	int n = 0;
+	done = drain_uploads( { &a, &b }, 5 * tile + tile / 2, []() { return false; }, [&]( size_t, upload_queue_t::tile_t const& ) { n += 1; } );
+	CHECK( n == 5 && done == 5 * tile );
+	CHECK( a.top().cost == 6.0f && b.top().cost == 5.0f );
+	// .. but one tile if they are fewer.
+	n = 0;
+	done = drain_uploads( { &a, &b }, 1, []() { return false; }, [&]( size_t, upload_queue_t::tile_t const& ) { n += 1; } );
+	CHECK( n == 1 && done == tile );
+
+	// the time: asked after each tile, never before the first.
+	fill();
+	int asked = 0;
+	n = 0;
+	done = drain_uploads( { &a, &b }, SIZE_MAX, [&]() { return ++asked > 3; }, [&]( size_t, upload_queue_t::tile_t const& ) { n += 1; } );
+	CHECK( n == 4 && asked == 4 );
+	n = 0;
+	done = drain_uploads( { &a, &b }, SIZE_MAX, []() { return true; }, [&]( size_t, upload_queue_t::tile_t const& ) { n += 1; } );
+	CHECK( n == 1 && done == tile );
+
+	// nothing to do.
+	a.clear();
+	b.clear();
+	CHECK( drain_uploads( { &a, &b }, SIZE_MAX, []() { return false; }, []( size_t, upload_queue_t::tile_t const& ) { CHECK( false ); } ) == 0 );
+	CHECK( drain_uploads( {}, SIZE_MAX, []() { return false; }, []( size_t, upload_queue_t::tile_t const& ) { CHECK( false ); } ) == 0 );
+}
+
+// a frame of w x h texels; the framebuffer, or the texture of the render thread.
+struct frame_t {
+	frame_t( int const w, int const h ):
+		w( w ),
+		pixels( w * h, 0 )
+	{
+	}
+
+	void copy( copy_rect_t const& c ) {
+		std::vector<uint32_t> const old = pixels;
+		rfb::Rect const s = c.source();
+		for( int y = 0; y < c.rect.height(); ++y ) {
+			for( int x = 0; x < c.rect.width(); ++x ) {
+				pixels[w * (c.rect.tl.y + y) + c.rect.tl.x + x] = old[w * (s.tl.y + y) + s.tl.x + x];
+			}
+		}
+	}
+
+	void upload( upload_queue_t::tile_t const& t ) {
+		for( int y = t.rect.tl.y; y < t.rect.br.y; ++y ) {
+			for( int x = t.rect.tl.x; x < t.rect.br.x; ++x ) {
+				pixels[w * y + x] = t.pixels[size_t( t.stride ) * (y - t.rect.tl.y) + (x - t.rect.tl.x)];
+			}
+		}
+	}
+
+	int                   w;
+	std::vector<uint32_t> pixels;
+};
+
+struct region_t {
+	uint32_t                 serial;
+	std::vector<copy_rect_t> copies;
+	std::vector<rfb::Rect>   rects;
+	std::vector<uint32_t>    pixels;
+};
+
+rfb::Rect random_rect( int const w, int const h ) {
+	int const x0 = uniform( 0, w - 1 );
+	int const y0 = uniform( 0, h - 1 );
+	return { x0, y0, uniform( x0 + 1, std::min( x0 + w / 2, w ) ), uniform( y0 + 1, std::min( y0 + h / 2, h ) ) };
+}
+
+void check_regions() {
+	int const w = 120;
+	int const h = 80;
+	size_t moved = 0;
+	for( int run = 0; run < 200; ++run ) {
+		frame_t fb( w, h ), tex( w, h );
+		upload_queue_t queue;
+		queue.tile_size = 16;
+		std::vector<std::unique_ptr<region_t>> regions;
+		uint32_t serial = 0;
+		for( int frame = 0; frame < 60; ++frame ) {
+			// a region on top of those left: the copies at once, then the pixels.
+			if( uniform( 0, 2 ) != 0 ) {
+				auto region = std::make_unique<region_t>();
+				region->serial = ++serial;
+				for( int i = uniform( 0, 2 ); i > 0; --i ) {
+					rfb::Rect r = random_rect( w, h );
+					rfb::Point const d( uniform( -20, 20 ), uniform( -20, 20 ) );
+					r = r.intersect( rfb::Rect( 0, 0, w, h ).translate( d ) );
+					if( !r.is_empty() && (d.x != 0 || d.y != 0) ) {
+						region->copies.push_back( { r, d } );
+					}
+				}
+				rfb::Region damage;
+				for( int i = uniform( 0, 3 ); i > 0; --i ) {
+					damage.assign_union( random_rect( w, h ) );
+				}
+				damage.get_rects( &region->rects );
+				for( auto const& c: region->copies ) {
+					fb.copy( c );
+					tex.copy( c );
+					moved += queue.empty() ? 0 : 1;
+					queue.move( c );
+				}
+				for( auto const& r: region->rects ) {
+					for( int y = r.tl.y; y < r.br.y; ++y ) {
+						for( int x = r.tl.x; x < r.br.x; ++x ) {
+							uint32_t const p = rng();
+							fb.pixels[w * y + x] = p;
+							region->pixels.push_back( p );
+						}
+					}
+				}
+				queue.cover( region->rects, 0 );
+				queue.push( region->rects, region->pixels.data(), 0, region->serial );
+				regions.push_back( std::move( region ) );
+			}
+
+			queue.prioritize( [&]( upload_queue_t::tile_t const& t ) {
+				return float( rng() % 100 );
+			} );
+			drain_uploads( { &queue }, size_t( 4 * uniform( 1, 3000 ) ), []() { return false; }, [&]( size_t, upload_queue_t::tile_t const& t ) {
+				CHECK( t.rect.enclosed_by( rfb::Rect( 0, 0, w, h ) ) && !t.rect.is_empty() );
+				tex.upload( t );
+			} );
+
+			// those done are given back: spoilt, so that a tile left in them shows.
+			for( auto it = regions.begin(); it != regions.end(); ) {
+				if( queue.has( (*it)->serial ) ) {
+					++it;
+					continue;
+				}
+				std::fill( (*it)->pixels.begin(), (*it)->pixels.end(), 0xdeadbeefu );
+				it = regions.erase( it );
+			}
+			if( queue.empty() ) {
+				CHECK( regions.empty() );
+				CHECK( tex.pixels == fb.pixels );
+			}
+		}
+		drain_uploads( { &queue }, SIZE_MAX, []() { return false; }, [&]( size_t, upload_queue_t::tile_t const& t ) {
+			tex.upload( t );
+		} );
+		CHECK( tex.pixels == fb.pixels );
+	}
+	// the copies often went over tiles left.
+	CHECK( moved > 500 );
+
+	// a level is covered on its own.
+	upload_queue_t queue;
+	std::vector<uint32_t> pixels( 64 * 64 );
+	queue.push( { { 0, 0, 64, 64 } }, pixels.data(), 0 );
+	queue.push( { { 0, 0, 32, 32 } }, pixels.data(), 1 );
+	queue.cover( { { 0, 0, 64, 64 } }, 1 );
+	queue.move( { { 0, 0, 64, 64 }, { 0, 0 } } );
+	std::vector<upload_queue_t::tile_t> const tiles = drain( queue );
+	CHECK( tiles.size() == 1 && tiles[0].level == 0 && tiles[0].rect.equals( rfb::Rect( 0, 0, 64, 64 ) ) );
+}
+
+int main() {
+	check_push();
+	check_cost();
+	check_drain();
+	check_regions();
+	return 0;
+}
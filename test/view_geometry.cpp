@@ -0,0 +1,235 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// the geometry of vnc_layer_t without VrApi: the texels a view may see of a
+// cylinder layer, against views straight ahead, turned, behind and upwards,
+// and against random directions in random views; the grid of the rect which
+// is requested; the texture coordinates of a monitor and of the cursor, which
+// must agree with the mapping of the pointer, with the hotspot of the cursor
+// on the pointer.
+#include <random>
+#include "view_geometry.hpp"
+#include "check.hpp"
+
+
+std::mt19937 rng( 1 );
+
+float uniform( float const lo, float const hi ) {
+	return std::uniform_real_distribution<float>( lo, hi )( rng );
+}
+
+bool near( float const a, float const b, float const eps = 1e-4f ) {
+	return std::abs( a - b ) <= eps;
+}
+
+// turned by yaw to the left and pitched up by pitch [radians].
+view_t turned( float const yaw, float const pitch, float const tan_x, float const tan_y ) {
+	float const cy = std::cos( yaw ), sy = std::sin( yaw );
+	float const cp = std::cos( pitch ), sp = std::sin( pitch );
+	view_t v = {
+		{ cy, 0.0f, -sy },
+		{ -sy * sp, cp, -cy * sp },
+		{ sy * cp, sp, cy * cp },
+		tan_x, tan_y,
+	};
+	return v;
+}
+
+// a uniformly random rotation, from a random quaternion.
+view_t random_view( float const tan_x, float const tan_y ) {
+	std::normal_distribution<float> normal;
+	float q[4];
+	float n = 0.0f;
+	for( auto& c: q ) {
+		c = normal( rng );
+		n += c * c;
+	}
+	n = std::sqrt( n );
+	float const w = q[0] / n, x = q[1] / n, y = q[2] / n, z = q[3] / n;
+	view_t v = {
+		{ 1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y) },
+		{ 2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x) },
+		{ 2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y) },
+		tan_x, tan_y,
+	};
+	return v;
+}
+
+void check_views() {
+	float const res = 1000.0f; // texels per pi.
+	int const w = 1000;        // 180 deg around.
+	int const h = 500;
+
+	// straight ahead, 90 deg wide: a quarter of pi either side of the center.
+	{
+		rfb::Rect const r = visible_rect( turned( 0.0f, 0.0f, 1.0f, 0.5f ), res, w, h );
+		CHECK( near( r.tl.x, 250, 1 ) && near( r.br.x, 750, 1 ) );
+		// at the center column, v is tan_y.
+		float const dy = res / float( M_PI ) * 0.5f;
+		CHECK( near( r.tl.y, h / 2 - dy, 1 ) && near( r.br.y, h / 2 + dy, 1 ) );
+	}
+	// turned to the left by 45 deg: the left half.
+	{
+		rfb::Rect const r = visible_rect( turned( float( M_PI / 4 ), 0.0f, 1.0f, 0.5f ), res, w, h );
+		CHECK( r.tl.x == 0 && near( r.br.x, 500, 1 ) );
+	}
+	// turned by 90 deg: half of the view is off the layer.
+	{
+		rfb::Rect const r = visible_rect( turned( float( -M_PI / 2 ), 0.0f, 1.0f, 0.5f ), res, w, h );
+		CHECK( near( r.tl.x, 750, 1 ) && r.br.x == w );
+	}
+	// behind a layer 135 deg around: nothing.
+	{
+		rfb::Rect const r = visible_rect( turned( float( M_PI ), 0.0f, 1.0f, 0.5f ), res, 750, h );
+		CHECK( r.is_empty() );
+	}
+	// behind a layer 324 deg around: both of its ends, so all across.
+	{
+		int const wide = 1800;
+		rfb::Rect const r = visible_rect( turned( float( M_PI ), 0.0f, 1.0f, 0.5f ), res, wide, h );
+		CHECK( r.tl.x == 0 && r.br.x == wide );
+		// but not turned slightly away from one end.
+		rfb::Rect const s = visible_rect( turned( float( M_PI + 0.6 ), 0.0f, 1.0f, 0.5f ), res, wide, h );
+		CHECK( s.tl.x > 0 && s.br.x == wide );
+	}
+	// upwards: above the center; at the zenith, nothing of a layer 38 deg up
+	// and all around the top of one 72 deg up.
+	{
+		rfb::Rect const r = visible_rect( turned( 0.0f, 0.6f, 1.0f, 0.5f ), res, w, h );
+		CHECK( r.tl.y > h / 2 && r.br.y == h );
+		CHECK( visible_rect( turned( 0.0f, float( M_PI / 2 ), 1.0f, 0.5f ), res, w, h ).is_empty() );
+		int const tall = 2000;
+		rfb::Rect const s = visible_rect( turned( 0.0f, float( M_PI / 2 ), 1.0f, 0.5f ), res, w, tall );
+		CHECK( s.tl.x == 0 && s.br.x == w && s.br.y == tall );
+		// lowest at the corners of the view.
+		CHECK( near( s.tl.y, tall / 2 + res / float( M_PI ) / std::hypot( 1.0f, 0.5f ), 1 ) );
+		rfb::Rect const t = visible_rect( turned( 0.0f, -1.2f, 1.0f, 0.5f ), res, w, h );
+		CHECK( t.tl.y == 0 && t.br.y < h / 2 );
+	}
+
+	CHECK( near( widen_tan( 1.0f, 0.0f ), 1.0f ) );
+	CHECK( near( widen_tan( 0.0f, float( M_PI / 4 ) ), 1.0f ) );
+	CHECK( std::isfinite( widen_tan( 1.0f, float( M_PI ) ) ) );
+
+	// any direction in the view which hits the layer, in any view, is in the
+	// rect of the view widened by the margin vnc_layer_t takes.
+	for( int i = 0; i < 20000; ++i ) {
+		float const tan_x = uniform( 0.3f, 1.5f );
+		float const tan_y = uniform( 0.3f, 1.5f );
+		int const lw = int( uniform( 100.0f, 2000.0f ) );
+		int const lh = int( uniform( 100.0f, 2000.0f ) );
+		view_t view = random_view( tan_x, tan_y );
+		float const a = uniform( -tan_x, tan_x );
+		float const b = uniform( -tan_y, tan_y );
+		float d[3];
+		for( int k = 0; k < 3; ++k ) {
+			d[k] = view.axis[k] + a * view.right[k] + b * view.up[k];
+		}
+		// as the pointer maps it.
+		float tu, tv;
+		cylinder_texel( d, std::atan2( d[0], d[2] ), res, lw, lh, tu, tv );
+		view.tan_x = widen_tan( tan_x, float( M_PI / 12 ) );
+		view.tan_y = widen_tan( tan_y, float( M_PI / 12 ) );
+		rfb::Rect const r = visible_rect( view, res, lw, lh );
+		int const x = int( std::floor( tu ) );
+		int const y = int( std::floor( tv ) );
+		if( 0 <= x && x < lw && 0 <= y && y < lh ) {
+			CHECK( r.tl.x <= x && x < r.br.x );
+			CHECK( r.tl.y <= y && y < r.br.y );
+		}
+		CHECK( 0 <= r.tl.x && r.br.x <= lw && 0 <= r.tl.y && r.br.y <= lh );
+	}
+}
+
+void check_request() {
+	int const g = 64;
+	for( int i = 0; i < 10000; ++i ) {
+		int const scale = i % 3;
+		int const x0 = int( uniform( 0.0f, 2000.0f ) ), y0 = int( uniform( 0.0f, 2000.0f ) );
+		rfb::Rect const r( x0, y0, x0 + 1 + int( uniform( 0.0f, 500.0f ) ), y0 + 1 + int( uniform( 0.0f, 500.0f ) ) );
+		rfb::Rect const q = view_request( r, scale );
+		// the least rect on the grid which holds r in desktop pixels.
+		CHECK( q.tl.x % g == 0 && q.tl.y % g == 0 && q.br.x % g == 0 && q.br.y % g == 0 );
+		CHECK( q.tl.x <= (r.tl.x << scale) && (r.tl.x << scale) < q.tl.x + g );
+		CHECK( q.tl.y <= (r.tl.y << scale) && (r.tl.y << scale) < q.tl.y + g );
+		CHECK( q.br.x >= (r.br.x << scale) && (r.br.x << scale) > q.br.x - g );
+		CHECK( q.br.y >= (r.br.y << scale) && (r.br.y << scale) > q.br.y - g );
+		// a small turn within the grid does not change it.
+		if( ((r.tl.x + 1) << scale) >= q.tl.x + g || ((r.br.x + 1) << scale) > q.br.x ) {
+			continue;
+		}
+		CHECK( view_request( r.translate( { 1, 0 } ), scale ).equals( q ) );
+	}
+}
+
+void check_textures() {
+	for( int i = 0; i < 1000; ++i ) {
+		int const scale = i % 3;
+		int const tw = int( uniform( 200.0f, 2000.0f ) );
+		int const th = int( uniform( 200.0f, 2000.0f ) );
+		int const x0 = int( uniform( 0.0f, float( tw - 100 ) ) );
+		int const y0 = int( uniform( 0.0f, float( th - 100 ) ) );
+		rfb::Rect const r( x0, y0, int( uniform( float( x0 + 50 ), float( tw ) ) ), int( uniform( float( y0 + 50 ), float( th ) ) ) );
+		float const resolution = uniform( 500.0f, 4000.0f ); // desktop pixels per pi.
+		float const res = std::ldexp( resolution, -scale );
+		texture_map_t const m = monitor_texture( r, resolution, scale, tw, th );
+
+		CHECK( near( m.rect[0] * float( tw ), float( r.tl.x ), 1e-2f ) );
+		CHECK( near( m.rect[1] * float( th ), float( r.tl.y ), 1e-2f ) );
+		CHECK( near( m.rect[2] * float( tw ), float( r.width() ), 1e-2f ) );
+		CHECK( near( m.rect[3] * float( th ), float( r.height() ), 1e-2f ) );
+		// the center of the cylinder at the center of the monitor, pi
+		// radians around (s from 0 to 1) over res texels, the rows from the
+		// top to the bottom of the monitor.  s grows as u goes down, and the
+		// texel of a direction is where the pointer maps it.
+		CHECK( near( (m.scale[0] * 0.5f + m.offset[0]) * float( tw ), float( r.tl.x ) + 0.5f * float( r.width() ), 1e-2f ) );
+		CHECK( near( m.scale[0] * float( tw ), res, 1e-2f ) );
+		CHECK( near( m.offset[1] * float( th ), float( r.tl.y ), 1e-2f ) );
+		CHECK( near( (m.scale[1] + m.offset[1]) * float( th ), float( r.br.y ), 1e-2f ) );
+		float const u = uniform( -1.5f, 1.5f );
+		float const d[3] = { std::sin( u ), uniform( -1.0f, 1.0f ), std::cos( u ) };
+		float tu, tv;
+		cylinder_texel( d, u, res, r.width(), r.height(), tu, tv );
+		float const s = 0.5f - u / float( M_PI );
+		CHECK( near( (m.scale[0] * s + m.offset[0]) * float( tw ), float( r.tl.x ) + tu, 1e-1f ) );
+
+		// the cursor: a desktop pixel is as far from its corner in the
+		// texture of the cursor as it is on the monitor, and the corner is
+		// the hotspot away from the pointer.
+		int const cw = 32, ch = 48;
+		int const hot_x = int( uniform( 0.0f, float( cw ) ) );
+		int const hot_y = int( uniform( 0.0f, float( ch ) ) );
+		int const px = (r.tl.x << scale) + int( uniform( 0.0f, float( r.width() << scale ) ) );
+		int const py = (r.tl.y << scale) + int( uniform( 0.0f, float( r.height() << scale ) ) );
+		float const x = float( px - hot_x );
+		float const y = float( py - hot_y );
+		texture_map_t const c = cursor_texture( m, r, scale, tw, th, px, py, cw, ch, hot_x, hot_y );
+		// the pointer is on the hotspot: the texture coordinate of the
+		// pointer on the monitor is that of the hotspot in the cursor.
+		float const t_px = (std::ldexp( float( px ), -scale ) / float( tw ) - m.offset[0]) / m.scale[0];
+		float const t_py = (std::ldexp( float( py ), -scale ) / float( th ) - m.offset[1]) / m.scale[1];
+		CHECK( near( (c.scale[0] * t_px + c.offset[0]) * float( cw ), float( hot_x ), 1e-1f ) );
+		CHECK( near( (c.scale[1] * t_py + c.offset[1]) * float( ch ), float( hot_y ), 1e-1f ) );
+		for( float const t: { 0.0f, 0.3f, 1.0f } ) {
+			float const sx = std::ldexp( (m.scale[0] * t + m.offset[0]) * float( tw ), scale );
+			float const sy = std::ldexp( (m.scale[1] * t + m.offset[1]) * float( th ), scale );
+			CHECK( near( (c.scale[0] * t + c.offset[0]) * float( cw ), sx - x, 1e-1f ) );
+			CHECK( near( (c.scale[1] * t + c.offset[1]) * float( ch ), sy - y, 1e-1f ) );
+		}
+		// clipped to the monitor, in the texture of the cursor.
+		float const left   = std::ldexp( float( r.tl.x ), scale );
+		float const top    = std::ldexp( float( r.tl.y ), scale );
+		float const right  = std::ldexp( float( r.br.x ), scale );
+		float const bottom = std::ldexp( float( r.br.y ), scale );
+		CHECK( near( c.rect[0], std::max( (left - x) / float( cw ), 0.0f ) ) );
+		CHECK( near( c.rect[1], std::max( (top - y) / float( ch ), 0.0f ) ) );
+		CHECK( near( c.rect[0] + c.rect[2], std::max( std::min( (right - x) / float( cw ), 1.0f ), c.rect[0] ) ) );
+		CHECK( near( c.rect[1] + c.rect[3], std::max( std::min( (bottom - y) / float( ch ), 1.0f ), c.rect[1] ) ) );
+		CHECK( c.rect[2] >= 0.0f && c.rect[3] >= 0.0f );
+	}
+}
+
+int main() {
+	check_views();
+	check_request();
+	check_textures();
+	return 0;
+}
@@ -0,0 +1,61 @@
+// (c) Yasuhiro Fujii <http://mimosa-pudica.net>, under MIT License.
+// framebuffer_pixels_t below and above its threshold: the elements start as
+// zero either way, and a large framebuffer takes no memory before its pixels
+// are written, even when all of them are read.
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include "zero_page.hpp"
+#include "check.hpp"
+
+
+// [bytes] resident.
+size_t resident() {
+	std::FILE* const f = std::fopen( "/proc/self/statm", "r" );
+	size_t size = 0, pages = 0;
+	CHECK( std::fscanf( f, "%zu %zu", &size, &pages ) == 2 );
+	std::fclose( f );
+	return pages * size_t( sysconf( _SC_PAGESIZE ) );
+}
+
+bool zero( framebuffer_pixels_t const& pixels ) {
+	uint32_t any = 0;
+	for( uint32_t const p: pixels ) {
+		any |= p;
+	}
+	return any == 0;
+}
+
+int main() {
+	size_t const threshold = framebuffer_pixels_t::mmap_threshold / sizeof( uint32_t );
+
+	// from the heap, which has had other contents: cleared all the same.
+	for( int i = 0; i < 16; ++i ) {
+		framebuffer_pixels_t pixels( threshold / 2 + i );
+		CHECK( zero( pixels ) );
+		std::fill( pixels.begin(), pixels.end(), 0xffffffffu );
+	}
+
+	// 8K, mapped: at the start of a page, unlike the header malloc() puts before it.
+	size_t const size = 7680 * 4320;
+	CHECK( size > threshold );
+	size_t const before = resident();
+	framebuffer_pixels_t pixels( size );
+	CHECK( uintptr_t( pixels.data() ) % sysconf( _SC_PAGESIZE ) == 0 );
+	CHECK( zero( pixels ) );
+	CHECK( resident() - before < size * sizeof( uint32_t ) / 16 );
+
+	// only the rows written.
+	std::fill( pixels.begin(), pixels.begin() + size / 4, 0xff000000u );
+	size_t const grown = resident() - before;
+	CHECK( grown >= size * sizeof( uint32_t ) / 4 && grown < size * sizeof( uint32_t ) / 2 );
+
+	// moves without a copy, as the retained frame of a reconnection.
+	uint32_t const* const data = pixels.data();
+	framebuffer_pixels_t moved = std::move( pixels );
+	CHECK( moved.data() == data && moved[0] == 0xff000000u && moved[size - 1] == 0 );
+	CHECK( pixels.data() == nullptr && pixels.size() == 0 );
+	pixels = std::move( moved );
+	CHECK( pixels.data() == data && moved.data() == nullptr );
+	return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+# only what the Open H.264 encoding needs: the H.264 decoder and libswscale.
+# the source is expected in ./ffmpeg, e.g.
+#     git clone --depth 1 -b n4.1.4 https://github.com/FFmpeg/FFmpeg ffmpeg
+
+TOOLCHAIN="$ANDROID_NDK_HOME/toolchains/llvm/prebuilt/linux-x86_64/bin"
+
+build() {
+	mkdir "$1" &&
+	cd "$1" &&
+	../ffmpeg/configure \
+		"--prefix=$PWD/usr" \
+		"--target-os=android" \
+		"--arch=$2" \
+		"--enable-cross-compile" \
+		"--cc=$TOOLCHAIN/$3-clang" \
+		"--cxx=$TOOLCHAIN/$3-clang++" \
+		"--cross-prefix=$TOOLCHAIN/llvm-" \
+		"--enable-shared" \
+		"--disable-static" \
+		"--disable-programs" \
+		"--disable-doc" \
+		"--disable-everything" \
+		"--disable-avdevice" \
+		"--disable-avformat" \
+		"--disable-avfilter" \
+		"--disable-swresample" \
+		"--disable-postproc" \
+		"--disable-network" \
+		"--enable-decoder=h264" &&
+	make install &&
+	cd ..
+}
+
+build arm64-v8a aarch64 aarch64-linux-android21
+build armeabi-v7a arm armv7a-linux-androideabi21